@@ -0,0 +1,185 @@
+//
+// AssetLoader.cpp - Loads models and textures as jobs, creating their GPU resources on the owning thread
+//
+
+#include "pch.h"
+#include "AssetLoader.h"
+#include "modelclass.h"
+#include "Profiler.h"
+
+#include <string>
+
+using namespace DX;
+
+AssetLoader::AssetLoader(ID3D11Device* device, GeometryPool* geometryPool) :
+    m_device(device),
+    m_geometryPool(geometryPool),
+    m_start(std::chrono::steady_clock::now()),
+    m_jobs(JobSystem::Get()),
+    m_loads(m_jobs.Create([]() {})),
+    m_exit(false),
+    m_nextWorker(0),
+    m_pending(0),
+    m_stats{}
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    // Loads already running finish, those still queued only drop their request. The owning
+    // thread runs whichever of them no worker has taken while it waits.
+    m_exit = true;
+    m_jobs.Run(m_loads);
+    m_jobs.Wait(m_loads);
+}
+
+AssetHandle AssetLoader::Load(std::function<bool()> load, std::function<bool(ID3D11Device*)> create)
+{
+    AssetHandle handle;
+    handle.m_status = std::make_shared<std::atomic<AssetStatus>>(AssetStatus::Loading);
+
+    Request* request = new Request{ std::move(load), std::move(create), handle.m_status };
+    if (m_jobs.GetWorkerCount() == 0)
+    {
+        // Nothing would run a queued load until the loader goes
+        RunLoad(request);
+    }
+    else
+    {
+        // Handed to the workers in turn. A queued job could be taken by the owning thread while it
+        // waits on a frame's parallel loop, and a load would stall the frame.
+        m_jobs.Run(m_jobs.Create([this, request]() { RunLoad(request); }, m_loads), m_nextWorker);
+        m_nextWorker = (m_nextWorker + 1) % m_jobs.GetWorkerCount();
+    }
+
+    m_pending++;
+    m_stats.assetCount++;
+    return handle;
+}
+
+AssetHandle AssetLoader::LoadModel(ModelClass& model, const char* filename, VertexFormat format)
+{
+    std::string name = filename;
+    GeometryPool* pool = m_geometryPool;
+    return Load(
+        [&model, name, format]() { return model.LoadModelData(name.c_str(), format); },
+        [&model, pool](ID3D11Device* device) { return model.CreateModelBuffers(device, pool); });
+}
+
+AssetHandle AssetLoader::LoadTexture(const wchar_t* filename, ID3D11ShaderResourceView** textureView)
+{
+    // The file contents are handed from the worker to the creation step through the shared blob
+    auto data = std::make_shared<std::vector<uint8_t>>();
+    std::wstring name = filename;
+    return Load(
+        [data, name]() { *data = ReadData(name.c_str()); return !data->empty(); },
+        [data, name, textureView](ID3D11Device* device)
+        {
+            HRESULT hr = CreateDDSTextureFromMemory(device, data->data(), data->size(), nullptr, textureView);
+            data->clear();
+            data->shrink_to_fit();
+            if (FAILED(hr))
+            {
+                char message[256];
+                sprintf_s(message, "%ls: failed to create texture (%08X)\n", name.c_str(), static_cast<unsigned int>(hr));
+                OutputDebugStringA(message);
+                return false;
+            }
+            return true;
+        });
+}
+
+void AssetLoader::Update(double budgetSeconds)
+{
+    DX_PROFILE_ZONE("AssetLoader::Update");
+    const double start = GetElapsedSeconds();
+    for (;;)
+    {
+        std::unique_ptr<Request> request;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_creates.empty())
+                break;
+            request = std::move(m_creates.front());
+            m_creates.pop_front();
+        }
+
+        bool created;
+        {
+            DX_PROFILE_ZONE("AssetLoader::Create");
+            created = request->create && request->create(m_device);
+        }
+        request->status->store(created ? AssetStatus::Ready : AssetStatus::Failed);
+        m_stats.failedCount += created ? 0 : 1;
+        m_pending--;
+
+        if (m_pending == 0)
+        {
+            m_stats.fullyLoadedSeconds = GetElapsedSeconds();
+
+            char message[256];
+            sprintf_s(message, "Assets: %u loaded, %u failed, first frame %.1f ms, fully loaded %.1f ms\n",
+                m_stats.assetCount - m_stats.failedCount, m_stats.failedCount,
+                m_stats.firstFrameSeconds * 1000.0, m_stats.fullyLoadedSeconds * 1000.0);
+            OutputDebugStringA(message);
+
+            if (m_geometryPool)
+            {
+                RangeAllocatorStats vertexStats = m_geometryPool->GetVertexStats();
+                RangeAllocatorStats indexStats = m_geometryPool->GetIndexStats();
+                sprintf_s(message, "GeometryPool: vertices %u of %u bytes (%.0f%%, fragmentation %.2f), indices %u of %u bytes (%.0f%%, fragmentation %.2f)\n",
+                    vertexStats.usedBytes, vertexStats.capacity, vertexStats.GetOccupancy() * 100.f, vertexStats.GetFragmentation(),
+                    indexStats.usedBytes, indexStats.capacity, indexStats.GetOccupancy() * 100.f, indexStats.GetFragmentation());
+                OutputDebugStringA(message);
+            }
+        }
+
+        if (GetElapsedSeconds() - start >= budgetSeconds)
+            break;
+    }
+}
+
+void AssetLoader::OnFramePresented()
+{
+    if (m_stats.firstFrameSeconds == 0.0)
+    {
+        m_stats.firstFrameSeconds = GetElapsedSeconds();
+
+        char message[256];
+        sprintf_s(message, "Assets: first frame after %.1f ms, %u of %u assets ready\n",
+            m_stats.firstFrameSeconds * 1000.0, m_stats.assetCount - m_pending, m_stats.assetCount);
+        OutputDebugStringA(message);
+    }
+}
+
+void AssetLoader::RunLoad(Request* request)
+{
+    std::unique_ptr<Request> owned(request);
+    if (m_exit)
+    {
+        return;
+    }
+
+    bool loaded = false;
+    try
+    {
+        DX_PROFILE_ZONE("AssetLoader::Load");
+        loaded = owned->load();
+    }
+    catch (const std::exception&)
+    {
+        loaded = false;
+    }
+    if (!loaded)
+    {
+        owned->create = nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_creates.push_back(std::move(owned));
+}
+
+double AssetLoader::GetElapsedSeconds() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+}
@@ -0,0 +1,118 @@
+//
+// AssetLoader.h - Loads models and textures as jobs, creating their GPU resources on the owning thread
+//
+
+#pragma once
+
+#include "MeshQuantizer.h"
+#include "GeometryPool.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+class ModelClass;
+
+namespace DX
+{
+    enum class AssetStatus
+    {
+        Loading,
+        Ready,
+        Failed
+    };
+
+    // Completion handle for one queued asset. Copies refer to the same asset, and a default
+    // constructed handle refers to nothing and is never ready. The status only changes inside
+    // AssetLoader::Update, so an asset seen as ready on the owning thread stays ready.
+    class AssetHandle
+    {
+    public:
+        AssetHandle() noexcept = default;
+
+        AssetStatus GetStatus() const noexcept { return m_status ? m_status->load() : AssetStatus::Loading; }
+        bool IsReady() const noexcept { return GetStatus() == AssetStatus::Ready; }
+
+    private:
+        friend class AssetLoader;
+
+        std::shared_ptr<std::atomic<AssetStatus>> m_status;
+    };
+
+    struct AssetLoaderStats
+    {
+        uint32_t assetCount;
+        uint32_t failedCount;
+        double firstFrameSeconds;       // Construction to the first presented frame, 0 until then
+        double fullyLoadedSeconds;      // Construction to the last queued asset finishing, 0 until then
+    };
+
+    // Loads run as jobs of the engine's JobSystem, so they share its workers with the per frame
+    // loops instead of keeping threads of their own. Each goes to one of the workers in turn, and
+    // without workers it runs inside Load.
+    class AssetLoader
+    {
+    public:
+        // Models are sub-allocated from geometryPool when one is given
+        explicit AssetLoader(ID3D11Device* device, GeometryPool* geometryPool = nullptr);
+        ~AssetLoader();
+
+        AssetLoader(AssetLoader const&) = delete;
+        AssetLoader& operator= (AssetLoader const&) = delete;
+
+        // Queues an asset. load runs as a job and does the file and CPU work, then create runs
+        // inside Update and makes the device resources. Either returning false (or load throwing)
+        // fails the asset. Whatever both capture must outlive the loader.
+        AssetHandle Load(std::function<bool()> load, std::function<bool(ID3D11Device*)> create);
+
+        // ModelClass::LoadModelData as a job, then ModelClass::CreateModelBuffers into the pool
+        AssetHandle LoadModel(ModelClass& model, const char* filename, VertexFormat format = VertexFormat::Standard);
+
+        // Reads the DDS file as a job, then creates the texture into *textureView
+        AssetHandle LoadTexture(const wchar_t* filename, ID3D11ShaderResourceView** textureView);
+
+        // Call once per frame on the owning thread. Creates the device resources of finished loads,
+        // always one if there is one, then more until budgetSeconds is spent.
+        void Update(double budgetSeconds);
+
+        // Call after each Present, the first call records the time to first frame
+        void OnFramePresented();
+
+        bool IsIdle() const noexcept { return m_pending == 0; }
+        const AssetLoaderStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        struct Request
+        {
+            std::function<bool()> load;
+            std::function<bool(ID3D11Device*)> create;      // Cleared when load fails
+            std::shared_ptr<std::atomic<AssetStatus>> status;
+        };
+
+        // The job's body, on whichever thread runs it. Takes ownership of request.
+        void RunLoad(Request* request);
+        double GetElapsedSeconds() const;
+
+        ID3D11Device* m_device;
+        GeometryPool* m_geometryPool;
+        std::chrono::steady_clock::time_point m_start;
+
+        // Parent of every load job. It is only queued when the loader goes, so waiting on it then
+        // waits for all the loads.
+        JobSystem& m_jobs;
+        Job* m_loads;
+        std::atomic<bool> m_exit;
+
+        std::mutex m_mutex;
+        std::deque<std::unique_ptr<Request>> m_creates;     // Loaded, waiting for Update on the owning thread
+
+        // Only touched on the owning thread
+        uint32_t m_nextWorker;
+        uint32_t m_pending;
+        AssetLoaderStats m_stats;
+    };
+}
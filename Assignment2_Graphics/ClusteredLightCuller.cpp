@@ -0,0 +1,360 @@
+//
+// ClusteredLightCuller.cpp - Assigns point lights to a view space grid of clusters for forward shading
+//
+
+#include "pch.h"
+#include "ClusteredLightCuller.h"
+#include "JobSystem.h"
+
+#include <cfloat>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    // Boxes are tested four at a time, so the arrays are padded by up to three
+    constexpr size_t BlockPadding = 3;
+
+    // Cluster boxes are widened by this fraction of their depths, so a pixel on a slice boundary
+    // finds its lights in whichever slice its depth rounds into
+    constexpr float DepthSlack = 1e-3f;
+
+    // One bit per lane that is true
+    inline uint32_t XM_CALLCONV GetLaneMask(FXMVECTOR v) noexcept
+    {
+#if defined(_XM_SSE_INTRINSICS_)
+        return static_cast<uint32_t>(_mm_movemask_ps(v));
+#else
+        XMUINT4 lanes;
+        XMStoreUInt4(&lanes, v);
+        return (lanes.x >> 31) | ((lanes.y >> 31) << 1) | ((lanes.z >> 31) << 2) | ((lanes.w >> 31) << 3);
+#endif
+    }
+
+    inline uint32_t LowestBit(uint32_t bits) noexcept
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return index;
+#else
+        return static_cast<uint32_t>(__builtin_ctz(bits));
+#endif
+    }
+
+    // Tile of a normalized device coordinate, the coordinate clamped first so huge values stay in range
+    inline int TileOf(float ndc, uint32_t tiles) noexcept
+    {
+        ndc = std::max(-2.f, std::min(2.f, ndc));
+        return static_cast<int>(std::floor((ndc + 1.f) * .5f * float(tiles)));
+    }
+}
+
+ClusteredLightCuller::ClusteredLightCuller() noexcept :
+    m_tilesX(0),
+    m_tilesY(0),
+    m_slices(0),
+    m_nearZ(0.f),
+    m_farZ(0.f),
+    m_depthScale(0.f),
+    m_depthBias(0.f),
+    m_projection{},
+    m_stats{}
+{
+}
+
+void ClusteredLightCuller::SetGrid(uint32_t tilesX, uint32_t tilesY, uint32_t depthSlices)
+{
+    m_tilesX = tilesX;
+    m_tilesY = tilesY;
+    m_slices = depthSlices;
+    BuildClusterBounds();
+}
+
+void XM_CALLCONV ClusteredLightCuller::SetProjection(FXMMATRIX projection, float nearZ, float farZ)
+{
+    if (nearZ <= 0.f || farZ <= nearZ)
+        throw std::invalid_argument("ClusteredLightCuller needs 0 < nearZ < farZ");
+
+    XMStoreFloat4x4(&m_projection, projection);
+    m_nearZ = nearZ;
+    m_farZ = farZ;
+    BuildClusterBounds();
+}
+
+uint32_t ClusteredLightCuller::GetSlice(float depth) const noexcept
+{
+    if (m_slices == 0 || depth <= m_nearZ)
+    {
+        return 0;
+    }
+    const float slice = std::log(depth) * m_depthScale + m_depthBias;
+    return static_cast<uint32_t>(std::min(slice, float(m_slices - 1)));
+}
+
+// Slice s covers nearZ * (farZ / nearZ)^(s / slices) to the next one's, so the slice of a depth
+// is linear in its log. Each cluster's box takes in the corners of its tile at both depths.
+void ClusteredLightCuller::BuildClusterBounds()
+{
+    const size_t clusterCount = size_t(m_tilesX) * m_tilesY * m_slices;
+    m_clusters.assign(clusterCount, LightCluster{ 0, 0 });
+    m_lightIndices.clear();
+    if (clusterCount == 0 || m_nearZ <= 0.f)
+    {
+        return;
+    }
+
+    const float logRange = std::log(m_farZ / m_nearZ);
+    m_depthScale = float(m_slices) / logRange;
+    m_depthBias = -float(m_slices) * std::log(m_nearZ) / logRange;
+
+    m_sliceDepths.resize(m_slices + 1);
+    for (uint32_t s = 0; s <= m_slices; s++)
+    {
+        m_sliceDepths[s] = m_nearZ * std::exp(logRange * float(s) / float(m_slices));
+    }
+    m_sliceDepths[m_slices] = m_farZ;
+
+    m_boundsMinX.assign(clusterCount + BlockPadding, 0.f);
+    m_boundsMinY.assign(clusterCount + BlockPadding, 0.f);
+    m_boundsMinDepth.assign(clusterCount + BlockPadding, 0.f);
+    m_boundsMaxX.assign(clusterCount + BlockPadding, 0.f);
+    m_boundsMaxY.assign(clusterCount + BlockPadding, 0.f);
+    m_boundsMaxDepth.assign(clusterCount + BlockPadding, 0.f);
+
+    // At view depth d, ndc.x = x / d * _11 - _31 (view space z is -d), and likewise for y
+    const float scaleX = 1.f / m_projection._11;
+    const float scaleY = 1.f / m_projection._22;
+    for (uint32_t s = 0; s < m_slices; s++)
+    {
+        const float depths[2] = { s == 0 ? 0.f : m_sliceDepths[s] * (1.f - DepthSlack), m_sliceDepths[s + 1] * (1.f + DepthSlack) };
+        for (uint32_t y = 0; y < m_tilesY; y++)
+        {
+            const float ndcY[2] = { 1.f - 2.f * float(y) / float(m_tilesY), 1.f - 2.f * float(y + 1) / float(m_tilesY) };
+            for (uint32_t x = 0; x < m_tilesX; x++)
+            {
+                const float ndcX[2] = { -1.f + 2.f * float(x) / float(m_tilesX), -1.f + 2.f * float(x + 1) / float(m_tilesX) };
+
+                float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+                for (int corner = 0; corner < 8; corner++)
+                {
+                    const float depth = depths[corner >> 2];
+                    const float cornerX = depth * (ndcX[corner & 1] + m_projection._31) * scaleX;
+                    const float cornerY = depth * (ndcY[(corner >> 1) & 1] + m_projection._32) * scaleY;
+                    minX = std::min(minX, cornerX);
+                    maxX = std::max(maxX, cornerX);
+                    minY = std::min(minY, cornerY);
+                    maxY = std::max(maxY, cornerY);
+                }
+
+                const uint32_t cluster = GetClusterIndex(x, y, s);
+                m_boundsMinX[cluster] = minX;
+                m_boundsMinY[cluster] = minY;
+                m_boundsMinDepth[cluster] = depths[0];
+                m_boundsMaxX[cluster] = maxX;
+                m_boundsMaxY[cluster] = maxY;
+                m_boundsMaxDepth[cluster] = depths[1];
+            }
+        }
+    }
+}
+
+void XM_CALLCONV ClusteredLightCuller::Cull(const PointLight* lights, size_t lightCount, FXMMATRIX view, unsigned int threadCount)
+{
+    m_stats = {};
+    m_stats.lightCount = static_cast<uint32_t>(lightCount);
+    m_lightIndices.clear();
+    if (m_clusters.empty() || m_nearZ <= 0.f)
+    {
+        return;
+    }
+
+    // Into view space, each light with the slices its depth range reaches, one more on either side
+    // when it reaches into that slice's widened box
+    m_viewLights.resize(lightCount);
+    for (size_t i = 0; i < lightCount; i++)
+    {
+        XMFLOAT3 position;
+        XMStoreFloat3(&position, XMVector3Transform(XMLoadFloat3(&lights[i].position), view));
+
+        ViewLight& light = m_viewLights[i];
+        light.x = position.x;
+        light.y = position.y;
+        light.depth = -position.z;
+        light.radius = lights[i].radius;
+        light.firstSlice = 1;
+        light.lastSlice = 0;
+
+        const float nearest = light.depth - light.radius;
+        const float farthest = light.depth + light.radius;
+        if (farthest <= 0.f || nearest >= m_farZ || light.radius <= 0.f)
+        {
+            continue;
+        }
+        light.firstSlice = GetSlice(nearest);
+        light.lastSlice = GetSlice(farthest);
+        if (light.firstSlice > 0 && m_sliceDepths[light.firstSlice] * (1.f + DepthSlack) >= nearest)
+        {
+            light.firstSlice--;
+        }
+        if (light.lastSlice + 1 < m_slices && m_sliceDepths[light.lastSlice + 1] * (1.f - DepthSlack) <= farthest)
+        {
+            light.lastSlice++;
+        }
+        m_stats.visibleLights++;
+    }
+
+    JobSystem& jobs = JobSystem::Get();
+    if (threadCount == 0)
+    {
+        threadCount = jobs.GetThreadCount();
+    }
+    const size_t bandCount = std::max<size_t>(1, std::min<size_t>({ threadCount, m_slices, lightCount / MinLightsPerJob }));
+    if (m_bands.size() < bandCount)
+    {
+        m_bands.resize(bandCount);
+    }
+
+    // The calling thread takes its share of the bands of slices while it waits for the jobs
+    auto bandBegin = [this, bandCount](size_t band)
+    {
+        return static_cast<uint32_t>(m_slices * band / bandCount);
+    };
+    jobs.ParallelFor(bandCount, 1, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            CullBand(bandBegin(i), bandBegin(i + 1), m_bands[i]);
+        }
+    });
+
+    // Bands cover consecutive clusters, so their lists join end to end
+    const uint32_t clustersPerSlice = m_tilesX * m_tilesY;
+    for (size_t i = 0; i < bandCount; i++)
+    {
+        const Band& band = m_bands[i];
+        const uint32_t base = static_cast<uint32_t>(m_lightIndices.size());
+        for (uint32_t cluster = bandBegin(i) * clustersPerSlice; cluster < bandBegin(i + 1) * clustersPerSlice; cluster++)
+        {
+            m_clusters[cluster].offset += base;
+        }
+        m_lightIndices.insert(m_lightIndices.end(), band.indices.begin(), band.indices.end());
+        m_stats.clusterTests += band.stats.clusterTests;
+        m_stats.maxClusterLights = std::max(m_stats.maxClusterLights, band.stats.maxClusterLights);
+    }
+    m_stats.lightIndices = static_cast<uint32_t>(m_lightIndices.size());
+}
+
+void ClusteredLightCuller::CullBand(uint32_t firstSlice, uint32_t endSlice, Band& band)
+{
+    const uint32_t lightCount = static_cast<uint32_t>(m_viewLights.size());
+    const uint32_t words = (lightCount + 31) / 32;
+    const uint32_t tileCount = m_tilesX * m_tilesY;
+
+    band.indices.clear();
+    band.bits.resize(size_t(tileCount) * words);
+    band.stats = {};
+
+    for (uint32_t slice = firstSlice; slice < endSlice; slice++)
+    {
+        std::fill(band.bits.begin(), band.bits.end(), 0u);
+        for (uint32_t i = 0; i < lightCount; i++)
+        {
+            const ViewLight& light = m_viewLights[i];
+            if (slice >= light.firstSlice && slice <= light.lastSlice)
+            {
+                AssignLight(light, i, slice, band.bits.data(), words, band.stats);
+            }
+        }
+
+        // Each tile's bits, lowest first, become its cluster's list
+        for (uint32_t tile = 0; tile < tileCount; tile++)
+        {
+            LightCluster& cluster = m_clusters[slice * tileCount + tile];
+            cluster.offset = static_cast<uint32_t>(band.indices.size());
+            const uint32_t* bits = band.bits.data() + size_t(tile) * words;
+            for (uint32_t word = 0; word < words; word++)
+            {
+                for (uint32_t remaining = bits[word]; remaining != 0; remaining &= remaining - 1)
+                {
+                    band.indices.push_back(word * 32 + LowestBit(remaining));
+                }
+            }
+            cluster.count = static_cast<uint32_t>(band.indices.size()) - cluster.offset;
+            band.stats.maxClusterLights = std::max(band.stats.maxClusterLights, cluster.count);
+        }
+    }
+}
+
+// Sets the light's bit in every tile of the slice whose cluster box its sphere touches
+void ClusteredLightCuller::AssignLight(const ViewLight& light, uint32_t lightIndex, uint32_t slice, uint32_t* bits, uint32_t words,
+    LightClusterStats& stats) const
+{
+    // Tiles the light's box projects into over the part of its depth range within this slice.
+    // x / depth is smallest at the near depth when x is negative and at the far depth otherwise.
+    const float nearest = std::max({ light.depth - light.radius, slice == 0 ? 0.f : m_sliceDepths[slice], 1e-6f });
+    const float farthest = std::max(std::min(light.depth + light.radius, m_sliceDepths[slice + 1]), nearest);
+    const float left = light.x - light.radius;
+    const float right = light.x + light.radius;
+    const float bottom = light.y - light.radius;
+    const float top = light.y + light.radius;
+    const float ndcLeft = (left < 0.f ? left / nearest : left / farthest) * m_projection._11 - m_projection._31;
+    const float ndcRight = (right < 0.f ? right / farthest : right / nearest) * m_projection._11 - m_projection._31;
+    const float ndcBottom = (bottom < 0.f ? bottom / nearest : bottom / farthest) * m_projection._22 - m_projection._32;
+    const float ndcTop = (top < 0.f ? top / farthest : top / nearest) * m_projection._22 - m_projection._32;
+    if (ndcRight < -1.f || ndcLeft > 1.f || ndcTop < -1.f || ndcBottom > 1.f)
+    {
+        return;
+    }
+
+    const int firstX = std::max(TileOf(ndcLeft, m_tilesX), 0);
+    const int lastX = std::min(TileOf(ndcRight, m_tilesX), int(m_tilesX) - 1);
+    // Rows count down from the top, where ndc.y is 1
+    const int firstY = std::max(TileOf(-ndcTop, m_tilesY), 0);
+    const int lastY = std::min(TileOf(-ndcBottom, m_tilesY), int(m_tilesY) - 1);
+
+    // Squared distance from the center to each box, the per axis gap is 0 inside the box's range
+    const XMVECTOR centerX = XMVectorReplicate(light.x);
+    const XMVECTOR centerY = XMVectorReplicate(light.y);
+    const XMVECTOR centerDepth = XMVectorReplicate(light.depth);
+    const XMVECTOR radiusSquared = XMVectorReplicate(light.radius * light.radius);
+    const XMVECTOR zero = XMVectorZero();
+    const uint32_t word = lightIndex / 32;
+    const uint32_t bit = 1u << (lightIndex & 31);
+    for (int y = firstY; y <= lastY; y++)
+    {
+        const uint32_t rowCluster = GetClusterIndex(0, y, slice);
+        for (int x = firstX; x <= lastX; x += 4)
+        {
+            const size_t i = rowCluster + x;
+            const XMVECTOR minX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(m_boundsMinX.data() + i));
+            const XMVECTOR minY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(m_boundsMinY.data() + i));
+            const XMVECTOR minDepth = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(m_boundsMinDepth.data() + i));
+            const XMVECTOR maxX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(m_boundsMaxX.data() + i));
+            const XMVECTOR maxY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(m_boundsMaxY.data() + i));
+            const XMVECTOR maxDepth = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(m_boundsMaxDepth.data() + i));
+
+            const XMVECTOR gapX = XMVectorMax(XMVectorMax(XMVectorSubtract(minX, centerX), XMVectorSubtract(centerX, maxX)), zero);
+            const XMVECTOR gapY = XMVectorMax(XMVectorMax(XMVectorSubtract(minY, centerY), XMVectorSubtract(centerY, maxY)), zero);
+            const XMVECTOR gapDepth = XMVectorMax(XMVectorMax(XMVectorSubtract(minDepth, centerDepth), XMVectorSubtract(centerDepth, maxDepth)), zero);
+            XMVECTOR distanceSquared = XMVectorMultiply(gapX, gapX);
+            distanceSquared = XMVectorMultiplyAdd(gapY, gapY, distanceSquared);
+            distanceSquared = XMVectorMultiplyAdd(gapDepth, gapDepth, distanceSquared);
+
+            // Lanes past the light's last tile belong to other tiles, or the padding
+            const int lanes = std::min(4, lastX - x + 1);
+            uint32_t touched = GetLaneMask(XMVectorLessOrEqual(distanceSquared, radiusSquared)) & ((1u << lanes) - 1);
+            stats.clusterTests += lanes;
+            for (; touched != 0; touched &= touched - 1)
+            {
+                const uint32_t tile = y * m_tilesX + x + LowestBit(touched);
+                bits[size_t(tile) * words + word] |= bit;
+            }
+        }
+    }
+}
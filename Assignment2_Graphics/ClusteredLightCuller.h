@@ -0,0 +1,127 @@
+//
+// ClusteredLightCuller.h - Assigns point lights to a view space grid of clusters for forward shading
+//
+
+#pragma once
+
+#include <vector>
+
+namespace DX
+{
+    // One point light, laid out like PointLight in light_ps.hlsl
+    struct PointLight
+    {
+        DirectX::XMFLOAT3 position;     // World space
+        float radius;                   // Nothing past this distance is lit
+        DirectX::XMFLOAT3 color;
+        float intensity;
+    };
+
+    // Where a cluster's lights are in the index list
+    struct LightCluster
+    {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    struct LightClusterStats
+    {
+        uint32_t lightCount;
+        uint32_t visibleLights;     // Within the grid's depth range
+        uint32_t clusterTests;      // Sphere against cluster box, counted per lane of the SIMD tests
+        uint32_t lightIndices;
+        uint32_t maxClusterLights;
+    };
+
+    // Splits the view frustum into tilesX x tilesY screen tiles, each cut into depth slices that grow
+    // exponentially from the near to the far plane, and lists the point lights touching each of these
+    // clusters. A pixel finds its cluster from its screen position and view depth, then shades only
+    // that cluster's lights.
+    //
+    // Every cluster is bounded by a view space box. A light is narrowed down to the slices its depth
+    // range covers and, per slice, the tiles its bounding box projects into, then its sphere is
+    // tested against four of those cluster boxes at a time. Clusters collect their lights as bits,
+    // so each list comes out in light order. Jobs each take a band of slices.
+    class ClusteredLightCuller
+    {
+    public:
+        // Fewer lights than this per job are assigned on the calling thread only
+        static constexpr size_t MinLightsPerJob = 64;
+
+        ClusteredLightCuller() noexcept;
+
+        void SetGrid(uint32_t tilesX, uint32_t tilesY, uint32_t depthSlices);
+
+        // Right handed perspective projection, as SimpleMath builds it. The slices run from nearZ to
+        // farZ view depth, the first also takes in everything nearer.
+        void XM_CALLCONV SetProjection(DirectX::FXMMATRIX projection, float nearZ, float farZ);
+
+        // Assigns the lights, in world space, to the clusters seen through view. Up to threadCount
+        // bands are assigned as jobs, 0 gives each thread of the job system one.
+        void XM_CALLCONV Cull(const PointLight* lights, size_t lightCount, DirectX::FXMMATRIX view, unsigned int threadCount = 1);
+
+        // Tile rows count down from the top of the screen
+        uint32_t GetClusterIndex(uint32_t x, uint32_t y, uint32_t slice) const noexcept { return (slice * m_tilesY + y) * m_tilesX + x; }
+
+        // Slice of a view depth, log(depth) * GetDepthScale() + GetDepthBias() clamped to the grid
+        uint32_t GetSlice(float depth) const noexcept;
+        float GetDepthScale() const noexcept { return m_depthScale; }
+        float GetDepthBias() const noexcept { return m_depthBias; }
+
+        uint32_t GetTilesX() const noexcept { return m_tilesX; }
+        uint32_t GetTilesY() const noexcept { return m_tilesY; }
+        uint32_t GetSliceCount() const noexcept { return m_slices; }
+        const std::vector<LightCluster>& GetClusters() const noexcept { return m_clusters; }
+        const std::vector<uint32_t>& GetLightIndices() const noexcept { return m_lightIndices; }
+        const LightClusterStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        // A light in view space, with depth counted along the view direction
+        struct ViewLight
+        {
+            float x;
+            float y;
+            float depth;
+            float radius;
+            uint32_t firstSlice;    // Past lastSlice when the light is out of the grid's depth range
+            uint32_t lastSlice;
+        };
+
+        // Lists of one band of slices, offsets relative to the band until Cull joins them
+        struct Band
+        {
+            std::vector<uint32_t> indices;
+            std::vector<uint32_t> bits;     // Light bits of each tile in the current slice
+            LightClusterStats stats;
+        };
+
+        void BuildClusterBounds();
+        void CullBand(uint32_t firstSlice, uint32_t endSlice, Band& band);
+        void AssignLight(const ViewLight& light, uint32_t lightIndex, uint32_t slice, uint32_t* bits, uint32_t words,
+            LightClusterStats& stats) const;
+
+        uint32_t m_tilesX;
+        uint32_t m_tilesY;
+        uint32_t m_slices;
+        float m_nearZ;
+        float m_farZ;
+        float m_depthScale;
+        float m_depthBias;
+        DirectX::XMFLOAT4X4 m_projection;
+
+        // Cluster boxes in view space, with depth positive, padded to whole blocks of four
+        std::vector<float> m_boundsMinX;
+        std::vector<float> m_boundsMinY;
+        std::vector<float> m_boundsMinDepth;
+        std::vector<float> m_boundsMaxX;
+        std::vector<float> m_boundsMaxY;
+        std::vector<float> m_boundsMaxDepth;
+        std::vector<float> m_sliceDepths;   // Near depth of each slice and the far depth of the last
+
+        std::vector<ViewLight> m_viewLights;
+        std::vector<Band> m_bands;
+        std::vector<LightCluster> m_clusters;
+        std::vector<uint32_t> m_lightIndices;
+        LightClusterStats m_stats;
+    };
+}
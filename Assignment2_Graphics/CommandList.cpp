@@ -0,0 +1,152 @@
+//
+// CommandList.cpp - Backend independent draw commands, recorded in parallel and replayed in order
+//
+
+#include "pch.h"
+#include "CommandList.h"
+#include "JobSystem.h"
+
+#include <cstring>
+
+using namespace DirectX;
+using namespace DX;
+
+CommandBuffer::CommandBuffer() noexcept :
+    m_wordCount(0),
+    m_commandCount(0)
+{
+}
+
+void CommandBuffer::Clear() noexcept
+{
+    m_wordCount = 0;
+    m_commandCount = 0;
+}
+
+void CommandBuffer::SetPipeline(const void* pipeline)
+{
+    SetPipelineCommand& command = Push<SetPipelineCommand>();
+    command.pipeline = pipeline;
+}
+
+void CommandBuffer::SetTexture(uint32_t slot, const void* texture)
+{
+    SetTextureCommand& command = Push<SetTextureCommand>();
+    command.slot = slot;
+    command.padding = 0;
+    command.texture = texture;
+}
+
+void CommandBuffer::SetConstants(uint32_t slot, uint32_t block)
+{
+    SetConstantsCommand& command = Push<SetConstantsCommand>();
+    command.slot = slot;
+    command.block = block;
+}
+
+void CommandBuffer::SetView(const XMFLOAT4X4& viewProjection, const XMFLOAT3& cameraPosition)
+{
+    SetViewCommand& command = Push<SetViewCommand>();
+    command.viewProjection = viewProjection;
+    command.cameraPosition = cameraPosition;
+    command.padding = 0.0f;
+}
+
+void CommandBuffer::DrawMesh(const void* mesh, int32_t lod, uint32_t instanceCount, uint32_t firstInstance)
+{
+    DrawMeshCommand& command = Push<DrawMeshCommand>();
+    command.mesh = mesh;
+    command.lod = lod;
+    command.instanceCount = instanceCount;
+    command.firstInstance = firstInstance;
+    command.padding = 0;
+}
+
+void CommandBuffer::DrawMeshClusters(const void* mesh, const XMFLOAT4X4& world)
+{
+    DrawMeshClustersCommand& command = Push<DrawMeshClustersCommand>();
+    command.mesh = mesh;
+    command.world = world;
+}
+
+NullCommandBackend::NullCommandBackend(bool record) noexcept :
+    m_record(record),
+    m_stats{}
+{
+}
+
+void NullCommandBackend::Execute(const CommandBuffer& commands)
+{
+    commands.ForEach([this](const CommandHeader& header)
+    {
+        m_stats.commands++;
+        m_stats.bytes += header.size;
+        m_stats.typeCounts[static_cast<size_t>(header.type)]++;
+        if (header.type == CommandType::DrawMesh)
+        {
+            m_stats.instances += std::max(1u, CommandBuffer::As<DrawMeshCommand>(header).instanceCount);
+        }
+        else if (header.type == CommandType::DrawMeshClusters)
+        {
+            m_stats.instances++;
+        }
+    });
+
+    if (m_record && commands.GetSize() > 0)
+    {
+        size_t offset = m_recorded.size();
+        m_recorded.resize(offset + commands.GetSize());
+        commands.ForEach([this, &offset](const CommandHeader& header)
+        {
+            memcpy(m_recorded.data() + offset, &header, header.size);
+            offset += header.size;
+        });
+    }
+}
+
+void NullCommandBackend::Reset() noexcept
+{
+    m_stats = {};
+    m_recorded.clear();
+}
+
+void CommandList::Record(size_t itemCount, unsigned int threadCount,
+    const std::function<void(CommandBuffer&, size_t, size_t)>& record)
+{
+    JobSystem& jobs = JobSystem::Get();
+    if (threadCount == 0)
+    {
+        threadCount = jobs.GetThreadCount();
+    }
+    m_bufferCount = std::max<size_t>(1, std::min<size_t>(threadCount, itemCount / MinItemsPerJob));
+    if (m_buffers.size() < m_bufferCount)
+    {
+        m_buffers.resize(m_bufferCount);
+    }
+    for (size_t i = 0; i < m_bufferCount; i++)
+    {
+        m_buffers[i].Clear();
+    }
+
+    // The calling thread records its share of the ranges while it waits for the jobs
+    const size_t bufferCount = m_bufferCount;
+    auto rangeBegin = [itemCount, bufferCount](size_t buffer)
+    {
+        return itemCount * buffer / bufferCount;
+    };
+    jobs.ParallelFor(bufferCount, 1, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            record(m_buffers[i], rangeBegin(i), rangeBegin(i + 1));
+        }
+    });
+}
+
+void CommandList::Execute(CommandBackend& backend) const
+{
+    for (size_t i = 0; i < m_bufferCount; i++)
+    {
+        backend.Execute(m_buffers[i]);
+    }
+}
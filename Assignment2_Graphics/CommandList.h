@@ -0,0 +1,215 @@
+//
+// CommandList.h - Backend independent draw commands, recorded in parallel and replayed in order
+//
+
+#pragma once
+
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+namespace DX
+{
+    enum class CommandType : uint32_t
+    {
+        SetPipeline,
+        SetTexture,
+        SetConstants,
+        SetView,
+        DrawMesh,
+        DrawMeshClusters,
+        Count
+    };
+
+    // Starts every command. size is in bytes, header included, and always a multiple of 8.
+    struct CommandHeader
+    {
+        CommandType type;
+        uint32_t size;
+    };
+
+    // Resources are opaque to the commands, each backend knows what its handles point at. The D3D11
+    // backend takes pipelines as Shader, textures as shader resource views and meshes as ModelClass.
+
+    struct SetPipelineCommand
+    {
+        static constexpr CommandType Type = CommandType::SetPipeline;
+        CommandHeader header;
+        const void* pipeline;
+    };
+
+    struct SetTextureCommand
+    {
+        static constexpr CommandType Type = CommandType::SetTexture;
+        CommandHeader header;
+        uint32_t slot;
+        uint32_t padding;
+        const void* texture;
+    };
+
+    // Binds a block of per object constants, already uploaded, to a vertex shader slot
+    struct SetConstantsCommand
+    {
+        static constexpr CommandType Type = CommandType::SetConstants;
+        CommandHeader header;
+        uint32_t slot;
+        uint32_t block;
+    };
+
+    // Camera for the draws after it that cull on the CPU as they are replayed
+    struct SetViewCommand
+    {
+        static constexpr CommandType Type = CommandType::SetView;
+        CommandHeader header;
+        DirectX::XMFLOAT4X4 viewProjection;
+        DirectX::XMFLOAT3 cameraPosition;
+        float padding;
+    };
+
+    // One level of detail of a mesh, instanceCount 0 for a plain draw
+    struct DrawMeshCommand
+    {
+        static constexpr CommandType Type = CommandType::DrawMesh;
+        CommandHeader header;
+        const void* mesh;
+        int32_t lod;
+        uint32_t instanceCount;
+        uint32_t firstInstance;
+        uint32_t padding;
+    };
+
+    // The full detail mesh without the clusters that the last SetView can't see
+    struct DrawMeshClustersCommand
+    {
+        static constexpr CommandType Type = CommandType::DrawMeshClusters;
+        CommandHeader header;
+        const void* mesh;
+        DirectX::XMFLOAT4X4 world;
+    };
+
+    // Commands recorded by one thread, packed one after another in a linear buffer that keeps its
+    // memory between frames
+    class CommandBuffer
+    {
+    public:
+        CommandBuffer() noexcept;
+
+        void Clear() noexcept;
+
+        void SetPipeline(const void* pipeline);
+        void SetTexture(uint32_t slot, const void* texture);
+        void SetConstants(uint32_t slot, uint32_t block);
+        void SetView(const DirectX::XMFLOAT4X4& viewProjection, const DirectX::XMFLOAT3& cameraPosition);
+        void DrawMesh(const void* mesh, int32_t lod, uint32_t instanceCount = 0, uint32_t firstInstance = 0);
+        void DrawMeshClusters(const void* mesh, const DirectX::XMFLOAT4X4& world);
+
+        // Calls visit with the header of every command in recorded order. The header is the first
+        // member of its command, so it converts back with As.
+        template <typename Visit>
+        void ForEach(Visit&& visit) const
+        {
+            const uint8_t* command = reinterpret_cast<const uint8_t*>(m_words.data());
+            const uint8_t* end = command + GetSize();
+            while (command < end)
+            {
+                const CommandHeader& header = *reinterpret_cast<const CommandHeader*>(command);
+                visit(header);
+                command += header.size;
+            }
+        }
+
+        template <typename T>
+        static const T& As(const CommandHeader& header) noexcept { return *reinterpret_cast<const T*>(&header); }
+
+        size_t GetSize() const noexcept { return m_wordCount * sizeof(uint64_t); }
+        uint32_t GetCommandCount() const noexcept { return m_commandCount; }
+
+    private:
+        template <typename T>
+        T& Push()
+        {
+            static_assert(std::is_trivially_copyable<T>::value && std::is_standard_layout<T>::value, "Commands are plain data");
+            static_assert(sizeof(T) % sizeof(uint64_t) == 0, "Commands are whole 8 byte words");
+            constexpr size_t words = sizeof(T) / sizeof(uint64_t);
+            if (m_wordCount + words > m_words.size())
+            {
+                m_words.resize(std::max<size_t>(m_words.size() * 2, m_wordCount + words));
+            }
+            T* command = reinterpret_cast<T*>(m_words.data() + m_wordCount);
+            m_wordCount += words;
+            m_commandCount++;
+            command->header.type = T::Type;
+            command->header.size = static_cast<uint32_t>(sizeof(T));
+            return *command;
+        }
+
+        // Words keep every command 8 byte aligned, the buffer only grows
+        std::vector<uint64_t> m_words;
+        size_t m_wordCount;
+        uint32_t m_commandCount;
+    };
+
+    // Turns commands into work for a device, or into nothing at all
+    class CommandBackend
+    {
+    public:
+        virtual ~CommandBackend() = default;
+
+        // Replays one buffer's commands in order
+        virtual void Execute(const CommandBuffer& commands) = 0;
+    };
+
+    struct CommandStats
+    {
+        uint32_t commands;
+        uint32_t bytes;
+        uint32_t typeCounts[static_cast<size_t>(CommandType::Count)];
+        uint32_t instances;         // Drawn by DrawMesh commands, 1 for each plain draw
+    };
+
+    // Backend without a device. It only counts what it is given and, when recording, keeps a copy of
+    // every command, so the whole frame building path can run and be timed headless.
+    class NullCommandBackend : public CommandBackend
+    {
+    public:
+        explicit NullCommandBackend(bool record = false) noexcept;
+
+        void Execute(const CommandBuffer& commands) override;
+
+        // Forget the counts and the recorded commands
+        void Reset() noexcept;
+
+        const CommandStats& GetStats() const noexcept { return m_stats; }
+        const std::vector<uint8_t>& GetRecorded() const noexcept { return m_recorded; }
+
+    private:
+        bool m_record;
+        CommandStats m_stats;
+        std::vector<uint8_t> m_recorded;
+    };
+
+    // A frame's commands, one buffer per recording job. Jobs take contiguous ranges of the items,
+    // so replaying the buffers one after the other keeps the items' order.
+    class CommandList
+    {
+    public:
+        // Fewer items than this per job are recorded on the calling thread only
+        static constexpr size_t MinItemsPerJob = 128;
+
+        // Records itemCount items, calling record(buffer, begin, end) once per buffer with its own
+        // range. Up to threadCount buffers are recorded as jobs, 0 gives each thread of the job
+        // system one.
+        void Record(size_t itemCount, unsigned int threadCount,
+            const std::function<void(CommandBuffer&, size_t, size_t)>& record);
+
+        // Replays every buffer of the last Record in order
+        void Execute(CommandBackend& backend) const;
+
+        size_t GetBufferCount() const noexcept { return m_bufferCount; }
+        const CommandBuffer& GetBuffer(size_t buffer) const noexcept { return m_buffers[buffer]; }
+
+    private:
+        std::vector<CommandBuffer> m_buffers;
+        size_t m_bufferCount = 0;
+    };
+}
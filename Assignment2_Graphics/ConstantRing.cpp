@@ -0,0 +1,132 @@
+//
+// ConstantRing.cpp - Dynamic constant buffer that per draw constant blocks are sub-allocated from
+//
+
+#include "pch.h"
+#include "ConstantRing.h"
+
+#include <cstring>
+
+using namespace DX;
+
+ConstantRing::ConstantRing(ID3D11Device* device, uint32_t blockSize, uint32_t capacity) :
+    m_device(device),
+    m_offsetSupported(false),
+    m_blockSize(blockSize),
+    m_blockStride(0),
+    m_capacity(0),
+    m_cursor(0),
+    m_stats{}
+{
+    if (blockSize == 0 || blockSize % ConstantSize != 0)
+        throw std::invalid_argument("ConstantRing block size must be a non-zero multiple of 16 bytes");
+
+    // Both are Direct3D 11.1 options: binding part of a buffer, and appending to a dynamic
+    // constant buffer without discarding it
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+    if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+    {
+        m_offsetSupported = options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+    }
+
+    if (m_offsetSupported)
+    {
+        m_blockStride = (blockSize + BlockAlignment - 1) / BlockAlignment * BlockAlignment;
+        CreateBuffer(std::max(capacity, 1u));
+    }
+    else
+    {
+        m_blockStride = blockSize;
+        CreateBuffer(1);
+    }
+
+    char message[256];
+    sprintf_s(message, "ConstantRing: %u byte blocks, %s\n", blockSize,
+        m_offsetSupported ? "bound with constant offsets" : "constant offsets unsupported, uploaded per draw");
+    OutputDebugStringA(message);
+}
+
+uint32_t ConstantRing::Write(ID3D11DeviceContext1* context, const void* blocks, uint32_t count)
+{
+    if (count == 0)
+        return 0;
+
+    const uint8_t* source = static_cast<const uint8_t*>(blocks);
+    if (!m_offsetSupported)
+    {
+        m_blocks.assign(source, source + size_t(count) * m_blockSize);
+        return 0;
+    }
+
+    if (count > m_capacity)
+    {
+        uint32_t capacity = m_capacity;
+        while (capacity < count)
+        {
+            capacity *= 2;
+        }
+        CreateBuffer(capacity);
+    }
+
+    // Append behind the blocks already handed out, the GPU may still be reading those. Only a
+    // full ring is discarded, which gives it fresh memory to start again from the front.
+    D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+    if (m_cursor + count > m_capacity)
+    {
+        mapType = D3D11_MAP_WRITE_DISCARD;
+        m_cursor = 0;
+        m_stats.discards++;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    ThrowIfFailed(context->Map(m_buffer.Get(), 0, mapType, 0, &mapped));
+    uint8_t* destination = static_cast<uint8_t*>(mapped.pData) + size_t(m_cursor) * m_blockStride;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memcpy(destination + size_t(i) * m_blockStride, source + size_t(i) * m_blockSize, m_blockSize);
+    }
+    context->Unmap(m_buffer.Get(), 0);
+
+    m_stats.bytesWritten += count * m_blockSize;
+    m_stats.maps++;
+
+    const uint32_t first = m_cursor;
+    m_cursor += count;
+    return first;
+}
+
+void ConstantRing::BindVS(ID3D11DeviceContext1* context, UINT slot, uint32_t block)
+{
+    ID3D11Buffer* buffer = m_buffer.Get();
+    if (m_offsetSupported)
+    {
+        // Offsets and sizes are counted in constants
+        UINT firstConstant = block * (m_blockStride / ConstantSize);
+        UINT constantCount = m_blockStride / ConstantSize;
+        context->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+        return;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    ThrowIfFailed(context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+    memcpy(mapped.pData, m_blocks.data() + size_t(block) * m_blockSize, m_blockSize);
+    context->Unmap(buffer, 0);
+    context->VSSetConstantBuffers(slot, 1, &buffer);
+
+    m_stats.bytesWritten += m_blockSize;
+    m_stats.maps++;
+}
+
+void ConstantRing::CreateBuffer(uint32_t capacity)
+{
+    D3D11_BUFFER_DESC desc = {};
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.ByteWidth = capacity * m_blockStride;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    ThrowIfFailed(m_device->CreateBuffer(&desc, nullptr, m_buffer.ReleaseAndGetAddressOf()));
+    m_capacity = capacity;
+
+    // A new buffer is discarded on its first Write like a full one
+    m_cursor = capacity;
+}
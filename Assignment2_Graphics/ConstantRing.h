@@ -0,0 +1,65 @@
+//
+// ConstantRing.h - Dynamic constant buffer that per draw constant blocks are sub-allocated from
+//
+
+#pragma once
+
+#include <vector>
+
+namespace DX
+{
+    struct ConstantRingStats
+    {
+        uint32_t bytesWritten;      // Copied into mapped memory since ResetStats
+        uint32_t maps;
+        uint32_t discards;          // Times the ring was discarded to start again from the front
+    };
+
+    // Blocks of constants written together with one Map and bound one at a time with a constant
+    // offset (VSSetConstantBuffers1, Direct3D 11.1). Writes append with WRITE_NO_OVERWRITE and the
+    // buffer is only discarded when it wraps, so blocks the GPU may still read are never touched.
+    // Offsets are whole multiples of 16 constants, so blocks are padded to multiples of 256 bytes.
+    //
+    // Where the driver can't offset constant buffers the blocks are kept on the CPU instead and each
+    // is copied into a buffer of its own size as it is bound, one WRITE_DISCARD per draw.
+    class ConstantRing
+    {
+    public:
+        static constexpr uint32_t ConstantSize = 16;        // Bytes in one shader constant, a float4
+        static constexpr uint32_t BlockAlignment = 256;     // Bytes between blocks, 16 constants
+
+        // blockSize is in bytes and capacity in blocks. The ring grows when a single Write needs more.
+        ConstantRing(ID3D11Device* device, uint32_t blockSize, uint32_t capacity);
+
+        ConstantRing(ConstantRing const&) = delete;
+        ConstantRing& operator= (ConstantRing const&) = delete;
+
+        // Copies count tightly packed blocks into the ring and returns the index Bind takes for the
+        // first, the others follow it. Blocks stay valid until the next Write.
+        uint32_t Write(ID3D11DeviceContext1* context, const void* blocks, uint32_t count);
+
+        // Binds one block of the last Write to a vertex shader constant buffer slot
+        void BindVS(ID3D11DeviceContext1* context, UINT slot, uint32_t block);
+
+        bool IsOffsetSupported() const noexcept { return m_offsetSupported; }
+        uint32_t GetBlockSize() const noexcept { return m_blockSize; }
+
+        const ConstantRingStats& GetStats() const noexcept { return m_stats; }
+        void ResetStats() noexcept { m_stats = {}; }
+
+    private:
+        void CreateBuffer(uint32_t capacity);
+
+        Microsoft::WRL::ComPtr<ID3D11Device> m_device;
+        Microsoft::WRL::ComPtr<ID3D11Buffer> m_buffer;
+        bool m_offsetSupported;
+        uint32_t m_blockSize;
+        uint32_t m_blockStride;     // Ring bytes per block, or the block size when offsets are unsupported
+        uint32_t m_capacity;        // Blocks
+        uint32_t m_cursor;          // Next free block
+
+        // Without offsets, the blocks of the last Write
+        std::vector<uint8_t> m_blocks;
+        ConstantRingStats m_stats;
+    };
+}
@@ -0,0 +1,81 @@
+//
+// D3D11CommandBackend.cpp - Replays command lists on a Direct3D 11 context
+//
+
+#include "pch.h"
+#include "D3D11CommandBackend.h"
+
+#include "Shader.h"
+#include "modelclass.h"
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+using namespace DX;
+
+D3D11CommandBackend::D3D11CommandBackend(ID3D11DeviceContext1* context, ConstantRing* objectConstants) noexcept :
+    m_context(context),
+    m_objectConstants(objectConstants)
+{
+}
+
+void D3D11CommandBackend::Execute(const CommandBuffer& commands)
+{
+    commands.ForEach([this](const CommandHeader& header)
+    {
+        switch (header.type)
+        {
+        case CommandType::SetPipeline:
+            static_cast<Shader*>(const_cast<void*>(CommandBuffer::As<SetPipelineCommand>(header).pipeline))->EnableShader(m_context);
+            break;
+
+        case CommandType::SetTexture:
+        {
+            const SetTextureCommand& command = CommandBuffer::As<SetTextureCommand>(header);
+            ID3D11ShaderResourceView* texture = static_cast<ID3D11ShaderResourceView*>(const_cast<void*>(command.texture));
+            m_context->PSSetShaderResources(command.slot, 1, &texture);
+            break;
+        }
+
+        case CommandType::SetConstants:
+        {
+            const SetConstantsCommand& command = CommandBuffer::As<SetConstantsCommand>(header);
+            m_objectConstants->BindVS(m_context, command.slot, command.block);
+            break;
+        }
+
+        case CommandType::SetView:
+        {
+            const SetViewCommand& command = CommandBuffer::As<SetViewCommand>(header);
+            m_viewProjection = Matrix(command.viewProjection);
+            m_cameraPosition = Vector3(command.cameraPosition.x, command.cameraPosition.y, command.cameraPosition.z);
+            break;
+        }
+
+        case CommandType::DrawMesh:
+        {
+            const DrawMeshCommand& command = CommandBuffer::As<DrawMeshCommand>(header);
+            ModelClass* mesh = static_cast<ModelClass*>(const_cast<void*>(command.mesh));
+            if (command.instanceCount > 0)
+            {
+                mesh->RenderInstanced(m_context, command.lod, command.instanceCount, command.firstInstance);
+            }
+            else
+            {
+                mesh->Render(m_context, command.lod);
+            }
+            break;
+        }
+
+        case CommandType::DrawMeshClusters:
+        {
+            const DrawMeshClustersCommand& command = CommandBuffer::As<DrawMeshClustersCommand>(header);
+            ModelClass* mesh = static_cast<ModelClass*>(const_cast<void*>(command.mesh));
+            mesh->RenderClusters(m_context, Matrix(command.world), m_viewProjection, m_cameraPosition);
+            break;
+        }
+
+        default:
+            break;
+        }
+    });
+}
@@ -0,0 +1,27 @@
+//
+// D3D11CommandBackend.h - Replays command lists on a Direct3D 11 context
+//
+
+#pragma once
+
+#include "CommandList.h"
+#include "ConstantRing.h"
+
+namespace DX
+{
+    // Pipelines are Shader, textures ID3D11ShaderResourceView and meshes ModelClass. Constant blocks
+    // are bound from the ring the frame's object constants were written to.
+    class D3D11CommandBackend : public CommandBackend
+    {
+    public:
+        D3D11CommandBackend(ID3D11DeviceContext1* context, ConstantRing* objectConstants) noexcept;
+
+        void Execute(const CommandBuffer& commands) override;
+
+    private:
+        ID3D11DeviceContext1* m_context;
+        ConstantRing* m_objectConstants;
+        DirectX::SimpleMath::Matrix m_viewProjection;
+        DirectX::SimpleMath::Vector3 m_cameraPosition;
+    };
+}
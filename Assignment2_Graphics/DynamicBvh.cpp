@@ -0,0 +1,697 @@
+//
+// DynamicBvh.cpp - Dynamic bounding volume hierarchy of axis aligned boxes for spatial queries
+//
+
+#include "pch.h"
+#include "DynamicBvh.h"
+
+#include <cassert>
+#include <cfloat>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    constexpr uint32_t PlaneCount = 6;
+
+    inline float Component(const XMFLOAT3& v, int axis) noexcept
+    {
+        return (&v.x)[axis];
+    }
+
+    inline void Union(const XMFLOAT3& minA, const XMFLOAT3& maxA, const XMFLOAT3& minB, const XMFLOAT3& maxB,
+        XMFLOAT3& boundsMin, XMFLOAT3& boundsMax) noexcept
+    {
+        boundsMin = XMFLOAT3(std::min(minA.x, minB.x), std::min(minA.y, minB.y), std::min(minA.z, minB.z));
+        boundsMax = XMFLOAT3(std::max(maxA.x, maxB.x), std::max(maxA.y, maxB.y), std::max(maxA.z, maxB.z));
+    }
+
+    // Half the surface area, which is all the insertion cost compares
+    inline float Area(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax) noexcept
+    {
+        float x = boundsMax.x - boundsMin.x;
+        float y = boundsMax.y - boundsMin.y;
+        float z = boundsMax.z - boundsMin.z;
+        return x * y + y * z + z * x;
+    }
+
+    inline float UnionArea(const XMFLOAT3& minA, const XMFLOAT3& maxA, const XMFLOAT3& minB, const XMFLOAT3& maxB) noexcept
+    {
+        XMFLOAT3 boundsMin, boundsMax;
+        Union(minA, maxA, minB, maxB, boundsMin, boundsMax);
+        return Area(boundsMin, boundsMax);
+    }
+
+    inline bool Contains(const XMFLOAT3& outerMin, const XMFLOAT3& outerMax, const XMFLOAT3& innerMin, const XMFLOAT3& innerMax) noexcept
+    {
+        return outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z &&
+            innerMax.x <= outerMax.x && innerMax.y <= outerMax.y && innerMax.z <= outerMax.z;
+    }
+
+    enum class PlaneTest { Outside, Intersecting, Inside };
+
+    PlaneTest TestFrustum(const XMFLOAT4* planes, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax) noexcept
+    {
+        float cx = (boundsMin.x + boundsMax.x) * 0.5f;
+        float cy = (boundsMin.y + boundsMax.y) * 0.5f;
+        float cz = (boundsMin.z + boundsMax.z) * 0.5f;
+        float ex = (boundsMax.x - boundsMin.x) * 0.5f;
+        float ey = (boundsMax.y - boundsMin.y) * 0.5f;
+        float ez = (boundsMax.z - boundsMin.z) * 0.5f;
+
+        PlaneTest result = PlaneTest::Inside;
+        for (uint32_t i = 0; i < PlaneCount; i++)
+        {
+            const XMFLOAT4& plane = planes[i];
+            float distance = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+            float radius = std::abs(plane.x) * ex + std::abs(plane.y) * ey + std::abs(plane.z) * ez;
+            if (distance + radius < 0.f)
+                return PlaneTest::Outside;
+            if (distance - radius < 0.f)
+                result = PlaneTest::Intersecting;
+        }
+        return result;
+    }
+
+    inline bool TestSphere(const XMFLOAT3& center, float radiusSquared, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax) noexcept
+    {
+        float dx = center.x - std::max(boundsMin.x, std::min(center.x, boundsMax.x));
+        float dy = center.y - std::max(boundsMin.y, std::min(center.y, boundsMax.y));
+        float dz = center.z - std::max(boundsMin.z, std::min(center.z, boundsMax.z));
+        return dx * dx + dy * dy + dz * dz <= radiusSquared;
+    }
+
+    struct Ray
+    {
+        XMFLOAT3 origin;
+        XMFLOAT3 inverseDirection;
+        bool parallel[3];
+    };
+
+    // Slab test, returns the distance where the ray enters the box
+    bool TestRay(const Ray& ray, float maxDistance, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, float& entry) noexcept
+    {
+        float tMin = 0.f;
+        float tMax = maxDistance;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float origin = Component(ray.origin, axis);
+            float lower = Component(boundsMin, axis);
+            float upper = Component(boundsMax, axis);
+            if (ray.parallel[axis])
+            {
+                if (origin < lower || origin > upper)
+                    return false;
+                continue;
+            }
+
+            float t0 = (lower - origin) * Component(ray.inverseDirection, axis);
+            float t1 = (upper - origin) * Component(ray.inverseDirection, axis);
+            tMin = std::max(tMin, std::min(t0, t1));
+            tMax = std::min(tMax, std::max(t0, t1));
+            if (tMin > tMax)
+                return false;
+        }
+        entry = tMin;
+        return true;
+    }
+}
+
+DynamicBvh::DynamicBvh(float margin) noexcept :
+    m_root(NullNode),
+    m_freeList(NullNode),
+    m_objectCount(0),
+    m_margin(margin)
+{
+}
+
+void DynamicBvh::Reserve(size_t objectCount)
+{
+    // A binary tree of n leaves has n - 1 internal nodes
+    m_nodes.reserve(objectCount * 2);
+}
+
+void DynamicBvh::Clear() noexcept
+{
+    m_nodes.clear();
+    m_root = NullNode;
+    m_freeList = NullNode;
+    m_objectCount = 0;
+}
+
+uint32_t DynamicBvh::Insert(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, uint32_t userData)
+{
+    uint32_t leaf = AllocateNode();
+    Node& node = m_nodes[leaf];
+    node.child0 = NullNode;
+    node.child1 = NullNode;
+    node.height = 0;
+    node.userData = userData;
+    SetLeafBounds(leaf, boundsMin, boundsMax);
+
+    InsertLeaf(leaf);
+    m_objectCount++;
+    return leaf;
+}
+
+void DynamicBvh::Remove(uint32_t proxy)
+{
+    if (proxy >= m_nodes.size() || !m_nodes[proxy].IsLeaf())
+        throw std::out_of_range("DynamicBvh::Remove");
+
+    RemoveLeaf(proxy);
+    FreeNode(proxy);
+    m_objectCount--;
+}
+
+bool DynamicBvh::Move(uint32_t proxy, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+    Node& node = m_nodes[proxy];
+    if (Contains(node.boundsMin, node.boundsMax, boundsMin, boundsMax))
+    {
+        // Still inside the enlarged box, which the parents already enclose
+        node.objectMin = boundsMin;
+        node.objectMax = boundsMax;
+        return false;
+    }
+
+    RemoveLeaf(proxy);
+    SetLeafBounds(proxy, boundsMin, boundsMax);
+    InsertLeaf(proxy);
+    return true;
+}
+
+void DynamicBvh::SetBounds(uint32_t proxy, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+    SetLeafBounds(proxy, boundsMin, boundsMax);
+}
+
+void DynamicBvh::Refit()
+{
+    if (m_root == NullNode || m_nodes[m_root].IsLeaf())
+        return;
+
+    // Internal nodes in preorder, so walking the list backwards meets children before parents
+    m_scratch.clear();
+    m_scratch.push_back(m_root);
+    for (size_t i = 0; i < m_scratch.size(); i++)
+    {
+        const Node& node = m_nodes[m_scratch[i]];
+        if (!m_nodes[node.child0].IsLeaf())
+            m_scratch.push_back(node.child0);
+        if (!m_nodes[node.child1].IsLeaf())
+            m_scratch.push_back(node.child1);
+    }
+
+    for (size_t i = m_scratch.size(); i > 0; i--)
+    {
+        UpdateNode(m_scratch[i - 1]);
+    }
+}
+
+void DynamicBvh::Rebuild()
+{
+    if (m_root == NullNode)
+        return;
+
+    // Keep the leaves, their indices are the proxies, and give every internal node back
+    m_scratch.clear();
+    m_scratch.reserve(m_objectCount);
+    uint32_t stack[MaxStackDepth];
+    uint32_t top = 0;
+    stack[top++] = m_root;
+    while (top > 0)
+    {
+        uint32_t index = stack[--top];
+        const Node& node = m_nodes[index];
+        if (node.IsLeaf())
+        {
+            m_scratch.push_back(index);
+            continue;
+        }
+        stack[top++] = node.child0;
+        stack[top++] = node.child1;
+        FreeNode(index);
+    }
+
+    m_root = BuildRange(m_scratch.data(), m_scratch.size());
+    m_nodes[m_root].parent = NullNode;
+}
+
+void XM_CALLCONV DynamicBvh::QueryFrustum(FXMMATRIX viewProjection, std::vector<uint32_t>& results) const
+{
+    if (m_root == NullNode)
+        return;
+
+    // Same planes as FrustumCuller (Gribb & Hartmann, D3D clip z is [0, w]), unnormalized
+    XMMATRIX columns = XMMatrixTranspose(viewProjection);
+    XMFLOAT4 planes[PlaneCount];
+    XMStoreFloat4(&planes[0], columns.r[2]);
+    XMStoreFloat4(&planes[1], XMVectorAdd(columns.r[3], columns.r[0]));
+    XMStoreFloat4(&planes[2], XMVectorSubtract(columns.r[3], columns.r[0]));
+    XMStoreFloat4(&planes[3], XMVectorAdd(columns.r[3], columns.r[1]));
+    XMStoreFloat4(&planes[4], XMVectorSubtract(columns.r[3], columns.r[1]));
+    XMStoreFloat4(&planes[5], XMVectorSubtract(columns.r[3], columns.r[2]));
+
+    uint32_t stack[MaxStackDepth];
+    uint32_t top = 0;
+    stack[top++] = m_root;
+    while (top > 0)
+    {
+        uint32_t index = stack[--top];
+        const Node& node = m_nodes[index];
+        if (node.IsLeaf())
+        {
+            if (TestFrustum(planes, node.objectMin, node.objectMax) != PlaneTest::Outside)
+                results.push_back(node.userData);
+            continue;
+        }
+
+        PlaneTest test = TestFrustum(planes, node.boundsMin, node.boundsMax);
+        if (test == PlaneTest::Inside)
+        {
+            // Everything below is visible, no more plane tests needed
+            CollectLeaves(index, results);
+        }
+        else if (test == PlaneTest::Intersecting)
+        {
+            assert(top + 2 <= MaxStackDepth);
+            stack[top++] = node.child0;
+            stack[top++] = node.child1;
+        }
+    }
+}
+
+void XM_CALLCONV DynamicBvh::QuerySphere(FXMVECTOR center, float radius, std::vector<uint32_t>& results) const
+{
+    if (m_root == NullNode)
+        return;
+
+    XMFLOAT3 sphereCenter;
+    XMStoreFloat3(&sphereCenter, center);
+    const float radiusSquared = radius * radius;
+
+    uint32_t stack[MaxStackDepth];
+    uint32_t top = 0;
+    stack[top++] = m_root;
+    while (top > 0)
+    {
+        const Node& node = m_nodes[stack[--top]];
+        if (node.IsLeaf())
+        {
+            if (TestSphere(sphereCenter, radiusSquared, node.objectMin, node.objectMax))
+                results.push_back(node.userData);
+        }
+        else if (TestSphere(sphereCenter, radiusSquared, node.boundsMin, node.boundsMax))
+        {
+            assert(top + 2 <= MaxStackDepth);
+            stack[top++] = node.child0;
+            stack[top++] = node.child1;
+        }
+    }
+}
+
+bool XM_CALLCONV DynamicBvh::RayCast(FXMVECTOR origin, FXMVECTOR direction, float maxDistance,
+    uint32_t& userData, float& distance) const
+{
+    if (m_root == NullNode)
+        return false;
+
+    Ray ray;
+    XMStoreFloat3(&ray.origin, origin);
+    XMFLOAT3 rayDirection;
+    XMStoreFloat3(&rayDirection, direction);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float component = Component(rayDirection, axis);
+        ray.parallel[axis] = component == 0.f;
+        (&ray.inverseDirection.x)[axis] = ray.parallel[axis] ? 0.f : 1.f / component;
+    }
+
+    float entry;
+    if (!TestRay(ray, maxDistance, m_nodes[m_root].boundsMin, m_nodes[m_root].boundsMax, entry))
+        return false;
+
+    // Nearer child on top, so the closest hit is found early and prunes everything behind it
+    uint32_t stack[MaxStackDepth];
+    float stackEntry[MaxStackDepth];
+    uint32_t top = 0;
+    stack[top] = m_root;
+    stackEntry[top++] = entry;
+
+    uint32_t hit = NullNode;
+    float nearest = maxDistance;
+    while (top > 0)
+    {
+        top--;
+        if (stackEntry[top] > nearest)
+            continue;
+
+        const Node& node = m_nodes[stack[top]];
+        if (node.IsLeaf())
+        {
+            if (TestRay(ray, nearest, node.objectMin, node.objectMax, entry) && (hit == NullNode || entry < nearest))
+            {
+                hit = stack[top];
+                nearest = entry;
+            }
+            continue;
+        }
+
+        float entry0, entry1;
+        const Node& child0 = m_nodes[node.child0];
+        const Node& child1 = m_nodes[node.child1];
+        bool hit0 = TestRay(ray, nearest, child0.boundsMin, child0.boundsMax, entry0);
+        bool hit1 = TestRay(ray, nearest, child1.boundsMin, child1.boundsMax, entry1);
+
+        assert(top + 2 <= MaxStackDepth);
+        if (hit0 && hit1)
+        {
+            bool nearFirst = entry0 <= entry1;
+            stack[top] = nearFirst ? node.child1 : node.child0;
+            stackEntry[top++] = nearFirst ? entry1 : entry0;
+            stack[top] = nearFirst ? node.child0 : node.child1;
+            stackEntry[top++] = nearFirst ? entry0 : entry1;
+        }
+        else if (hit0 || hit1)
+        {
+            stack[top] = hit0 ? node.child0 : node.child1;
+            stackEntry[top++] = hit0 ? entry0 : entry1;
+        }
+    }
+
+    if (hit == NullNode)
+        return false;
+
+    userData = m_nodes[hit].userData;
+    distance = nearest;
+    return true;
+}
+
+DynamicBvhStats DynamicBvh::GetStats() const
+{
+    DynamicBvhStats stats = {};
+    stats.objectCount = static_cast<uint32_t>(m_objectCount);
+    if (m_root == NullNode)
+        return stats;
+
+    const Node& root = m_nodes[m_root];
+    stats.height = root.height;
+
+    float internalArea = 0.f;
+    uint32_t stack[MaxStackDepth];
+    uint32_t top = 0;
+    stack[top++] = m_root;
+    while (top > 0)
+    {
+        const Node& node = m_nodes[stack[--top]];
+        stats.nodeCount++;
+        if (!node.IsLeaf())
+        {
+            internalArea += Area(node.boundsMin, node.boundsMax);
+            stack[top++] = node.child0;
+            stack[top++] = node.child1;
+        }
+    }
+
+    float rootArea = Area(root.boundsMin, root.boundsMax);
+    stats.areaRatio = rootArea > 0.f ? internalArea / rootArea : 0.f;
+    return stats;
+}
+
+uint32_t DynamicBvh::AllocateNode()
+{
+    if (m_freeList == NullNode)
+    {
+        m_nodes.emplace_back();
+        return static_cast<uint32_t>(m_nodes.size() - 1);
+    }
+
+    uint32_t node = m_freeList;
+    m_freeList = m_nodes[node].parent;
+    return node;
+}
+
+void DynamicBvh::FreeNode(uint32_t node) noexcept
+{
+    // Marked as an internal node so Remove rejects stale proxies
+    m_nodes[node].parent = m_freeList;
+    m_nodes[node].child0 = 0;
+    m_freeList = node;
+}
+
+void DynamicBvh::SetLeafBounds(uint32_t leaf, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax) noexcept
+{
+    Node& node = m_nodes[leaf];
+    node.objectMin = boundsMin;
+    node.objectMax = boundsMax;
+    node.boundsMin = XMFLOAT3(boundsMin.x - m_margin, boundsMin.y - m_margin, boundsMin.z - m_margin);
+    node.boundsMax = XMFLOAT3(boundsMax.x + m_margin, boundsMax.y + m_margin, boundsMax.z + m_margin);
+}
+
+void DynamicBvh::UpdateNode(uint32_t node) noexcept
+{
+    Node& parent = m_nodes[node];
+    const Node& child0 = m_nodes[parent.child0];
+    const Node& child1 = m_nodes[parent.child1];
+    Union(child0.boundsMin, child0.boundsMax, child1.boundsMin, child1.boundsMax, parent.boundsMin, parent.boundsMax);
+    parent.height = 1 + std::max(child0.height, child1.height);
+}
+
+void DynamicBvh::InsertLeaf(uint32_t leaf)
+{
+    if (m_root == NullNode)
+    {
+        m_root = leaf;
+        m_nodes[leaf].parent = NullNode;
+        return;
+    }
+
+    // Walk down towards the sibling whose pairing adds the least area. Every node above the new
+    // parent grows by the same amount whichever way the walk goes, so that growth is carried along.
+    XMFLOAT3 leafMin = m_nodes[leaf].boundsMin;
+    XMFLOAT3 leafMax = m_nodes[leaf].boundsMax;
+    uint32_t index = m_root;
+    while (!m_nodes[index].IsLeaf())
+    {
+        const Node& node = m_nodes[index];
+        float area = Area(node.boundsMin, node.boundsMax);
+        float combinedArea = UnionArea(node.boundsMin, node.boundsMax, leafMin, leafMax);
+
+        // Cost of making this node the sibling, and the growth pushed onto anything below it
+        float cost = 2.f * combinedArea;
+        float inheritedCost = 2.f * (combinedArea - area);
+
+        float childCost[2];
+        const uint32_t children[2] = { node.child0, node.child1 };
+        for (int i = 0; i < 2; i++)
+        {
+            const Node& child = m_nodes[children[i]];
+            float childArea = UnionArea(child.boundsMin, child.boundsMax, leafMin, leafMax);
+            if (!child.IsLeaf())
+                childArea -= Area(child.boundsMin, child.boundsMax);
+            childCost[i] = childArea + inheritedCost;
+        }
+
+        if (cost < childCost[0] && cost < childCost[1])
+            break;
+
+        index = childCost[0] < childCost[1] ? children[0] : children[1];
+    }
+
+    uint32_t sibling = index;
+    uint32_t oldParent = m_nodes[sibling].parent;
+    uint32_t newParent = AllocateNode();
+    Node& parent = m_nodes[newParent];
+    parent.parent = oldParent;
+    parent.child0 = sibling;
+    parent.child1 = leaf;
+    parent.userData = 0;
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+    UpdateNode(newParent);
+
+    if (oldParent == NullNode)
+    {
+        m_root = newParent;
+    }
+    else if (m_nodes[oldParent].child0 == sibling)
+    {
+        m_nodes[oldParent].child0 = newParent;
+    }
+    else
+    {
+        m_nodes[oldParent].child1 = newParent;
+    }
+
+    for (index = newParent; index != NullNode; index = m_nodes[index].parent)
+    {
+        index = Balance(index);
+        UpdateNode(index);
+    }
+}
+
+void DynamicBvh::RemoveLeaf(uint32_t leaf)
+{
+    if (leaf == m_root)
+    {
+        m_root = NullNode;
+        return;
+    }
+
+    uint32_t parent = m_nodes[leaf].parent;
+    uint32_t grandParent = m_nodes[parent].parent;
+    uint32_t sibling = m_nodes[parent].child0 == leaf ? m_nodes[parent].child1 : m_nodes[parent].child0;
+
+    // The sibling takes the parent's place
+    m_nodes[sibling].parent = grandParent;
+    FreeNode(parent);
+    if (grandParent == NullNode)
+    {
+        m_root = sibling;
+        return;
+    }
+
+    if (m_nodes[grandParent].child0 == parent)
+    {
+        m_nodes[grandParent].child0 = sibling;
+    }
+    else
+    {
+        m_nodes[grandParent].child1 = sibling;
+    }
+
+    for (uint32_t index = grandParent; index != NullNode; index = m_nodes[index].parent)
+    {
+        index = Balance(index);
+        UpdateNode(index);
+    }
+}
+
+// Rotates the taller child of a up when the two children's heights differ by more than one, and
+// returns the node now at a's place
+uint32_t DynamicBvh::Balance(uint32_t a)
+{
+    Node& nodeA = m_nodes[a];
+    if (nodeA.IsLeaf() || nodeA.height < 2)
+        return a;
+
+    uint32_t b = nodeA.child0;
+    uint32_t c = nodeA.child1;
+    int balance = static_cast<int>(m_nodes[c].height) - static_cast<int>(m_nodes[b].height);
+    if (balance >= -1 && balance <= 1)
+        return a;
+
+    // The taller child becomes the parent of a, and a takes the taller grandchild's shorter sibling
+    uint32_t up = balance > 1 ? c : b;
+    Node& nodeUp = m_nodes[up];
+    uint32_t grandChild0 = nodeUp.child0;
+    uint32_t grandChild1 = nodeUp.child1;
+    bool keepFirst = m_nodes[grandChild0].height > m_nodes[grandChild1].height;
+    uint32_t kept = keepFirst ? grandChild0 : grandChild1;
+    uint32_t moved = keepFirst ? grandChild1 : grandChild0;
+
+    uint32_t oldParent = nodeA.parent;
+    nodeUp.parent = oldParent;
+    nodeUp.child0 = a;
+    nodeUp.child1 = kept;
+    nodeA.parent = up;
+    if (balance > 1)
+    {
+        nodeA.child1 = moved;
+    }
+    else
+    {
+        nodeA.child0 = moved;
+    }
+    m_nodes[moved].parent = a;
+    m_nodes[kept].parent = up;
+
+    if (oldParent == NullNode)
+    {
+        m_root = up;
+    }
+    else if (m_nodes[oldParent].child0 == a)
+    {
+        m_nodes[oldParent].child0 = up;
+    }
+    else
+    {
+        m_nodes[oldParent].child1 = up;
+    }
+
+    UpdateNode(a);
+    UpdateNode(up);
+    return up;
+}
+
+uint32_t DynamicBvh::BuildRange(uint32_t* leaves, size_t count)
+{
+    if (count == 1)
+        return leaves[0];
+
+    // Split at the median of the object centers along their longest extent
+    XMFLOAT3 centerMin(FLT_MAX, FLT_MAX, FLT_MAX);
+    XMFLOAT3 centerMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t i = 0; i < count; i++)
+    {
+        const Node& node = m_nodes[leaves[i]];
+        XMFLOAT3 center(node.objectMin.x + node.objectMax.x, node.objectMin.y + node.objectMax.y,
+            node.objectMin.z + node.objectMax.z);
+        Union(centerMin, centerMax, center, center, centerMin, centerMax);
+    }
+
+    int axis = 0;
+    float extent = centerMax.x - centerMin.x;
+    for (int i = 1; i < 3; i++)
+    {
+        if (Component(centerMax, i) - Component(centerMin, i) > extent)
+        {
+            extent = Component(centerMax, i) - Component(centerMin, i);
+            axis = i;
+        }
+    }
+
+    size_t half = count / 2;
+    std::nth_element(leaves, leaves + half, leaves + count,
+        [this, axis](uint32_t left, uint32_t right)
+        {
+            const Node& a = m_nodes[left];
+            const Node& b = m_nodes[right];
+            return Component(a.objectMin, axis) + Component(a.objectMax, axis) <
+                Component(b.objectMin, axis) + Component(b.objectMax, axis);
+        });
+
+    uint32_t child0 = BuildRange(leaves, half);
+    uint32_t child1 = BuildRange(leaves + half, count - half);
+
+    uint32_t index = AllocateNode();
+    Node& node = m_nodes[index];
+    node.child0 = child0;
+    node.child1 = child1;
+    node.userData = 0;
+    m_nodes[child0].parent = index;
+    m_nodes[child1].parent = index;
+    UpdateNode(index);
+    return index;
+}
+
+void DynamicBvh::CollectLeaves(uint32_t node, std::vector<uint32_t>& results) const
+{
+    uint32_t stack[MaxStackDepth];
+    uint32_t top = 0;
+    stack[top++] = node;
+    while (top > 0)
+    {
+        const Node& current = m_nodes[stack[--top]];
+        if (current.IsLeaf())
+        {
+            results.push_back(current.userData);
+            continue;
+        }
+        assert(top + 2 <= MaxStackDepth);
+        stack[top++] = current.child0;
+        stack[top++] = current.child1;
+    }
+}
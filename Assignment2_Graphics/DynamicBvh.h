@@ -0,0 +1,102 @@
+//
+// DynamicBvh.h - Dynamic bounding volume hierarchy of axis aligned boxes for spatial queries
+//
+
+#pragma once
+
+#include <vector>
+
+namespace DX
+{
+    struct DynamicBvhStats
+    {
+        uint32_t objectCount;
+        uint32_t nodeCount;
+        uint32_t height;            // Edges from the root to the deepest leaf
+        float areaRatio;            // Summed surface area of the internal nodes over the root's, lower is better
+    };
+
+    // Binary tree of boxes, one leaf per object. Objects are inserted next to the sibling that grows
+    // the tree's surface area the least, and rotations keep the tree balanced whatever the insertion
+    // order (the dynamic tree from Box2D, in 3D).
+    //
+    // Leaves are enlarged by a margin, so an object that moves less than that keeps its place. Move
+    // reinserts only objects that leave their enlarged box. For many small moves at once, SetBounds
+    // followed by one Refit updates the boxes without changing the tree's shape, and Rebuild
+    // restores the quality afterwards.
+    //
+    // Queries test the exact object boxes at the leaves and append the user data of the hits. They
+    // don't modify the tree, so any number can run at once between updates.
+    class DynamicBvh
+    {
+    public:
+        static constexpr uint32_t NullNode = 0xFFFFFFFFu;
+
+        explicit DynamicBvh(float margin = 0.1f) noexcept;
+
+        void Reserve(size_t objectCount);
+        void Clear() noexcept;
+
+        // Returns the object's proxy, its handle for the calls below
+        uint32_t Insert(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, uint32_t userData);
+        void Remove(uint32_t proxy);
+
+        // Returns true when the object left its enlarged box and was reinserted
+        bool Move(uint32_t proxy, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax);
+
+        // Changes the object's box without touching the tree, Refit brings the parents up to date
+        void SetBounds(uint32_t proxy, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax);
+        void Refit();
+
+        // Builds the tree again top down, splitting the objects at the median of their longest axis
+        void Rebuild();
+
+        void XM_CALLCONV QueryFrustum(DirectX::FXMMATRIX viewProjection, std::vector<uint32_t>& results) const;
+        void XM_CALLCONV QuerySphere(DirectX::FXMVECTOR center, float radius, std::vector<uint32_t>& results) const;
+
+        // Nearest object box hit within maxDistance, in units of direction. A ray starting inside a
+        // box hits it at distance 0.
+        bool XM_CALLCONV RayCast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxDistance,
+            uint32_t& userData, float& distance) const;
+
+        uint32_t GetUserData(uint32_t proxy) const noexcept { return m_nodes[proxy].userData; }
+        size_t GetObjectCount() const noexcept { return m_objectCount; }
+        DynamicBvhStats GetStats() const;
+
+    private:
+        // Deepest traversal the fixed query stacks allow, far beyond a balanced tree of any real size
+        static constexpr uint32_t MaxStackDepth = 256;
+
+        struct Node
+        {
+            DirectX::XMFLOAT3 boundsMin;    // Enlarged for leaves
+            uint32_t parent;                // Next free node while on the free list
+            DirectX::XMFLOAT3 boundsMax;
+            uint32_t child0;                // NullNode for leaves
+            uint32_t child1;
+            uint32_t height;                // 0 for leaves
+            uint32_t userData;
+            DirectX::XMFLOAT3 objectMin;    // Exact object box, leaves only
+            DirectX::XMFLOAT3 objectMax;
+
+            bool IsLeaf() const noexcept { return child0 == NullNode; }
+        };
+
+        uint32_t AllocateNode();
+        void FreeNode(uint32_t node) noexcept;
+        void SetLeafBounds(uint32_t leaf, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax) noexcept;
+        void UpdateNode(uint32_t node) noexcept;
+        void InsertLeaf(uint32_t leaf);
+        void RemoveLeaf(uint32_t leaf);
+        uint32_t Balance(uint32_t node);
+        uint32_t BuildRange(uint32_t* leaves, size_t count);
+        void CollectLeaves(uint32_t node, std::vector<uint32_t>& results) const;
+
+        std::vector<Node> m_nodes;
+        uint32_t m_root;
+        uint32_t m_freeList;
+        size_t m_objectCount;
+        float m_margin;
+        std::vector<uint32_t> m_scratch;
+    };
+}
@@ -0,0 +1,149 @@
+//
+// FrameLimiter.cpp - Holds frames to a target interval by sleeping most of the wait and spinning the rest
+//
+
+#include "pch.h"
+#include "FrameLimiter.h"
+
+#include <thread>
+
+#if defined(_WIN32)
+#include <timeapi.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using namespace DX;
+
+namespace
+{
+    // Sleeps measured before the estimate stops settling and starts following changes, such as
+    // another process raising the system timer resolution
+    constexpr uint64_t MaxSleepSamples = 1000;
+
+    // Sleeps stop once the time left is within this many standard deviations above the mean sleep
+    constexpr double SleepMarginDeviations = 2.0;
+
+    // First guess for a sleep, long enough that the early waits spin rather than oversleep
+    constexpr double InitialSleepSeconds = 0.005;
+
+    // Tells the core it is in a spin loop, so it doesn't flood the pipeline with clock reads or
+    // starve the other hyperthread
+    inline void SpinPause() noexcept
+    {
+#if defined(_WIN32)
+        YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+        _mm_pause();
+#endif
+    }
+}
+
+constexpr std::chrono::microseconds FrameLimiter::SleepQuantum;
+
+FrameLimiter::FrameLimiter() noexcept :
+    m_target(0),
+    m_started(false),
+    m_timerPeriodSet(false),
+    m_sleepMean(InitialSleepSeconds),
+    m_sleepM2(0.0),
+    m_sleepCount(1),
+    m_stats{}
+{
+}
+
+FrameLimiter::~FrameLimiter()
+{
+    SetTargetSeconds(0.0);
+}
+
+void FrameLimiter::SetTargetSeconds(double seconds) noexcept
+{
+    m_target = std::chrono::nanoseconds(static_cast<int64_t>(std::max(seconds, 0.0) * 1e9));
+
+    // The finer timer costs the whole system power, so it is only asked for while frames are held
+#if defined(_WIN32)
+    const bool wantTimerPeriod = m_target.count() != 0;
+    if (wantTimerPeriod != m_timerPeriodSet)
+    {
+        if (wantTimerPeriod)
+        {
+            m_timerPeriodSet = timeBeginPeriod(1) == TIMERR_NOERROR;
+        }
+        else
+        {
+            timeEndPeriod(1);
+            m_timerPeriodSet = false;
+        }
+    }
+#endif
+
+    m_started = false;
+    m_stats.frames = 0;
+    m_stats.lateFrames = 0;
+    m_stats.lastErrorSeconds = 0.0;
+    m_stats.maxErrorSeconds = 0.0;
+}
+
+void FrameLimiter::Wait()
+{
+    if (m_target.count() == 0)
+    {
+        return;
+    }
+
+    // The first frame only starts the schedule
+    const Clock::time_point now = Clock::now();
+    if (!m_started)
+    {
+        m_started = true;
+        m_deadline = now + m_target;
+        return;
+    }
+
+    m_stats.frames++;
+    if (now >= m_deadline)
+    {
+        m_stats.lateFrames++;
+        m_deadline = now + m_target;
+        return;
+    }
+
+    SleepUntil(m_deadline);
+    const double error = std::chrono::duration<double>(Clock::now() - m_deadline).count();
+    m_stats.lastErrorSeconds = error;
+    m_stats.maxErrorSeconds = std::max(m_stats.maxErrorSeconds, error);
+    m_deadline += m_target;
+}
+
+void FrameLimiter::SleepUntil(Clock::time_point deadline)
+{
+    for (;;)
+    {
+        const double estimate = m_sleepMean + SleepMarginDeviations * std::sqrt(m_sleepM2 / m_sleepCount);
+        m_stats.sleepEstimateSeconds = estimate;
+        if (std::chrono::duration<double>(deadline - Clock::now()).count() <= estimate)
+        {
+            break;
+        }
+
+        const Clock::time_point start = Clock::now();
+        std::this_thread::sleep_for(SleepQuantum);
+        const double observed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        m_sleepCount = std::min(m_sleepCount + 1, MaxSleepSamples);
+        const double delta = observed - m_sleepMean;
+        m_sleepMean += delta / m_sleepCount;
+        m_sleepM2 += delta * (observed - m_sleepMean);
+        if (m_sleepCount == MaxSleepSamples)
+        {
+            m_sleepM2 *= double(MaxSleepSamples - 1) / MaxSleepSamples;
+        }
+    }
+
+    // The rest is spun on the clock, sleeping can't be trusted to wake within it
+    while (Clock::now() < deadline)
+    {
+        SpinPause();
+    }
+}
@@ -0,0 +1,64 @@
+//
+// FrameLimiter.h - Holds frames to a target interval by sleeping most of the wait and spinning the rest
+//
+
+#pragma once
+
+#include <chrono>
+
+namespace DX
+{
+    struct FrameLimiterStats
+    {
+        uint32_t frames;                // Waits since the target was set
+        uint32_t lateFrames;            // Arrived after their deadline, the schedule restarted from them
+        double lastErrorSeconds;        // Release time minus deadline of the last frame that waited
+        double maxErrorSeconds;
+        double sleepEstimateSeconds;    // Longest a SleepQuantum sleep is expected to take
+    };
+
+    // Frames are released on a fixed schedule, one target interval apart, so the error of one
+    // release doesn't carry into the next. Sleeps are never trusted to wake on time: the wait sleeps in
+    // SleepQuantum steps while the time left is above the running mean plus two standard
+    // deviations of how long those sleeps really took, then spins on the clock until the deadline.
+    // On Windows the system timer runs at 1 ms while a target is set, at its default 15.6 ms a
+    // SleepQuantum sleep would take a whole tick and leave most of the wait to the spin.
+    class FrameLimiter
+    {
+    public:
+        static constexpr std::chrono::microseconds SleepQuantum{ 1000 };
+
+        FrameLimiter() noexcept;
+        ~FrameLimiter();
+
+        FrameLimiter(FrameLimiter const&) = delete;
+        FrameLimiter& operator= (FrameLimiter const&) = delete;
+
+        // 0 turns the limiter off
+        void SetTargetSeconds(double seconds) noexcept;
+        double GetTargetSeconds() const noexcept { return m_target.count() / 1e9; }
+
+        // Blocks until the next frame's deadline. A frame that is already late restarts the
+        // schedule from now instead of trying to catch up.
+        void Wait();
+
+        const FrameLimiterStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        void SleepUntil(Clock::time_point deadline);
+
+        std::chrono::nanoseconds m_target;
+        Clock::time_point m_deadline;
+        bool m_started;
+        bool m_timerPeriodSet;      // timeBeginPeriod(1) is in effect, until the target goes back to 0
+
+        // Welford's running mean and variance of sleep durations, in seconds
+        double m_sleepMean;
+        double m_sleepM2;
+        uint64_t m_sleepCount;
+
+        FrameLimiterStats m_stats;
+    };
+}
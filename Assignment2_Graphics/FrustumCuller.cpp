@@ -0,0 +1,301 @@
+//
+// FrustumCuller.cpp - View frustum culling of world space bounding boxes stored as structure of arrays
+//
+
+#include "pch.h"
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+
+#if defined(__AVX__) && !defined(_XM_NO_INTRINSICS_)
+#include <immintrin.h>
+#endif
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    constexpr int PlaneCount = 6;
+
+    // Each plane component splatted across a register, with the absolute values of the normal for
+    // the extents. A box is outside a plane when dot(n, center) + d + dot(|n|, extents) < 0. All six
+    // planes are always tested: stopping once a block is culled would chain the planes one after
+    // another, which costs more than the tests it saves.
+    struct CullPlanes
+    {
+        XMVECTOR x[PlaneCount];
+        XMVECTOR y[PlaneCount];
+        XMVECTOR z[PlaneCount];
+        XMVECTOR w[PlaneCount];
+        XMVECTOR absX[PlaneCount];
+        XMVECTOR absY[PlaneCount];
+        XMVECTOR absZ[PlaneCount];
+    };
+
+    struct BoundsArrays
+    {
+        const float* centerX;
+        const float* centerY;
+        const float* centerZ;
+        const float* extentX;
+        const float* extentY;
+        const float* extentZ;
+    };
+
+    // One bit per lane that is true
+    inline uint32_t XM_CALLCONV GetLaneMask(FXMVECTOR v) noexcept
+    {
+#if defined(_XM_SSE_INTRINSICS_)
+        return static_cast<uint32_t>(_mm_movemask_ps(v));
+#else
+        XMUINT4 lanes;
+        XMStoreUInt4(&lanes, v);
+        return (lanes.x >> 31) | ((lanes.y >> 31) << 1) | ((lanes.z >> 31) << 2) | ((lanes.w >> 31) << 3);
+#endif
+    }
+
+#if defined(__AVX__) && !defined(_XM_NO_INTRINSICS_)
+    inline __m256 MultiplyAdd8(__m256 a, __m256 b, __m256 c) noexcept
+    {
+#if defined(__AVX2__) || defined(__FMA__)
+        return _mm256_fmadd_ps(a, b, c);
+#else
+        return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+    }
+#endif
+
+    // Culls boxes [begin, end), begin on a block boundary, and writes the visible indices to output.
+    // output needs room for a whole block past the range, lanes are stored before they are counted.
+    size_t CullRange(const BoundsArrays& bounds, size_t begin, size_t end, const CullPlanes& planes, uint32_t* output)
+    {
+        size_t written = 0;
+        size_t i = begin;
+
+#if defined(__AVX__) && !defined(_XM_NO_INTRINSICS_)
+        // Eight boxes at a time
+        __m256 x[PlaneCount], y[PlaneCount], z[PlaneCount], w[PlaneCount], absX[PlaneCount], absY[PlaneCount], absZ[PlaneCount];
+        for (int p = 0; p < PlaneCount; p++)
+        {
+            x[p] = _mm256_set1_ps(XMVectorGetX(planes.x[p]));
+            y[p] = _mm256_set1_ps(XMVectorGetX(planes.y[p]));
+            z[p] = _mm256_set1_ps(XMVectorGetX(planes.z[p]));
+            w[p] = _mm256_set1_ps(XMVectorGetX(planes.w[p]));
+            absX[p] = _mm256_set1_ps(XMVectorGetX(planes.absX[p]));
+            absY[p] = _mm256_set1_ps(XMVectorGetX(planes.absY[p]));
+            absZ[p] = _mm256_set1_ps(XMVectorGetX(planes.absZ[p]));
+        }
+        const __m256 zero8 = _mm256_setzero_ps();
+        for (; i + 8 <= end; i += 8)
+        {
+            const __m256 cx = _mm256_loadu_ps(bounds.centerX + i);
+            const __m256 cy = _mm256_loadu_ps(bounds.centerY + i);
+            const __m256 cz = _mm256_loadu_ps(bounds.centerZ + i);
+            const __m256 ex = _mm256_loadu_ps(bounds.extentX + i);
+            const __m256 ey = _mm256_loadu_ps(bounds.extentY + i);
+            const __m256 ez = _mm256_loadu_ps(bounds.extentZ + i);
+
+            __m256 outside = _mm256_setzero_ps();
+            for (int p = 0; p < PlaneCount; p++)
+            {
+                __m256 center = MultiplyAdd8(cx, x[p], w[p]);
+                center = MultiplyAdd8(cy, y[p], center);
+                __m256 extent = _mm256_mul_ps(ex, absX[p]);
+                extent = MultiplyAdd8(ey, absY[p], extent);
+                center = MultiplyAdd8(cz, z[p], center);
+                extent = MultiplyAdd8(ez, absZ[p], extent);
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(center, extent), zero8, _CMP_LT_OQ));
+            }
+
+            const uint32_t visible = ~static_cast<uint32_t>(_mm256_movemask_ps(outside));
+            for (uint32_t lane = 0; lane < 8; lane++)
+            {
+                output[written] = static_cast<uint32_t>(i + lane);
+                written += (visible >> lane) & 1;
+            }
+        }
+#endif
+
+        // Four boxes at a time, the padding makes the last block whole
+        const XMVECTOR zero = XMVectorZero();
+        for (; i < end; i += 4)
+        {
+            const XMVECTOR cx = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(bounds.centerX + i));
+            const XMVECTOR cy = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(bounds.centerY + i));
+            const XMVECTOR cz = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(bounds.centerZ + i));
+            const XMVECTOR ex = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(bounds.extentX + i));
+            const XMVECTOR ey = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(bounds.extentY + i));
+            const XMVECTOR ez = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(bounds.extentZ + i));
+
+            // The center and extent terms are two separate chains, so they overlap
+            XMVECTOR outside = XMVectorFalseInt();
+            for (int p = 0; p < PlaneCount; p++)
+            {
+                XMVECTOR center = XMVectorMultiplyAdd(cx, planes.x[p], planes.w[p]);
+                center = XMVectorMultiplyAdd(cy, planes.y[p], center);
+                XMVECTOR extent = XMVectorMultiply(ex, planes.absX[p]);
+                extent = XMVectorMultiplyAdd(ey, planes.absY[p], extent);
+                center = XMVectorMultiplyAdd(cz, planes.z[p], center);
+                extent = XMVectorMultiplyAdd(ez, planes.absZ[p], extent);
+                outside = XMVectorOrInt(outside, XMVectorLess(XMVectorAdd(center, extent), zero));
+            }
+
+            // Lanes past the end are padding
+            uint32_t visible = ~GetLaneMask(outside);
+            if (i + 4 > end)
+            {
+                visible &= (1u << (end - i)) - 1;
+            }
+            for (uint32_t lane = 0; lane < 4; lane++)
+            {
+                output[written] = static_cast<uint32_t>(i + lane);
+                written += (visible >> lane) & 1;
+            }
+        }
+
+        return written;
+    }
+
+    void CullChunk(const BoundsArrays& bounds, size_t begin, size_t end, const CullPlanes& planes, std::vector<uint32_t>& visible)
+    {
+        visible.resize(end - begin + 8);
+        visible.resize(CullRange(bounds, begin, end, planes, visible.data()));
+    }
+}
+
+FrustumCuller::FrustumCuller() noexcept :
+    m_count(0),
+    m_stats{}
+{
+}
+
+void FrustumCuller::Reserve(size_t boundsCount)
+{
+    const size_t padded = (boundsCount + BlockSize - 1) / BlockSize * BlockSize;
+    m_centerX.reserve(padded);
+    m_centerY.reserve(padded);
+    m_centerZ.reserve(padded);
+    m_extentX.reserve(padded);
+    m_extentY.reserve(padded);
+    m_extentZ.reserve(padded);
+    m_visible.reserve(boundsCount);
+}
+
+void FrustumCuller::Clear() noexcept
+{
+    m_count = 0;
+    m_centerX.clear();
+    m_centerY.clear();
+    m_centerZ.clear();
+    m_extentX.clear();
+    m_extentY.clear();
+    m_extentZ.clear();
+    m_visible.clear();
+}
+
+uint32_t XM_CALLCONV FrustumCuller::Add(FXMVECTOR center, FXMVECTOR extents)
+{
+    // Grow a whole block at a time, the padding boxes are never reported
+    if (m_count % BlockSize == 0)
+    {
+        const size_t padded = m_count + BlockSize;
+        m_centerX.resize(padded);
+        m_centerY.resize(padded);
+        m_centerZ.resize(padded);
+        m_extentX.resize(padded);
+        m_extentY.resize(padded);
+        m_extentZ.resize(padded);
+    }
+
+    const uint32_t index = static_cast<uint32_t>(m_count++);
+    Set(index, center, extents);
+    return index;
+}
+
+void XM_CALLCONV FrustumCuller::Set(uint32_t index, FXMVECTOR center, FXMVECTOR extents)
+{
+    m_centerX[index] = XMVectorGetX(center);
+    m_centerY[index] = XMVectorGetY(center);
+    m_centerZ[index] = XMVectorGetZ(center);
+    m_extentX[index] = XMVectorGetX(extents);
+    m_extentY[index] = XMVectorGetY(extents);
+    m_extentZ[index] = XMVectorGetZ(extents);
+}
+
+void XM_CALLCONV FrustumCuller::TransformBounds(FXMVECTOR center, FXMVECTOR extents, FXMMATRIX world,
+    XMVECTOR& worldCenter, XMVECTOR& worldExtents) noexcept
+{
+    worldCenter = XMVector3Transform(center, world);
+    worldExtents = XMVectorMultiply(XMVectorSplatX(extents), XMVectorAbs(world.r[0]));
+    worldExtents = XMVectorMultiplyAdd(XMVectorSplatY(extents), XMVectorAbs(world.r[1]), worldExtents);
+    worldExtents = XMVectorMultiplyAdd(XMVectorSplatZ(extents), XMVectorAbs(world.r[2]), worldExtents);
+}
+
+void XM_CALLCONV FrustumCuller::Cull(FXMMATRIX viewProjection, unsigned int threadCount)
+{
+    // World space planes of the view projection matrix (Gribb & Hartmann), D3D clip z is [0, w].
+    // Only the sign of the test matters, so they aren't normalized.
+    XMMATRIX columns = XMMatrixTranspose(viewProjection);
+    const XMVECTOR frustum[PlaneCount] =
+    {
+        columns.r[2],
+        XMVectorAdd(columns.r[3], columns.r[0]),
+        XMVectorSubtract(columns.r[3], columns.r[0]),
+        XMVectorAdd(columns.r[3], columns.r[1]),
+        XMVectorSubtract(columns.r[3], columns.r[1]),
+        XMVectorSubtract(columns.r[3], columns.r[2])
+    };
+
+    CullPlanes planes;
+    for (int p = 0; p < PlaneCount; p++)
+    {
+        planes.x[p] = XMVectorSplatX(frustum[p]);
+        planes.y[p] = XMVectorSplatY(frustum[p]);
+        planes.z[p] = XMVectorSplatZ(frustum[p]);
+        planes.w[p] = XMVectorSplatW(frustum[p]);
+        planes.absX[p] = XMVectorAbs(planes.x[p]);
+        planes.absY[p] = XMVectorAbs(planes.y[p]);
+        planes.absZ[p] = XMVectorAbs(planes.z[p]);
+    }
+
+    const BoundsArrays bounds = { m_centerX.data(), m_centerY.data(), m_centerZ.data(), m_extentX.data(), m_extentY.data(), m_extentZ.data() };
+
+    // A few ranges per thread, so those that finish early take over from the others
+    JobSystem& jobs = JobSystem::Get();
+    if (threadCount == 0)
+    {
+        threadCount = jobs.GetThreadCount() * 4;
+    }
+    const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, m_count / MinBoundsPerJob));
+    m_chunks.resize(chunkCount);
+
+    // Ranges start on block boundaries. The calling thread culls its share while it waits for the jobs.
+    auto chunkBegin = [this, chunkCount](size_t chunk)
+    {
+        return chunk == chunkCount ? m_count : (m_count * chunk / chunkCount) / BlockSize * BlockSize;
+    };
+    jobs.ParallelFor(chunkCount, 1, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            CullChunk(bounds, chunkBegin(i), chunkBegin(i + 1), planes, m_chunks[i]);
+        }
+    });
+
+    // Concatenate in index order, a single range is handed over as is
+    if (chunkCount == 1)
+    {
+        m_visible.swap(m_chunks[0]);
+    }
+    else
+    {
+        m_visible.clear();
+        for (const auto& chunk : m_chunks)
+        {
+            m_visible.insert(m_visible.end(), chunk.begin(), chunk.end());
+        }
+    }
+
+    m_stats.boundsCount = static_cast<uint32_t>(m_count);
+    m_stats.visibleCount = static_cast<uint32_t>(m_visible.size());
+}
@@ -0,0 +1,63 @@
+//
+// FrustumCuller.h - View frustum culling of world space bounding boxes stored as structure of arrays
+//
+
+#pragma once
+
+#include <vector>
+
+namespace DX
+{
+    struct FrustumCullStats
+    {
+        uint32_t boundsCount;
+        uint32_t visibleCount;
+    };
+
+    // World space axis aligned boxes as centers and half extents, one array per component, so the
+    // planes are tested against four boxes at a time with SSE (eight with AVX when the build
+    // enables it). The arrays are padded to whole blocks of eight.
+    class FrustumCuller
+    {
+    public:
+        // Fewer boxes than this per job are culled on the calling thread only
+        static constexpr size_t MinBoundsPerJob = 8 * 1024;
+
+        FrustumCuller() noexcept;
+
+        void Reserve(size_t boundsCount);
+        void Clear() noexcept;
+
+        // Returns the box's index, which is what the visible list holds
+        uint32_t XM_CALLCONV Add(DirectX::FXMVECTOR center, DirectX::FXMVECTOR extents);
+        void XM_CALLCONV Set(uint32_t index, DirectX::FXMVECTOR center, DirectX::FXMVECTOR extents);
+
+        // World space box around an object space box after the transform (Arvo)
+        static void XM_CALLCONV TransformBounds(DirectX::FXMVECTOR center, DirectX::FXMVECTOR extents, DirectX::FXMMATRIX world,
+            DirectX::XMVECTOR& worldCenter, DirectX::XMVECTOR& worldExtents) noexcept;
+
+        // Collects the boxes that intersect the frustum of viewProjection, in index order. Boxes
+        // touching a plane count as visible. Up to threadCount ranges are culled as jobs, 0 gives
+        // each thread of the job system a few.
+        void XM_CALLCONV Cull(DirectX::FXMMATRIX viewProjection, unsigned int threadCount = 1);
+
+        size_t GetCount() const noexcept { return m_count; }
+        const std::vector<uint32_t>& GetVisible() const noexcept { return m_visible; }
+        const FrustumCullStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        static constexpr size_t BlockSize = 8;
+
+        size_t m_count;
+        std::vector<float> m_centerX;
+        std::vector<float> m_centerY;
+        std::vector<float> m_centerZ;
+        std::vector<float> m_extentX;
+        std::vector<float> m_extentY;
+        std::vector<float> m_extentZ;
+
+        std::vector<std::vector<uint32_t>> m_chunks;
+        std::vector<uint32_t> m_visible;
+        FrustumCullStats m_stats;
+    };
+}
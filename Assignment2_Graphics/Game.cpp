@@ -6,6 +6,8 @@
 #include "pch.h"
 #include "Game.h"
 
+#include <chrono>
+
 extern void ExitGame() noexcept;
 
 using namespace DirectX;
@@ -20,16 +22,115 @@ namespace
     const XMVECTORF32 SCENE_BOUNDS = { 20.f, 20.f, 20.f, 0.f };
     constexpr float ROT_SPEED = 0.01f;
     constexpr float MOV_SPEED = 0.05f;
+
+    // Frame interval the limiter holds to once F10 turns it on, below the display's so it shows
+    constexpr double FRAME_LIMIT_SECONDS = 1.0 / 30.0;
+
+    // Fixed step of Update once F9 moves it to its own thread. Camera speeds are per step, so
+    // this matches the usual display rate the serial loop runs at.
+    constexpr double UPDATE_STEP_SECONDS = 1.0 / 60.0;
+
+    // Time per frame spent creating the GPU resources of assets that finished loading
+    constexpr double ASSET_CREATE_BUDGET = 0.004;
+
+    // Starting sizes of the shared geometry buffers, enough for the whole scene without growing
+    constexpr uint32_t GEOMETRY_POOL_VERTEX_BYTES = 256 * 1024;
+    constexpr uint32_t GEOMETRY_POOL_INDEX_BYTES = 64 * 1024;
+
+    // Projection depth range, the far plane also normalizes render queue depths
+    constexpr float NEAR_PLANE = 0.01f;
+    constexpr float FAR_PLANE = 100.f;
+    constexpr float FIELD_OF_VIEW = 70.f;       // Vertical, in degrees
+
+    // Software captures are drawn at the default window size and at 4K, each timed over this many frames
+    constexpr int SOFTWARE_CAPTURE_WIDTH = 3840;
+    constexpr int SOFTWARE_CAPTURE_HEIGHT = 2160;
+    constexpr int SOFTWARE_CAPTURE_FRAMES = 4;
+
+    // Software depth buffer the occluders are drawn into, independent of the window size
+    constexpr uint32_t OCCLUSION_WIDTH = 256;
+    constexpr uint32_t OCCLUSION_HEIGHT = 128;
+
+    // Per object constant blocks in the ring before it is discarded and starts again
+    constexpr uint32_t OBJECT_CONSTANT_BLOCKS = 512;
+
+    // Point light clusters: screen tiles, and depth slices from LIGHT_GRID_NEAR to the far plane
+    constexpr uint32_t LIGHT_TILES_X = 16;
+    constexpr uint32_t LIGHT_TILES_Y = 9;
+    constexpr uint32_t LIGHT_SLICES = 24;
+    constexpr float LIGHT_GRID_NEAR = 0.1f;
+
+    // Lanterns by the tent and the canoe, and the fireflies scattered around the camp
+    const XMFLOAT3 LANTERN_POSITIONS[] = { { 1.8f, -10.f, 2.6f }, { .4f, -10.1f, 1.1f } };
+    constexpr int FIREFLY_COUNT = 48;
+    const XMFLOAT3 FIREFLY_CENTER = { 1.6f, -10.f, 3.2f };
+    constexpr float FIREFLY_SPREAD = 2.8f;
+
+    // The layout below was placed with offsets along the world axes. A child of a turned or scaled
+    // parent needs its offset in the parent's own frame instead.
+    Vector3 ToParentFrame(const Vector3& offset, float parentYaw, float parentScale = 1.f)
+    {
+        return Vector3::Transform(offset, Matrix::CreateRotationY(-parentYaw)) / parentScale;
+    }
+
+    // An object is drawn once its model and its texture have both finished loading
+    inline bool IsReady(const DX::AssetHandle& model, const DX::AssetHandle& texture) noexcept
+    {
+        return model.IsReady() && texture.IsReady();
+    }
+
+    // Camera 'view' matrix for a right hand coord system, looking along pitch and yaw
+    Matrix CameraView(const Vector3& position, float pitch, float yaw)
+    {
+        // sinf/cosf - calculate the sine of a float 
+        float y = sinf(pitch);
+        float r = cosf(pitch);
+        float z = r * cosf(yaw);
+        float x = r * sinf(yaw);
+        return Matrix(XMMatrixLookAtRH(position, position + Vector3(x, y, z), Vector3::Up));
+    }
+
+    // Blends angles the short way round, yaw wraps at plus and minus pi
+    float LerpAngle(float from, float to, float t)
+    {
+        float difference = to - from;
+        if (difference > XM_PI)
+        {
+            difference -= XM_2PI;
+        }
+        else if (difference < -XM_PI)
+        {
+            difference += XM_2PI;
+        }
+        return from + difference * t;
+    }
 }
 
 // Constructor 
 Game::Game() noexcept(false) :
+    m_input{},
+    m_hasSnapshot(false),
+    m_simulationTime(0.0),
     m_pitch(0),
     m_yaw(0),
-    m_camPos(INIT_POS)
+    m_camPos(INIT_POS),
+    m_stateChangesSaved(0),
+    m_instanceCapacity(0),
+    m_constantBytes(0),
+    m_softwareCapture(false),
+#ifdef DX_PROFILE
+    m_profileCapture(false),
+#endif
+    m_lodPixelScale(1.f)
 {
-    m_deviceResources = std::make_unique<DX::DeviceResources>();
+    // The lighting shaders are shader model 5.0, for their point light buffers and cluster loops
+    m_deviceResources = std::make_unique<DX::DeviceResources>(DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_FORMAT_D32_FLOAT, 2, D3D_FEATURE_LEVEL_11_0);
     m_deviceResources->RegisterDeviceNotify(this);
+    m_occlusionCuller.Resize(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+    m_lightCuller.SetGrid(LIGHT_TILES_X, LIGHT_TILES_Y, LIGHT_SLICES);
+    m_pointLightBuffer.capacity = m_lightClusterBuffer.capacity = m_lightIndexBuffer.capacity = 0;
+    m_updateTimer.SetFixedTimeStep(true);
+    m_updateTimer.SetTargetElapsedSeconds(UPDATE_STEP_SECONDS);
 
 // Only runs if DXTK_AUDIO flag is defined in pch.h
 #ifdef DXTK_AUDIO
@@ -41,6 +142,9 @@ Game::Game() noexcept(false) :
 // Suspends the audio engine and resets the audio loop 
 Game::~Game()
 {
+    // Update may be running on its own thread, stop it before anything it uses goes
+    m_updateThread.Stop();
+
     if (m_audEngine)
     {
         m_audEngine->Suspend();
@@ -51,8 +155,11 @@ Game::~Game()
 // Initialize the Direct3D resources required to run.
 void Game::Initialize(HWND window, int width, int height)
 {
+    DX_PROFILE_THREAD("Main");
     m_deviceResources->SetWindow(window, width, height);
 
+    CreateScene();
+
     m_deviceResources->CreateDeviceResources();
     CreateDeviceDependentResources();
 
@@ -99,10 +206,28 @@ void Game::Initialize(HWND window, int width, int height)
 // Executes the basic game loop.
 void Game::Tick()
 {
-    m_timer.Tick([&]()
-        {
-            Update(m_timer);
-        });
+    // Hold the frame back to the limit, if there is one, before it is timed
+    m_frameLimiter.Wait();
+    DX_PROFILE_FRAME();
+
+    ReadInput();
+
+    // Unless Update has a thread of its own, it runs here and publishes the snapshot Render draws
+    if (m_updateThread.IsRunning())
+    {
+        m_timer.Tick([]() {});
+    }
+    else
+    {
+        m_timer.Tick([&]()
+            {
+                Update(m_timer, TakeInput());
+            });
+        PublishSnapshot(0.0);
+    }
+
+    // Upload whatever the loader's workers have finished since the last frame
+    m_assetLoader->Update(ASSET_CREATE_BUDGET);
 
     Render();
 
@@ -126,16 +251,20 @@ void Game::Tick()
         }
     }
 #endif
+
+#ifdef DX_PROFILE
+    if (m_profileCapture)
+    {
+        WriteProfile();
+        m_profileCapture = false;
+    }
+#endif
 }
 
-// Updates the world.
-void Game::Update(DX::StepTimer const& timer)
+// Reads the mouse, keyboard and gamepad, acts on the keys that control the application and leaves
+// the rest for the next Update
+void Game::ReadInput()
 {
-    float delta = float(timer.GetElapsedSeconds());
-    auto time = static_cast<float>(timer.GetTotalSeconds());
-
-// Region holding all mouse input info
-#pragma region MouseInput
     auto mouse = m_mouse->GetState();
     m_MouseTracker.Update(mouse);		//updates the more advanced mouse state. 
 
@@ -149,26 +278,89 @@ void Game::Update(DX::StepTimer const& timer)
         m_mouse->SetMode(DirectX::Mouse::MODE_ABSOLUTE);
     }
 
+    auto kb = m_keyboard->GetState();
+    m_keyboardTracker.Update(kb);
+    auto pad = m_gamePad->GetState(0);
+
+    // Exit game on 'Esc' press or the gamepad's view button
+    if (kb.Escape || (pad.IsConnected() && pad.IsViewPressed()))
+    {
+        ExitGame();
+    }
+
+    // Draw the next frame on the CPU too on 'F12' press
+    if (m_keyboardTracker.pressed.F12)
+    {
+        m_softwareCapture = true;
+    }
+
+    // Toggle the frame limiter on 'F10' press
+    if (m_keyboardTracker.pressed.F10)
+    {
+        m_frameLimiter.SetTargetSeconds(m_frameLimiter.GetTargetSeconds() > 0.0 ? 0.0 : FRAME_LIMIT_SECONDS);
+    }
+
+    // Move Update to a thread of its own, or back, on 'F9' press
+    if (m_keyboardTracker.pressed.F9)
+    {
+        if (m_updateThread.IsRunning())
+        {
+            m_updateThread.Stop();
+        }
+        else
+        {
+            StartUpdateThread();
+        }
+    }
+
+#ifdef DX_PROFILE
+    // Write out the profiler's capture on 'F11' press
+    if (m_keyboardTracker.pressed.F11)
+    {
+        m_profileCapture = true;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_input.keyboard = kb;
+    m_input.gamePad = pad;
+
     // Allow mouse control of the camera when the mouse mode is relative 
     if (mouse.positionMode == Mouse::MODE_RELATIVE)
     {
-        Vector3 delta = Vector3(float(mouse.x), float(mouse.y), 0.f) * ROT_SPEED;
-        m_pitch -= delta.y;
-        m_yaw -= delta.x;
+        m_input.mouseX += float(mouse.x);
+        m_input.mouseY += float(mouse.y);
     }
+}
+
+// Input since the last Update, the mouse movement is only given out once
+Game::InputState Game::TakeInput()
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    InputState input = m_input;
+    m_input.mouseX = m_input.mouseY = 0.f;
+    return input;
+}
 
+// Updates the world. Runs on the window's thread, or on m_updateThread once F9 starts it, and
+// only touches the simulation: the camera, the scene hierarchy and the lights.
+void Game::Update(DX::StepTimer const& timer, const InputState& input)
+{
+    DX_PROFILE_ZONE("Game::Update");
+    m_simulationTime += timer.GetElapsedSeconds();
+    auto time = static_cast<float>(m_simulationTime);
 
+// Region holding all mouse input info
+#pragma region MouseInput
+    // Mouse movement only adds up while the mouse is relative (see ReadInput)
+    Vector3 delta = Vector3(input.mouseX, input.mouseY, 0.f) * ROT_SPEED;
+    m_pitch -= delta.y;
+    m_yaw -= delta.x;
 #pragma endregion 
 
 // Region holding all keyboard input info 
 #pragma region KeyboardInput
-    auto kb = m_keyboard->GetState();
-    
-    // Exit game on 'Esc' press 
-    if (kb.Escape)
-    {
-        ExitGame();
-    }
+    const auto& kb = input.keyboard;
     
     // Reset camera position and rotation on 'R' press 
     if (kb.R)
@@ -202,17 +394,11 @@ void Game::Update(DX::StepTimer const& timer)
 
 // Region holding gamepad input info 
 #pragma region GamePad
-    auto pad = m_gamePad->GetState(0);
+    const auto& pad = input.gamePad;
 
     // Only run if a gamepad controller is connected
     if (pad.IsConnected())
     {
-        // Quit the application 
-        if (pad.IsViewPressed())
-        {
-            ExitGame();
-        }
-
         // Reset the camera rotation 
         if (pad.IsLeftStickPressed())
         {
@@ -266,21 +452,110 @@ void Game::Update(DX::StepTimer const& timer)
     {
         m_yaw += XM_2PI;
     }
+#pragma endregion
+
+    // Refresh the world matrices of any scene nodes that moved
+    m_scene.Update();
+    UpdateLights(time);
+
+    // What Render gets of this step, the view is built from the camera there (see ApplySnapshot)
+    m_simulation.camPos = m_camPos;
+    m_simulation.pitch = m_pitch;
+    m_simulation.yaw = m_yaw;
+    const uint32_t nodeCount = static_cast<uint32_t>(m_scene.GetNodeCount());
+    m_simulation.worlds.resize(nodeCount);
+    for (uint32_t node = 0; node < nodeCount; node++)
+    {
+        m_simulation.worlds[node] = m_scene.GetWorld(node);
+    }
+}
+
+// Hands the last Update to Render. Copies into the slot the snapshot was last written to, so its
+// vectors are only allocated once.
+void Game::PublishSnapshot(double stepSeconds)
+{
+    FrameSnapshot& snapshot = m_snapshots.GetWriteBuffer();
+    if (stepSeconds > 0.0)
+    {
+        snapshot.previous = m_previousSimulation;
+    }
+    snapshot.current = m_simulation;
+    snapshot.published = std::chrono::steady_clock::now();
+    snapshot.stepSeconds = stepSeconds;
+    m_snapshots.Publish();
+}
 
-    // Camera rotation calculations 
-    // sinf/cosf - calculate the sine of a float 
-    float y = sinf(m_pitch);
-    float r = cosf(m_pitch);
-    float z = r * cosf(m_yaw);
-    float x = r * sinf(m_yaw);
+// Takes the newest snapshot and builds what Render draws from it. Snapshots from the update thread
+// are a step apart, so Render blends from the one before towards it over the next step. That
+// draws up to a step late, but always between two real states. False until the first snapshot.
+bool Game::ApplySnapshot()
+{
+    if (m_snapshots.Acquire())
+    {
+        m_hasSnapshot = true;
+    }
+    if (!m_hasSnapshot)
+    {
+        return false;
+    }
 
-    // Change the cameras lookAt vector based on the rotation calculations
-    XMVECTOR lookAt = m_camPos + Vector3(x, y, z);
+    const FrameSnapshot& snapshot = m_snapshots.GetReadBuffer();
+    const SimulationState& previous = snapshot.previous;
+    const SimulationState& current = snapshot.current;
+    float t = 1.f;
+    if (snapshot.stepSeconds > 0.0 && previous.worlds.size() == current.worlds.size() &&
+        previous.pointLights.size() == current.pointLights.size())
+    {
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - snapshot.published).count();
+        t = static_cast<float>(std::min(std::max(elapsed / snapshot.stepSeconds, 0.0), 1.0));
+    }
 
-    // XMMatrixLookAtRH: Builds camera 'view' matrix for a right hand coord system 
-    m_view = XMMatrixLookAtRH(m_camPos, lookAt, Vector3::Up);
-#pragma endregion
+    if (t >= 1.f)
+    {
+        m_frameCamPos = current.camPos;
+        m_view = CameraView(current.camPos, current.pitch, current.yaw);
+        m_frameWorlds = current.worlds;
+        m_pointLights = current.pointLights;
+        return true;
+    }
+
+    m_frameCamPos = Vector3::Lerp(previous.camPos, current.camPos, t);
+    m_view = CameraView(m_frameCamPos, previous.pitch + (current.pitch - previous.pitch) * t, LerpAngle(previous.yaw, current.yaw, t));
+
+    m_frameWorlds.resize(current.worlds.size());
+    for (size_t i = 0; i < current.worlds.size(); i++)
+    {
+        m_frameWorlds[i] = Matrix::Lerp(Matrix(previous.worlds[i]), Matrix(current.worlds[i]), t);
+    }
+
+    m_pointLights = current.pointLights;
+    for (size_t i = 0; i < m_pointLights.size(); i++)
+    {
+        XMStoreFloat3(&m_pointLights[i].position, XMVectorLerp(XMLoadFloat3(&previous.pointLights[i].position),
+            XMLoadFloat3(&current.pointLights[i].position), t));
+        m_pointLights[i].intensity = previous.pointLights[i].intensity + (current.pointLights[i].intensity - previous.pointLights[i].intensity) * t;
+    }
+    return true;
+}
 
+// Runs Update on its own thread at the fixed step until F9 stops it. Each step keeps the state
+// before it, so the snapshot it publishes holds both ends to blend between.
+void Game::StartUpdateThread()
+{
+    m_updateTimer.ResetElapsedTime();
+    m_updateThread.Start(UPDATE_STEP_SECONDS, [this]()
+    {
+        const uint32_t frameCount = m_updateTimer.GetFrameCount();
+        m_updateTimer.Tick([this]()
+            {
+                m_previousSimulation = m_simulation;
+                Update(m_updateTimer, TakeInput());
+            });
+        if (m_updateTimer.GetFrameCount() != frameCount)
+        {
+            PublishSnapshot(UPDATE_STEP_SECONDS);
+        }
+    });
 }
 #pragma endregion
 
@@ -288,8 +563,9 @@ void Game::Update(DX::StepTimer const& timer)
 // Draws the scene.
 void Game::Render()
 {
+    DX_PROFILE_ZONE("Game::Render");
     // Don't try to render anything before the first Update.
-    if (m_timer.GetFrameCount() == 0)
+    if (m_timer.GetFrameCount() == 0 || !ApplySnapshot())
     {
         return;
     }
@@ -305,190 +581,99 @@ void Game::Render()
     m_deviceResources->PIXBeginEvent(L"Draw sprite");
     m_sprites->Begin();
         m_font->DrawString(m_sprites.get(), L"CMP502: Assignment 2", XMFLOAT2(10, 10), Colors::Yellow);
+
+        // Spread of the last frame times, refreshed once a second
+        const DX::FrameTimeStats& frameTimes = m_timer.GetFrameTimeStats();
+        wchar_t frameText[128];
+        swprintf_s(frameText, L"%u fps, frame p50 %.1f p95 %.1f p99 %.1f max %.1f ms%s", m_timer.GetFramesPerSecond(),
+            frameTimes.p50Seconds * 1000.0, frameTimes.p95Seconds * 1000.0, frameTimes.p99Seconds * 1000.0,
+            frameTimes.maxSeconds * 1000.0, m_frameLimiter.GetTargetSeconds() > 0.0 ? L", limited" : L"");
+        m_font->DrawString(m_sprites.get(), frameText, XMFLOAT2(10, 40), Colors::Yellow);
     m_sprites->End();
     m_deviceResources->PIXEndEvent();
 
 #pragma region ModelRendering
 
-    // 
-    // Initialise transformation matrices
-    //
-    Matrix translate;
-    Matrix scale; 
-    Matrix rotate;
-
     // Draw skybox before all other models 
-    m_effect->SetView(m_view);
-    m_sky->Draw(m_effect.get(), m_skyInputLayout.Get());
+    if (m_cubemapAsset.IsReady())
+    {
+        m_effect->SetTexture(m_cubemap.Get());
+        m_effect->SetView(m_view);
+        m_sky->Draw(m_effect.get(), m_skyInputLayout.Get());
+    }
+
+    // The sprites and sky bound their own geometry, so the pool binds its buffers again on the first model
+    m_geometryPool->ResetBindings();
 
     // Set rendering states after skybox rendering 
     context->OMSetBlendState(m_states->Opaque(), nullptr, 0xFFFFFFFF);
     context->OMSetDepthStencilState(m_states->DepthDefault(), 0);
     context->RSSetState(m_states->CullClockwise());
 
-    // Turn the basic lighting shader on
-    m_BasicLightingShader.EnableShader(context);
-    
     //
     // Model Rendering
+    // Every object's world matrix comes from its node in the scene hierarchy (see CreateScene).
+    // Draws are queued with a sort key and submitted grouped by shader, texture and mesh.
     //
 #pragma region ModelRendering
+    m_sceneDraws.clear();
+    m_drawWorlds.clear();
+    m_drawVariants.clear();
+    m_drawKeys.clear();
+    m_frustumCuller.Clear();
+    m_occlusionCuller.Begin(m_view * m_proj);
+    m_renderQueue.Clear();
+
+    // Ground model. The ground uses quantized vertices, so it has its own variant of the lighting
+    // shader. At full detail the clusters that are off screen or facing away are culled first.
+    QueueDraw(m_groundModel, m_groundModelAsset, m_QuantizedLightingShader, m_grassTex.Get(), m_grassTexAsset, m_groundNode, &m_groundLod, true);
+
+    // Rock platform and tent models. These and the trees are the large objects that hide others,
+    // so they are also drawn into the occlusion buffer.
+    QueueDraw(m_platform, m_platformAsset, m_BasicLightingShader, m_rockTex.Get(), m_rockTexAsset, m_platformNode, nullptr, false, true);
+    QueueDraw(m_tent, m_tentAsset, m_BasicLightingShader, m_tentTex.Get(), m_tentTexAsset, m_tentNode, &m_tentLod, false, true);
+
+    // Simple tree models, top and trunk
+    for (int i = 0; i < 2; i++)
+    {
+        QueueDraw(m_treeSimple, m_treeSimpleAsset, m_BasicLightingShader, m_treeLeavesTex.Get(), m_treeLeavesTexAsset, m_treeSimpleNodes[i], &m_treeSimpleLod[i], false, true);
+        QueueDraw(m_treeSimpleTrunk, m_treeSimpleTrunkAsset, m_BasicLightingShader, m_treeBarkTex.Get(), m_treeBarkTexAsset, m_treeSimpleNodes[i], nullptr, false, true);
+    }
 
-    // Ground model
-    // Create transformations (translate, rotate, scale variables) and multiply with the world matrix to 
-    // render models in required positions
-    m_world = Matrix::Identity;
-    translate = Matrix::CreateTranslation(0.f, -10.f, 0.f);
-    scale = Matrix::CreateScale(2.f, 2.f, 2.f);
-    m_world = m_world * translate;
-    // Set the shader parameters before rendering to get the correct texture
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_grassTex.Get());
-    // Render the model 
-    m_groundModel.Render(context);
-
-    // Rock platform model
-    // No reset for m_world here so that platform can be transformed in relation to the ground model
-    translate = Matrix::CreateTranslation(1.2f, 9.6f, 3.2f);
-    scale = Matrix::CreateScale(2.f, 2.f, 2.f);
-    rotate = Matrix::CreateRotationY(-.5f);
-    m_world = m_world * rotate * scale * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_rockTex.Get());
-    m_platform.Render(context);
-
-    // Tent model
-    m_world = SimpleMath::Matrix::Identity;
-    translate = Matrix::CreateTranslation(1.2f, -10.25f, 3.3f);
-    rotate = Matrix::CreateRotationY(1.2f);
-    m_world = m_world * rotate * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_tentTex.Get());
-    m_tent.Render(context);
-
-    // SImple tree top model
-    m_world = SimpleMath::Matrix::Identity;
-    translate = Matrix::CreateTranslation(2.2f, -10.35f, 5.2f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_treeLeavesTex.Get());
-    m_treeSimple.Render(context);
-
-    // Simple tree trunk model
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_treeBarkTex.Get());
-    m_treeSimpleTrunk.Render(context);
-
-    // Mushroom model
-    // No reset for m_world here so that mushroom can be placed in relation to the tree
-    translate = Matrix::CreateTranslation(-0.2f, 0.f, -0.05f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_mushroomTex.Get());
-    m_mushroom.Render(context);
-
-    // Mushroom group model 
-    // No reset for m_world here so that mushroom group can be placed in relation to the mushroom
-    translate = Matrix::CreateTranslation(.4f, 0.f, -0.35f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_mushroomTex.Get());
-    m_mushroomGroup.Render(context);
-
-    // Tree stump model
-    // No reset for m_world here so that stump can be placed in relation to the mushroom group
-    translate = Matrix::CreateTranslation(-.7f, 0.f, 0.f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_treeBarkTex.Get());
-    m_stump.Render(context);
-
-    // Crop model
-    m_world = Matrix::Identity;
-    translate = Matrix::CreateTranslation(-.2f, -10.35f, 3.2f);
-    scale = Matrix::CreateScale(.5f, .5f, .5f);
-    m_world = m_world * scale * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_bambooTex.Get());
-    m_crop.Render(context);
-
-    // Crop model
-    // m_world not reset to place each crop in relation to the last
-    translate = Matrix::CreateTranslation(0.f, 0.f, -.25f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_bambooTex.Get());
-    m_crop.Render(context);
-
-    // Crop model
-    translate = Matrix::CreateTranslation(0.f, 0.f, -.25f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_bambooTex.Get());
-    m_crop.Render(context);
-    
-    // Crop model
-    translate = Matrix::CreateTranslation(0.f, 0.f, -.25f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_bambooTex.Get());
-    m_crop.Render(context);
+    // Mushroom, mushroom group and tree stump models
+    QueueDraw(m_mushroom, m_mushroomAsset, m_BasicLightingShader, m_mushroomTex.Get(), m_mushroomTexAsset, m_mushroomNode);
+    for (int i = 0; i < 2; i++)
+    {
+        QueueDraw(m_mushroomGroup, m_mushroomGroupAsset, m_BasicLightingShader, m_mushroomTex.Get(), m_mushroomTexAsset, m_mushroomGroupNodes[i]);
+    }
+    QueueDraw(m_stump, m_stumpAsset, m_BasicLightingShader, m_treeBarkTex.Get(), m_treeBarkTexAsset, m_stumpNode);
 
-    // Canoe model
-    m_world = Matrix::Identity;
-    translate = Matrix::CreateTranslation(0.65f, -10.35f, 1.3f);
-    rotate = Matrix::CreateRotationY(.5f);
-    m_world = m_world * rotate * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_woodGrainTex.Get());
-    m_canoe.Render(context);
-
-    // Canoe paddle
-    // No reset for m_world here so that the canoe paddle can be placed in relation to the canoe
-    translate = Matrix::CreateTranslation(0.4f, 0.f, 0.2f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_woodGrainTex.Get());
-    m_canoePaddle.Render(context);
-
-    // Mushroom group model 
-    // No reset for m_world here so that mushroom group can be placed in relation to the canoe paddle
-    translate = Matrix::CreateTranslation(1.3f, 0.f, 0.f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_mushroomTex.Get());
-    m_mushroomGroup.Render(context);
-
-    // Log model
-    m_world = Matrix::Identity;
-    translate = Matrix::CreateTranslation(2.6f, -10.35f, 2.4f);
-    rotate = Matrix::CreateRotationY(.87f);
-    m_world = m_world * rotate * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_treeBarkTex.Get());
-    m_log.Render(context);
-
-    // Campfire logs model
-    // No reset for m_world here so that campfire logs can be placed in relation to the log model
-    translate = Matrix::CreateTranslation(-.3f, 0.f, .4f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_treeBarkTex.Get());
-    m_campfireLogs.Render(context);
-
-    // Simple tree trunk model 
-    // No reset for m_world here so that tree trunk can be placed in relation to the campfire logs
-    translate = Matrix::CreateTranslation(1.25f, 0.f, 1.5f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_treeBarkTex.Get());
-    m_treeSimpleTrunk.Render(context);
-
-    // Simple tree top model
-    // No reset for m_world here so that tree top can be placed in relation to the tree trunk
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_treeLeavesTex.Get());
-    m_treeSimple.Render(context);
-
-    // Fat tree top model 
-    // No reset for m_world here so that tree top can be placed in relation to the last tree position
-    translate = Matrix::CreateTranslation(-.5f, 0.f, -.2f);
-    m_world = m_world * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_treeLeavesTex.Get());
-    m_treeFat.Render(context);
-
-    // Fat tree trunk model 
-    // No reset for m_world here so that tree top can be placed in relation to the tree trunk
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_treeBarkTex.Get());
-    m_treeFatTrunk.Render(context);
-
-    // Custom geometry -- prism render 
-    m_world = Matrix::Identity;
-    translate = Matrix::CreateTranslation(3.5f, -10.35f, 2.2f);
-    scale = Matrix::CreateScale(0.3f, 0.3f, 0.3f);
-    m_world = m_world *  scale * translate;
-    m_BasicLightingShader.SetShaderParameters(context, &m_world, &m_view, &m_proj, &m_Light, m_tentTex.Get());
+    // Crop models
+    for (int i = 0; i < 4; i++)
+    {
+        QueueDraw(m_crop, m_cropAsset, m_BasicLightingShader, m_bambooTex.Get(), m_bambooTexAsset, m_cropNodes[i]);
+    }
+
+    // Canoe and paddle models
+    QueueDraw(m_canoe, m_canoeAsset, m_BasicLightingShader, m_woodGrainTex.Get(), m_woodGrainTexAsset, m_canoeNode);
+    QueueDraw(m_canoePaddle, m_canoePaddleAsset, m_BasicLightingShader, m_woodGrainTex.Get(), m_woodGrainTexAsset, m_canoePaddleNode);
+
+    // Log and campfire logs models
+    QueueDraw(m_log, m_logAsset, m_BasicLightingShader, m_treeBarkTex.Get(), m_treeBarkTexAsset, m_logNode);
+    QueueDraw(m_campfireLogs, m_campfireLogsAsset, m_BasicLightingShader, m_treeBarkTex.Get(), m_treeBarkTexAsset, m_campfireLogsNode);
+
+    // Fat tree models, top and trunk
+    QueueDraw(m_treeFat, m_treeFatAsset, m_BasicLightingShader, m_treeLeavesTex.Get(), m_treeLeavesTexAsset, m_treeFatNode, &m_treeFatLod, false, true);
+    QueueDraw(m_treeFatTrunk, m_treeFatTrunkAsset, m_BasicLightingShader, m_treeBarkTex.Get(), m_treeBarkTexAsset, m_treeFatNode, nullptr, false, true);
+
+    SubmitDraws(context);
+    if (m_softwareCapture)
+    {
+        RenderSoftware();
+        m_softwareCapture = false;
+    }
+
+    // Custom geometry -- prism render, queue it like the models above to show it
     //m_prism.Render(context);   
 #pragma endregion
    
@@ -496,9 +681,448 @@ void Game::Render()
     m_deviceResources->PIXEndEvent();
 
     // Show the new frame.
-    m_deviceResources->Present();
+    {
+        DX_PROFILE_ZONE("Present");
+        m_deviceResources->Present();
+    }
+    m_assetLoader->OnFramePresented();
 }
 
+// Queues one model draw if its model and texture have loaded. The level of detail is chosen here,
+// so each selector is still updated once per frame. Occluders are also drawn into the occlusion
+// buffer at full detail.
+void Game::QueueDraw(ModelClass& model, const DX::AssetHandle& modelAsset, Shader& shader,
+    ID3D11ShaderResourceView* texture, const DX::AssetHandle& textureAsset, uint32_t node,
+    DX::LodSelector* lod, bool cullClusters, bool occluder)
+{
+    if (!IsReady(modelAsset, textureAsset))
+    {
+        return;
+    }
+
+    const Matrix world = m_frameWorlds[node];
+
+    SceneDraw draw;
+    draw.model = &model;
+    draw.shader = &shader;
+    // Only the basic lighting shader has an instanced variant
+    draw.instancedShader = &shader == &m_BasicLightingShader ? &m_InstancedLightingShader : nullptr;
+    draw.texture = texture;
+    draw.lod = lod ? model.SelectLod(*lod, world, m_frameCamPos, m_lodPixelScale) : 0;
+    draw.cullClusters = cullClusters && draw.lod == 0;
+
+    // Draws of one mesh and texture batch when they are at the same level of detail. Culled
+    // clusters differ per instance, so those draws always go on their own.
+    const uint32_t variant = draw.cullClusters || !draw.instancedShader ? DX::InstanceBatcher::NoInstancing : static_cast<uint32_t>(draw.lod);
+
+    XMVECTOR center, extents;
+    DX::FrustumCuller::TransformBounds(model.GetBoundsCenter(), model.GetBoundsExtents(), world, center, extents);
+    m_frustumCuller.Add(center, extents);
+    XMStoreFloat3(&draw.boundsCenter, center);
+    XMStoreFloat3(&draw.boundsExtents, extents);
+
+    if (occluder)
+    {
+        const std::vector<uint32_t>& indices = model.GetOccluderIndices();
+        m_occlusionCuller.AddOccluder(model.GetOccluderPositions().data(), indices.data(), indices.size(), world);
+    }
+
+    const float depth = (world.Translation() - m_frameCamPos).Length() / FAR_PLANE;
+    m_drawKeys.push_back(DX::RenderQueue::MakeKey(DX::RenderPass::Opaque, m_renderQueue.GetShaderId(&shader),
+        m_renderQueue.GetTextureId(texture), m_renderQueue.GetMeshId(&model), depth));
+    m_sceneDraws.push_back(draw);
+    m_drawWorlds.push_back(world);
+    m_drawVariants.push_back(variant);
+}
+
+// Culls the queued draws against the view frustum and then the occluders, sorts the rest, groups
+// repeats into instanced batches and records them as commands, replayed on the context afterwards.
+// All constants are uploaded before the first draw, each draw then only binds its own block.
+void Game::SubmitDraws(ID3D11DeviceContext1* context)
+{
+    DX_PROFILE_ZONE("Game::SubmitDraws");
+    const Matrix viewProjection = m_view * m_proj;
+    m_frustumCuller.Cull(viewProjection, 0);
+    m_occlusionCuller.Rasterize(0);
+    for (uint32_t draw : m_frustumCuller.GetVisible())
+    {
+        const SceneDraw& sceneDraw = m_sceneDraws[draw];
+        if (m_occlusionCuller.IsVisible(XMLoadFloat3(&sceneDraw.boundsCenter), XMLoadFloat3(&sceneDraw.boundsExtents)))
+        {
+            m_renderQueue.Add(m_drawKeys[draw], draw);
+        }
+    }
+
+    m_renderQueue.Sort();
+    const std::vector<DX::RenderItem>& items = m_renderQueue.GetItems();
+    const DX::RenderQueueStats& queueStats = m_renderQueue.GetStats();
+    if (queueStats.GetChangesSaved() != m_stateChangesSaved)
+    {
+        char message[256];
+        sprintf_s(message, "Render queue: %u draws, %u shader, %u texture and %u mesh changes, %u fewer than in submission order\n",
+            queueStats.drawCount, queueStats.shaderChanges, queueStats.textureChanges, queueStats.meshChanges, queueStats.GetChangesSaved());
+        OutputDebugStringA(message);
+        m_stateChangesSaved = queueStats.GetChangesSaved();
+    }
+    m_instanceBatcher.Build(items.data(), items.size(), m_drawVariants.data(), m_drawWorlds.data());
+    UploadInstances(context);
+    UploadConstants(context, viewProjection);
+    UploadLights(context);
+
+    // Batches are recorded in parallel when there are enough of them, then replayed in order
+    const std::vector<DX::InstanceBatch>& batches = m_instanceBatcher.GetBatches();
+    m_commandList.Record(batches.size(), 0, [this, &viewProjection](DX::CommandBuffer& commands, size_t begin, size_t end)
+    {
+        RecordDraws(commands, begin, end, viewProjection);
+    });
+    DX::D3D11CommandBackend backend(context, m_objectConstantRing.get());
+    m_commandList.Execute(backend);
+
+    // Without constant buffer offsets the blocks are uploaded as they are bound, so this is only
+    // known after the draws
+    const DX::ConstantRingStats& ringStats = m_objectConstantRing->GetStats();
+    const uint32_t constantBytes = static_cast<uint32_t>(sizeof(Shader::FrameBufferType)) + ringStats.bytesWritten;
+    if (constantBytes != m_constantBytes)
+    {
+        char message[256];
+        sprintf_s(message, "Constants: %u bytes in %u maps for %u objects\n", constantBytes, ringStats.maps + 1,
+            static_cast<uint32_t>(m_objectConstants.size()));
+        OutputDebugStringA(message);
+        m_constantBytes = constantBytes;
+    }
+}
+
+// Records the draws of batches begin to end, setting only what differs from the previous draw in
+// the same buffer. Each buffer starts from unknown state and its own view.
+void Game::RecordDraws(DX::CommandBuffer& commands, size_t begin, size_t end, const Matrix& viewProjection) const
+{
+    commands.SetView(viewProjection, m_frameCamPos);
+
+    const std::vector<DX::RenderItem>& items = m_renderQueue.GetItems();
+    const std::vector<DX::InstanceBatch>& batches = m_instanceBatcher.GetBatches();
+    const Shader* boundShader = nullptr;
+    ID3D11ShaderResourceView* boundTexture = nullptr;
+    bool textureBound = false;
+    for (size_t b = begin; b < end; b++)
+    {
+        // An instanced batch is one draw of its first item's mesh, anything else draws item by item
+        const DX::InstanceBatch& batch = batches[b];
+        const bool instanced = batch.firstInstance != DX::InstanceBatcher::NotInstanced;
+        const uint32_t drawCount = instanced ? 1 : batch.itemCount;
+        uint32_t objectBlock = m_batchObjectBlocks[b];
+        for (uint32_t i = 0; i < drawCount; i++)
+        {
+            const uint32_t drawIndex = items[batch.firstItem + i].draw;
+            const SceneDraw& draw = m_sceneDraws[drawIndex];
+            const Shader* shader = instanced ? draw.instancedShader : draw.shader;
+
+            if (shader != boundShader)
+            {
+                commands.SetPipeline(shader);
+                boundShader = shader;
+            }
+            if (!textureBound || draw.texture != boundTexture)
+            {
+                commands.SetTexture(0, draw.texture);
+                boundTexture = draw.texture;
+                textureBound = true;
+            }
+
+            if (instanced)
+            {
+                commands.DrawMesh(draw.model, draw.lod, batch.itemCount, batch.firstInstance);
+            }
+            else
+            {
+                commands.SetConstants(1, objectBlock++);
+                if (draw.cullClusters)
+                {
+                    commands.DrawMeshClusters(draw.model, m_drawWorlds[drawIndex]);
+                }
+                else
+                {
+                    commands.DrawMesh(draw.model, draw.lod);
+                }
+            }
+        }
+    }
+}
+
+// Uploads the frame's camera and light, bound to both shader stages for every lighting shader, and
+// the world and world view projection matrices of each draw that isn't instanced, in the order
+// SubmitDraws issues them. Also notes the block of each batch's first draw.
+void Game::UploadConstants(ID3D11DeviceContext1* context, const Matrix& viewProjection)
+{
+    DX_PROFILE_ZONE("Game::UploadConstants");
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    DX::ThrowIfFailed(context->Map(m_frameConstants.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+    Shader::FillFrameBuffer(*static_cast<Shader::FrameBufferType*>(mapped.pData), m_view, m_proj, &m_Light, m_frameCamPos);
+    context->Unmap(m_frameConstants.Get(), 0);
+
+    ID3D11Buffer* frameConstants = m_frameConstants.Get();
+    context->VSSetConstantBuffers(0, 1, &frameConstants);
+    context->PSSetConstantBuffers(0, 1, &frameConstants);
+
+    const std::vector<DX::RenderItem>& items = m_renderQueue.GetItems();
+    m_objectConstants.clear();
+    m_batchObjectBlocks.clear();
+    for (const DX::InstanceBatch& batch : m_instanceBatcher.GetBatches())
+    {
+        m_batchObjectBlocks.push_back(static_cast<uint32_t>(m_objectConstants.size()));
+        if (batch.firstInstance != DX::InstanceBatcher::NotInstanced)
+        {
+            continue;
+        }
+        for (uint32_t i = 0; i < batch.itemCount; i++)
+        {
+            Shader::ObjectBufferType object;
+            Shader::FillObjectBuffer(object, XMLoadFloat4x4(&m_drawWorlds[items[batch.firstItem + i].draw]), viewProjection);
+            m_objectConstants.push_back(object);
+        }
+    }
+
+    m_objectConstantRing->ResetStats();
+    const uint32_t firstBlock = m_objectConstantRing->Write(context, m_objectConstants.data(), static_cast<uint32_t>(m_objectConstants.size()));
+    for (uint32_t& block : m_batchObjectBlocks)
+    {
+        block += firstBlock;
+    }
+}
+
+// Writes this frame's instance worlds into the instance buffer and binds it to vertex buffer slot 1.
+// The buffer grows in powers of two and is never shrunk.
+void Game::UploadInstances(ID3D11DeviceContext* context)
+{
+    const std::vector<XMFLOAT4X4>& instances = m_instanceBatcher.GetInstances();
+    if (instances.empty())
+    {
+        return;
+    }
+
+    if (instances.size() > m_instanceCapacity)
+    {
+        uint32_t capacity = std::max(m_instanceCapacity, 64u);
+        while (capacity < instances.size())
+        {
+            capacity *= 2;
+        }
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.ByteWidth = capacity * sizeof(XMFLOAT4X4);
+        desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&desc, nullptr, m_instanceBuffer.ReleaseAndGetAddressOf()));
+        m_instanceCapacity = capacity;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    DX::ThrowIfFailed(context->Map(m_instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+    memcpy(mapped.pData, instances.data(), instances.size() * sizeof(XMFLOAT4X4));
+    context->Unmap(m_instanceBuffer.Get(), 0);
+
+    ID3D11Buffer* instanceBuffer = m_instanceBuffer.Get();
+    UINT stride = sizeof(XMFLOAT4X4);
+    UINT offset = 0;
+    context->IASetVertexBuffers(1, 1, &instanceBuffer, &stride, &offset);
+}
+
+// Assigns the point lights to their clusters and uploads the lights, cluster ranges and light
+// lists with the cluster lookup constants, all bound to the pixel shader for the frame
+void Game::UploadLights(ID3D11DeviceContext* context)
+{
+    m_lightCuller.Cull(m_pointLights.data(), m_pointLights.size(), m_view, 0);
+
+    const std::vector<DX::LightCluster>& clusters = m_lightCuller.GetClusters();
+    const std::vector<uint32_t>& indices = m_lightCuller.GetLightIndices();
+    UploadLightBuffer(context, m_pointLightBuffer, m_pointLights.data(), m_pointLights.size(), sizeof(DX::PointLight), DXGI_FORMAT_UNKNOWN);
+    UploadLightBuffer(context, m_lightClusterBuffer, clusters.data(), clusters.size(), sizeof(DX::LightCluster), DXGI_FORMAT_R32G32_UINT);
+    UploadLightBuffer(context, m_lightIndexBuffer, indices.data(), indices.size(), sizeof(uint32_t), DXGI_FORMAT_R32_UINT);
+
+    // View depth is minus view space z, the third column of the view matrix
+    const auto size = m_deviceResources->GetOutputSize();
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    DX::ThrowIfFailed(context->Map(m_clusterConstants.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+    Shader::ClusterBufferType* constants = static_cast<Shader::ClusterBufferType*>(mapped.pData);
+    constants->viewDepthPlane = XMFLOAT4(-m_view._13, -m_view._23, -m_view._33, -m_view._43);
+    constants->tileScale = XMFLOAT2(float(LIGHT_TILES_X) / float(std::max(1L, size.right)), float(LIGHT_TILES_Y) / float(std::max(1L, size.bottom)));
+    constants->depthScale = m_lightCuller.GetDepthScale();
+    constants->depthBias = m_lightCuller.GetDepthBias();
+    constants->clusterCount[0] = m_lightCuller.GetTilesX();
+    constants->clusterCount[1] = m_lightCuller.GetTilesY();
+    constants->clusterCount[2] = m_lightCuller.GetSliceCount();
+    constants->padding = 0;
+    context->Unmap(m_clusterConstants.Get(), 0);
+
+    ID3D11Buffer* clusterConstants = m_clusterConstants.Get();
+    ID3D11ShaderResourceView* views[] = { m_pointLightBuffer.view.Get(), m_lightClusterBuffer.view.Get(), m_lightIndexBuffer.view.Get() };
+    context->PSSetConstantBuffers(3, 1, &clusterConstants);
+    context->PSSetShaderResources(1, 3, views);
+}
+
+// Writes count elements into a light buffer, creating it again in powers of two when it is too
+// small. An unknown format makes it a structured buffer of stride byte elements.
+void Game::UploadLightBuffer(ID3D11DeviceContext* context, LightBuffer& target, const void* data, size_t count,
+    uint32_t stride, DXGI_FORMAT format)
+{
+    if (!target.buffer || count > target.capacity)
+    {
+        uint32_t capacity = std::max(target.capacity, 64u);
+        while (capacity < count)
+        {
+            capacity *= 2;
+        }
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.ByteWidth = capacity * stride;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        if (format == DXGI_FORMAT_UNKNOWN)
+        {
+            desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+            desc.StructureByteStride = stride;
+        }
+        auto device = m_deviceResources->GetD3DDevice();
+        DX::ThrowIfFailed(device->CreateBuffer(&desc, nullptr, target.buffer.ReleaseAndGetAddressOf()));
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+        viewDesc.Format = format;
+        viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        viewDesc.Buffer.FirstElement = 0;
+        viewDesc.Buffer.NumElements = capacity;
+        DX::ThrowIfFailed(device->CreateShaderResourceView(target.buffer.Get(), &viewDesc, target.view.ReleaseAndGetAddressOf()));
+        target.capacity = capacity;
+    }
+
+    if (count > 0)
+    {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        DX::ThrowIfFailed(context->Map(target.buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+        memcpy(mapped.pData, data, count * stride);
+        context->Unmap(target.buffer.Get(), 0);
+    }
+}
+
+// Draws this frame's queued draws again on the CPU, at the default window size and at 4K, on one
+// thread per core. Each size is timed over a few frames, logged and written out as a TGA image.
+// The models' meshes are only read back for the capture and dropped after it.
+void Game::RenderSoftware()
+{
+    DX_PROFILE_ZONE("Game::RenderSoftware");
+    std::vector<ModelClass*> models;
+    for (const SceneDraw& draw : m_sceneDraws)
+    {
+        models.push_back(draw.model);
+    }
+    std::sort(models.begin(), models.end());
+    models.erase(std::unique(models.begin(), models.end()), models.end());
+
+    const auto loadStart = std::chrono::steady_clock::now();
+    size_t loaded = 0;
+    for (ModelClass* model : models)
+    {
+        loaded += model->LoadSoftwareMesh() ? 1 : 0;
+    }
+    char message[256];
+    sprintf_s(message, "Software: %zu of %zu meshes read back in %.2f ms\n", loaded, models.size(),
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count());
+    OutputDebugStringA(message);
+
+    DX::SoftwareLight light;
+    light.ambient = m_Light.getAmbientColour();
+    light.diffuse = m_Light.getDiffuseColour();
+    light.position = m_Light.getPosition();
+    light.padding = 0.f;
+    const DX::SoftwareTexture* sky = m_cubemapAsset.IsReady() ? GetSoftwareTexture(m_cubemap.Get()) : nullptr;
+
+    int sizes[2][2] = { { 0, 0 }, { SOFTWARE_CAPTURE_WIDTH, SOFTWARE_CAPTURE_HEIGHT } };
+    GetDefaultSize(sizes[0][0], sizes[0][1]);
+    for (const auto& size : sizes)
+    {
+        const Matrix projection = Matrix::CreatePerspectiveFieldOfView(XMConvertToRadians(FIELD_OF_VIEW),
+            float(size[0]) / float(size[1]), NEAR_PLANE, FAR_PLANE);
+        m_softwareRasterizer.Resize(uint32_t(size[0]), uint32_t(size[1]));
+
+        const auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < SOFTWARE_CAPTURE_FRAMES; frame++)
+        {
+            m_softwareRasterizer.Begin(m_view, projection, light, sky);
+            for (size_t i = 0; i < m_sceneDraws.size(); i++)
+            {
+                const SceneDraw& draw = m_sceneDraws[i];
+                draw.model->RenderSoftware(m_softwareRasterizer, draw.lod, Matrix(m_drawWorlds[i]), GetSoftwareTexture(draw.texture));
+            }
+            m_softwareRasterizer.Render(0);
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / SOFTWARE_CAPTURE_FRAMES;
+
+        char filename[64];
+        sprintf_s(filename, "software_%dx%d.tga", size[0], size[1]);
+        const bool written = DX::SoftwareTexture::WriteTga(filename, m_softwareRasterizer.GetWidth(), m_softwareRasterizer.GetHeight(),
+            m_softwareRasterizer.GetColor(), m_softwareRasterizer.GetPitch());
+
+        const DX::SoftwareRasterStats& stats = m_softwareRasterizer.GetStats();
+        sprintf_s(message, "Software %dx%d: %.2f ms (%.1f fps), %u of %u triangles drawn, %u pixels shaded, %s%s\n",
+            size[0], size[1], seconds * 1000.0, 1.0 / seconds, stats.rasterizedTriangles, stats.triangles, stats.shadedPixels,
+            written ? "written to " : "could not write ", filename);
+        OutputDebugStringA(message);
+    }
+
+    for (ModelClass* model : models)
+    {
+        model->ReleaseSoftwareMesh();
+    }
+}
+
+// CPU copy of one of the scene's textures, read from its file the first time it is asked for. Null
+// for a texture that isn't one of them or that the software renderer can't read.
+const DX::SoftwareTexture* Game::GetSoftwareTexture(ID3D11ShaderResourceView* texture)
+{
+    for (SoftwareTextureFile& file : m_softwareTextures)
+    {
+        if (file.texture->Get() != texture)
+        {
+            continue;
+        }
+
+        if (!file.copy)
+        {
+            char filename[MAX_PATH];
+            file.copy = std::make_unique<DX::SoftwareTexture>();
+            if (WideCharToMultiByte(CP_ACP, 0, file.filename.c_str(), -1, filename, MAX_PATH, nullptr, nullptr) == 0 ||
+                !file.copy->LoadDds(filename))
+            {
+                char message[256];
+                sprintf_s(message, "Software renderer: could not read %ls\n", file.filename.c_str());
+                OutputDebugStringA(message);
+            }
+        }
+        return file.copy->IsEmpty() ? nullptr : file.copy.get();
+    }
+    return nullptr;
+}
+
+#ifdef DX_PROFILE
+// Writes what the profiler still holds to profile.json, for chrome://tracing or Perfetto, and logs
+// each zone's times over the whole frames in it
+void Game::WriteProfile()
+{
+    DX::ProfileCapture capture;
+    DX::Profiler::Get().Capture(capture);
+    const bool written = DX::Profiler::WriteChromeTrace("profile.json", capture);
+
+    char message[256];
+    sprintf_s(message, "Profile: %zu frames, %zu zones, %s profile.json\n", capture.frames.size(), capture.events.size(),
+        written ? "written to" : "could not write");
+    OutputDebugStringA(message);
+
+    std::vector<DX::ProfileZoneStats> zones;
+    DX::Profiler::Summarize(capture, zones);
+    DX::Profiler::LogSummary(zones);
+}
+#endif
+
 // Helper method to clear the back buffers.
 void Game::Clear()
 {
@@ -571,6 +1195,85 @@ void Game::GetDefaultSize(int& width, int& height) const noexcept
 }
 #pragma endregion
 
+#pragma region Scene
+// Places every object. Objects set down next to each other are parented, so moving one node
+// carries the ones placed relative to it along.
+void Game::CreateScene()
+{
+    m_scene.Clear();
+
+    // Ground, with the rock platform sitting on it
+    m_groundNode = m_scene.AddNode(DX::TransformHierarchy::NoParent, Vector3(0.f, -10.f, 0.f));
+    m_platformNode = m_scene.AddNode(m_groundNode, Vector3(1.2f, -.4f, 3.2f), Quaternion::CreateFromYawPitchRoll(-.5f, 0.f, 0.f), Vector3(2.f));
+
+    // Tent
+    m_tentNode = m_scene.AddNode(DX::TransformHierarchy::NoParent, Vector3(1.2f, -10.25f, 3.3f), Quaternion::CreateFromYawPitchRoll(1.2f, 0.f, 0.f));
+
+    // Simple tree with a mushroom, a mushroom group and a stump placed one after the other beside it
+    m_treeSimpleNodes[0] = m_scene.AddNode(DX::TransformHierarchy::NoParent, Vector3(2.2f, -10.35f, 5.2f));
+    m_mushroomNode = m_scene.AddNode(m_treeSimpleNodes[0], Vector3(-.2f, 0.f, -.05f));
+    m_mushroomGroupNodes[0] = m_scene.AddNode(m_mushroomNode, Vector3(.4f, 0.f, -.35f));
+    m_stumpNode = m_scene.AddNode(m_mushroomGroupNodes[0], Vector3(-.7f, 0.f, 0.f));
+
+    // Row of crops, each a quarter unit along from the last
+    m_cropNodes[0] = m_scene.AddNode(DX::TransformHierarchy::NoParent, Vector3(-.2f, -10.35f, 3.2f), Quaternion::Identity, Vector3(.5f));
+    for (int i = 1; i < 4; i++)
+    {
+        m_cropNodes[i] = m_scene.AddNode(m_cropNodes[i - 1], ToParentFrame(Vector3(0.f, 0.f, -.25f), 0.f, .5f));
+    }
+
+    // Canoe with its paddle, and a mushroom group past the paddle
+    m_canoeNode = m_scene.AddNode(DX::TransformHierarchy::NoParent, Vector3(.65f, -10.35f, 1.3f), Quaternion::CreateFromYawPitchRoll(.5f, 0.f, 0.f));
+    m_canoePaddleNode = m_scene.AddNode(m_canoeNode, ToParentFrame(Vector3(.4f, 0.f, .2f), .5f));
+    m_mushroomGroupNodes[1] = m_scene.AddNode(m_canoePaddleNode, ToParentFrame(Vector3(1.3f, 0.f, 0.f), .5f));
+
+    // Log with the campfire logs, then a second simple tree and the fat tree
+    m_logNode = m_scene.AddNode(DX::TransformHierarchy::NoParent, Vector3(2.6f, -10.35f, 2.4f), Quaternion::CreateFromYawPitchRoll(.87f, 0.f, 0.f));
+    m_campfireLogsNode = m_scene.AddNode(m_logNode, ToParentFrame(Vector3(-.3f, 0.f, .4f), .87f));
+    m_treeSimpleNodes[1] = m_scene.AddNode(m_campfireLogsNode, ToParentFrame(Vector3(1.25f, 0.f, 1.5f), .87f));
+    m_treeFatNode = m_scene.AddNode(m_treeSimpleNodes[1], ToParentFrame(Vector3(-.5f, 0.f, -.2f), .87f));
+
+    // Custom geometry prism
+    m_prismNode = m_scene.AddNode(DX::TransformHierarchy::NoParent, Vector3(3.5f, -10.35f, 2.2f), Quaternion::Identity, Vector3(.3f));
+
+    // Fireflies spread evenly over a disc around the camp, each at its own height and phase
+    m_fireflies.resize(FIREFLY_COUNT);
+    for (int i = 0; i < FIREFLY_COUNT; i++)
+    {
+        const float angle = 2.39996f * float(i);
+        const float distance = FIREFLY_SPREAD * sqrtf((float(i) + .5f) / float(FIREFLY_COUNT));
+        m_fireflies[i] = XMFLOAT4(FIREFLY_CENTER.x + distance * cosf(angle), FIREFLY_CENTER.y + .25f * sinf(1.7f * float(i)),
+            FIREFLY_CENTER.z + distance * sinf(angle), float(i));
+    }
+}
+
+// Rebuilds the point lights for this step. The campfire flickers above its logs, the lanterns
+// stay put and the fireflies drift around their origins, pulsing.
+void Game::UpdateLights(float time)
+{
+    std::vector<DX::PointLight>& pointLights = m_simulation.pointLights;
+    pointLights.clear();
+
+    const Vector3 fire = Matrix(m_scene.GetWorld(m_campfireLogsNode)).Translation() + Vector3(0.f, .15f, 0.f);
+    const float flicker = .85f + .1f * sinf(time * 11.f) + .05f * sinf(time * 23.f);
+    pointLights.push_back({ fire, 2.5f, XMFLOAT3(1.f, .55f, .2f), 1.5f * flicker });
+
+    for (const XMFLOAT3& lantern : LANTERN_POSITIONS)
+    {
+        pointLights.push_back({ lantern, 1.5f, XMFLOAT3(1.f, .8f, .5f), 1.f });
+    }
+
+    for (const XMFLOAT4& firefly : m_fireflies)
+    {
+        const float phase = firefly.w;
+        const XMFLOAT3 position(firefly.x + .3f * sinf(time * .7f + phase), firefly.y + .15f * sinf(time * 1.3f + 2.f * phase),
+            firefly.z + .3f * cosf(time * .5f + phase));
+        const float pulse = std::max(0.f, sinf(time * 3.f + 5.f * phase));
+        pointLights.push_back({ position, .4f, XMFLOAT3(.7f, 1.f, .3f), pulse });
+    }
+}
+#pragma endregion
+
 #pragma region Direct3D Resources
 // These are the resources that depend on the device.
 void Game::CreateDeviceDependentResources()
@@ -587,6 +1290,19 @@ void Game::CreateDeviceDependentResources()
 
     // Load and set up shaders (vertex and pixel shader pairs)
     m_BasicLightingShader.InitStandard(device, L"light_vs.cso", L"light_ps.cso");
+    m_QuantizedLightingShader.InitStandard(device, L"light_quantized_vs.cso", L"light_ps.cso", DX::VertexFormat::Quantized);
+    m_InstancedLightingShader.InitStandard(device, L"light_instanced_vs.cso", L"light_ps.cso", DX::VertexFormat::Standard, true);
+
+    // Constants shared by the lighting shaders, see light_common.hlsli
+    D3D11_BUFFER_DESC frameDesc = {};
+    frameDesc.Usage = D3D11_USAGE_DYNAMIC;
+    frameDesc.ByteWidth = sizeof(Shader::FrameBufferType);
+    frameDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    frameDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    DX::ThrowIfFailed(device->CreateBuffer(&frameDesc, nullptr, m_frameConstants.ReleaseAndGetAddressOf()));
+    frameDesc.ByteWidth = sizeof(Shader::ClusterBufferType);
+    DX::ThrowIfFailed(device->CreateBuffer(&frameDesc, nullptr, m_clusterConstants.ReleaseAndGetAddressOf()));
+    m_objectConstantRing = std::make_unique<DX::ConstantRing>(device, static_cast<uint32_t>(sizeof(Shader::ObjectBufferType)), OBJECT_CONSTANT_BLOCKS);
 
 #pragma region InitializeModels
     // Initialize shapes and models 
@@ -594,21 +1310,28 @@ void Game::CreateDeviceDependentResources()
     m_room = GeometricPrimitive::CreateBox(context, XMFLOAT3(SCENE_BOUNDS[0], SCENE_BOUNDS[1], SCENE_BOUNDS[2]), false, true);
     m_prism.InitializePrism(device);
     m_sphere = GeometricPrimitive::CreateSphere(context);
-    m_groundModel.InitializeModel(device, "Models/ground_block.obj");
-    m_log.InitializeModel(device, "Models/log.obj");
-    m_platform.InitializeModel(device, "Models/platform_grass.obj");
-    m_tent.InitializeModel(device, "Models/tent_smallClosed.obj");
-    m_treeSimple.InitializeModel(device, "Models/tree_simple_top.obj");
-    m_treeSimpleTrunk.InitializeModel(device, "Models/tree_simple_trunk.obj");
-    m_treeFat.InitializeModel(device, "Models/tree_dark_top.obj");
-    m_treeFatTrunk.InitializeModel(device, "Models/tree_dark_trunk.obj");
-    m_mushroomGroup.InitializeModel(device, "Models/mushroom_redGroup.obj");
-    m_mushroom.InitializeModel(device, "Models/mushroom_tanTall.obj");
-    m_canoe.InitializeModel(device, "Models/canoe.obj");
-    m_canoePaddle.InitializeModel(device, "Models/canoe_paddle.obj");
-    m_stump.InitializeModel(device, "Models/stump_round.obj");
-    m_campfireLogs.InitializeModel(device, "Models/campfire_logs.obj");
-    m_crop.InitializeModel(device, "Models/crop.obj");
+
+    // Models and textures load in the background while the first frames are drawn. Each
+    // object appears once its handles are ready, the ground is queued first as it is the largest.
+    // All models share the pool's buffers, so consecutive draws don't rebind the input assembler.
+    m_geometryPool = std::make_unique<DX::GeometryPool>(device, GEOMETRY_POOL_VERTEX_BYTES, GEOMETRY_POOL_INDEX_BYTES);
+    m_assetLoader = std::make_unique<DX::AssetLoader>(device, m_geometryPool.get());
+    // The terrain is the largest mesh, so it uses the 16 byte quantized vertex format
+    m_groundModelAsset = m_assetLoader->LoadModel(m_groundModel, "Models/ground_block.obj", DX::VertexFormat::Quantized);
+    m_logAsset = m_assetLoader->LoadModel(m_log, "Models/log.obj");
+    m_platformAsset = m_assetLoader->LoadModel(m_platform, "Models/platform_grass.obj");
+    m_tentAsset = m_assetLoader->LoadModel(m_tent, "Models/tent_smallClosed.obj");
+    m_treeSimpleAsset = m_assetLoader->LoadModel(m_treeSimple, "Models/tree_simple_top.obj");
+    m_treeSimpleTrunkAsset = m_assetLoader->LoadModel(m_treeSimpleTrunk, "Models/tree_simple_trunk.obj");
+    m_treeFatAsset = m_assetLoader->LoadModel(m_treeFat, "Models/tree_dark_top.obj");
+    m_treeFatTrunkAsset = m_assetLoader->LoadModel(m_treeFatTrunk, "Models/tree_dark_trunk.obj");
+    m_mushroomGroupAsset = m_assetLoader->LoadModel(m_mushroomGroup, "Models/mushroom_redGroup.obj");
+    m_mushroomAsset = m_assetLoader->LoadModel(m_mushroom, "Models/mushroom_tanTall.obj");
+    m_canoeAsset = m_assetLoader->LoadModel(m_canoe, "Models/canoe.obj");
+    m_canoePaddleAsset = m_assetLoader->LoadModel(m_canoePaddle, "Models/canoe_paddle.obj");
+    m_stumpAsset = m_assetLoader->LoadModel(m_stump, "Models/stump_round.obj");
+    m_campfireLogsAsset = m_assetLoader->LoadModel(m_campfireLogs, "Models/campfire_logs.obj");
+    m_cropAsset = m_assetLoader->LoadModel(m_crop, "Models/crop.obj");
 #pragma endregion
 
     // Skybox effect and input layout 
@@ -616,21 +1339,24 @@ void Game::CreateDeviceDependentResources()
     m_sky->CreateInputLayout(m_effect.get(), m_skyInputLayout.ReleaseAndGetAddressOf());
 
 #pragma region LoadTextures
-    // Load in textures 
-    DX::ThrowIfFailed(CreateDDSTextureFromFile(device, L"Textures/skybox3.dds", nullptr, m_cubemap.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(CreateDDSTextureFromFile(device, L"Textures/Grass_Base_Color.dds", nullptr, m_grassTex.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(CreateDDSTextureFromFile(device, L"Textures/Rock_Base_Color.dds", nullptr, m_rockTex.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(CreateDDSTextureFromFile(device, L"Textures/red-fabric.dds", nullptr, m_tentTex.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(CreateDDSTextureFromFile(device, L"Textures/Wood_Bark.dds", nullptr, m_treeBarkTex.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(CreateDDSTextureFromFile(device, L"Textures/Stylized_Leaves.dds", nullptr, m_treeLeavesTex.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(CreateDDSTextureFromFile(device, L"Textures/Mushroom_Top.dds", nullptr, m_mushroomTex.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(CreateDDSTextureFromFile(device, L"Textures/Wood_Grain.dds", nullptr, m_woodGrainTex.ReleaseAndGetAddressOf()));
-    DX::ThrowIfFailed(CreateDDSTextureFromFile(device, L"Textures/bamboo_tex.dds", nullptr, m_bambooTex.ReleaseAndGetAddressOf()));
+    // Load in textures, the skybox texture is set on the effect once it is ready
+    m_softwareTextures.clear();
+    auto loadTexture = [this](const wchar_t* filename, ComPtr<ID3D11ShaderResourceView>& texture)
+    {
+        m_softwareTextures.push_back({ &texture, filename, nullptr });
+        return m_assetLoader->LoadTexture(filename, texture.ReleaseAndGetAddressOf());
+    };
+    m_cubemapAsset = loadTexture(L"Textures/skybox3.dds", m_cubemap);
+    m_grassTexAsset = loadTexture(L"Textures/Grass_Base_Color.dds", m_grassTex);
+    m_rockTexAsset = loadTexture(L"Textures/Rock_Base_Color.dds", m_rockTex);
+    m_tentTexAsset = loadTexture(L"Textures/red-fabric.dds", m_tentTex);
+    m_treeBarkTexAsset = loadTexture(L"Textures/Wood_Bark.dds", m_treeBarkTex);
+    m_treeLeavesTexAsset = loadTexture(L"Textures/Stylized_Leaves.dds", m_treeLeavesTex);
+    m_mushroomTexAsset = loadTexture(L"Textures/Mushroom_Top.dds", m_mushroomTex);
+    m_woodGrainTexAsset = loadTexture(L"Textures/Wood_Grain.dds", m_woodGrainTex);
+    m_bambooTexAsset = loadTexture(L"Textures/bamboo_tex.dds", m_bambooTex);
 #pragma endregion
 
-    // Set texture for skybox
-    m_effect->SetTexture(m_cubemap.Get());
-
     // Set world to identity matrix
     m_world = Matrix::Identity;
 }
@@ -640,12 +1366,21 @@ void Game::CreateWindowSizeDependentResources()
 {
     auto size = m_deviceResources->GetOutputSize();
     m_view = Matrix::CreateLookAt(Vector3(2.f, 2.f, 2.f), Vector3::Zero, Vector3::UnitY);
-    m_proj = Matrix::CreatePerspectiveFieldOfView(XMConvertToRadians(70.f), float(size.right) / float(size.bottom), 0.01f, 100.f);
+    m_proj = Matrix::CreatePerspectiveFieldOfView(XMConvertToRadians(FIELD_OF_VIEW), float(size.right) / float(size.bottom), NEAR_PLANE, FAR_PLANE);
     m_effect->SetProjection(m_proj);
+
+    // LOD errors are compared in pixels, which depends on the field of view and window height
+    m_lodPixelScale = DX::LodSelector::GetPixelScale(m_proj, float(size.bottom));
+
+    // The light clusters are cut from the view frustum
+    m_lightCuller.SetProjection(m_proj, LIGHT_GRID_NEAR, FAR_PLANE);
 }
 
 void Game::OnDeviceLost()
 {
+    // Stop the background loads before releasing the objects they write into
+    m_assetLoader.reset();
+
    // Shape/model resets 
     m_room.reset();   
     m_sphere.reset();
@@ -665,6 +1400,29 @@ void Game::OnDeviceLost()
     m_campfireLogs.Shutdown();
     m_stump.Shutdown();
     m_crop.Shutdown();
+    m_geometryPool.reset();
+
+    // Queued draws and sort key ids refer to the models and textures being released
+    m_sceneDraws.clear();
+    m_drawWorlds.clear();
+    m_drawVariants.clear();
+    m_drawKeys.clear();
+    m_frustumCuller.Clear();
+    m_renderQueue.Clear();
+    m_renderQueue.ResetIds();
+    m_instanceBuffer.Reset();
+    m_instanceCapacity = 0;
+    m_frameConstants.Reset();
+    m_objectConstantRing.reset();
+    m_objectConstants.clear();
+    m_batchObjectBlocks.clear();
+    m_clusterConstants.Reset();
+    for (LightBuffer* lightBuffer : { &m_pointLightBuffer, &m_lightClusterBuffer, &m_lightIndexBuffer })
+    {
+        lightBuffer->buffer.Reset();
+        lightBuffer->view.Reset();
+        lightBuffer->capacity = 0;
+    }
 
     // Texture resets 
     m_cubemap.Reset();
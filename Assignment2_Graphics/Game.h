@@ -6,11 +6,30 @@
 
 #include "DeviceResources.h"
 #include "StepTimer.h"
+#include "FrameLimiter.h"
+#include "TripleBuffer.h"
+#include "UpdateThread.h"
 #include "pch.h"
 #include "modelclass.h"
 #include "Shader.h"
 #include "Light.h"
 #include "SkyboxEffect.h"
+#include "AssetLoader.h"
+#include "TransformHierarchy.h"
+#include "RenderQueue.h"
+#include "InstanceBatcher.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "ConstantRing.h"
+#include "ClusteredLightCuller.h"
+#include "CommandList.h"
+#include "D3D11CommandBackend.h"
+#include "SoftwareRasterizer.h"
+#include "Profiler.h"
+
+#include <chrono>
+#include <mutex>
+#include <string>
 
 // A basic game implementation that creates a D3D11 device and
 // provides a game loop.
@@ -53,25 +72,118 @@ public:
 
 private:
 
-    void Update(DX::StepTimer const& timer);
+    // Devices are read on the window's thread, Update takes what they gave since it last ran.
+    // Mouse movement adds up until then.
+    struct InputState
+    {
+        DirectX::Keyboard::State keyboard;
+        DirectX::GamePad::State gamePad;
+        float mouseX;       // Relative movement, while the left button holds the mouse
+        float mouseY;
+    };
+
+    // Everything Render needs from one Update: the camera, every scene node's world matrix and
+    // the point lights
+    struct SimulationState
+    {
+        DirectX::SimpleMath::Vector3 camPos;
+        float pitch;
+        float yaw;
+        std::vector<DirectX::XMFLOAT4X4> worlds;
+        std::vector<DX::PointLight> pointLights;
+    };
+
+    // Handed from Update to Render through m_snapshots, never changed once published. Render
+    // blends from previous to current by how far it is into the step after current was published.
+    struct FrameSnapshot
+    {
+        SimulationState previous;
+        SimulationState current;
+        std::chrono::steady_clock::time_point published;
+        double stepSeconds;     // 0 when Update ran on the window's thread, nothing is blended
+    };
+
+    void ReadInput();
+    InputState TakeInput();
+    void Update(DX::StepTimer const& timer, const InputState& input);
+    void PublishSnapshot(double stepSeconds);
+    bool ApplySnapshot();
+    void StartUpdateThread();
     void Render();
 
     void Clear();
 
+    void CreateScene();
+    void UpdateLights(float time);
+
+    // One model draw for this frame, the render queue's items and the culler's boxes index into
+    // m_sceneDraws (and the matching m_drawWorlds, m_drawVariants and m_drawKeys)
+    struct SceneDraw
+    {
+        ModelClass* model;
+        Shader* shader;
+        Shader* instancedShader;    // Used when the draw is batched with others, null if it never is
+        ID3D11ShaderResourceView* texture;
+        int lod;
+        bool cullClusters;          // Full detail drawn as the clusters that survive culling
+        DirectX::XMFLOAT3 boundsCenter;     // World space box tested against the occluders
+        DirectX::XMFLOAT3 boundsExtents;
+    };
+
+    void QueueDraw(ModelClass& model, const DX::AssetHandle& modelAsset, Shader& shader,
+        ID3D11ShaderResourceView* texture, const DX::AssetHandle& textureAsset, uint32_t node,
+        DX::LodSelector* lod = nullptr, bool cullClusters = false, bool occluder = false);
+    void SubmitDraws(ID3D11DeviceContext1* context);
+    void RecordDraws(DX::CommandBuffer& commands, size_t begin, size_t end, const DirectX::SimpleMath::Matrix& viewProjection) const;
+    void UploadInstances(ID3D11DeviceContext* context);
+    void UploadConstants(ID3D11DeviceContext1* context, const DirectX::SimpleMath::Matrix& viewProjection);
+    void UploadLights(ID3D11DeviceContext* context);
+    void RenderSoftware();
+    const DX::SoftwareTexture* GetSoftwareTexture(ID3D11ShaderResourceView* texture);
+#ifdef DX_PROFILE
+    void WriteProfile();
+#endif
+
+    // Dynamic buffer read through a shader resource view, grown like the instance buffer
+    struct LightBuffer
+    {
+        Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+        Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> view;
+        uint32_t capacity;
+    };
+    void UploadLightBuffer(ID3D11DeviceContext* context, LightBuffer& target, const void* data, size_t count,
+        uint32_t stride, DXGI_FORMAT format);
+
     void CreateDeviceDependentResources();
     void CreateWindowSizeDependentResources();
 
     // Device resources.
     std::unique_ptr<DX::DeviceResources> m_deviceResources;
 
-    // Rendering loop timer.
+    // Rendering loop timer, and the limiter F10 turns on to hold frames to FRAME_LIMIT_SECONDS
     DX::StepTimer m_timer;
+    DX::FrameLimiter m_frameLimiter;
 
     // User input 
     std::unique_ptr<DirectX::Keyboard> m_keyboard;
     std::unique_ptr<DirectX::Mouse> m_mouse;
     DirectX::Mouse::ButtonStateTracker m_MouseTracker;
+    DirectX::Keyboard::KeyboardStateTracker m_keyboardTracker;
     std::unique_ptr<DirectX::GamePad> m_gamePad;
+    std::mutex m_inputMutex;
+    InputState m_input;             // Guarded by m_inputMutex
+
+    // F9 moves Update to a thread of its own, stepping m_updateTimer at a fixed rate, while this
+    // thread renders the last snapshot it published. Otherwise Tick runs Update then Render.
+    DX::UpdateThread m_updateThread;
+    DX::StepTimer m_updateTimer;
+    DX::TripleBuffer<FrameSnapshot> m_snapshots;
+    bool m_hasSnapshot;
+
+    // State of the last two Updates, only touched by the thread running Update
+    SimulationState m_simulation;
+    SimulationState m_previousSimulation;
+    double m_simulationTime;
 
     // DirectXTK objects.
     std::unique_ptr<DirectX::CommonStates> m_states;
@@ -89,15 +201,29 @@ private:
     DirectX::SimpleMath::Matrix m_proj;
     DirectX::SimpleMath::Matrix m_world;
 
-    // Camera 
+    // Camera, moved by Update
     DirectX::SimpleMath::Vector3 m_camPos;
     float m_pitch;
     float m_yaw;
 
+    // Camera position and node worlds Render draws with, blended from the snapshot with m_view
+    DirectX::SimpleMath::Vector3 m_frameCamPos;
+    std::vector<DirectX::XMFLOAT4X4> m_frameWorlds;
+
 
     // Light
     Light m_Light;
 
+    // Point lights of the campfire, lanterns and fireflies, rebuilt by every Update and blended
+    // from the snapshot for Render. The pixel shader only loops over those in its cluster of the view frustum.
+    std::vector<DX::PointLight> m_pointLights;
+    std::vector<DirectX::XMFLOAT4> m_fireflies;     // Origin the firefly drifts around, and its phase
+    DX::ClusteredLightCuller m_lightCuller;
+    LightBuffer m_pointLightBuffer;
+    LightBuffer m_lightClusterBuffer;
+    LightBuffer m_lightIndexBuffer;
+    Microsoft::WRL::ComPtr<ID3D11Buffer> m_clusterConstants;
+
     // Skybox 
     std::unique_ptr<DirectX::GeometricPrimitive> m_sky;
     std::unique_ptr<DX::SkyboxEffect> m_effect; 
@@ -119,6 +245,8 @@ private:
 
     //Shaders
     Shader m_BasicLightingShader;
+    Shader m_QuantizedLightingShader;
+    Shader m_InstancedLightingShader;
 
     // Geometric primitive shapes/Models 
     std::unique_ptr<DirectX::GeometricPrimitive> m_room;
@@ -142,6 +270,71 @@ private:
     ModelClass m_campfireLogs;
     ModelClass m_crop;
 
+    // Scene layout, one node per drawn object
+    DX::TransformHierarchy m_scene;
+    uint32_t m_groundNode;
+    uint32_t m_platformNode;
+    uint32_t m_tentNode;
+    uint32_t m_treeSimpleNodes[2];
+    uint32_t m_mushroomNode;
+    uint32_t m_mushroomGroupNodes[2];
+    uint32_t m_stumpNode;
+    uint32_t m_cropNodes[4];
+    uint32_t m_canoeNode;
+    uint32_t m_canoePaddleNode;
+    uint32_t m_logNode;
+    uint32_t m_campfireLogsNode;
+    uint32_t m_treeFatNode;
+    uint32_t m_prismNode;
+
+    // Draws of the current frame. Those whose world bounds are in the view frustum and not hidden
+    // behind the large occluders are sorted by state before submission. Repeats of a mesh with the same texture and level of detail are
+    // drawn instanced, their worlds in a per frame buffer.
+    std::vector<SceneDraw> m_sceneDraws;
+    std::vector<DirectX::XMFLOAT4X4> m_drawWorlds;
+    std::vector<uint32_t> m_drawVariants;
+    std::vector<uint64_t> m_drawKeys;
+    DX::FrustumCuller m_frustumCuller;
+    DX::OcclusionCuller m_occlusionCuller;
+    DX::RenderQueue m_renderQueue;
+    uint32_t m_stateChangesSaved;   // By last frame's sort, logged when it changes
+    DX::InstanceBatcher m_instanceBatcher;
+    DX::CommandList m_commandList;
+    Microsoft::WRL::ComPtr<ID3D11Buffer> m_instanceBuffer;
+    uint32_t m_instanceCapacity;
+
+    // Shader constants. The camera and light are uploaded once per frame, the per object matrices
+    // of every draw that isn't instanced are computed together and written to a ring in one Map.
+    Microsoft::WRL::ComPtr<ID3D11Buffer> m_frameConstants;
+    std::unique_ptr<DX::ConstantRing> m_objectConstantRing;
+    std::vector<Shader::ObjectBufferType> m_objectConstants;
+    std::vector<uint32_t> m_batchObjectBlocks;     // Ring block of each batch's first draw
+    uint32_t m_constantBytes;       // Uploaded last frame, logged when it changes
+
+    // CPU renderer, F12 draws the next frame's queued draws with it as well. Its textures are read
+    // from the same files as the GPU's, on the first capture that needs them.
+    struct SoftwareTextureFile
+    {
+        const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>* texture;
+        std::wstring filename;
+        std::unique_ptr<DX::SoftwareTexture> copy;
+    };
+    DX::SoftwareRasterizer m_softwareRasterizer;
+    std::vector<SoftwareTextureFile> m_softwareTextures;
+    bool m_softwareCapture;
+
+#ifdef DX_PROFILE
+    // F11 writes the profiler's last frames out at the end of the frame
+    bool m_profileCapture;
+#endif
+
+    // Level of detail selection, one selector per drawn instance so each keeps its own hysteresis
+    float m_lodPixelScale;
+    DX::LodSelector m_groundLod;
+    DX::LodSelector m_tentLod;
+    DX::LodSelector m_treeSimpleLod[2];
+    DX::LodSelector m_treeFatLod;
+
 
     // Textures
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_skyTex;
@@ -155,4 +348,38 @@ private:
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_pumpkinTex;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_tentTex;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_waterTex;
+
+    // Completion handles for the models and textures above, an object is only drawn once its
+    // model and texture are both ready
+    DX::AssetHandle m_groundModelAsset;
+    DX::AssetHandle m_logAsset;
+    DX::AssetHandle m_platformAsset;
+    DX::AssetHandle m_tentAsset;
+    DX::AssetHandle m_treeSimpleAsset;
+    DX::AssetHandle m_treeSimpleTrunkAsset;
+    DX::AssetHandle m_treeFatAsset;
+    DX::AssetHandle m_treeFatTrunkAsset;
+    DX::AssetHandle m_mushroomGroupAsset;
+    DX::AssetHandle m_mushroomAsset;
+    DX::AssetHandle m_canoeAsset;
+    DX::AssetHandle m_canoePaddleAsset;
+    DX::AssetHandle m_stumpAsset;
+    DX::AssetHandle m_campfireLogsAsset;
+    DX::AssetHandle m_cropAsset;
+    DX::AssetHandle m_cubemapAsset;
+    DX::AssetHandle m_grassTexAsset;
+    DX::AssetHandle m_rockTexAsset;
+    DX::AssetHandle m_tentTexAsset;
+    DX::AssetHandle m_treeBarkTexAsset;
+    DX::AssetHandle m_treeLeavesTexAsset;
+    DX::AssetHandle m_mushroomTexAsset;
+    DX::AssetHandle m_woodGrainTexAsset;
+    DX::AssetHandle m_bambooTexAsset;
+
+    // Shared vertex and index buffers the loaded models are sub-allocated from
+    std::unique_ptr<DX::GeometryPool> m_geometryPool;
+
+    // Loads the models and textures in the background. Declared last so it is destroyed first,
+    // before the objects its workers write into.
+    std::unique_ptr<DX::AssetLoader> m_assetLoader;
 };
\ No newline at end of file
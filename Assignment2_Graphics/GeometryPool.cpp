@@ -0,0 +1,135 @@
+//
+// GeometryPool.cpp - Shared static vertex and index buffers that every pooled model is sub-allocated from
+//
+
+#include "pch.h"
+#include "GeometryPool.h"
+
+using namespace DX;
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    HRESULT CreatePoolBuffer(ID3D11Device* device, UINT bindFlags, uint32_t size, ID3D11Buffer** buffer)
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.ByteWidth = size;
+        desc.BindFlags = bindFlags;
+        return device->CreateBuffer(&desc, nullptr, buffer);
+    }
+}
+
+GeometryPool::GeometryPool(ID3D11Device* device, uint32_t vertexCapacity, uint32_t indexCapacity) :
+    m_device(device),
+    m_vertexAllocator(std::max(vertexCapacity, 256u)),
+    m_indexAllocator(std::max(indexCapacity, 256u)),
+    m_bound(false),
+    m_boundStride(0),
+    m_boundIndexFormat(DXGI_FORMAT_UNKNOWN)
+{
+    device->GetImmediateContext(m_context.ReleaseAndGetAddressOf());
+    ThrowIfFailed(CreatePoolBuffer(device, D3D11_BIND_VERTEX_BUFFER, m_vertexAllocator.GetCapacity(), m_vertexBuffer.ReleaseAndGetAddressOf()));
+    ThrowIfFailed(CreatePoolBuffer(device, D3D11_BIND_INDEX_BUFFER, m_indexAllocator.GetCapacity(), m_indexBuffer.ReleaseAndGetAddressOf()));
+}
+
+bool GeometryPool::Allocate(const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+    const void* indices, uint32_t indexCount, DXGI_FORMAT indexFormat, GeometryAllocation& allocation)
+{
+    const uint32_t indexSize = indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    allocation.vertexOffset = allocation.indexOffset = RangeAllocator::InvalidOffset;
+    allocation.baseVertex = allocation.firstIndex = 0;
+    if (vertexCount == 0 || indexCount == 0 || vertexStride == 0)
+        return false;
+
+    // Vertices start on a multiple of their own stride so the offset is a whole base vertex, and
+    // indices on 4 bytes so either index size divides it
+    if (!Reserve(m_vertexAllocator, m_vertexBuffer, D3D11_BIND_VERTEX_BUFFER, vertexCount * vertexStride, vertexStride, allocation.vertexOffset))
+        return false;
+    if (!Reserve(m_indexAllocator, m_indexBuffer, D3D11_BIND_INDEX_BUFFER, indexCount * indexSize, sizeof(uint32_t), allocation.indexOffset))
+    {
+        Free(allocation);
+        return false;
+    }
+
+    Upload(m_vertexBuffer.Get(), allocation.vertexOffset, vertices, vertexCount * vertexStride);
+    Upload(m_indexBuffer.Get(), allocation.indexOffset, indices, indexCount * indexSize);
+    allocation.baseVertex = allocation.vertexOffset / vertexStride;
+    allocation.firstIndex = allocation.indexOffset / indexSize;
+    return true;
+}
+
+void GeometryPool::Free(GeometryAllocation& allocation)
+{
+    if (allocation.vertexOffset != RangeAllocator::InvalidOffset)
+    {
+        m_vertexAllocator.Free(allocation.vertexOffset);
+    }
+    if (allocation.indexOffset != RangeAllocator::InvalidOffset)
+    {
+        m_indexAllocator.Free(allocation.indexOffset);
+    }
+    allocation.vertexOffset = allocation.indexOffset = RangeAllocator::InvalidOffset;
+    allocation.baseVertex = allocation.firstIndex = 0;
+}
+
+void GeometryPool::Bind(ID3D11DeviceContext* context, uint32_t vertexStride, DXGI_FORMAT indexFormat)
+{
+    // Quantized and standard models share the vertex buffer at different strides
+    if (!m_bound || m_boundStride != vertexStride)
+    {
+        ID3D11Buffer* vertexBuffer = m_vertexBuffer.Get();
+        UINT stride = vertexStride;
+        UINT offset = 0;
+        context->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+    }
+    if (!m_bound || m_boundIndexFormat != indexFormat)
+    {
+        context->IASetIndexBuffer(m_indexBuffer.Get(), indexFormat, 0);
+    }
+    if (!m_bound)
+    {
+        context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    }
+
+    m_bound = true;
+    m_boundStride = vertexStride;
+    m_boundIndexFormat = indexFormat;
+}
+
+bool GeometryPool::Reserve(RangeAllocator& allocator, ComPtr<ID3D11Buffer>& buffer, UINT bindFlags,
+    uint32_t size, uint32_t alignment, uint32_t& offset)
+{
+    offset = allocator.Allocate(size, alignment);
+    if (offset != RangeAllocator::InvalidOffset)
+        return true;
+
+    // Double the buffer (or more for a mesh bigger than that) and copy the old contents across.
+    // Allocations keep their offsets, only the binding changes.
+    const uint64_t capacity = std::max<uint64_t>(uint64_t(allocator.GetCapacity()) * 2, uint64_t(allocator.GetCapacity()) + size + alignment);
+    if (capacity > D3D11_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_A_TERM * 1024ull * 1024ull)
+        return false;
+
+    ComPtr<ID3D11Buffer> grown;
+    if (FAILED(CreatePoolBuffer(m_device.Get(), bindFlags, static_cast<uint32_t>(capacity), grown.GetAddressOf())))
+        return false;
+    m_context->CopySubresourceRegion(grown.Get(), 0, 0, 0, 0, buffer.Get(), 0, nullptr);
+    buffer.Swap(grown);
+    allocator.Grow(static_cast<uint32_t>(capacity));
+    m_bound = false;
+
+    char message[256];
+    sprintf_s(message, "GeometryPool: %s buffer grown to %u bytes\n", bindFlags == D3D11_BIND_VERTEX_BUFFER ? "vertex" : "index", allocator.GetCapacity());
+    OutputDebugStringA(message);
+
+    offset = allocator.Allocate(size, alignment);
+    return offset != RangeAllocator::InvalidOffset;
+}
+
+void GeometryPool::Upload(ID3D11Buffer* buffer, uint32_t offset, const void* data, uint32_t size)
+{
+    D3D11_BOX box = { offset, 0, 0, offset + size, 1, 1 };
+    m_context->UpdateSubresource(buffer, 0, &box, data, 0, 0);
+}
@@ -0,0 +1,62 @@
+//
+// GeometryPool.h - Shared static vertex and index buffers that every pooled model is sub-allocated from
+//
+
+#pragma once
+
+#include "RangeAllocator.h"
+
+namespace DX
+{
+    // Where one mesh lives in the pool. DrawIndexed takes firstIndex and baseVertex as they are,
+    // offset by the mesh's own draw ranges.
+    struct GeometryAllocation
+    {
+        uint32_t vertexOffset;      // Bytes, RangeAllocator::InvalidOffset when nothing is allocated
+        uint32_t indexOffset;
+        uint32_t baseVertex;
+        uint32_t firstIndex;
+    };
+
+    class GeometryPool
+    {
+    public:
+        // Capacities are in bytes, both buffers grow when a mesh doesn't fit
+        GeometryPool(ID3D11Device* device, uint32_t vertexCapacity, uint32_t indexCapacity);
+
+        GeometryPool(GeometryPool const&) = delete;
+        GeometryPool& operator= (GeometryPool const&) = delete;
+
+        // Copies a mesh into the pool. Vertices of any stride and 16 or 32-bit indices share the same
+        // buffers. Uses the immediate context, so call it on the thread that renders.
+        bool Allocate(const void* vertices, uint32_t vertexCount, uint32_t vertexStride,
+            const void* indices, uint32_t indexCount, DXGI_FORMAT indexFormat, GeometryAllocation& allocation);
+        void Free(GeometryAllocation& allocation);
+
+        // Binds the pool to the input assembler, skipping whatever is still bound from the last call
+        void Bind(ID3D11DeviceContext* context, uint32_t vertexStride, DXGI_FORMAT indexFormat);
+
+        // Forget what Bind last set, call this after anything else has used the input assembler
+        void ResetBindings() noexcept { m_bound = false; }
+
+        RangeAllocatorStats GetVertexStats() const noexcept { return m_vertexAllocator.GetStats(); }
+        RangeAllocatorStats GetIndexStats() const noexcept { return m_indexAllocator.GetStats(); }
+
+    private:
+        bool Reserve(RangeAllocator& allocator, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, UINT bindFlags,
+            uint32_t size, uint32_t alignment, uint32_t& offset);
+        void Upload(ID3D11Buffer* buffer, uint32_t offset, const void* data, uint32_t size);
+
+        Microsoft::WRL::ComPtr<ID3D11Device> m_device;
+        Microsoft::WRL::ComPtr<ID3D11DeviceContext> m_context;
+        Microsoft::WRL::ComPtr<ID3D11Buffer> m_vertexBuffer;
+        Microsoft::WRL::ComPtr<ID3D11Buffer> m_indexBuffer;
+        RangeAllocator m_vertexAllocator;
+        RangeAllocator m_indexAllocator;
+
+        // Input assembler state last set by Bind
+        bool m_bound;
+        uint32_t m_boundStride;
+        DXGI_FORMAT m_boundIndexFormat;
+    };
+}
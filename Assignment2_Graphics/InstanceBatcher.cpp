@@ -0,0 +1,65 @@
+//
+// InstanceBatcher.cpp - Groups repeated draws of a sorted render queue into instanced batches
+//
+
+#include "pch.h"
+#include "InstanceBatcher.h"
+
+using namespace DirectX;
+using namespace DX;
+
+InstanceBatcher::InstanceBatcher() noexcept :
+    m_stats{}
+{
+}
+
+void InstanceBatcher::Build(const RenderItem* items, size_t itemCount, const uint32_t* variants,
+    const XMFLOAT4X4* worlds, uint32_t minInstances)
+{
+    // Everything above the depth bits: pass, shader, texture and mesh
+    const uint64_t stateMask = ~((uint64_t(1) << RenderQueue::MeshShift) - 1);
+    minInstances = std::max(minInstances, 2u);
+
+    m_batches.clear();
+    m_instances.clear();
+    m_stats = {};
+    m_stats.drawCount = static_cast<uint32_t>(itemCount);
+
+    // Sorting already put matching draws next to each other, so a batch is a run of them
+    size_t first = 0;
+    while (first < itemCount)
+    {
+        const uint64_t state = items[first].key & stateMask;
+        const uint32_t variant = variants[items[first].draw];
+
+        size_t end = first + 1;
+        if (variant != NoInstancing)
+        {
+            while (end < itemCount && (items[end].key & stateMask) == state && variants[items[end].draw] == variant)
+                end++;
+        }
+
+        InstanceBatch batch;
+        batch.firstItem = static_cast<uint32_t>(first);
+        batch.itemCount = static_cast<uint32_t>(end - first);
+        batch.firstInstance = NotInstanced;
+        if (batch.itemCount >= minInstances)
+        {
+            batch.firstInstance = static_cast<uint32_t>(m_instances.size());
+            for (size_t i = first; i < end; i++)
+            {
+                m_instances.push_back(worlds[items[i].draw]);
+            }
+            m_stats.instancedBatches++;
+            m_stats.instanceCount += batch.itemCount;
+            m_stats.drawCalls++;
+        }
+        else
+        {
+            m_stats.drawCalls += batch.itemCount;
+        }
+        m_batches.push_back(batch);
+
+        first = end;
+    }
+}
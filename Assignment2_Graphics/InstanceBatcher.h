@@ -0,0 +1,57 @@
+//
+// InstanceBatcher.h - Groups repeated draws of a sorted render queue into instanced batches
+//
+
+#pragma once
+
+#include "RenderQueue.h"
+
+#include <vector>
+
+namespace DX
+{
+    // A run of consecutive queue items that is drawn together
+    struct InstanceBatch
+    {
+        uint32_t firstItem;         // Into the sorted render queue items
+        uint32_t itemCount;
+        uint32_t firstInstance;     // Into the packed instance worlds, NotInstanced when drawn one by one
+    };
+
+    struct InstanceBatchStats
+    {
+        uint32_t drawCount;         // Queued draws
+        uint32_t drawCalls;         // What submitting the batches costs
+        uint32_t instancedBatches;
+        uint32_t instanceCount;     // Worlds packed for the instanced batches
+    };
+
+    // Draws batch when their keys match in everything but depth and they have the same variant (the
+    // level of detail, say). The world matrices of each instanced batch are packed contiguously, in
+    // queue order, ready for one per instance vertex buffer and a single DrawIndexedInstanced.
+    //
+    // Works on plain arrays only, so the grouping can be checked and timed without a device.
+    class InstanceBatcher
+    {
+    public:
+        static constexpr uint32_t NotInstanced = 0xFFFFFFFFu;
+        // Variant of draws that must be submitted on their own
+        static constexpr uint32_t NoInstancing = 0xFFFFFFFFu;
+
+        InstanceBatcher() noexcept;
+
+        // items are sorted, variants and worlds are indexed by RenderItem::draw. Runs shorter than
+        // minInstances are left as one batch that is drawn one by one.
+        void Build(const RenderItem* items, size_t itemCount, const uint32_t* variants,
+            const DirectX::XMFLOAT4X4* worlds, uint32_t minInstances = 2);
+
+        const std::vector<InstanceBatch>& GetBatches() const noexcept { return m_batches; }
+        const std::vector<DirectX::XMFLOAT4X4>& GetInstances() const noexcept { return m_instances; }
+        const InstanceBatchStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        std::vector<InstanceBatch> m_batches;
+        std::vector<DirectX::XMFLOAT4X4> m_instances;
+        InstanceBatchStats m_stats;
+    };
+}
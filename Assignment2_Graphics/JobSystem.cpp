@@ -0,0 +1,507 @@
+//
+// JobSystem.cpp - Fixed pool of worker threads running small jobs from work stealing deques
+//
+
+#include "pch.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <stdexcept>
+
+using namespace DX;
+
+static_assert(sizeof(Job) == 128, "Jobs are meant to fill two cache lines");
+static_assert((JobSystem::JobsPerThread & (JobSystem::JobsPerThread - 1)) == 0, "JobsPerThread must be a power of two");
+
+namespace
+{
+    constexpr size_t CacheLineBytes = 64;
+
+    // Rounds of stealing a worker makes, yielding in between, before it goes to sleep
+    constexpr int IdleRounds = 64;
+
+    // Chase-Lev deque of job pointers (Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient
+    // Work-Stealing for Weak Memory Models"). Only the owner pushes and pops, at the bottom; any
+    // thread steals from the top. The accesses that must be ordered against the other end are
+    // sequentially consistent instead of relying on fences.
+    class JobDeque
+    {
+    public:
+        static constexpr int64_t Capacity = static_cast<int64_t>(JobSystem::JobsPerThread);
+
+        JobDeque() noexcept :
+            m_top(0),
+            m_bottom(0),
+            m_jobs(new std::atomic<Job*>[Capacity])
+        {
+        }
+
+        // False when full
+        bool Push(Job* job) noexcept
+        {
+            const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+            const int64_t top = m_top.load(std::memory_order_acquire);
+            if (bottom - top >= Capacity)
+            {
+                return false;
+            }
+            m_jobs[bottom & (Capacity - 1)].store(job, std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_seq_cst);
+            return true;
+        }
+
+        Job* Pop() noexcept
+        {
+            const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+            m_bottom.store(bottom, std::memory_order_seq_cst);
+            int64_t top = m_top.load(std::memory_order_seq_cst);
+            if (top > bottom)
+            {
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            Job* job = m_jobs[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (top == bottom)
+            {
+                // The last job, a thief may be taking it too
+                if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    job = nullptr;
+                }
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        Job* Steal() noexcept
+        {
+            int64_t top = m_top.load(std::memory_order_seq_cst);
+            const int64_t bottom = m_bottom.load(std::memory_order_seq_cst);
+            if (top >= bottom)
+            {
+                return nullptr;
+            }
+
+            Job* job = m_jobs[top & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                return nullptr;
+            }
+            return job;
+        }
+
+    private:
+        // Thieves hammer the top, the owner the bottom, so each has a cache line of its own
+        std::atomic<int64_t> m_top;
+        char m_topPadding[CacheLineBytes - sizeof(std::atomic<int64_t>)];
+        std::atomic<int64_t> m_bottom;
+        char m_bottomPadding[CacheLineBytes - sizeof(std::atomic<int64_t>)];
+        std::unique_ptr<std::atomic<Job*>[]> m_jobs;
+    };
+}
+
+namespace DX
+{
+    struct JobSystem::ThreadQueue
+    {
+        JobDeque deque;
+
+        // Jobs only this thread may run, queued by any thread
+        std::mutex mailboxMutex;
+        std::vector<Job*> mailbox;
+        std::atomic<uint32_t> mailboxCount;
+
+        // Ring the thread's jobs are created in
+        std::unique_ptr<Job[]> jobs;
+        uint64_t jobsCreated;
+
+        uint32_t index;
+        uint32_t random;        // Picks the first queue to steal from
+        bool inUse;             // Guarded by m_queueMutex, for threads outside the pool
+
+        // Only the owner writes these
+        std::atomic<uint64_t> jobsRun;
+        std::atomic<uint64_t> jobsStolen;
+        std::atomic<uint64_t> sleeps;
+
+        explicit ThreadQueue(uint32_t queueIndex) :
+            mailboxCount(0),
+            jobs(new Job[JobsPerThread]),
+            jobsCreated(0),
+            index(queueIndex),
+            random(queueIndex * 2654435761u + 1),
+            inUse(false),
+            jobsRun(0),
+            jobsStolen(0),
+            sleeps(0)
+        {
+            for (size_t i = 0; i < JobsPerThread; i++)
+            {
+                jobs[i].unfinished.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // The calling thread's queue. Threads outside the pool give theirs back when they exit.
+    struct JobThreadSlot
+    {
+        JobSystem* system = nullptr;
+        JobSystem::ThreadQueue* queue = nullptr;
+        bool external = false;
+
+        ~JobThreadSlot()
+        {
+            if (system && external)
+            {
+                system->ReleaseQueue(queue->index);
+            }
+        }
+    };
+}
+
+namespace
+{
+    thread_local JobThreadSlot t_slot;
+}
+
+JobSystem& JobSystem::Get()
+{
+    static JobSystem s_jobs(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return s_jobs;
+}
+
+JobSystem::JobSystem(uint32_t workerCount) :
+    m_queues(new std::atomic<ThreadQueue*>[workerCount + MaxExternalThreads]),
+    m_queueCount(workerCount),
+    m_workerCount(workerCount),
+    m_wakeEpoch(0),
+    m_sleepers(0),
+    m_exit(false)
+{
+    for (uint32_t i = 0; i < workerCount + MaxExternalThreads; i++)
+    {
+        m_queues[i].store(nullptr, std::memory_order_relaxed);
+    }
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        m_ownedQueues.push_back(std::make_unique<ThreadQueue>(i));
+        m_queues[i].store(m_ownedQueues.back().get(), std::memory_order_relaxed);
+    }
+
+    m_workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        m_workers.emplace_back(&JobSystem::WorkerMain, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_exit = true;
+    }
+    m_wakeCondition.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+
+    // The queue goes with the system, the destroying thread mustn't hand it back at exit
+    if (t_slot.system == this)
+    {
+        t_slot.system = nullptr;
+        t_slot.queue = nullptr;
+    }
+}
+
+uint32_t JobSystem::GetThreadIndex()
+{
+    return GetQueue().index;
+}
+
+JobSystem::ThreadQueue& JobSystem::GetQueue()
+{
+    if (t_slot.system == this)
+    {
+        return *t_slot.queue;
+    }
+
+    // First use from a thread outside the pool. A queue given back by a thread that exited may
+    // still hold jobs, they are stolen or run by whoever takes it next.
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    ThreadQueue* queue = nullptr;
+    for (uint32_t i = m_workerCount; i < m_queueCount.load(std::memory_order_relaxed); i++)
+    {
+        ThreadQueue* candidate = m_queues[i].load(std::memory_order_relaxed);
+        if (!candidate->inUse)
+        {
+            queue = candidate;
+            break;
+        }
+    }
+    if (!queue)
+    {
+        const uint32_t index = m_queueCount.load(std::memory_order_relaxed);
+        if (index == m_workerCount + MaxExternalThreads)
+        {
+            throw std::runtime_error("JobSystem: too many threads outside the pool");
+        }
+        m_ownedQueues.push_back(std::make_unique<ThreadQueue>(index));
+        queue = m_ownedQueues.back().get();
+        m_queues[index].store(queue, std::memory_order_release);
+        m_queueCount.store(index + 1, std::memory_order_seq_cst);
+    }
+
+    queue->inUse = true;
+    t_slot.system = this;
+    t_slot.queue = queue;
+    t_slot.external = true;
+    return *queue;
+}
+
+void JobSystem::ReleaseQueue(uint32_t index)
+{
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_queues[index].load(std::memory_order_relaxed)->inUse = false;
+}
+
+Job* JobSystem::Allocate(void (*function)(Job&), Job* parent)
+{
+    // The next slot of the ring that has finished. Jobs waiting on their children, like a
+    // parallel loop's root, stay unfinished for a long time and are stepped over.
+    ThreadQueue& queue = GetQueue();
+    Job* job = nullptr;
+    while (!job)
+    {
+        for (size_t i = 0; i < JobsPerThread && !job; i++)
+        {
+            Job* candidate = &queue.jobs[queue.jobsCreated++ & (JobsPerThread - 1)];
+            if (candidate->unfinished.load(std::memory_order_acquire) == 0)
+            {
+                job = candidate;
+            }
+        }
+
+        // Every slot is in flight, help until one is done
+        if (!job)
+        {
+            if (Job* other = FindJob(queue))
+            {
+                Execute(*other);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    job->function = function;
+    job->parent = parent;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    if (parent)
+    {
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+void JobSystem::Run(Job* job, uint32_t thread)
+{
+    if (thread == AnyThread)
+    {
+        // A full deque means JobsPerThread jobs are queued already, this one just runs now
+        if (!GetQueue().deque.Push(job))
+        {
+            Execute(*job);
+            return;
+        }
+        Wake(false);
+        return;
+    }
+
+    ThreadQueue* target = thread < m_queueCount.load(std::memory_order_acquire) ? m_queues[thread].load(std::memory_order_acquire) : nullptr;
+    if (!target)
+    {
+        throw std::out_of_range("JobSystem: no thread with that index");
+    }
+    {
+        std::lock_guard<std::mutex> lock(target->mailboxMutex);
+        target->mailbox.push_back(job);
+        target->mailboxCount.store(static_cast<uint32_t>(target->mailbox.size()), std::memory_order_seq_cst);
+    }
+    Wake(true);
+}
+
+void JobSystem::Wait(const Job* job)
+{
+    ThreadQueue& queue = GetQueue();
+    while (job->unfinished.load(std::memory_order_acquire) != 0)
+    {
+        if (Job* other = FindJob(queue))
+        {
+            Execute(*other);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::Execute(Job& job)
+{
+    job.function(job);
+    Finish(&job);
+    ThreadQueue& queue = *t_slot.queue;
+    queue.jobsRun.store(queue.jobsRun.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void JobSystem::Finish(Job* job) noexcept
+{
+    // The last child to finish finishes its parent, and so on up. A finished job's slot may be
+    // reused at once, so its parent is read first.
+    while (job)
+    {
+        Job* parent = job->parent;
+        if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            break;
+        }
+        job = parent;
+    }
+}
+
+// Jobs for this thread only first, then its own newest, then the oldest of another thread's,
+// starting from a random one so thieves spread out
+Job* JobSystem::FindJob(ThreadQueue& queue)
+{
+    if (queue.mailboxCount.load(std::memory_order_seq_cst) != 0)
+    {
+        std::lock_guard<std::mutex> lock(queue.mailboxMutex);
+        if (!queue.mailbox.empty())
+        {
+            Job* job = queue.mailbox.front();
+            queue.mailbox.erase(queue.mailbox.begin());
+            queue.mailboxCount.store(static_cast<uint32_t>(queue.mailbox.size()), std::memory_order_relaxed);
+            return job;
+        }
+    }
+
+    if (Job* job = queue.deque.Pop())
+    {
+        return job;
+    }
+
+    const uint32_t queueCount = m_queueCount.load(std::memory_order_seq_cst);
+    queue.random ^= queue.random << 13;
+    queue.random ^= queue.random >> 17;
+    queue.random ^= queue.random << 5;
+    const uint32_t first = queue.random % queueCount;
+    for (uint32_t i = 0; i < queueCount; i++)
+    {
+        ThreadQueue* victim = m_queues[(first + i) % queueCount].load(std::memory_order_acquire);
+        if (victim == &queue || !victim)
+        {
+            continue;
+        }
+        if (Job* job = victim->deque.Steal())
+        {
+            queue.jobsStolen.store(queue.jobsStolen.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+// Only takes the lock when a worker sleeps. The queue was written before m_sleepers is read, and
+// a worker counts itself in before it looks at the queues, so one of the two sees the other. The
+// queue count is sequentially consistent for the same reason, a new queue is seen by both too.
+void JobSystem::Wake(bool all)
+{
+    if (m_sleepers.load(std::memory_order_seq_cst) == 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_wakeEpoch.fetch_add(1, std::memory_order_release);
+    }
+    if (all)
+    {
+        m_wakeCondition.notify_all();
+    }
+    else
+    {
+        m_wakeCondition.notify_one();
+    }
+}
+
+void JobSystem::WorkerMain(uint32_t index)
+{
+    DX_PROFILE_THREAD("Job worker");
+    ThreadQueue& queue = *m_queues[index].load(std::memory_order_relaxed);
+    t_slot.system = this;
+    t_slot.queue = &queue;
+    t_slot.external = false;
+
+    // Only a hint, the scheduler still moves the worker when its processor is busy. Processor 0
+    // is left to the thread that created the pool.
+#if defined(_WIN32)
+    SetThreadIdealProcessor(GetCurrentThread(), (index + 1) % std::max(1u, std::thread::hardware_concurrency()));
+#endif
+
+    int idleRounds = 0;
+    while (!m_exit.load(std::memory_order_relaxed))
+    {
+        if (Job* job = FindJob(queue))
+        {
+            Execute(*job);
+            idleRounds = 0;
+            continue;
+        }
+        if (++idleRounds < IdleRounds)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Look once more after counting in as a sleeper, a job queued since is either found now
+        // or moves the epoch before the wait starts
+        m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+        const uint64_t epoch = m_wakeEpoch.load(std::memory_order_acquire);
+        Job* job = FindJob(queue);
+        if (!job)
+        {
+            queue.sleeps.store(queue.sleeps.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wakeCondition.wait(lock, [this, epoch]()
+            {
+                return m_exit.load(std::memory_order_relaxed) || m_wakeEpoch.load(std::memory_order_relaxed) != epoch;
+            });
+        }
+        m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+        idleRounds = 0;
+        if (job)
+        {
+            Execute(*job);
+        }
+    }
+}
+
+JobSystemStats JobSystem::GetStats() const
+{
+    JobSystemStats stats = {};
+    const uint32_t queueCount = m_queueCount.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < queueCount; i++)
+    {
+        const ThreadQueue* queue = m_queues[i].load(std::memory_order_acquire);
+        stats.jobsRun += queue->jobsRun.load(std::memory_order_relaxed);
+        stats.jobsStolen += queue->jobsStolen.load(std::memory_order_relaxed);
+        stats.sleeps += queue->sleeps.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
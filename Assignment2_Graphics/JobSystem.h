@@ -0,0 +1,183 @@
+//
+// JobSystem.h - Fixed pool of worker threads running small jobs from work stealing deques
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace DX
+{
+    // A function and what is left of it: the job itself until it has run, and each child created
+    // under it until the child is done. Two cache lines, taken from a ring of JobsPerThread per
+    // thread. A job is only valid until it has finished, its slot is reused after that.
+    struct Job
+    {
+        static constexpr size_t DataBytes = 96;
+
+        void (*function)(Job&);
+        Job* parent;
+        std::atomic<uint32_t> unfinished;
+        alignas(16) unsigned char data[DataBytes];     // The function object
+    };
+
+    struct JobSystemStats
+    {
+        uint64_t jobsRun;
+        uint64_t jobsStolen;        // Run by a thread other than the one that queued them
+        uint64_t sleeps;            // Times a worker found nothing to do and slept
+    };
+
+    // Every thread that queues jobs owns a Chase-Lev deque: it pushes and pops the bottom, other
+    // threads steal from the top, and only a steal of the last job takes a compare and swap.
+    // Workers sleep once there is nothing left to steal. Threads other than the workers get a
+    // deque of their own the first time they use the system, and run jobs only while they wait.
+    //
+    // Job functions are copied into the job and never destroyed, so they capture by reference or
+    // by pointer, and whatever they reference must outlive them (Wait before it goes). A thread
+    // with JobsPerThread of its jobs unfinished runs others until one is done before it creates
+    // another. Threads outside the pool must be done with a system before it is destroyed.
+    class JobSystem
+    {
+    public:
+        static constexpr size_t JobsPerThread = 4096;
+        static constexpr uint32_t MaxExternalThreads = 256;
+        static constexpr uint32_t AnyThread = UINT32_MAX;
+
+        // Shared by the whole engine, one worker per hardware thread but the first
+        static JobSystem& Get();
+
+        explicit JobSystem(uint32_t workerCount);
+        ~JobSystem();
+
+        JobSystem(JobSystem const&) = delete;
+        JobSystem& operator= (JobSystem const&) = delete;
+
+        uint32_t GetWorkerCount() const noexcept { return m_workerCount; }
+
+        // Workers and the thread that waits, what a parallel loop can hope to use
+        uint32_t GetThreadCount() const noexcept { return m_workerCount + 1; }
+
+        // The calling thread's index for Run's affinity. Workers are 0 to GetWorkerCount() - 1.
+        uint32_t GetThreadIndex();
+
+        // Creates a job that calls function. A job with a parent holds the parent unfinished
+        // until it is done, so waiting on the parent waits for all its children too.
+        template <typename F>
+        Job* Create(const F& function, Job* parent = nullptr)
+        {
+            static_assert(sizeof(F) <= Job::DataBytes && alignof(F) <= 16, "Job function too large, capture a pointer to its data");
+            static_assert(std::is_trivially_copyable<F>::value && std::is_trivially_destructible<F>::value,
+                "Job functions are copied and never destroyed, capture by reference or pointer");
+
+            Job* job = Allocate(&Invoke<F>, parent);
+            new (job->data) F(function);
+            return job;
+        }
+
+        // Queues a job. Any thread may steal it unless thread names the one that must run it, a
+        // thread outside the pool only runs its own while it waits.
+        void Run(Job* job, uint32_t thread = AnyThread);
+
+        // Runs other jobs until job and its children have finished
+        void Wait(const Job* job);
+
+        // Calls body(begin, end) over ranges covering 0 to count and returns when all have run.
+        // Ranges are split in halves, the second half queued each time, down to a grain of about
+        // four ranges per thread but never below minGrain. A range that was stolen splits to half
+        // its grain, so uneven work is cut finer where threads ran out of it.
+        template <typename F>
+        void ParallelFor(size_t count, size_t minGrain, const F& body)
+        {
+            minGrain = std::max<size_t>(minGrain, 1);
+            const size_t grain = std::max(minGrain, count / (GetThreadCount() * 4));
+            if (count <= grain || m_workerCount == 0)
+            {
+                if (count > 0)
+                {
+                    body(size_t(0), count);
+                }
+                return;
+            }
+
+            // The root only counts the ranges, it never runs
+            Job* root = Allocate(&Invoke<ParallelForRange<F>>, nullptr);
+            ParallelForRange<F> range = { this, &body, root, 0, count, grain, minGrain, GetThreadIndex() };
+            range();
+            Finish(root);
+            Wait(root);
+        }
+
+        JobSystemStats GetStats() const;
+
+    private:
+        struct ThreadQueue;
+
+        template <typename F>
+        static void Invoke(Job& job)
+        {
+            (*reinterpret_cast<F*>(job.data))();
+        }
+
+        template <typename F>
+        struct ParallelForRange
+        {
+            JobSystem* system;
+            const F* body;
+            Job* root;
+            size_t begin;
+            size_t end;
+            size_t grain;
+            size_t minGrain;
+            uint32_t thread;        // That queued this range
+
+            void operator()() const
+            {
+                const uint32_t current = system->GetThreadIndex();
+                const size_t splitGrain = current == thread ? grain : std::max(minGrain, grain / 2);
+                size_t last = end;
+                while (last - begin > splitGrain)
+                {
+                    const size_t middle = begin + (last - begin) / 2;
+                    system->Run(system->Create(ParallelForRange{ system, body, root, middle, last, splitGrain, minGrain, current }, root));
+                    last = middle;
+                }
+                (*body)(begin, last);
+            }
+        };
+
+        Job* Allocate(void (*function)(Job&), Job* parent);
+        void Execute(Job& job);
+        void Finish(Job* job) noexcept;
+        ThreadQueue& GetQueue();
+        Job* FindJob(ThreadQueue& queue);
+        void Wake(bool all);
+        void ReleaseQueue(uint32_t index);
+        void WorkerMain(uint32_t index);
+
+        // Worker queues first, then one per thread outside the pool that has used it. Queues are
+        // never freed while the system lives, a thread that exits leaves its queue to the next.
+        std::unique_ptr<std::atomic<ThreadQueue*>[]> m_queues;
+        std::atomic<uint32_t> m_queueCount;
+        std::vector<std::unique_ptr<ThreadQueue>> m_ownedQueues;
+        std::mutex m_queueMutex;
+        uint32_t m_workerCount;
+        std::vector<std::thread> m_workers;
+
+        // Workers with nothing to do sleep on m_wakeCondition until the epoch moves
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+        std::atomic<uint64_t> m_wakeEpoch;
+        std::atomic<uint32_t> m_sleepers;
+        std::atomic<bool> m_exit;
+
+        friend struct JobThreadSlot;
+    };
+}
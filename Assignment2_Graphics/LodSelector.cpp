@@ -0,0 +1,36 @@
+//
+// LodSelector.cpp - Screen space error LOD selection with hysteresis
+//
+
+#include "pch.h"
+#include "LodSelector.h"
+
+using namespace DX;
+
+int LodSelector::Select(const MeshLod* levels, int levelCount, float worldScale, float distance, float pixelScale,
+    float threshold, float hysteresis) noexcept
+{
+    if (levelCount <= 1 || distance <= 0.f)
+    {
+        m_level = 0;
+        return m_level;
+    }
+    m_level = std::min(m_level, levelCount - 1);
+
+    const float pixelsPerUnit = worldScale * pixelScale / distance;
+
+    // Refine as soon as the current level is visibly wrong
+    while (m_level > 0 && levels[m_level].error * pixelsPerUnit > threshold)
+    {
+        m_level--;
+    }
+
+    // Coarsen only with some margin below the threshold
+    const float coarsenThreshold = threshold * (1.f - hysteresis);
+    while (m_level + 1 < levelCount && levels[m_level + 1].error * pixelsPerUnit <= coarsenThreshold)
+    {
+        m_level++;
+    }
+
+    return m_level;
+}
@@ -0,0 +1,37 @@
+//
+// LodSelector.h - Screen space error LOD selection with hysteresis
+//
+
+#pragma once
+
+#include "MeshData.h"
+
+namespace DX
+{
+    // Picks the coarsest level whose geometric error projects to at most threshold pixels. One
+    // selector per drawn instance: it remembers the current level and only switches to a coarser
+    // one once that level is comfortably under the threshold, so objects near a switch distance
+    // don't flicker between levels.
+    class LodSelector
+    {
+    public:
+        LodSelector() noexcept : m_level(0) {}
+
+        // Pixels per object space unit at distance 1, from the projection matrix and viewport height
+        static float GetPixelScale(const DirectX::XMFLOAT4X4& projection, float viewportHeight) noexcept
+        {
+            return projection.m[1][1] * viewportHeight * 0.5f;
+        }
+
+        // levels are ordered finest first with increasing object space error. worldScale converts
+        // the errors to world units, distance is from the camera to the nearest point of the object.
+        int Select(const MeshLod* levels, int levelCount, float worldScale, float distance, float pixelScale,
+            float threshold = 1.f, float hysteresis = 0.25f) noexcept;
+
+        int GetLevel() const noexcept { return m_level; }
+        void Reset() noexcept { m_level = 0; }
+
+    private:
+        int m_level;
+    };
+}
@@ -0,0 +1,185 @@
+//
+// MappedFile.cpp - Read-only memory mapped view of a file on disk
+//
+
+#include "pch.h"
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace DX;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() noexcept :
+    m_file(INVALID_HANDLE_VALUE),
+    m_mapping(nullptr),
+    m_data(nullptr),
+    m_size(0)
+{
+}
+
+bool MappedFile::Open(const char* filename)
+{
+    Close();
+
+    m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize))
+    {
+        Close();
+        return false;
+    }
+
+    // CreateFileMapping rejects zero length files, so leave the view empty
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+    if (m_size == 0)
+    {
+        return true;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+    {
+        Close();
+        return false;
+    }
+
+    m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close() noexcept
+{
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+        m_data = nullptr;
+    }
+
+    if (m_mapping)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+
+    m_size = 0;
+}
+
+bool MappedFile::GetFileInfo(const char* filename, uint64_t& size, uint64_t& lastWriteTime)
+{
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &info))
+    {
+        return false;
+    }
+
+    size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    lastWriteTime = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+#else
+
+MappedFile::MappedFile() noexcept :
+    m_file(-1),
+    m_data(nullptr),
+    m_size(0)
+{
+}
+
+bool MappedFile::Open(const char* filename)
+{
+    Close();
+
+    m_file = open(filename, O_RDONLY);
+    if (m_file < 0)
+    {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(m_file, &fileStat) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    // mmap rejects zero length mappings, so leave the view empty
+    m_size = static_cast<size_t>(fileStat.st_size);
+    if (m_size == 0)
+    {
+        return true;
+    }
+
+    void* view = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+    if (view == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+
+    madvise(view, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char*>(view);
+    return true;
+}
+
+void MappedFile::Close() noexcept
+{
+    if (m_data)
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+        m_data = nullptr;
+    }
+
+    if (m_file >= 0)
+    {
+        close(m_file);
+        m_file = -1;
+    }
+
+    m_size = 0;
+}
+
+bool MappedFile::GetFileInfo(const char* filename, uint64_t& size, uint64_t& lastWriteTime)
+{
+    struct stat fileStat;
+    if (stat(filename, &fileStat) != 0)
+    {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(fileStat.st_size);
+    lastWriteTime = static_cast<uint64_t>(fileStat.st_mtim.tv_sec) * 1000000000ull + static_cast<uint64_t>(fileStat.st_mtim.tv_nsec);
+    return true;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
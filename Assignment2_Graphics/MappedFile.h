@@ -0,0 +1,43 @@
+//
+// MappedFile.h - Read-only memory mapped view of a file on disk
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace DX
+{
+    // Maps a whole file into the address space so loaders can parse it in place
+    // without copying it through the CRT stream buffers first.
+    class MappedFile
+    {
+    public:
+        MappedFile() noexcept;
+        ~MappedFile();
+
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator= (MappedFile const&) = delete;
+
+        // Returns false if the file can't be opened. An empty file opens with a null data pointer.
+        bool Open(const char* filename);
+        void Close() noexcept;
+
+        const char* GetData() const noexcept { return m_data; }
+        size_t GetSize() const noexcept { return m_size; }
+
+        // Size and last write time of a file, without opening it
+        static bool GetFileInfo(const char* filename, uint64_t& size, uint64_t& lastWriteTime);
+
+    private:
+#ifdef _WIN32
+        HANDLE m_file;
+        HANDLE m_mapping;
+#else
+        int m_file;
+#endif
+        const char* m_data;
+        size_t m_size;
+    };
+}
@@ -0,0 +1,291 @@
+//
+// MeshCache.cpp - Versioned binary mesh cache (.meshbin) written next to each parsed OBJ
+//
+
+#include "pch.h"
+#include "MeshCache.h"
+
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    constexpr uint32_t MeshCacheMagic = 0x4E49424D; // 'MBIN'
+    constexpr uint64_t StreamAlignment = 16;
+
+    inline uint64_t AlignUp(uint64_t value) noexcept
+    {
+        return (value + StreamAlignment - 1) & ~(StreamAlignment - 1);
+    }
+
+    // 64-bit FNV-1a over the source file contents
+    uint64_t HashBytes(const char* data, size_t size) noexcept
+    {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= static_cast<uint8_t>(data[i]);
+            hash *= 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    bool HashFile(const char* filename, uint64_t& hash)
+    {
+        MappedFile file;
+        if (!file.Open(filename))
+        {
+            return false;
+        }
+
+        hash = HashBytes(file.GetData(), file.GetSize());
+        return true;
+    }
+
+    // A changed size always means a stale cache. A changed write time alone (e.g. after a fresh
+    // checkout) only invalidates it if the contents hash differs as well.
+    bool IsUnchanged(const char* filename, uint64_t size, uint64_t writeTime, uint64_t hash)
+    {
+        uint64_t currentSize, currentWriteTime;
+        if (!MappedFile::GetFileInfo(filename, currentSize, currentWriteTime))
+        {
+            return size == MeshCacheDependency::MissingFile;
+        }
+        if (currentSize != size)
+        {
+            return false;
+        }
+
+        uint64_t currentHash;
+        return currentWriteTime == writeTime || (HashFile(filename, currentHash) && currentHash == hash);
+    }
+
+    // Folder of a file, with its trailing separator, that the dependency names are relative to
+    std::string GetDirectory(const char* filename)
+    {
+        std::string directory(filename);
+        size_t separator = directory.find_last_of("/\\");
+        directory.erase(separator == std::string::npos ? 0 : separator + 1);
+        return directory;
+    }
+}
+
+MeshCache::MeshCache() noexcept :
+    m_header(nullptr),
+    m_vertices(nullptr),
+    m_indices(nullptr),
+    m_materials(nullptr),
+    m_subsets(nullptr),
+    m_lods(nullptr),
+    m_meshlets(nullptr),
+    m_meshletVertices(nullptr),
+    m_meshletTriangles(nullptr)
+{
+}
+
+std::string MeshCache::GetCachePath(const char* sourceFile)
+{
+    std::string path(sourceFile);
+    size_t extension = path.find_last_of('.');
+    size_t separator = path.find_last_of("/\\");
+    if (extension != std::string::npos && (separator == std::string::npos || extension > separator))
+    {
+        path.erase(extension);
+    }
+    return path + ".meshbin";
+}
+
+bool MeshCache::Open(const char* sourceFile)
+{
+    Close();
+
+    if (!m_file.Open(GetCachePath(sourceFile).c_str()) || m_file.GetSize() < sizeof(MeshCacheHeader))
+    {
+        Close();
+        return false;
+    }
+
+    const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(m_file.GetData());
+    const uint64_t fileSize = m_file.GetSize();
+    if (header->magic != MeshCacheMagic ||
+        header->version != Version ||
+        header->vertexStride != sizeof(MeshVertex) ||
+        (header->indexStride != sizeof(uint16_t) && header->indexStride != sizeof(uint32_t)) ||
+        header->vertexOffset % StreamAlignment != 0 ||
+        header->indexOffset % StreamAlignment != 0 ||
+        header->materialOffset % StreamAlignment != 0 ||
+        header->subsetOffset % StreamAlignment != 0 ||
+        header->lodOffset % StreamAlignment != 0 ||
+        header->meshletOffset % StreamAlignment != 0 ||
+        header->meshletVertexOffset % StreamAlignment != 0 ||
+        header->meshletTriangleOffset % StreamAlignment != 0 ||
+        header->dependencyOffset % StreamAlignment != 0 ||
+        header->vertexOffset + uint64_t(header->vertexCount) * header->vertexStride > fileSize ||
+        header->indexOffset + uint64_t(header->indexCount) * header->indexStride > fileSize ||
+        header->materialOffset + uint64_t(header->materialCount) * sizeof(MeshMaterial) > fileSize ||
+        header->subsetOffset + uint64_t(header->subsetCount) * sizeof(MeshSubset) > fileSize ||
+        header->lodOffset + uint64_t(header->lodCount) * sizeof(MeshLod) > fileSize ||
+        header->meshletOffset + uint64_t(header->meshletCount) * sizeof(Meshlet) > fileSize ||
+        header->meshletVertexOffset + uint64_t(header->meshletVertexCount) * sizeof(uint32_t) > fileSize ||
+        header->meshletTriangleOffset + header->meshletTriangleCount > fileSize ||
+        header->dependencyOffset + uint64_t(header->dependencyCount) * sizeof(MeshCacheDependency) > fileSize)
+    {
+        Close();
+        return false;
+    }
+
+    // The OBJ and every file it pulled in (its MTL libraries) must be as they were when it was written
+    if (header->sourceSize == MeshCacheDependency::MissingFile ||
+        !IsUnchanged(sourceFile, header->sourceSize, header->sourceWriteTime, header->sourceHash))
+    {
+        Close();
+        return false;
+    }
+    const std::string directory = GetDirectory(sourceFile);
+    const MeshCacheDependency* dependencies = reinterpret_cast<const MeshCacheDependency*>(m_file.GetData() + header->dependencyOffset);
+    for (uint32_t i = 0; i < header->dependencyCount; i++)
+    {
+        const MeshCacheDependency& dependency = dependencies[i];
+        if (std::find(dependency.name, dependency.name + sizeof(dependency.name), '\0') == dependency.name + sizeof(dependency.name) ||
+            !IsUnchanged((directory + dependency.name).c_str(), dependency.size, dependency.writeTime, dependency.hash))
+        {
+            Close();
+            return false;
+        }
+    }
+
+    m_header = header;
+    m_vertices = m_file.GetData() + header->vertexOffset;
+    m_indices = m_file.GetData() + header->indexOffset;
+    m_materials = reinterpret_cast<const MeshMaterial*>(m_file.GetData() + header->materialOffset);
+    m_subsets = reinterpret_cast<const MeshSubset*>(m_file.GetData() + header->subsetOffset);
+    m_lods = reinterpret_cast<const MeshLod*>(m_file.GetData() + header->lodOffset);
+    m_meshlets = reinterpret_cast<const Meshlet*>(m_file.GetData() + header->meshletOffset);
+    m_meshletVertices = reinterpret_cast<const uint32_t*>(m_file.GetData() + header->meshletVertexOffset);
+    m_meshletTriangles = reinterpret_cast<const uint8_t*>(m_file.GetData() + header->meshletTriangleOffset);
+    return true;
+}
+
+void MeshCache::Close() noexcept
+{
+    m_file.Close();
+    m_header = nullptr;
+    m_vertices = nullptr;
+    m_indices = nullptr;
+    m_materials = nullptr;
+    m_subsets = nullptr;
+    m_lods = nullptr;
+    m_meshlets = nullptr;
+    m_meshletVertices = nullptr;
+    m_meshletTriangles = nullptr;
+}
+
+bool MeshCache::Write(const char* sourceFile, const MeshData& mesh, const std::vector<std::string>& dependencies)
+{
+    MeshCacheHeader header = {};
+    header.magic = MeshCacheMagic;
+    header.version = Version;
+    if (!MappedFile::GetFileInfo(sourceFile, header.sourceSize, header.sourceWriteTime) ||
+        !HashFile(sourceFile, header.sourceHash))
+    {
+        return false;
+    }
+
+    // Dependencies that are missing now are recorded too, so the cache goes stale when they appear
+    const std::string directory = GetDirectory(sourceFile);
+    std::vector<MeshCacheDependency> records(dependencies.size());
+    for (size_t i = 0; i < dependencies.size(); i++)
+    {
+        MeshCacheDependency& record = records[i];
+        if (dependencies[i].size() >= sizeof(record.name))
+        {
+            return false;
+        }
+        memset(record.name, 0, sizeof(record.name));
+        memcpy(record.name, dependencies[i].c_str(), dependencies[i].size());
+
+        const std::string path = directory + dependencies[i];
+        if (!MappedFile::GetFileInfo(path.c_str(), record.size, record.writeTime) || !HashFile(path.c_str(), record.hash))
+        {
+            record.size = MeshCacheDependency::MissingFile;
+            record.writeTime = 0;
+            record.hash = 0;
+        }
+    }
+
+    XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+    XMFLOAT3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (const auto& vertex : mesh.vertices)
+    {
+        boundsMin.x = std::min(boundsMin.x, vertex.position.x);
+        boundsMin.y = std::min(boundsMin.y, vertex.position.y);
+        boundsMin.z = std::min(boundsMin.z, vertex.position.z);
+        boundsMax.x = std::max(boundsMax.x, vertex.position.x);
+        boundsMax.y = std::max(boundsMax.y, vertex.position.y);
+        boundsMax.z = std::max(boundsMax.z, vertex.position.z);
+    }
+    header.boundsMin = boundsMin;
+    header.boundsMax = boundsMax;
+
+    header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    header.vertexStride = sizeof(MeshVertex);
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    header.indexStride = static_cast<uint32_t>(mesh.GetIndexStride());
+    header.vertexOffset = AlignUp(sizeof(MeshCacheHeader));
+    header.indexOffset = AlignUp(header.vertexOffset + uint64_t(header.vertexCount) * header.vertexStride);
+    header.materialCount = static_cast<uint32_t>(mesh.materials.size());
+    header.subsetCount = static_cast<uint32_t>(mesh.subsets.size());
+    header.materialOffset = AlignUp(header.indexOffset + uint64_t(header.indexCount) * header.indexStride);
+    header.subsetOffset = header.materialOffset + uint64_t(header.materialCount) * sizeof(MeshMaterial);
+    header.lodCount = static_cast<uint32_t>(mesh.lods.size());
+    header.lodOffset = header.subsetOffset + uint64_t(header.subsetCount) * sizeof(MeshSubset);
+    header.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+    header.meshletVertexCount = static_cast<uint32_t>(mesh.meshletVertices.size());
+    header.meshletTriangleCount = static_cast<uint32_t>(mesh.meshletTriangles.size());
+    header.meshletOffset = header.lodOffset + uint64_t(header.lodCount) * sizeof(MeshLod);
+    header.meshletVertexOffset = header.meshletOffset + uint64_t(header.meshletCount) * sizeof(Meshlet);
+    header.meshletTriangleOffset = AlignUp(header.meshletVertexOffset + uint64_t(header.meshletVertexCount) * sizeof(uint32_t));
+    header.dependencyCount = static_cast<uint32_t>(records.size());
+    header.dependencyOffset = AlignUp(header.meshletTriangleOffset + header.meshletTriangleCount);
+
+    std::ofstream outFile(GetCachePath(sourceFile), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!outFile)
+    {
+        return false;
+    }
+
+    const char padding[StreamAlignment] = {};
+    outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outFile.write(padding, static_cast<std::streamsize>(header.vertexOffset - sizeof(header)));
+    outFile.write(reinterpret_cast<const char*>(mesh.vertices.data()), static_cast<std::streamsize>(mesh.vertices.size() * sizeof(MeshVertex)));
+    outFile.write(padding, static_cast<std::streamsize>(header.indexOffset - (header.vertexOffset + uint64_t(header.vertexCount) * header.vertexStride)));
+
+    if (header.indexStride == sizeof(uint16_t))
+    {
+        std::vector<uint16_t> shortIndices(mesh.indices.begin(), mesh.indices.end());
+        outFile.write(reinterpret_cast<const char*>(shortIndices.data()), static_cast<std::streamsize>(shortIndices.size() * sizeof(uint16_t)));
+    }
+    else
+    {
+        outFile.write(reinterpret_cast<const char*>(mesh.indices.data()), static_cast<std::streamsize>(mesh.indices.size() * sizeof(uint32_t)));
+    }
+
+    // Material, subset, LOD and meshlet records are multiples of 16 bytes, so only the index and
+    // meshlet vertex streams need padding
+    outFile.write(padding, static_cast<std::streamsize>(header.materialOffset - (header.indexOffset + uint64_t(header.indexCount) * header.indexStride)));
+    outFile.write(reinterpret_cast<const char*>(mesh.materials.data()), static_cast<std::streamsize>(mesh.materials.size() * sizeof(MeshMaterial)));
+    outFile.write(reinterpret_cast<const char*>(mesh.subsets.data()), static_cast<std::streamsize>(mesh.subsets.size() * sizeof(MeshSubset)));
+    outFile.write(reinterpret_cast<const char*>(mesh.lods.data()), static_cast<std::streamsize>(mesh.lods.size() * sizeof(MeshLod)));
+    outFile.write(reinterpret_cast<const char*>(mesh.meshlets.data()), static_cast<std::streamsize>(mesh.meshlets.size() * sizeof(Meshlet)));
+    outFile.write(reinterpret_cast<const char*>(mesh.meshletVertices.data()), static_cast<std::streamsize>(mesh.meshletVertices.size() * sizeof(uint32_t)));
+    outFile.write(padding, static_cast<std::streamsize>(header.meshletTriangleOffset - (header.meshletVertexOffset + uint64_t(header.meshletVertexCount) * sizeof(uint32_t))));
+    outFile.write(reinterpret_cast<const char*>(mesh.meshletTriangles.data()), static_cast<std::streamsize>(mesh.meshletTriangles.size()));
+    outFile.write(padding, static_cast<std::streamsize>(header.dependencyOffset - (header.meshletTriangleOffset + header.meshletTriangleCount)));
+    outFile.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(MeshCacheDependency)));
+
+    return static_cast<bool>(outFile);
+}
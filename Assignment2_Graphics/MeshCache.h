@@ -0,0 +1,108 @@
+//
+// MeshCache.h - Versioned binary mesh cache (.meshbin) written next to each parsed OBJ
+//
+
+#pragma once
+
+#include "MappedFile.h"
+#include "MeshData.h"
+
+#include <string>
+#include <vector>
+
+namespace DX
+{
+    // File layout: header, vertex stream, index stream, material table, subset table, LOD table,
+    // meshlet table, meshlet vertex stream, meshlet triangle stream, dependency table. Every stream
+    // starts on a 16 byte boundary so the mapped file can be handed to CreateBuffer without any copying.
+    struct MeshCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceSize;            // Size, write time and content hash of the OBJ this was built from
+        uint64_t sourceWriteTime;
+        uint64_t sourceHash;
+        DirectX::XMFLOAT3 boundsMin;    // Object space AABB of the vertex positions
+        DirectX::XMFLOAT3 boundsMax;
+        uint32_t vertexCount;
+        uint32_t vertexStride;
+        uint32_t indexCount;
+        uint32_t indexStride;           // 2 or 4 bytes
+        uint32_t materialCount;
+        uint32_t subsetCount;
+        uint32_t lodCount;
+        uint32_t meshletCount;
+        uint32_t meshletVertexCount;
+        uint32_t meshletTriangleCount;
+        uint32_t dependencyCount;
+        uint32_t reserved;
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint64_t materialOffset;
+        uint64_t subsetOffset;
+        uint64_t lodOffset;
+        uint64_t meshletOffset;
+        uint64_t meshletVertexOffset;
+        uint64_t meshletTriangleOffset;
+        uint64_t dependencyOffset;
+    };
+
+    static_assert(sizeof(MeshCacheHeader) % 16 == 0, "MeshCacheHeader must keep the streams aligned");
+
+    // Another file the cached mesh was built from, such as an MTL library, checked the same way as
+    // the OBJ itself. The name is relative to the OBJ's folder.
+    struct MeshCacheDependency
+    {
+        static constexpr uint64_t MissingFile = UINT64_MAX;     // Size of a file that didn't exist, the cache is stale once it does
+
+        char name[232];
+        uint64_t size;
+        uint64_t writeTime;
+        uint64_t hash;
+    };
+
+    static_assert(sizeof(MeshCacheDependency) % 16 == 0, "MeshCacheDependency must keep the streams aligned");
+
+    class MeshCache
+    {
+    public:
+        // Bump whenever the file layout or the mesh processing that feeds it changes
+        static constexpr uint32_t Version = 7;
+
+        MeshCache() noexcept;
+
+        // Maps the cache for sourceFile if one exists and is still valid for it and its dependencies.
+        bool Open(const char* sourceFile);
+        void Close() noexcept;
+        bool IsOpen() const noexcept { return m_header != nullptr; }
+
+        // Writes the cache for sourceFile. Indices are stored 16-bit when the mesh allows it.
+        // dependencies name the other files the mesh was built from, relative to sourceFile's folder.
+        static bool Write(const char* sourceFile, const MeshData& mesh, const std::vector<std::string>& dependencies);
+
+        static std::string GetCachePath(const char* sourceFile);
+
+        // Stream pointers point straight into the mapped file and are valid until Close.
+        const void* GetVertices() const noexcept { return m_vertices; }
+        const void* GetIndices() const noexcept { return m_indices; }
+        const MeshMaterial* GetMaterials() const noexcept { return m_materials; }
+        const MeshSubset* GetSubsets() const noexcept { return m_subsets; }
+        const MeshLod* GetLods() const noexcept { return m_lods; }
+        const Meshlet* GetMeshlets() const noexcept { return m_meshlets; }
+        const uint32_t* GetMeshletVertices() const noexcept { return m_meshletVertices; }
+        const uint8_t* GetMeshletTriangles() const noexcept { return m_meshletTriangles; }
+        const MeshCacheHeader& GetHeader() const noexcept { return *m_header; }
+
+    private:
+        MappedFile m_file;
+        const MeshCacheHeader* m_header;
+        const void* m_vertices;
+        const void* m_indices;
+        const MeshMaterial* m_materials;
+        const MeshSubset* m_subsets;
+        const MeshLod* m_lods;
+        const Meshlet* m_meshlets;
+        const uint32_t* m_meshletVertices;
+        const uint8_t* m_meshletTriangles;
+    };
+}
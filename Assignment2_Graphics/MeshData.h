@@ -0,0 +1,106 @@
+//
+// MeshData.h - CPU side indexed triangle mesh shared by the mesh loading and processing code
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace DX
+{
+    // Matches ModelClass::VertexType and the light_vs input layout (position, texcoord, normal)
+    struct MeshVertex
+    {
+        DirectX::XMFLOAT3 position;
+        DirectX::XMFLOAT2 texture;
+        DirectX::XMFLOAT3 normal;
+    };
+
+    static_assert(sizeof(MeshVertex) == 32, "MeshVertex must match the GPU vertex layout");
+
+    // Surface properties read from an MTL file. Plain data so it can be stored in the mesh cache as is.
+    struct MeshMaterial
+    {
+        char name[64];
+        DirectX::XMFLOAT3 ambient;      // Ka
+        DirectX::XMFLOAT3 diffuse;      // Kd
+        DirectX::XMFLOAT3 specular;     // Ks
+        float specularPower;            // Ns
+        float opacity;                  // d
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(MeshMaterial) % 16 == 0, "MeshMaterial must keep the cache streams aligned");
+
+    // Contiguous range of the index buffer drawn with a single material
+    struct MeshSubset
+    {
+        uint32_t materialIndex;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(MeshSubset) % 16 == 0, "MeshSubset must keep the cache streams aligned");
+
+    // One level of detail: a run of subsets and its geometric error against the full detail mesh
+    struct MeshLod
+    {
+        uint32_t firstSubset;
+        uint32_t subsetCount;
+        float error;                    // Object space units
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(MeshLod) % 16 == 0, "MeshLod must keep the cache streams aligned");
+
+    // Small cluster of the full detail triangles, culled as a unit. Triangles index the cluster's
+    // own vertex list, which in turn indexes the mesh vertices.
+    struct Meshlet
+    {
+        uint32_t vertexOffset;          // Into MeshData::meshletVertices
+        uint32_t triangleOffset;        // Into MeshData::meshletTriangles, 3 local indices per triangle
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+        DirectX::XMFLOAT3 center;       // Object space bounding sphere
+        float radius;
+        DirectX::XMFLOAT3 coneAxis;     // Average front face direction
+        float coneCutoff;               // Sine of the cone half angle, 1 if the cluster can't be backface culled
+        uint32_t materialIndex;
+        uint32_t reserved[3];
+    };
+
+    static_assert(sizeof(Meshlet) % 16 == 0, "Meshlet must keep the cache streams aligned");
+
+    // Indexed triangle list, with triangles grouped into one subset per material. Coarser levels of
+    // detail share the vertices and append their own subsets; without lods every subset is level 0.
+    struct MeshData
+    {
+        std::vector<MeshVertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<MeshMaterial> materials;
+        std::vector<MeshSubset> subsets;
+        std::vector<MeshLod> lods;
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> meshletVertices;
+        std::vector<uint8_t> meshletTriangles;
+
+        void Clear() noexcept
+        {
+            vertices.clear();
+            indices.clear();
+            materials.clear();
+            subsets.clear();
+            lods.clear();
+            meshlets.clear();
+            meshletVertices.clear();
+            meshletTriangles.clear();
+        }
+
+        // Meshes with fewer than 65,536 vertices get a 16-bit index buffer
+        bool Uses16BitIndices() const noexcept { return vertices.size() < 0x10000; }
+        size_t GetIndexStride() const noexcept { return Uses16BitIndices() ? sizeof(uint16_t) : sizeof(uint32_t); }
+        size_t GetByteSize() const noexcept { return vertices.size() * sizeof(MeshVertex) + indices.size() * GetIndexStride(); }
+    };
+}
@@ -0,0 +1,336 @@
+//
+// MeshOptimizer.cpp - Triangle and vertex reordering for post-transform cache, overdraw and fetch locality
+//
+
+#include "pch.h"
+#include "MeshOptimizer.h"
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    constexpr uint32_t InvalidIndex = 0xFFFFFFFFu;
+
+    // Triangles that use each vertex, stored as one flat array with per-vertex offsets
+    struct TriangleAdjacency
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> counts;
+        std::vector<uint32_t> triangles;
+
+        void Build(const std::vector<uint32_t>& indices, size_t vertexCount)
+        {
+            counts.assign(vertexCount, 0);
+            for (uint32_t index : indices)
+                counts[index]++;
+
+            offsets.resize(vertexCount + 1);
+            offsets[0] = 0;
+            for (size_t v = 0; v < vertexCount; v++)
+                offsets[v + 1] = offsets[v] + counts[v];
+
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            triangles.resize(indices.size());
+            for (size_t i = 0; i < indices.size(); i++)
+                triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    };
+
+    // Next fanning vertex when the candidates are exhausted: most recent dead-end, else the next live vertex in order
+    uint32_t SkipDeadEnd(std::vector<uint32_t>& deadEnds, const std::vector<uint32_t>& liveTriangles, size_t& cursor)
+    {
+        while (!deadEnds.empty())
+        {
+            uint32_t vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[vertex] > 0)
+                return vertex;
+        }
+
+        while (cursor < liveTriangles.size())
+        {
+            if (liveTriangles[cursor] > 0)
+                return static_cast<uint32_t>(cursor);
+            cursor++;
+        }
+
+        return InvalidIndex;
+    }
+
+    // Sorting key and triangle range of one overdraw cluster
+    struct Cluster
+    {
+        size_t firstTriangle;
+        size_t triangleCount;
+        float sortKey;
+    };
+}
+
+void MeshOptimizer::Optimize(MeshData& mesh, unsigned int cacheSize)
+{
+    // Triangles are only reordered within their subset so the material draw ranges stay intact
+    std::vector<MeshSubset> ranges(mesh.subsets);
+    if (ranges.empty())
+    {
+        ranges.push_back({ 0, 0, static_cast<uint32_t>(mesh.indices.size()), 0 });
+    }
+
+    std::vector<uint32_t> indices;
+    for (const auto& range : ranges)
+    {
+        indices.assign(mesh.indices.begin() + range.firstIndex, mesh.indices.begin() + range.firstIndex + range.indexCount);
+
+        // Tipsify is a greedy heuristic, so keep the original order if it happened to be better already
+        std::vector<uint32_t> original(indices);
+        float originalAcmr = AnalyzeVertexCache(indices, mesh.vertices.size(), cacheSize).acmr;
+        OptimizeVertexCache(indices, mesh.vertices.size(), cacheSize);
+        if (AnalyzeVertexCache(indices, mesh.vertices.size(), cacheSize).acmr > originalAcmr)
+        {
+            indices.swap(original);
+        }
+
+        OptimizeOverdraw(indices, mesh.vertices, 1.05f, cacheSize);
+        std::copy(indices.begin(), indices.end(), mesh.indices.begin() + range.firstIndex);
+    }
+
+    OptimizeVertexFetch(mesh);
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || vertexCount == 0)
+    {
+        return;
+    }
+
+    TriangleAdjacency adjacency;
+    adjacency.Build(indices, vertexCount);
+
+    std::vector<uint32_t> liveTriangles(adjacency.counts);
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    deadEnds.reserve(indices.size());
+
+    uint32_t timeStamp = cacheSize + 1;
+    size_t cursor = 0;
+    uint32_t fanVertex = 0;
+    while (liveTriangles[fanVertex] == 0 && fanVertex + 1 < vertexCount)
+        fanVertex++;
+
+    while (fanVertex != InvalidIndex)
+    {
+        candidates.clear();
+
+        // Emit every remaining triangle around the fanning vertex
+        for (uint32_t i = adjacency.offsets[fanVertex]; i < adjacency.offsets[fanVertex + 1]; i++)
+        {
+            uint32_t triangle = adjacency.triangles[i];
+            if (emitted[triangle])
+                continue;
+
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint32_t vertex = indices[triangle * 3 + corner];
+                output.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveTriangles[vertex]--;
+                if (timeStamp - cacheTime[vertex] > cacheSize)
+                {
+                    cacheTime[vertex] = timeStamp++;
+                }
+            }
+            emitted[triangle] = true;
+        }
+
+        // Pick the candidate that will still be in the cache once its remaining triangles are emitted,
+        // preferring the one that entered the cache earliest
+        uint32_t best = InvalidIndex;
+        int bestPriority = -1;
+        for (uint32_t vertex : candidates)
+        {
+            if (liveTriangles[vertex] == 0)
+                continue;
+
+            int priority = 0;
+            if (timeStamp - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+            {
+                priority = static_cast<int>(timeStamp - cacheTime[vertex]);
+            }
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                best = vertex;
+            }
+        }
+
+        fanVertex = (best != InvalidIndex) ? best : SkipDeadEnd(deadEnds, liveTriangles, cursor);
+    }
+
+    indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices, float threshold, unsigned int cacheSize)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+    {
+        return;
+    }
+
+    // Hard boundaries: triangles where every vertex misses the cache already start from scratch,
+    // so cutting there costs nothing
+    std::vector<uint32_t> cacheTime(vertices.size(), 0);
+    std::vector<uint32_t> missesBefore(triangleCount + 1, 0);
+    std::vector<size_t> hardBoundaries;
+    uint32_t timeStamp = cacheSize + 1;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        uint32_t misses = 0;
+        for (int corner = 0; corner < 3; corner++)
+        {
+            uint32_t vertex = indices[t * 3 + corner];
+            if (timeStamp - cacheTime[vertex] > cacheSize)
+            {
+                cacheTime[vertex] = timeStamp++;
+                misses++;
+            }
+        }
+        if (misses == 3 || t == 0)
+        {
+            hardBoundaries.push_back(t);
+        }
+        missesBefore[t + 1] = missesBefore[t] + misses;
+    }
+    hardBoundaries.push_back(triangleCount);
+
+    // Soft boundaries: split a hard cluster further wherever its running ACMR is within threshold
+    // of the whole cluster's ACMR
+    std::vector<Cluster> clusters;
+    for (size_t h = 0; h + 1 < hardBoundaries.size(); h++)
+    {
+        size_t begin = hardBoundaries[h];
+        size_t end = hardBoundaries[h + 1];
+        float clusterAcmr = float(missesBefore[end] - missesBefore[begin]) / float(end - begin);
+
+        size_t start = begin;
+        for (size_t t = begin; t < end; t++)
+        {
+            float runningAcmr = float(missesBefore[t + 1] - missesBefore[start]) / float(t + 1 - start);
+            if (t + 1 == end || (runningAcmr <= clusterAcmr * threshold && (t + 1 - start) >= 8))
+            {
+                clusters.push_back({ start, t + 1 - start, 0.f });
+                start = t + 1;
+            }
+        }
+    }
+
+    if (clusters.size() < 2)
+    {
+        return;
+    }
+
+    // Mesh centroid, then each cluster's area weighted centroid and normal
+    XMVECTOR meshCenter = XMVectorZero();
+    for (const auto& vertex : vertices)
+        meshCenter = XMVectorAdd(meshCenter, XMLoadFloat3(&vertex.position));
+    meshCenter = XMVectorScale(meshCenter, 1.f / float(vertices.size()));
+
+    for (auto& cluster : clusters)
+    {
+        XMVECTOR centroid = XMVectorZero();
+        XMVECTOR normal = XMVectorZero();
+        float area = 0.f;
+        for (size_t t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; t++)
+        {
+            XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t * 3 + 0]].position);
+            XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t * 3 + 1]].position);
+            XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t * 3 + 2]].position);
+
+            // Cross product length is twice the triangle area, so it doubles as the weight
+            XMVECTOR cross = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+            float weight = XMVectorGetX(XMVector3Length(cross));
+            centroid = XMVectorAdd(centroid, XMVectorScale(XMVectorAdd(XMVectorAdd(p0, p1), p2), weight / 3.f));
+            normal = XMVectorAdd(normal, cross);
+            area += weight;
+        }
+
+        if (area > 0.f)
+        {
+            centroid = XMVectorScale(centroid, 1.f / area);
+            normal = XMVector3Normalize(normal);
+            cluster.sortKey = XMVectorGetX(XMVector3Dot(XMVectorSubtract(centroid, meshCenter), normal));
+        }
+    }
+
+    // Clusters facing away from the centre occlude the rest, so they go first
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b)
+        {
+            return a.sortKey > b.sortKey;
+        });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (const auto& cluster : clusters)
+    {
+        output.insert(output.end(), indices.begin() + cluster.firstTriangle * 3,
+            indices.begin() + (cluster.firstTriangle + cluster.triangleCount) * 3);
+    }
+    indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(MeshData& mesh)
+{
+    std::vector<uint32_t> remap(mesh.vertices.size(), InvalidIndex);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    for (auto& index : mesh.indices)
+    {
+        if (remap[index] == InvalidIndex)
+        {
+            remap[index] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    mesh.vertices.swap(vertices);
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+    VertexCacheStats stats = { 0.f, 0.f };
+    if (indices.empty() || vertexCount == 0)
+    {
+        return stats;
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    uint32_t timeStamp = cacheSize + 1;
+    size_t misses = 0, uniqueVertices = 0;
+    for (uint32_t index : indices)
+    {
+        if (timeStamp - cacheTime[index] > cacheSize)
+        {
+            cacheTime[index] = timeStamp++;
+            misses++;
+        }
+        if (!used[index])
+        {
+            used[index] = true;
+            uniqueVertices++;
+        }
+    }
+
+    stats.acmr = float(misses) / float(indices.size() / 3);
+    stats.atvr = float(misses) / float(uniqueVertices);
+    return stats;
+}
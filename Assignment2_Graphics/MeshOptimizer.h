@@ -0,0 +1,39 @@
+//
+// MeshOptimizer.h - Triangle and vertex reordering for post-transform cache, overdraw and fetch locality
+//
+
+#pragma once
+
+#include "MeshData.h"
+
+namespace DX
+{
+    // Post-transform cache efficiency of an index buffer under a FIFO cache model
+    struct VertexCacheStats
+    {
+        float acmr;     // Average cache miss ratio: transformed vertices per triangle (0.5 - 3.0)
+        float atvr;     // Average transform to vertex ratio: transformed vertices per unique vertex (1.0 is ideal)
+    };
+
+    class MeshOptimizer
+    {
+    public:
+        static constexpr unsigned int DefaultCacheSize = 16;
+
+        // Runs the cache and overdraw passes on each subset, then the fetch pass on the whole mesh
+        static void Optimize(MeshData& mesh, unsigned int cacheSize = DefaultCacheSize);
+
+        // Reorders triangles for vertex cache locality (Tipsify, Sander et al. 2007)
+        static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize = DefaultCacheSize);
+
+        // Splits a cache optimized index buffer into clusters and sorts them so outward facing
+        // clusters draw first. threshold bounds the allowed ACMR increase (1.05 = 5% worse).
+        static void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices,
+            float threshold = 1.05f, unsigned int cacheSize = DefaultCacheSize);
+
+        // Reorders vertices into first use order and drops vertices nothing references
+        static void OptimizeVertexFetch(MeshData& mesh);
+
+        static VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize = DefaultCacheSize);
+    };
+}
@@ -0,0 +1,126 @@
+//
+// MeshQuantizer.cpp - Compact 16 byte vertex format and its CPU encode/decode routines
+//
+
+#include "pch.h"
+#include "MeshQuantizer.h"
+
+#include <cfloat>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+using namespace DX;
+
+namespace
+{
+    // +1 for components >= 0, -1 otherwise
+    inline XMVECTOR XM_CALLCONV SignNotZero(FXMVECTOR v) noexcept
+    {
+        return XMVectorSelect(XMVectorNegate(XMVectorSplatOne()), XMVectorSplatOne(), XMVectorGreaterOrEqual(v, XMVectorZero()));
+    }
+}
+
+QuantizationParams MeshQuantizer::ComputeParams(const MeshVertex* vertices, size_t count) noexcept
+{
+    XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+    for (size_t i = 0; i < count; i++)
+    {
+        XMVECTOR position = XMLoadFloat3(&vertices[i].position);
+        boundsMin = XMVectorMin(boundsMin, position);
+        boundsMax = XMVectorMax(boundsMax, position);
+    }
+    if (count == 0)
+    {
+        boundsMin = boundsMax = XMVectorZero();
+    }
+
+    QuantizationParams params = {};
+    XMStoreFloat3(&params.positionScale, XMVectorSubtract(boundsMax, boundsMin));
+    XMStoreFloat3(&params.positionOffset, boundsMin);
+    return params;
+}
+
+void MeshQuantizer::Encode(const MeshVertex* vertices, size_t count, const QuantizationParams& params, QuantizedVertex* output) noexcept
+{
+    // Flat axes have a zero scale; everything on them encodes to 0
+    XMVECTOR scale = XMLoadFloat3(&params.positionScale);
+    XMVECTOR invScale = XMVectorSelect(XMVectorZero(), XMVectorReciprocal(scale), XMVectorGreater(scale, XMVectorZero()));
+    XMVECTOR offset = XMLoadFloat3(&params.positionOffset);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        XMVECTOR position = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&vertices[i].position), offset), invScale);
+        XMStoreUShortN4(&output[i].position, XMVectorSaturate(position));
+        XMStoreShortN2(&output[i].normal, EncodeOctahedral(XMLoadFloat3(&vertices[i].normal)));
+        XMStoreHalf2(&output[i].texture, XMLoadFloat2(&vertices[i].texture));
+    }
+}
+
+void MeshQuantizer::Decode(const QuantizedVertex* vertices, size_t count, const QuantizationParams& params, MeshVertex* output) noexcept
+{
+    XMVECTOR scale = XMLoadFloat3(&params.positionScale);
+    XMVECTOR offset = XMLoadFloat3(&params.positionOffset);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        XMStoreFloat3(&output[i].position, XMVectorMultiplyAdd(XMLoadUShortN4(&vertices[i].position), scale, offset));
+        XMStoreFloat3(&output[i].normal, DecodeOctahedral(XMLoadShortN2(&vertices[i].normal)));
+        XMStoreFloat2(&output[i].texture, XMLoadHalf2(&vertices[i].texture));
+    }
+}
+
+QuantizationStats MeshQuantizer::Measure(const MeshVertex* original, const QuantizedVertex* quantized, size_t count,
+    const QuantizationParams& params) noexcept
+{
+    QuantizationStats stats = { 0.f, 0.f, 0.f };
+    float maxNormalAngle = 0.f;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        MeshVertex decoded;
+        Decode(&quantized[i], 1, params, &decoded);
+
+        XMVECTOR positionError = XMVector3Length(XMVectorSubtract(XMLoadFloat3(&decoded.position), XMLoadFloat3(&original[i].position)));
+        XMVECTOR texCoordError = XMVector2Length(XMVectorSubtract(XMLoadFloat2(&decoded.texture), XMLoadFloat2(&original[i].texture)));
+        stats.maxPositionError = std::max(stats.maxPositionError, XMVectorGetX(positionError));
+        stats.maxTexCoordError = std::max(stats.maxTexCoordError, XMVectorGetX(texCoordError));
+
+        // Only compare directions, a source normal that isn't unit length is still encoded as unit length.
+        // The angle comes from both its sine and cosine, acos of a float cosine can't tell angles
+        // below 0.02 degrees apart.
+        XMVECTOR sourceNormal = XMVector3Normalize(XMLoadFloat3(&original[i].normal));
+        XMVECTOR decodedNormal = XMLoadFloat3(&decoded.normal);
+        float sine = XMVectorGetX(XMVector3Length(XMVector3Cross(decodedNormal, sourceNormal)));
+        float cosine = XMVectorGetX(XMVector3Dot(decodedNormal, sourceNormal));
+        maxNormalAngle = std::max(maxNormalAngle, std::atan2(sine, cosine));
+    }
+
+    stats.maxNormalError = XMConvertToDegrees(maxNormalAngle);
+    return stats;
+}
+
+XMVECTOR XM_CALLCONV MeshQuantizer::EncodeOctahedral(FXMVECTOR normal) noexcept
+{
+    // Project onto the octahedron |x| + |y| + |z| = 1, a zero normal encodes to the origin.
+    // Both hemispheres are worked out and selected by mask, so there's no branch to mispredict.
+    XMVECTOR l1 = XMVector3Dot(XMVectorAbs(normal), XMVectorSplatOne());
+    XMVECTOR p = XMVectorSelect(XMVectorZero(), XMVectorDivide(normal, l1), XMVectorGreater(l1, XMVectorZero()));
+
+    // Fold the lower hemisphere over the diagonals
+    XMVECTOR swapped = XMVectorSwizzle<1, 0, 2, 3>(XMVectorAbs(p));
+    XMVECTOR folded = XMVectorMultiply(XMVectorSubtract(XMVectorSplatOne(), swapped), SignNotZero(p));
+    return XMVectorSelect(p, folded, XMVectorLess(XMVectorSplatZ(p), XMVectorZero()));
+}
+
+XMVECTOR XM_CALLCONV MeshQuantizer::DecodeOctahedral(FXMVECTOR encoded) noexcept
+{
+    // z = 1 - |x| - |y|, then unfold the lower hemisphere (Cigolle et al. 2014), all in vector lanes
+    XMVECTOR absEncoded = XMVectorAbs(encoded);
+    XMVECTOR z = XMVectorSubtract(XMVectorSubtract(XMVectorSplatOne(), XMVectorSplatX(absEncoded)), XMVectorSplatY(absEncoded));
+    XMVECTOR n = XMVectorSelect(z, encoded, g_XMSelect1100);
+
+    XMVECTOR t = XMVectorMax(XMVectorNegate(z), XMVectorZero());
+    n = XMVectorSubtract(n, XMVectorMultiply(t, XMVectorSelect(XMVectorZero(), SignNotZero(encoded), g_XMSelect1100)));
+    return XMVector3Normalize(XMVectorSelect(XMVectorZero(), n, g_XMSelect1110));
+}
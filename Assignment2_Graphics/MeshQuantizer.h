@@ -0,0 +1,65 @@
+//
+// MeshQuantizer.h - Compact 16 byte vertex format and its CPU encode/decode routines
+//
+
+#pragma once
+
+#include "MeshData.h"
+
+#include <DirectXPackedVector.h>
+
+namespace DX
+{
+    // Vertex layouts ModelClass can upload and Shader::InitStandard can describe
+    enum class VertexFormat
+    {
+        Standard,   // MeshVertex, 32 bytes of floats
+        Quantized   // QuantizedVertex, 16 bytes
+    };
+
+    // Position: 16-bit UNORM within the mesh AABB (w unused). Normal: octahedral 2 x 16-bit SNORM.
+    // Texture: half floats. Matches the light_quantized_vs input layout.
+    struct QuantizedVertex
+    {
+        DirectX::PackedVector::XMUSHORTN4 position;
+        DirectX::PackedVector::XMSHORTN2 normal;
+        DirectX::PackedVector::XMHALF2 texture;
+    };
+
+    static_assert(sizeof(QuantizedVertex) == 16, "QuantizedVertex must match the quantized GPU vertex layout");
+
+    // Position decode constants, laid out as the QuantizationBuffer cbuffer in light_quantized_vs:
+    // position = unorm * positionScale + positionOffset
+    struct QuantizationParams
+    {
+        DirectX::XMFLOAT3 positionScale;
+        float padding0;
+        DirectX::XMFLOAT3 positionOffset;
+        float padding1;
+    };
+
+    // Largest round trip error over a mesh, for judging whether a model quantizes acceptably
+    struct QuantizationStats
+    {
+        float maxPositionError;     // Object space units
+        float maxNormalError;       // Degrees
+        float maxTexCoordError;     // Texture space units
+    };
+
+    class MeshQuantizer
+    {
+    public:
+        // Decode constants covering the AABB of the given vertices
+        static QuantizationParams ComputeParams(const MeshVertex* vertices, size_t count) noexcept;
+
+        static void Encode(const MeshVertex* vertices, size_t count, const QuantizationParams& params, QuantizedVertex* output) noexcept;
+        static void Decode(const QuantizedVertex* vertices, size_t count, const QuantizationParams& params, MeshVertex* output) noexcept;
+
+        static QuantizationStats Measure(const MeshVertex* original, const QuantizedVertex* quantized, size_t count,
+            const QuantizationParams& params) noexcept;
+
+        // Unit vector to the [-1, 1]^2 octahedral square (x, y) and back
+        static DirectX::XMVECTOR XM_CALLCONV EncodeOctahedral(DirectX::FXMVECTOR normal) noexcept;
+        static DirectX::XMVECTOR XM_CALLCONV DecodeOctahedral(DirectX::FXMVECTOR encoded) noexcept;
+    };
+}
@@ -0,0 +1,471 @@
+//
+// MeshSimplifier.cpp - Quadric error edge collapse simplification and LOD chain generation
+//
+
+#include "pch.h"
+#include "MeshSimplifier.h"
+
+#include <cstring>
+#include <unordered_map>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    constexpr uint32_t InvalidIndex = 0xFFFFFFFFu;
+
+    // Symmetric 4x4 matrix of summed squared distances to unit planes. With unweighted planes the
+    // square root of the sum bounds the distance to every plane that was merged in.
+    struct Quadric
+    {
+        double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+
+        void AddPlane(double nx, double ny, double nz, double d) noexcept
+        {
+            a00 += nx * nx; a01 += nx * ny; a02 += nx * nz; a03 += nx * d;
+            a11 += ny * ny; a12 += ny * nz; a13 += ny * d;
+            a22 += nz * nz; a23 += nz * d;
+            a33 += d * d;
+        }
+
+        void Add(const Quadric& q) noexcept
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+            a11 += q.a11; a12 += q.a12; a13 += q.a13;
+            a22 += q.a22; a23 += q.a23;
+            a33 += q.a33;
+        }
+
+        double Evaluate(const XMFLOAT3& p) const noexcept
+        {
+            const double x = p.x, y = p.y, z = p.z;
+            double result = a00 * x * x + a11 * y * y + a22 * z * z + a33
+                + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z + a03 * x + a13 * y + a23 * z);
+            return std::max(result, 0.0);
+        }
+    };
+
+    struct PositionKey
+    {
+        uint32_t x, y, z;
+
+        bool operator==(const PositionKey& other) const noexcept
+        {
+            return x == other.x && y == other.y && z == other.z;
+        }
+    };
+
+    struct PositionHash
+    {
+        size_t operator()(const PositionKey& key) const noexcept
+        {
+            return (key.x * 73856093u) ^ (key.y * 19349663u) ^ (key.z * 83492791u);
+        }
+    };
+
+    inline uint64_t EdgeKey(uint32_t a, uint32_t b) noexcept
+    {
+        return (static_cast<uint64_t>(a) << 32) | b;
+    }
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        float error;
+    };
+
+    // Everything a pass needs to know about the current triangles, at position granularity
+    struct Topology
+    {
+        std::vector<uint32_t> offsets;          // Triangles around each position
+        std::vector<uint32_t> triangles;
+        std::unordered_map<uint64_t, uint32_t> edges;   // Directed position edges and how often they occur
+        std::vector<uint8_t> borderEdges;               // Open edges touching each position, 255 if non-manifold
+
+        void Build(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& position)
+        {
+            const size_t vertexCount = position.size();
+            offsets.assign(vertexCount + 1, 0);
+            for (uint32_t index : indices)
+                offsets[position[index] + 1]++;
+            for (size_t v = 0; v < vertexCount; v++)
+                offsets[v + 1] += offsets[v];
+
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            triangles.resize(indices.size());
+            for (size_t i = 0; i < indices.size(); i++)
+                triangles[fill[position[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+
+            edges.clear();
+            edges.reserve(indices.size());
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                for (int k = 0; k < 3; k++)
+                    edges[EdgeKey(position[indices[i + k]], position[indices[i + (k + 1) % 3]])]++;
+            }
+
+            // An edge used twice in one direction joins more than two triangles (two sided panels do
+            // this), such vertices are treated like complex borders and never move
+            borderEdges.assign(vertexCount, 0);
+            for (const auto& edge : edges)
+            {
+                uint32_t a = static_cast<uint32_t>(edge.first >> 32);
+                uint32_t b = static_cast<uint32_t>(edge.first & 0xFFFFFFFFu);
+                if (edge.second > 1)
+                {
+                    borderEdges[a] = borderEdges[b] = 255;
+                }
+                else if (!IsEdge(b, a))
+                {
+                    borderEdges[a] = static_cast<uint8_t>(std::min(borderEdges[a] + 1, 255));
+                    borderEdges[b] = static_cast<uint8_t>(std::min(borderEdges[b] + 1, 255));
+                }
+            }
+        }
+
+        bool IsEdge(uint32_t a, uint32_t b) const
+        {
+            return edges.find(EdgeKey(a, b)) != edges.end();
+        }
+
+        bool IsBorderEdge(uint32_t a, uint32_t b) const
+        {
+            return IsEdge(a, b) != IsEdge(b, a);
+        }
+    };
+
+    inline XMVECTOR XM_CALLCONV TriangleNormal(FXMVECTOR p0, FXMVECTOR p1, FXMVECTOR p2) noexcept
+    {
+        return XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+    }
+
+    // Checks that collapsing position from onto position to keeps the mesh manifold, keeps borders and
+    // seams in place and flips no triangle. wedgeMap receives the target vertex for every vertex at from.
+    bool CanCollapse(uint32_t from, uint32_t to, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& position,
+        const std::vector<MeshVertex>& vertices, const Topology& topology, std::vector<std::pair<uint32_t, uint32_t>>& wedgeMap)
+    {
+        // Border vertices only slide along their (simple) border
+        if (topology.borderEdges[from] > 0 && (topology.borderEdges[from] != 2 || !topology.IsBorderEdge(from, to)))
+        {
+            return false;
+        }
+
+        // Link condition: the only neighbours from and to share are the apexes of the triangles on their edge
+        size_t sharedTriangles = 0;
+        std::vector<uint32_t> fromRing, toRing;
+        for (uint32_t i = topology.offsets[from]; i < topology.offsets[from + 1]; i++)
+        {
+            const uint32_t* triangle = &indices[topology.triangles[i] * 3];
+            bool hasTo = false;
+            for (int k = 0; k < 3; k++)
+            {
+                fromRing.push_back(position[triangle[k]]);
+                hasTo |= position[triangle[k]] == to;
+            }
+            sharedTriangles += hasTo ? 1 : 0;
+        }
+        for (uint32_t i = topology.offsets[to]; i < topology.offsets[to + 1]; i++)
+        {
+            const uint32_t* triangle = &indices[topology.triangles[i] * 3];
+            for (int k = 0; k < 3; k++)
+                toRing.push_back(position[triangle[k]]);
+        }
+        std::sort(fromRing.begin(), fromRing.end());
+        fromRing.erase(std::unique(fromRing.begin(), fromRing.end()), fromRing.end());
+        std::sort(toRing.begin(), toRing.end());
+        toRing.erase(std::unique(toRing.begin(), toRing.end()), toRing.end());
+
+        size_t sharedNeighbours = 0;
+        for (uint32_t neighbour : fromRing)
+        {
+            if (neighbour != from && neighbour != to && std::binary_search(toRing.begin(), toRing.end(), neighbour))
+                sharedNeighbours++;
+        }
+        if (sharedTriangles == 0 || sharedNeighbours > sharedTriangles)
+        {
+            return false;
+        }
+
+        // Every vertex at from has to continue into exactly one vertex at to across a shared triangle,
+        // otherwise the collapse would drag an attribute seam across the surface
+        wedgeMap.clear();
+        XMVECTOR target = XMLoadFloat3(&vertices[to].position);
+        for (uint32_t i = topology.offsets[from]; i < topology.offsets[from + 1]; i++)
+        {
+            const uint32_t* triangle = &indices[topology.triangles[i] * 3];
+            uint32_t fromVertex = InvalidIndex, toVertex = InvalidIndex;
+            for (int k = 0; k < 3; k++)
+            {
+                if (position[triangle[k]] == from)
+                    fromVertex = triangle[k];
+                else if (position[triangle[k]] == to)
+                    toVertex = triangle[k];
+            }
+
+            auto mapped = std::find_if(wedgeMap.begin(), wedgeMap.end(),
+                [fromVertex](const std::pair<uint32_t, uint32_t>& entry) { return entry.first == fromVertex; });
+            if (mapped == wedgeMap.end())
+            {
+                wedgeMap.emplace_back(fromVertex, toVertex);
+            }
+            else if (toVertex != InvalidIndex)
+            {
+                if (mapped->second != InvalidIndex && mapped->second != toVertex)
+                    return false;
+                mapped->second = toVertex;
+            }
+
+            // Triangles that survive the collapse must not flip over
+            if (toVertex == InvalidIndex)
+            {
+                XMVECTOR p[3], moved[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = XMLoadFloat3(&vertices[triangle[k]].position);
+                    moved[k] = (position[triangle[k]] == from) ? target : p[k];
+                }
+                XMVECTOR before = TriangleNormal(p[0], p[1], p[2]);
+                XMVECTOR after = TriangleNormal(moved[0], moved[1], moved[2]);
+                if (XMVectorGetX(XMVector3Dot(before, after)) <= 0.f)
+                    return false;
+            }
+        }
+
+        for (const auto& entry : wedgeMap)
+        {
+            if (entry.second == InvalidIndex)
+                return false;
+        }
+        return true;
+    }
+}
+
+size_t MeshSimplifier::Simplify(const std::vector<MeshVertex>& vertices, const uint32_t* indices, size_t indexCount,
+    size_t targetIndexCount, float maxError, std::vector<uint32_t>& output, float* error)
+{
+    output.assign(indices, indices + indexCount);
+    float resultError = 0.f;
+    const size_t vertexCount = vertices.size();
+
+    // Vertices split by UV or normal seams share a position; topology and quadrics work on positions
+    std::vector<uint32_t> position(vertexCount);
+    std::unordered_map<PositionKey, uint32_t, PositionHash> positions;
+    positions.reserve(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        PositionKey key;
+        std::memcpy(&key, &vertices[v].position, sizeof(key));
+        position[v] = positions.emplace(key, static_cast<uint32_t>(v)).first->second;
+    }
+
+    // Plane quadrics of the input triangles
+    std::vector<Quadric> quadrics(vertexCount, Quadric());
+    for (size_t i = 0; i + 2 < output.size(); i += 3)
+    {
+        XMVECTOR p0 = XMLoadFloat3(&vertices[output[i + 0]].position);
+        XMVECTOR p1 = XMLoadFloat3(&vertices[output[i + 1]].position);
+        XMVECTOR p2 = XMLoadFloat3(&vertices[output[i + 2]].position);
+        XMVECTOR normal = TriangleNormal(p0, p1, p2);
+        float length = XMVectorGetX(XMVector3Length(normal));
+        if (length <= 0.f)
+            continue;
+
+        XMFLOAT3 n;
+        XMStoreFloat3(&n, XMVectorScale(normal, 1.f / length));
+        double d = -XMVectorGetX(XMVector3Dot(XMLoadFloat3(&n), p0));
+        for (int k = 0; k < 3; k++)
+            quadrics[position[output[i + k]]].AddPlane(n.x, n.y, n.z, d);
+    }
+
+    // Open borders get an extra plane through each border edge, perpendicular to its triangle, so
+    // sliding a border vertex along a curved border is penalised
+    Topology topology;
+    topology.Build(output, position);
+    for (size_t i = 0; i + 2 < output.size(); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = position[output[i + k]];
+            uint32_t b = position[output[i + (k + 1) % 3]];
+            if (topology.IsEdge(b, a))
+                continue;
+
+            XMVECTOR p0 = XMLoadFloat3(&vertices[a].position);
+            XMVECTOR p1 = XMLoadFloat3(&vertices[b].position);
+            XMVECTOR p2 = XMLoadFloat3(&vertices[output[i + (k + 2) % 3]].position);
+            XMVECTOR edge = XMVectorSubtract(p1, p0);
+            XMVECTOR normal = XMVector3Normalize(XMVector3Cross(edge, TriangleNormal(p0, p1, p2)));
+            XMFLOAT3 n;
+            XMStoreFloat3(&n, normal);
+            double d = -XMVectorGetX(XMVector3Dot(normal, p0));
+            quadrics[a].AddPlane(n.x, n.y, n.z, d);
+            quadrics[b].AddPlane(n.x, n.y, n.z, d);
+        }
+    }
+
+    std::vector<Collapse> candidates;
+    std::vector<uint8_t> locked(vertexCount);
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<std::pair<uint32_t, uint32_t>> wedgeMap;
+    std::vector<uint32_t> simplified;
+
+    // Each pass collapses the cheapest independent edges, then rebuilds the triangles
+    bool stop = false;
+    while (output.size() > targetIndexCount && !stop)
+    {
+        // Both directions of every edge, the cheaper one is tried first and the other is the fallback
+        // when the cheaper one would break a seam or flip a triangle
+        candidates.clear();
+        for (const auto& edge : topology.edges)
+        {
+            uint32_t a = static_cast<uint32_t>(edge.first >> 32);
+            uint32_t b = static_cast<uint32_t>(edge.first & 0xFFFFFFFFu);
+            if (a > b && topology.IsEdge(b, a))
+                continue;
+
+            Quadric ab = quadrics[a];
+            ab.Add(quadrics[b]);
+            candidates.push_back({ a, b, static_cast<float>(std::sqrt(ab.Evaluate(vertices[b].position))) });
+            candidates.push_back({ b, a, static_cast<float>(std::sqrt(ab.Evaluate(vertices[a].position))) });
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y)
+            {
+                return x.error < y.error;
+            });
+
+        std::fill(locked.begin(), locked.end(), uint8_t(0));
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = static_cast<uint32_t>(v);
+
+        size_t remainingIndices = output.size();
+        size_t collapses = 0;
+        for (const auto& candidate : candidates)
+        {
+            if (remainingIndices <= targetIndexCount)
+                break;
+            if (candidate.error > maxError)
+            {
+                stop = true;
+                break;
+            }
+            if (locked[candidate.from] || locked[candidate.to])
+                continue;
+
+            const uint32_t from = candidate.from, to = candidate.to;
+            if (!CanCollapse(from, to, output, position, vertices, topology, wedgeMap))
+                continue;
+
+            for (const auto& entry : wedgeMap)
+                remap[entry.first] = entry.second;
+            quadrics[to].Add(quadrics[from]);
+            resultError = std::max(resultError, candidate.error);
+            collapses++;
+
+            // The one-ring of from changes shape, so nothing in it may collapse again this pass
+            locked[from] = locked[to] = 1;
+            for (uint32_t i = topology.offsets[from]; i < topology.offsets[from + 1]; i++)
+            {
+                const uint32_t* triangle = &output[topology.triangles[i] * 3];
+                bool removed = false;
+                for (int k = 0; k < 3; k++)
+                {
+                    locked[position[triangle[k]]] = 1;
+                    removed |= position[triangle[k]] == to;
+                }
+                remainingIndices -= removed ? 3 : 0;
+            }
+        }
+
+        if (collapses == 0)
+            break;
+
+        // Rewrite the triangles and drop the ones that collapsed to a line
+        simplified.clear();
+        simplified.reserve(output.size());
+        for (size_t i = 0; i + 2 < output.size(); i += 3)
+        {
+            uint32_t a = remap[output[i + 0]], b = remap[output[i + 1]], c = remap[output[i + 2]];
+            if (position[a] == position[b] || position[b] == position[c] || position[c] == position[a])
+                continue;
+
+            simplified.push_back(a);
+            simplified.push_back(b);
+            simplified.push_back(c);
+        }
+        output.swap(simplified);
+        topology.Build(output, position);
+    }
+
+    if (error)
+    {
+        *error = resultError;
+    }
+    return output.size();
+}
+
+void MeshSimplifier::BuildLods(MeshData& mesh, unsigned int levelCount, float ratio, float maxRelativeError)
+{
+    if (mesh.subsets.empty())
+    {
+        mesh.subsets.push_back({ 0, 0, static_cast<uint32_t>(mesh.indices.size()), 0 });
+    }
+    mesh.lods.clear();
+    mesh.lods.push_back({ 0, static_cast<uint32_t>(mesh.subsets.size()), 0.f, 0 });
+    if (mesh.vertices.empty())
+    {
+        return;
+    }
+
+    // Errors are bounded relative to the size of the mesh
+    XMVECTOR boundsMin = XMLoadFloat3(&mesh.vertices[0].position);
+    XMVECTOR boundsMax = boundsMin;
+    for (const auto& vertex : mesh.vertices)
+    {
+        boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&vertex.position));
+        boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&vertex.position));
+    }
+    const float maxError = maxRelativeError * 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(boundsMax, boundsMin)));
+
+    std::vector<uint32_t> source, simplified;
+    for (unsigned int level = 1; level <= levelCount; level++)
+    {
+        const MeshLod previous = mesh.lods.back();
+        const size_t firstSubset = mesh.subsets.size();
+        const size_t firstIndex = mesh.indices.size();
+        size_t previousIndices = 0, levelIndices = 0;
+        float levelError = 0.f;
+
+        for (uint32_t s = previous.firstSubset; s < previous.firstSubset + previous.subsetCount; s++)
+        {
+            const MeshSubset subset = mesh.subsets[s];
+            source.assign(mesh.indices.begin() + subset.firstIndex, mesh.indices.begin() + subset.firstIndex + subset.indexCount);
+
+            float error = 0.f;
+            size_t target = static_cast<size_t>(subset.indexCount / 3 * ratio) * 3;
+            MeshSimplifier::Simplify(mesh.vertices, source.data(), source.size(), target, maxError - previous.error, simplified, &error);
+            levelError = std::max(levelError, error);
+            previousIndices += subset.indexCount;
+
+            if (!simplified.empty())
+            {
+                mesh.subsets.push_back({ subset.materialIndex, static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(simplified.size()), 0 });
+                mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+                levelIndices += simplified.size();
+            }
+        }
+
+        // A level that barely reduces anything only costs memory
+        if (levelIndices == 0 || levelIndices * 10 > previousIndices * 9)
+        {
+            mesh.subsets.resize(firstSubset);
+            mesh.indices.resize(firstIndex);
+            break;
+        }
+
+        // The chain is simplified level from level, so the errors add up
+        mesh.lods.push_back({ static_cast<uint32_t>(firstSubset), static_cast<uint32_t>(mesh.subsets.size() - firstSubset),
+            previous.error + levelError, 0 });
+    }
+}
@@ -0,0 +1,30 @@
+//
+// MeshSimplifier.h - Quadric error edge collapse simplification and LOD chain generation
+//
+
+#pragma once
+
+#include "MeshData.h"
+
+namespace DX
+{
+    class MeshSimplifier
+    {
+    public:
+        // Collapses edges in order of quadric error (Garland & Heckbert 1997) until at most targetIndexCount
+        // indices remain or the next collapse would move the surface by more than maxError (object space
+        // units). Collapses are half edge collapses onto existing vertices, so output indexes the same
+        // vertex array. Open borders only collapse along themselves and vertices split by a UV or normal
+        // seam only collapse along that seam, so seams and hard edges keep their attributes.
+        // Returns the output index count; error receives the largest collapse error, which bounds the
+        // distance from the moved vertices to the original triangle planes around them.
+        static size_t Simplify(const std::vector<MeshVertex>& vertices, const uint32_t* indices, size_t indexCount,
+            size_t targetIndexCount, float maxError, std::vector<uint32_t>& output, float* error = nullptr);
+
+        // Appends up to levelCount coarser levels to mesh.lods, each simplified from the previous level to
+        // about ratio of its triangles. Every level keeps one subset per material and indexes the shared
+        // vertex array. Stops early when a level would exceed maxRelativeError of the bounding radius or
+        // would drop fewer than 10% of the triangles.
+        static void BuildLods(MeshData& mesh, unsigned int levelCount = 3, float ratio = 0.5f, float maxRelativeError = 0.05f);
+    };
+}
@@ -0,0 +1,211 @@
+//
+// MeshWelder.cpp - Builds shared, compactly indexed vertex arrays from OBJ face corners
+//
+
+#include "pch.h"
+#include "MeshWelder.h"
+
+#include <unordered_map>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    constexpr uint32_t EmptySlot = 0xFFFFFFFFu;
+
+    struct Corner
+    {
+        uint32_t v, vt, vn;
+    };
+
+    inline uint32_t HashCorner(const Corner& c) noexcept
+    {
+        // Mix the three indices so neighbouring corners spread across the table
+        uint32_t h = c.v * 0x9E3779B1u;
+        h ^= c.vt * 0x85EBCA77u + (h << 6) + (h >> 2);
+        h ^= c.vn * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+        return h ^ (h >> 15);
+    }
+
+    inline bool Near(float a, float b, float epsilon) noexcept
+    {
+        return std::fabs(a - b) <= epsilon;
+    }
+
+    bool NearlyEqual(const MeshVertex& a, const MeshVertex& b, float epsilon) noexcept
+    {
+        return Near(a.position.x, b.position.x, epsilon) && Near(a.position.y, b.position.y, epsilon) && Near(a.position.z, b.position.z, epsilon)
+            && Near(a.normal.x, b.normal.x, epsilon) && Near(a.normal.y, b.normal.y, epsilon) && Near(a.normal.z, b.normal.z, epsilon)
+            && Near(a.texture.x, b.texture.x, epsilon) && Near(a.texture.y, b.texture.y, epsilon);
+    }
+
+    inline uint64_t CellKey(int64_t x, int64_t y, int64_t z) noexcept
+    {
+        // 21 bits per axis is plenty for scene sized meshes at weld tolerances
+        return (static_cast<uint64_t>(x & 0x1FFFFF) << 42) | (static_cast<uint64_t>(y & 0x1FFFFF) << 21) | static_cast<uint64_t>(z & 0x1FFFFF);
+    }
+}
+
+void MeshWelder::WeldObj(const ObjData& obj, MeshData& mesh, float epsilon, WeldStats* stats)
+{
+    mesh.Clear();
+
+    const size_t cornerCount = obj.faces.size() / 3;
+
+    // Open addressed table of output vertex indices, at most half full
+    size_t tableSize = 16;
+    while (tableSize < cornerCount * 2)
+        tableSize <<= 1;
+    std::vector<uint32_t> table(tableSize, EmptySlot);
+    std::vector<Corner> unique;
+    unique.reserve(cornerCount / 2);
+
+    mesh.vertices.reserve(cornerCount / 2);
+    mesh.indices.reserve(cornerCount);
+
+    // Counting sort the triangles by material so each material is one contiguous subset.
+    // The sort is stable, so triangles keep their file order within a material.
+    const size_t triangleCount = cornerCount / 3;
+    const bool hasMaterials = obj.triangleMaterials.size() == triangleCount;
+    uint32_t materialCount = 1;
+    if (hasMaterials)
+    {
+        for (uint32_t material : obj.triangleMaterials)
+            materialCount = std::max(materialCount, material + 1);
+    }
+
+    std::vector<uint32_t> firstTriangle(materialCount + 1, 0);
+    for (size_t t = 0; t < triangleCount; t++)
+        firstTriangle[(hasMaterials ? obj.triangleMaterials[t] : 0) + 1]++;
+    for (uint32_t m = 0; m < materialCount; m++)
+        firstTriangle[m + 1] += firstTriangle[m];
+
+    std::vector<uint32_t> triangleOrder(triangleCount);
+    std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleOrder[fill[hasMaterials ? obj.triangleMaterials[t] : 0]++] = static_cast<uint32_t>(t);
+
+    for (uint32_t m = 0; m < materialCount; m++)
+    {
+        if (firstTriangle[m + 1] > firstTriangle[m])
+        {
+            mesh.subsets.push_back({ m, firstTriangle[m] * 3, (firstTriangle[m + 1] - firstTriangle[m]) * 3, 0 });
+        }
+    }
+
+    const size_t mask = tableSize - 1;
+    for (size_t c = 0; c < cornerCount; c++)
+    {
+        const size_t i = triangleOrder[c / 3] * 3 + c % 3;
+        const Corner corner = { obj.faces[i * 3 + 0], obj.faces[i * 3 + 1], obj.faces[i * 3 + 2] };
+        size_t slot = HashCorner(corner) & mask;
+        while (table[slot] != EmptySlot)
+        {
+            const Corner& existing = unique[table[slot]];
+            if (existing.v == corner.v && existing.vt == corner.vt && existing.vn == corner.vn)
+                break;
+            slot = (slot + 1) & mask;
+        }
+
+        if (table[slot] == EmptySlot)
+        {
+            // First time this triple is seen, OBJ indices are 1-based
+            MeshVertex vertex;
+            vertex.position = obj.positions[corner.v - 1];
+            vertex.texture = obj.texCoords[corner.vt - 1];
+            vertex.normal = obj.normals[corner.vn - 1];
+
+            table[slot] = static_cast<uint32_t>(mesh.vertices.size());
+            mesh.vertices.push_back(vertex);
+            unique.push_back(corner);
+        }
+
+        mesh.indices.push_back(table[slot]);
+    }
+
+    if (epsilon > 0.f)
+    {
+        WeldEpsilon(mesh, epsilon);
+    }
+
+    if (stats)
+    {
+        // The unwelded mesh had one vertex and one 32-bit index per corner
+        stats->inputVertices = cornerCount;
+        stats->outputVertices = mesh.vertices.size();
+        stats->inputBytes = cornerCount * (sizeof(MeshVertex) + sizeof(uint32_t));
+        stats->outputBytes = mesh.GetByteSize();
+    }
+}
+
+void MeshWelder::WeldEpsilon(MeshData& mesh, float epsilon)
+{
+    const size_t vertexCount = mesh.vertices.size();
+    if (vertexCount == 0 || epsilon <= 0.f)
+    {
+        return;
+    }
+
+    // Uniform grid over positions, each cell holding a chain of kept vertices
+    const float invCell = 1.f / epsilon;
+    std::unordered_map<uint64_t, uint32_t> cells;
+    cells.reserve(vertexCount);
+    std::vector<uint32_t> next(vertexCount, EmptySlot);
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<MeshVertex> welded;
+    welded.reserve(vertexCount);
+
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const MeshVertex& vertex = mesh.vertices[i];
+        int64_t cx = static_cast<int64_t>(std::floor(vertex.position.x * invCell));
+        int64_t cy = static_cast<int64_t>(std::floor(vertex.position.y * invCell));
+        int64_t cz = static_cast<int64_t>(std::floor(vertex.position.z * invCell));
+
+        // A match within epsilon can sit in any of the 27 surrounding cells
+        uint32_t match = EmptySlot;
+        for (int64_t dx = -1; dx <= 1 && match == EmptySlot; dx++)
+        {
+            for (int64_t dy = -1; dy <= 1 && match == EmptySlot; dy++)
+            {
+                for (int64_t dz = -1; dz <= 1 && match == EmptySlot; dz++)
+                {
+                    auto cell = cells.find(CellKey(cx + dx, cy + dy, cz + dz));
+                    if (cell == cells.end())
+                        continue;
+
+                    for (uint32_t kept = cell->second; kept != EmptySlot; kept = next[kept])
+                    {
+                        if (NearlyEqual(welded[kept], vertex, epsilon))
+                        {
+                            match = kept;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (match == EmptySlot)
+        {
+            match = static_cast<uint32_t>(welded.size());
+            welded.push_back(vertex);
+
+            auto inserted = cells.emplace(CellKey(cx, cy, cz), match);
+            if (!inserted.second)
+            {
+                next[match] = inserted.first->second;
+                inserted.first->second = match;
+            }
+        }
+
+        remap[i] = match;
+    }
+
+    for (auto& index : mesh.indices)
+    {
+        index = remap[index];
+    }
+    mesh.vertices.swap(welded);
+}
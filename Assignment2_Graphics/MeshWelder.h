@@ -0,0 +1,33 @@
+//
+// MeshWelder.h - Builds shared, compactly indexed vertex arrays from OBJ face corners
+//
+
+#pragma once
+
+#include "MeshData.h"
+#include "ObjLoader.h"
+
+namespace DX
+{
+    // Before/after sizes of a weld, for reporting
+    struct WeldStats
+    {
+        size_t inputVertices;
+        size_t outputVertices;
+        size_t inputBytes;
+        size_t outputBytes;
+    };
+
+    class MeshWelder
+    {
+    public:
+        // Emits one vertex per unique v/vt/vn triple referenced by the faces. An epsilon above
+        // zero additionally merges vertices whose position, uv and normal all lie within epsilon.
+        // Triangles are grouped by obj.triangleMaterials into one subset per material; the
+        // subset material indices are the triangleMaterials values and mesh.materials is left empty.
+        static void WeldObj(const ObjData& obj, MeshData& mesh, float epsilon = 0.f, WeldStats* stats = nullptr);
+
+        // Merges vertices whose attributes all lie within epsilon of each other and drops the unused ones.
+        static void WeldEpsilon(MeshData& mesh, float epsilon);
+    };
+}
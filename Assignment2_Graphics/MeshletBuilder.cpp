@@ -0,0 +1,235 @@
+//
+// MeshletBuilder.cpp - Splits a mesh into small clusters with bounding spheres and normal cones
+//
+
+#include "pch.h"
+#include "MeshletBuilder.h"
+
+#include <cfloat>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    constexpr uint32_t InvalidIndex = 0xFFFFFFFFu;
+    constexpr uint8_t NotInMeshlet = 0xFF;
+
+    // Front face direction of a triangle (counter-clockwise winding), zero if it is degenerate
+    inline XMVECTOR XM_CALLCONV FaceNormal(const std::vector<MeshVertex>& vertices, uint32_t a, uint32_t b, uint32_t c) noexcept
+    {
+        XMVECTOR p0 = XMLoadFloat3(&vertices[a].position);
+        XMVECTOR p1 = XMLoadFloat3(&vertices[b].position);
+        XMVECTOR p2 = XMLoadFloat3(&vertices[c].position);
+        XMVECTOR normal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+        float length = XMVectorGetX(XMVector3Length(normal));
+        return length > 0.f ? XMVectorScale(normal, 1.f / length) : XMVectorZero();
+    }
+}
+
+void MeshletBuilder::Build(MeshData& mesh, unsigned int maxVertices, unsigned int maxTriangles)
+{
+    mesh.meshlets.clear();
+    mesh.meshletVertices.clear();
+    mesh.meshletTriangles.clear();
+
+    // Local indices are bytes and 0xFF marks a vertex that isn't in the current cluster
+    maxVertices = std::max(3u, std::min(maxVertices, 255u));
+    maxTriangles = std::max(1u, maxTriangles);
+
+    // Only the full detail level is clustered
+    uint32_t firstSubset = 0;
+    uint32_t subsetCount = static_cast<uint32_t>(mesh.subsets.size());
+    if (!mesh.lods.empty())
+    {
+        firstSubset = mesh.lods[0].firstSubset;
+        subsetCount = mesh.lods[0].subsetCount;
+    }
+
+    // Vertices split by UV or normal seams share a position, clusters grow across the seams through it
+    const size_t vertexCount = mesh.vertices.size();
+    std::vector<uint32_t> position(vertexCount), order(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        order[v] = static_cast<uint32_t>(v);
+    auto less = [&mesh](uint32_t a, uint32_t b)
+    {
+        const XMFLOAT3& pa = mesh.vertices[a].position;
+        const XMFLOAT3& pb = mesh.vertices[b].position;
+        return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+    };
+    std::sort(order.begin(), order.end(), less);
+    for (size_t i = 0; i < vertexCount; i++)
+        position[order[i]] = (i > 0 && !less(order[i - 1], order[i])) ? position[order[i - 1]] : order[i];
+
+    std::vector<uint8_t> localIndex(vertexCount, NotInMeshlet);
+    std::vector<uint32_t> offsets, adjacency, fill;
+    std::vector<XMFLOAT3> normals;
+    std::vector<uint8_t> emitted;
+
+    for (uint32_t s = firstSubset; s < firstSubset + subsetCount; s++)
+    {
+        const MeshSubset subset = mesh.subsets[s];
+        const uint32_t triangleCount = subset.indexCount / 3;
+        if (triangleCount == 0)
+            continue;
+        const uint32_t* indices = &mesh.indices[subset.firstIndex];
+
+        // Triangles around each position, and the facing of every triangle
+        offsets.assign(vertexCount + 1, 0);
+        for (uint32_t i = 0; i < triangleCount * 3; i++)
+            offsets[position[indices[i]] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] += offsets[v];
+        fill.assign(offsets.begin(), offsets.end() - 1);
+        adjacency.resize(triangleCount * 3);
+        for (uint32_t i = 0; i < triangleCount * 3; i++)
+            adjacency[fill[position[indices[i]]]++] = i / 3;
+
+        normals.resize(triangleCount);
+        for (uint32_t t = 0; t < triangleCount; t++)
+            XMStoreFloat3(&normals[t], FaceNormal(mesh.vertices, indices[t * 3 + 0], indices[t * 3 + 1], indices[t * 3 + 2]));
+
+        emitted.assign(triangleCount, 0);
+        uint32_t seed = 0;
+        Meshlet meshlet = {};
+        XMVECTOR coneSum = XMVectorZero();
+
+        auto flush = [&]()
+        {
+            if (meshlet.triangleCount == 0)
+                return;
+
+            ComputeBounds(mesh.vertices, &mesh.meshletVertices[meshlet.vertexOffset], &mesh.meshletTriangles[meshlet.triangleOffset], meshlet);
+            for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+                localIndex[mesh.meshletVertices[meshlet.vertexOffset + v]] = NotInMeshlet;
+            mesh.meshlets.push_back(meshlet);
+
+            meshlet = {};
+            coneSum = XMVectorZero();
+        };
+
+        for (;;)
+        {
+            uint32_t best = InvalidIndex;
+            if (meshlet.triangleCount == 0)
+            {
+                // New clusters start at the next unused triangle in the cache optimized order
+                while (seed < triangleCount && emitted[seed])
+                    seed++;
+                if (seed == triangleCount)
+                    break;
+
+                best = seed;
+                meshlet.vertexOffset = static_cast<uint32_t>(mesh.meshletVertices.size());
+                meshlet.triangleOffset = static_cast<uint32_t>(mesh.meshletTriangles.size());
+                meshlet.materialIndex = subset.materialIndex;
+            }
+            else
+            {
+                // Grow through the neighbours of the cluster: fewest new vertices first, then the
+                // triangle facing closest to the cluster so far
+                XMVECTOR axis = XMVector3Normalize(coneSum);
+                float bestScore = FLT_MAX;
+                for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+                {
+                    const uint32_t vertex = position[mesh.meshletVertices[meshlet.vertexOffset + v]];
+                    for (uint32_t i = offsets[vertex]; i < offsets[vertex + 1]; i++)
+                    {
+                        const uint32_t t = adjacency[i];
+                        if (emitted[t])
+                            continue;
+
+                        uint32_t newVertices = 0;
+                        for (int k = 0; k < 3; k++)
+                            newVertices += localIndex[indices[t * 3 + k]] == NotInMeshlet ? 1 : 0;
+                        if (meshlet.vertexCount + newVertices > maxVertices)
+                            continue;
+
+                        float facing = XMVectorGetX(XMVector3Dot(axis, XMLoadFloat3(&normals[t])));
+                        float score = static_cast<float>(newVertices) + (1.f - facing);
+                        if (score < bestScore)
+                        {
+                            bestScore = score;
+                            best = t;
+                        }
+                    }
+                }
+
+                if (best == InvalidIndex)
+                {
+                    flush();
+                    continue;
+                }
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                const uint32_t vertex = indices[best * 3 + k];
+                if (localIndex[vertex] == NotInMeshlet)
+                {
+                    localIndex[vertex] = static_cast<uint8_t>(meshlet.vertexCount++);
+                    mesh.meshletVertices.push_back(vertex);
+                }
+                mesh.meshletTriangles.push_back(localIndex[vertex]);
+            }
+            emitted[best] = 1;
+            meshlet.triangleCount++;
+            coneSum = XMVectorAdd(coneSum, XMLoadFloat3(&normals[best]));
+
+            if (meshlet.triangleCount == maxTriangles)
+                flush();
+        }
+        flush();
+    }
+}
+
+void MeshletBuilder::ComputeBounds(const std::vector<MeshVertex>& vertices, const uint32_t* meshletVertices,
+    const uint8_t* meshletTriangles, Meshlet& meshlet)
+{
+    // Sphere around the centre of the cluster's AABB
+    XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+    for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+    {
+        XMVECTOR position = XMLoadFloat3(&vertices[meshletVertices[v]].position);
+        boundsMin = XMVectorMin(boundsMin, position);
+        boundsMax = XMVectorMax(boundsMax, position);
+    }
+    XMVECTOR center = XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f);
+    float radius = 0.f;
+    for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+    {
+        XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&vertices[meshletVertices[v]].position), center);
+        radius = std::max(radius, XMVectorGetX(XMVector3Length(offset)));
+    }
+    XMStoreFloat3(&meshlet.center, center);
+    meshlet.radius = radius;
+
+    // Normal cone around the average face direction
+    XMVECTOR axis = XMVectorZero();
+    for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+    {
+        const uint8_t* triangle = &meshletTriangles[t * 3];
+        axis = XMVectorAdd(axis, FaceNormal(vertices, meshletVertices[triangle[0]], meshletVertices[triangle[1]], meshletVertices[triangle[2]]));
+    }
+
+    float minDot = -1.f;
+    if (XMVectorGetX(XMVector3Length(axis)) > 0.f)
+    {
+        axis = XMVector3Normalize(axis);
+        minDot = 1.f;
+        for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+        {
+            const uint8_t* triangle = &meshletTriangles[t * 3];
+            XMVECTOR normal = FaceNormal(vertices, meshletVertices[triangle[0]], meshletVertices[triangle[1]], meshletVertices[triangle[2]]);
+            if (XMVectorGetX(XMVector3LengthSq(normal)) > 0.f)
+                minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(axis, normal)));
+        }
+    }
+    XMStoreFloat3(&meshlet.coneAxis, axis);
+
+    // A cone wider than ~84 degrees is never entirely backfacing from a useful distance. Otherwise
+    // the cluster is backfacing when the view direction is within 90 degrees minus the cone angle
+    // of the axis, whose cosine is the sine of the cone angle.
+    meshlet.coneCutoff = minDot <= 0.1f ? 1.f : std::sqrt(1.f - minDot * minDot);
+}
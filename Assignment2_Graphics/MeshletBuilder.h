@@ -0,0 +1,29 @@
+//
+// MeshletBuilder.h - Splits a mesh into small clusters with bounding spheres and normal cones
+//
+
+#pragma once
+
+#include "MeshData.h"
+
+namespace DX
+{
+    class MeshletBuilder
+    {
+    public:
+        // 64 vertices and 124 triangles keep a cluster's local indices in a byte and its data
+        // in a few cache lines
+        static constexpr unsigned int MaxVertices = 64;
+        static constexpr unsigned int MaxTriangles = 124;
+
+        // Replaces mesh.meshlets with clusters of the full detail subsets (LOD 0). Each cluster
+        // holds triangles of a single material and is grown from a seed triangle through its
+        // neighbours, preferring triangles that add few vertices and face the same way, so the
+        // normal cones stay narrow enough to cull. Run this after the vertex order is final.
+        static void Build(MeshData& mesh, unsigned int maxVertices = MaxVertices, unsigned int maxTriangles = MaxTriangles);
+
+        // Bounding sphere and normal cone of one cluster
+        static void ComputeBounds(const std::vector<MeshVertex>& vertices, const uint32_t* meshletVertices,
+            const uint8_t* meshletTriangles, Meshlet& meshlet);
+    };
+}
@@ -0,0 +1,145 @@
+//
+// MeshletCuller.cpp - Per frame CPU frustum and backface culling of meshlets into a compacted index list
+//
+
+#include "pch.h"
+#include "MeshletCuller.h"
+#include "JobSystem.h"
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    // Object space frustum planes and camera, so clusters are tested without transforming them
+    struct CullView
+    {
+        XMVECTOR planes[6];
+        XMVECTOR camera;
+    };
+
+    template <typename Chunk>
+    void CullRange(const Meshlet* meshlets, size_t begin, size_t end, const uint32_t* meshletVertices, const uint8_t* meshletTriangles,
+        const CullView& view, Chunk& chunk)
+    {
+        chunk.subsets.clear();
+        chunk.stats = {};
+
+        // Room for every triangle of the range, trimmed to what survives at the end
+        size_t capacity = 0;
+        for (size_t m = begin; m < end; m++)
+            capacity += meshlets[m].triangleCount * 3;
+        chunk.indices.resize(capacity);
+        uint32_t* output = chunk.indices.data();
+        uint32_t written = 0;
+
+        for (size_t m = begin; m < end; m++)
+        {
+            const Meshlet& meshlet = meshlets[m];
+            XMVECTOR center = XMLoadFloat3(&meshlet.center);
+            chunk.stats.clusterCount++;
+
+            // Outside any plane by more than the radius
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; p++)
+            {
+                outside = XMVectorGetX(XMPlaneDotCoord(view.planes[p], center)) < -meshlet.radius;
+            }
+            if (outside)
+            {
+                chunk.stats.frustumCulled++;
+                continue;
+            }
+
+            // Every triangle faces away when the view direction lies inside the inverted normal cone,
+            // widened by the bounding sphere (the apex free cone test from meshoptimizer)
+            XMVECTOR offset = XMVectorSubtract(center, view.camera);
+            float distance = XMVectorGetX(XMVector3Length(offset));
+            if (XMVectorGetX(XMVector3Dot(offset, XMLoadFloat3(&meshlet.coneAxis))) >= meshlet.coneCutoff * distance + meshlet.radius)
+            {
+                chunk.stats.backfaceCulled++;
+                continue;
+            }
+
+            // Clusters arrive grouped by material, so a new draw range only starts at a material change
+            if (chunk.subsets.empty() || chunk.subsets.back().materialIndex != meshlet.materialIndex)
+            {
+                chunk.subsets.push_back({ meshlet.materialIndex, written, 0, 0 });
+            }
+
+            const uint32_t* vertices = &meshletVertices[meshlet.vertexOffset];
+            const uint8_t* triangles = &meshletTriangles[meshlet.triangleOffset];
+            for (uint32_t i = 0; i < meshlet.triangleCount * 3; i++)
+            {
+                output[written + i] = vertices[triangles[i]];
+            }
+            written += meshlet.triangleCount * 3;
+            chunk.subsets.back().indexCount += meshlet.triangleCount * 3;
+            chunk.stats.triangleCount += meshlet.triangleCount;
+        }
+        chunk.indices.resize(written);
+    }
+}
+
+MeshletCuller::MeshletCuller() noexcept :
+    m_stats{}
+{
+}
+
+void XM_CALLCONV MeshletCuller::Cull(const Meshlet* meshlets, size_t meshletCount, const uint32_t* meshletVertices, const uint8_t* meshletTriangles,
+    FXMMATRIX world, CXMMATRIX viewProjection, FXMVECTOR cameraPosition, unsigned int threadCount)
+{
+    // Frustum planes of the combined matrix are in object space (Gribb & Hartmann), D3D clip z is [0, w]
+    CullView view;
+    XMMATRIX columns = XMMatrixTranspose(XMMatrixMultiply(world, viewProjection));
+    view.planes[0] = XMPlaneNormalize(XMVectorAdd(columns.r[3], columns.r[0]));
+    view.planes[1] = XMPlaneNormalize(XMVectorSubtract(columns.r[3], columns.r[0]));
+    view.planes[2] = XMPlaneNormalize(XMVectorAdd(columns.r[3], columns.r[1]));
+    view.planes[3] = XMPlaneNormalize(XMVectorSubtract(columns.r[3], columns.r[1]));
+    view.planes[4] = XMPlaneNormalize(columns.r[2]);
+    view.planes[5] = XMPlaneNormalize(XMVectorSubtract(columns.r[3], columns.r[2]));
+    view.camera = XMVector3Transform(cameraPosition, XMMatrixInverse(nullptr, world));
+
+    JobSystem& jobs = JobSystem::Get();
+    if (threadCount == 0)
+    {
+        threadCount = jobs.GetThreadCount();
+    }
+    const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, meshletCount / MinMeshletsPerJob));
+    m_chunks.resize(chunkCount);
+
+    // The calling thread culls its share of the ranges while it waits for the jobs
+    jobs.ParallelFor(chunkCount, 1, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            CullRange(meshlets, meshletCount * i / chunkCount, meshletCount * (i + 1) / chunkCount, meshletVertices, meshletTriangles, view, m_chunks[i]);
+        }
+    });
+
+    // Concatenate the ranges in cluster order, joining draw ranges that continue across a boundary.
+    // A single range is handed over as is.
+    m_indices.clear();
+    m_subsets.clear();
+    m_stats = {};
+    for (auto& chunk : m_chunks)
+    {
+        const uint32_t base = static_cast<uint32_t>(m_indices.size());
+        if (chunkCount == 1)
+            m_indices.swap(chunk.indices);
+        else
+            m_indices.insert(m_indices.end(), chunk.indices.begin(), chunk.indices.end());
+        for (const auto& subset : chunk.subsets)
+        {
+            if (!m_subsets.empty() && m_subsets.back().materialIndex == subset.materialIndex)
+                m_subsets.back().indexCount += subset.indexCount;
+            else
+                m_subsets.push_back({ subset.materialIndex, base + subset.firstIndex, subset.indexCount, 0 });
+        }
+
+        m_stats.clusterCount += chunk.stats.clusterCount;
+        m_stats.frustumCulled += chunk.stats.frustumCulled;
+        m_stats.backfaceCulled += chunk.stats.backfaceCulled;
+        m_stats.triangleCount += chunk.stats.triangleCount;
+    }
+}
@@ -0,0 +1,53 @@
+//
+// MeshletCuller.h - Per frame CPU frustum and backface culling of meshlets into a compacted index list
+//
+
+#pragma once
+
+#include "MeshData.h"
+
+namespace DX
+{
+    struct ClusterCullStats
+    {
+        uint32_t clusterCount;
+        uint32_t frustumCulled;
+        uint32_t backfaceCulled;
+        uint32_t triangleCount;     // Triangles left to draw
+    };
+
+    class MeshletCuller
+    {
+    public:
+        // Meshes with fewer clusters than this per job are culled on the calling thread only
+        static constexpr size_t MinMeshletsPerJob = 1024;
+
+        MeshletCuller() noexcept;
+
+        // Tests every cluster against the view frustum and its normal cone against the camera, then
+        // writes the triangles of the survivors as mesh vertex indices. Draw ranges are returned per
+        // run of clusters sharing a material. Up to threadCount ranges are culled as jobs, 0 gives
+        // each thread of the job system one.
+        void XM_CALLCONV Cull(const Meshlet* meshlets, size_t meshletCount, const uint32_t* meshletVertices, const uint8_t* meshletTriangles,
+            DirectX::FXMMATRIX world, DirectX::CXMMATRIX viewProjection, DirectX::FXMVECTOR cameraPosition,
+            unsigned int threadCount = 0);
+
+        const std::vector<uint32_t>& GetIndices() const noexcept { return m_indices; }
+        const std::vector<MeshSubset>& GetSubsets() const noexcept { return m_subsets; }
+        const ClusterCullStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        // What one job produced for its contiguous range of clusters
+        struct Chunk
+        {
+            std::vector<uint32_t> indices;
+            std::vector<MeshSubset> subsets;
+            ClusterCullStats stats;
+        };
+
+        std::vector<Chunk> m_chunks;
+        std::vector<uint32_t> m_indices;
+        std::vector<MeshSubset> m_subsets;
+        ClusterCullStats m_stats;
+    };
+}
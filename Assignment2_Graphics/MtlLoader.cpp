@@ -0,0 +1,203 @@
+//
+// MtlLoader.cpp - Wavefront MTL material library parser
+//
+
+#include "pch.h"
+#include "MtlLoader.h"
+#include "MappedFile.h"
+
+#include <cstring>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    inline bool IsBlank(char c) noexcept
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char* SkipBlanks(const char* p, const char* end) noexcept
+    {
+        while (p < end && IsBlank(*p))
+            ++p;
+        return p;
+    }
+
+    inline const char* NextLine(const char* p, const char* end) noexcept
+    {
+        while (p < end && *p != '\n')
+            ++p;
+        return (p < end) ? p + 1 : end;
+    }
+
+    // Keyword at p followed by a blank
+    inline bool IsKeyword(const char* p, const char* end, const char* keyword) noexcept
+    {
+        const size_t length = std::strlen(keyword);
+        return static_cast<size_t>(end - p) > length && std::strncmp(p, keyword, length) == 0 && IsBlank(p[length]);
+    }
+
+    void SetName(MeshMaterial& material, const char* name, size_t length) noexcept
+    {
+        length = std::min(length, sizeof(material.name) - 1);
+        std::memcpy(material.name, name, length);
+        material.name[length] = '\0';
+    }
+
+    // "r g b", or a single value used for all three channels
+    bool ParseColor(const char* p, const char* end, XMFLOAT3& color) noexcept
+    {
+        if (!ObjLoader::ParseFloat(p, end, color.x))
+        {
+            return false;
+        }
+        if (!ObjLoader::ParseFloat(p, end, color.y) || !ObjLoader::ParseFloat(p, end, color.z))
+        {
+            color.y = color.z = color.x;
+        }
+        return true;
+    }
+
+    bool SameProperties(const MeshMaterial& a, const MeshMaterial& b) noexcept
+    {
+        return a.ambient.x == b.ambient.x && a.ambient.y == b.ambient.y && a.ambient.z == b.ambient.z
+            && a.diffuse.x == b.diffuse.x && a.diffuse.y == b.diffuse.y && a.diffuse.z == b.diffuse.z
+            && a.specular.x == b.specular.x && a.specular.y == b.specular.y && a.specular.z == b.specular.z
+            && a.specularPower == b.specularPower && a.opacity == b.opacity;
+    }
+}
+
+MeshMaterial MtlLoader::GetDefaultMaterial(const char* name) noexcept
+{
+    MeshMaterial material = {};
+    SetName(material, name, std::strlen(name));
+    material.ambient = XMFLOAT3(0.f, 0.f, 0.f);
+    material.diffuse = XMFLOAT3(1.f, 1.f, 1.f);
+    material.specular = XMFLOAT3(0.f, 0.f, 0.f);
+    material.specularPower = 0.f;
+    material.opacity = 1.f;
+    return material;
+}
+
+bool MtlLoader::LoadFile(const char* filename, std::vector<MeshMaterial>& materials)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        return false;
+    }
+
+    return Parse(file.GetData(), file.GetSize(), materials);
+}
+
+bool MtlLoader::Parse(const char* text, size_t size, std::vector<MeshMaterial>& materials)
+{
+    const char* p = text;
+    const char* end = text + size;
+    MeshMaterial* material = nullptr;
+
+    while (p < end)
+    {
+        p = SkipBlanks(p, end);
+        const char* lineEnd = NextLine(p, end);
+
+        bool result = true;
+        if (IsKeyword(p, lineEnd, "newmtl"))
+        {
+            const char* name = SkipBlanks(p + 6, lineEnd);
+            const char* nameEnd = lineEnd;
+            while (nameEnd > name && (IsBlank(nameEnd[-1]) || nameEnd[-1] == '\n'))
+                --nameEnd;
+
+            materials.push_back(GetDefaultMaterial(""));
+            material = &materials.back();
+            SetName(*material, name, static_cast<size_t>(nameEnd - name));
+        }
+        else if (material && IsKeyword(p, lineEnd, "Ka"))
+        {
+            result = ParseColor(p + 2, lineEnd, material->ambient);
+        }
+        else if (material && IsKeyword(p, lineEnd, "Kd"))
+        {
+            result = ParseColor(p + 2, lineEnd, material->diffuse);
+        }
+        else if (material && IsKeyword(p, lineEnd, "Ks"))
+        {
+            result = ParseColor(p + 2, lineEnd, material->specular);
+        }
+        else if (material && IsKeyword(p, lineEnd, "Ns"))
+        {
+            const char* cursor = p + 2;
+            result = ObjLoader::ParseFloat(cursor, lineEnd, material->specularPower);
+        }
+        else if (material && IsKeyword(p, lineEnd, "d"))
+        {
+            const char* cursor = p + 1;
+            result = ObjLoader::ParseFloat(cursor, lineEnd, material->opacity);
+        }
+        else if (material && IsKeyword(p, lineEnd, "Tr"))
+        {
+            // Transparency is the inverse of dissolve
+            float transparency;
+            const char* cursor = p + 2;
+            result = ObjLoader::ParseFloat(cursor, lineEnd, transparency);
+            material->opacity = 1.f - transparency;
+        }
+
+        // Comments, texture maps, illum etc. are skipped
+        if (!result)
+        {
+            return false;
+        }
+        p = lineEnd;
+    }
+
+    return true;
+}
+
+void MtlLoader::ResolveMaterials(const char* objFilename, ObjData& obj, std::vector<MeshMaterial>& materials)
+{
+    materials.clear();
+
+    // Libraries are named relative to the OBJ file
+    std::string directory(objFilename);
+    size_t separator = directory.find_last_of("/\\");
+    directory.erase(separator == std::string::npos ? 0 : separator + 1);
+
+    std::vector<MeshMaterial> library;
+    for (const auto& libraryName : obj.materialLibraries)
+    {
+        LoadFile((directory + libraryName).c_str(), library);
+    }
+
+    // Map every usemtl name to a table entry, sharing entries between identical materials
+    std::vector<uint32_t> remap(obj.materialNames.size());
+    for (size_t i = 0; i < obj.materialNames.size(); i++)
+    {
+        MeshMaterial material = GetDefaultMaterial(obj.materialNames[i].c_str());
+        for (const auto& candidate : library)
+        {
+            if (std::strcmp(candidate.name, material.name) == 0)
+            {
+                material = candidate;
+                break;
+            }
+        }
+
+        size_t entry = 0;
+        while (entry < materials.size() && !SameProperties(materials[entry], material))
+            entry++;
+        if (entry == materials.size())
+        {
+            materials.push_back(material);
+        }
+        remap[i] = static_cast<uint32_t>(entry);
+    }
+
+    for (auto& triangleMaterial : obj.triangleMaterials)
+    {
+        triangleMaterial = remap[triangleMaterial];
+    }
+}
@@ -0,0 +1,30 @@
+//
+// MtlLoader.h - Wavefront MTL material library parser
+//
+
+#pragma once
+
+#include "MeshData.h"
+#include "ObjLoader.h"
+
+namespace DX
+{
+    // Reads newmtl blocks and their Ka/Kd/Ks/Ns/d/Tr values. Texture maps and illumination
+    // models are ignored, the light shader only has use for the colours.
+    class MtlLoader
+    {
+    public:
+        // Both append to materials. Names longer than the fixed name field are truncated.
+        static bool LoadFile(const char* filename, std::vector<MeshMaterial>& materials);
+        static bool Parse(const char* text, size_t size, std::vector<MeshMaterial>& materials);
+
+        // White diffuse, no specular, fully opaque
+        static MeshMaterial GetDefaultMaterial(const char* name) noexcept;
+
+        // Loads the OBJ's material libraries (relative to objFilename) and builds the material table
+        // for its usemtl names, rewriting obj.triangleMaterials to index that table. Names that end up
+        // with identical properties share one entry, so they also share a subset and a draw call.
+        // Names no library defines, and missing libraries, fall back to the default material.
+        static void ResolveMaterials(const char* objFilename, ObjData& obj, std::vector<MeshMaterial>& materials);
+    };
+}
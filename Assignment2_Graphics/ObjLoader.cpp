@@ -0,0 +1,712 @@
+//
+// ObjLoader.cpp - Multithreaded Wavefront OBJ parser
+//
+
+#include "pch.h"
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include "JobSystem.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    // Files smaller than this per chunk parse faster on one thread than split and merged
+    constexpr size_t MinChunkBytes = 256 * 1024;
+
+    // Powers of ten that are exactly representable as floats (5^10 < 2^24)
+    const float Pow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+    // One polygon corner. Positive values are absolute 1-based indices, 0 means the attribute
+    // is absent. Negative OBJ indices are stored chunk relative and listed in ObjChunk::relative.
+    struct ObjCorner
+    {
+        int32_t v, vt, vn;
+    };
+
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+        ObjData data;
+        std::vector<ObjCorner> corners;
+        std::vector<uint32_t> polygonSizes;
+        std::vector<uint32_t> relative;     // corners[i / 3] component i % 3 needs the chunk's attribute offset
+        std::vector<int32_t> polygonMaterials;  // Index into data.materialNames, -1 until the chunk's first usemtl
+        int32_t material;
+        bool result;
+    };
+
+    inline bool IsBlank(char c) noexcept
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline bool IsDigit(char c) noexcept
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline const char* SkipBlanks(const char* p, const char* end) noexcept
+    {
+        while (p < end && IsBlank(*p))
+            ++p;
+        return p;
+    }
+
+    inline const char* NextLine(const char* p, const char* end) noexcept
+    {
+        while (p < end && *p != '\n')
+            ++p;
+        return (p < end) ? p + 1 : end;
+    }
+
+    bool ParseIndex(const char*& cursor, const char* end, int32_t& value) noexcept
+    {
+        const char* p = cursor;
+        bool negative = false;
+        if (p < end && *p == '-')
+        {
+            negative = true;
+            ++p;
+        }
+
+        const char* digits = p;
+        int64_t result = 0;
+        while (p < end && IsDigit(*p) && result <= INT32_MAX)
+        {
+            result = result * 10 + (*p - '0');
+            ++p;
+        }
+
+        if (p == digits || result == 0 || result > INT32_MAX)
+        {
+            return false;
+        }
+
+        value = static_cast<int32_t>(negative ? -result : result);
+        cursor = p;
+        return true;
+    }
+
+    // Reads every v, v/vt, v//vn or v/vt/vn corner of a face. Negative indices count back from the
+    // attributes read so far; they are made relative to the start of the chunk here and fixed up
+    // once the chunks are merged.
+    bool ParseFace(const char* p, const char* end, ObjChunk& chunk)
+    {
+        const int32_t counts[3] =
+        {
+            static_cast<int32_t>(chunk.data.positions.size()),
+            static_cast<int32_t>(chunk.data.texCoords.size()),
+            static_cast<int32_t>(chunk.data.normals.size())
+        };
+
+        uint32_t cornerCount = 0;
+        while (true)
+        {
+            p = SkipBlanks(p, end);
+            if (p >= end || *p == '\n' || *p == '#')
+                break;
+
+            int32_t corner[3] = { 0, 0, 0 };
+            for (int i = 0; i < 3; i++)
+            {
+                if (i > 0)
+                {
+                    if (p >= end || *p != '/')
+                        break;
+                    ++p;
+
+                    // v//vn leaves the texcoord empty
+                    if (i == 1 && p < end && *p == '/')
+                        continue;
+                }
+                if (!ParseIndex(p, end, corner[i]))
+                    return false;
+
+                if (corner[i] < 0)
+                {
+                    corner[i] = counts[i] + corner[i] + 1;
+                    chunk.relative.push_back(static_cast<uint32_t>(chunk.corners.size() * 3 + i));
+                }
+            }
+
+            if (p < end && !IsBlank(*p) && *p != '\n')
+                return false;
+
+            chunk.corners.push_back({ corner[0], corner[1], corner[2] });
+            cornerCount++;
+        }
+
+        if (cornerCount < 3)
+        {
+            return false;
+        }
+
+        chunk.polygonSizes.push_back(cornerCount);
+        chunk.polygonMaterials.push_back(chunk.material);
+        return true;
+    }
+
+    // Rest of the line with the surrounding blanks removed, for names that may contain spaces
+    std::string ReadName(const char* p, const char* end)
+    {
+        p = SkipBlanks(p, end);
+        while (end > p && (IsBlank(end[-1]) || end[-1] == '\n'))
+            --end;
+        return std::string(p, end);
+    }
+
+    uint32_t FindOrAddName(std::vector<std::string>& names, const std::string& name)
+    {
+        auto found = std::find(names.begin(), names.end(), name);
+        if (found != names.end())
+        {
+            return static_cast<uint32_t>(found - names.begin());
+        }
+
+        names.push_back(name);
+        return static_cast<uint32_t>(names.size() - 1);
+    }
+
+    // Replaces every zero normal index with a smooth normal: the area weighted sum of the face
+    // normals around the corner's position, accumulated and normalized with SIMD vector math
+    void GenerateNormals(ObjData& data, std::vector<ObjCorner>& triangles)
+    {
+        const size_t positionCount = data.positions.size();
+        std::vector<XMFLOAT4> accumulated(positionCount, XMFLOAT4(0.f, 0.f, 0.f, 0.f));
+
+        for (size_t t = 0; t < triangles.size(); t += 3)
+        {
+            const size_t i0 = triangles[t + 0].v - 1;
+            const size_t i1 = triangles[t + 1].v - 1;
+            const size_t i2 = triangles[t + 2].v - 1;
+            XMVECTOR p0 = XMLoadFloat3(&data.positions[i0]);
+            XMVECTOR p1 = XMLoadFloat3(&data.positions[i1]);
+            XMVECTOR p2 = XMLoadFloat3(&data.positions[i2]);
+
+            // The unnormalized cross product is already weighted by twice the triangle area
+            XMVECTOR faceNormal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+            XMStoreFloat4(&accumulated[i0], XMVectorAdd(XMLoadFloat4(&accumulated[i0]), faceNormal));
+            XMStoreFloat4(&accumulated[i1], XMVectorAdd(XMLoadFloat4(&accumulated[i1]), faceNormal));
+            XMStoreFloat4(&accumulated[i2], XMVectorAdd(XMLoadFloat4(&accumulated[i2]), faceNormal));
+        }
+
+        // Generated normals are appended after the file's own, one per position
+        const size_t base = data.normals.size();
+        data.normals.resize(base + positionCount);
+        for (size_t i = 0; i < positionCount; i++)
+        {
+            XMStoreFloat3(&data.normals[base + i], XMVector3Normalize(XMLoadFloat4(&accumulated[i])));
+        }
+
+        for (auto& corner : triangles)
+        {
+            if (corner.vn == 0)
+            {
+                corner.vn = static_cast<int32_t>(base) + corner.v;
+            }
+        }
+    }
+
+    void ParseChunk(ObjChunk& chunk)
+    {
+        const char* p = chunk.begin;
+        const char* end = chunk.end;
+        ObjData& data = chunk.data;
+
+        // Rough guess at the record count so the streams don't reallocate while parsing
+        size_t estimate = static_cast<size_t>(end - p) / 32;
+        data.positions.reserve(estimate);
+        data.normals.reserve(estimate / 8);
+        data.texCoords.reserve(estimate / 8);
+        chunk.corners.reserve(estimate);
+        chunk.polygonSizes.reserve(estimate / 3);
+        chunk.polygonMaterials.reserve(estimate / 3);
+
+        chunk.material = -1;
+        chunk.result = true;
+        while (p < end)
+        {
+            p = SkipBlanks(p, end);
+            const char* lineEnd = NextLine(p, end);
+
+            if (p + 1 < lineEnd && p[0] == 'v' && IsBlank(p[1])) // Vertex
+            {
+                XMFLOAT3 vertex;
+                p += 1;
+                if (!ObjLoader::ParseFloat(p, lineEnd, vertex.x) ||
+                    !ObjLoader::ParseFloat(p, lineEnd, vertex.y) ||
+                    !ObjLoader::ParseFloat(p, lineEnd, vertex.z))
+                {
+                    chunk.result = false;
+                    return;
+                }
+                data.positions.push_back(vertex);
+            }
+            else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 't' && IsBlank(p[2])) // Tex Coord
+            {
+                XMFLOAT2 uv;
+                p += 2;
+                if (!ObjLoader::ParseFloat(p, lineEnd, uv.x) ||
+                    !ObjLoader::ParseFloat(p, lineEnd, uv.y))
+                {
+                    chunk.result = false;
+                    return;
+                }
+                data.texCoords.push_back(uv);
+            }
+            else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' && IsBlank(p[2])) // Normal
+            {
+                XMFLOAT3 normal;
+                p += 2;
+                if (!ObjLoader::ParseFloat(p, lineEnd, normal.x) ||
+                    !ObjLoader::ParseFloat(p, lineEnd, normal.y) ||
+                    !ObjLoader::ParseFloat(p, lineEnd, normal.z))
+                {
+                    chunk.result = false;
+                    return;
+                }
+                data.normals.push_back(normal);
+            }
+            else if (p + 1 < lineEnd && p[0] == 'f' && IsBlank(p[1])) // Face
+            {
+                if (!ParseFace(p + 1, lineEnd, chunk))
+                {
+                    // Parser error, or fewer than three corners
+                    chunk.result = false;
+                    return;
+                }
+            }
+
+            else if (p + 6 < lineEnd && std::strncmp(p, "usemtl", 6) == 0 && IsBlank(p[6])) // Material
+            {
+                chunk.material = static_cast<int32_t>(FindOrAddName(data.materialNames, ReadName(p + 6, lineEnd)));
+            }
+            else if (p + 6 < lineEnd && std::strncmp(p, "mtllib", 6) == 0 && IsBlank(p[6])) // Material library
+            {
+                FindOrAddName(data.materialLibraries, ReadName(p + 6, lineEnd));
+            }
+
+            // Comments, groups, smoothing groups etc. are skipped
+            p = lineEnd;
+        }
+    }
+}
+
+void ObjData::Clear() noexcept
+{
+    positions.clear();
+    texCoords.clear();
+    normals.clear();
+    faces.clear();
+    materialLibraries.clear();
+    materialNames.clear();
+    triangleMaterials.clear();
+}
+
+bool ObjLoader::LoadFile(const char* filename, ObjData& data, unsigned int threadCount)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        return false;
+    }
+
+    return Parse(file.GetData(), file.GetSize(), data, threadCount);
+}
+
+bool ObjLoader::Parse(const char* text, size_t size, ObjData& data, unsigned int threadCount)
+{
+    data.Clear();
+
+    JobSystem& jobs = JobSystem::Get();
+    if (threadCount == 0)
+    {
+        threadCount = jobs.GetThreadCount();
+    }
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, size / MinChunkBytes));
+
+    // Split the text into roughly equal chunks, moving each split point forward to the next line start
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char* end = text + size;
+    const char* begin = text;
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        const char* split = (i + 1 == chunkCount) ? end : NextLine(text + size * (i + 1) / chunkCount, end);
+        chunks[i].begin = begin;
+        chunks[i].end = std::max(begin, split);
+        begin = chunks[i].end;
+    }
+
+    // Each chunk is a job, the calling thread parses some of them while it waits
+    jobs.ParallelFor(chunkCount, 1, [&chunks](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            ParseChunk(chunks[i]);
+        }
+    });
+
+    // Merge the chunks in file order
+    size_t positionCount = 0, texCoordCount = 0, normalCount = 0, cornerCount = 0;
+    for (auto& chunk : chunks)
+    {
+        if (!chunk.result)
+        {
+            return false;
+        }
+        positionCount += chunk.data.positions.size();
+        texCoordCount += chunk.data.texCoords.size();
+        normalCount += chunk.data.normals.size();
+        cornerCount += chunk.corners.size();
+    }
+
+    data.positions.reserve(positionCount);
+    data.texCoords.reserve(texCoordCount);
+    data.normals.reserve(normalCount);
+
+    std::vector<ObjCorner> corners;
+    std::vector<uint32_t> polygonSizes;
+    std::vector<uint32_t> polygonMaterials;
+    corners.reserve(cornerCount);
+    int32_t material = -1;
+    for (auto& chunk : chunks)
+    {
+        // Material names are merged by name. Polygons before a chunk's first usemtl carry on
+        // with the material that was active at the end of the previous chunk.
+        for (int32_t polygonMaterial : chunk.polygonMaterials)
+        {
+            if (polygonMaterial >= 0)
+            {
+                material = static_cast<int32_t>(FindOrAddName(data.materialNames, chunk.data.materialNames[polygonMaterial]));
+            }
+            else if (material < 0)
+            {
+                material = static_cast<int32_t>(FindOrAddName(data.materialNames, std::string()));
+            }
+            polygonMaterials.push_back(static_cast<uint32_t>(material));
+        }
+        if (chunk.material >= 0)
+        {
+            material = static_cast<int32_t>(FindOrAddName(data.materialNames, chunk.data.materialNames[chunk.material]));
+        }
+        for (const auto& library : chunk.data.materialLibraries)
+        {
+            FindOrAddName(data.materialLibraries, library);
+        }
+
+        // Relative indices become absolute once the attribute counts before this chunk are known
+        const int32_t offsets[3] =
+        {
+            static_cast<int32_t>(data.positions.size()),
+            static_cast<int32_t>(data.texCoords.size()),
+            static_cast<int32_t>(data.normals.size())
+        };
+        for (uint32_t component : chunk.relative)
+        {
+            int32_t* corner = &chunk.corners[component / 3].v;
+            corner[component % 3] += offsets[component % 3];
+        }
+
+        data.positions.insert(data.positions.end(), chunk.data.positions.begin(), chunk.data.positions.end());
+        data.texCoords.insert(data.texCoords.end(), chunk.data.texCoords.begin(), chunk.data.texCoords.end());
+        data.normals.insert(data.normals.end(), chunk.data.normals.begin(), chunk.data.normals.end());
+        corners.insert(corners.end(), chunk.corners.begin(), chunk.corners.end());
+        polygonSizes.insert(polygonSizes.end(), chunk.polygonSizes.begin(), chunk.polygonSizes.end());
+    }
+
+    // Every index has to land inside its stream; a position is required, texcoord and normal are optional
+    bool missingTexCoords = false, missingNormals = false;
+    for (const auto& corner : corners)
+    {
+        if (corner.v < 1 || size_t(corner.v) > positionCount ||
+            corner.vt < 0 || size_t(corner.vt) > texCoordCount ||
+            corner.vn < 0 || size_t(corner.vn) > normalCount)
+        {
+            data.Clear();
+            return false;
+        }
+        missingTexCoords |= (corner.vt == 0);
+        missingNormals |= (corner.vn == 0);
+    }
+
+    // Triangulate the polygons, triangles pass straight through
+    std::vector<ObjCorner> triangles;
+    std::vector<uint32_t> polygon;
+    std::vector<uint32_t> clipped;
+    triangles.reserve(cornerCount + cornerCount / 2);
+    data.triangleMaterials.reserve(triangles.capacity() / 3);
+    size_t first = 0;
+    for (size_t polygonIndex = 0; polygonIndex < polygonSizes.size(); polygonIndex++)
+    {
+        const uint32_t size = polygonSizes[polygonIndex];
+        if (size == 3)
+        {
+            triangles.insert(triangles.end(), corners.begin() + first, corners.begin() + first + 3);
+        }
+        else
+        {
+            polygon.resize(size);
+            for (uint32_t i = 0; i < size; i++)
+                polygon[i] = static_cast<uint32_t>(corners[first + i].v - 1);
+
+            clipped.clear();
+            TriangulatePolygon(data.positions, polygon.data(), size, clipped);
+            for (uint32_t corner : clipped)
+                triangles.push_back(corners[first + corner]);
+        }
+        data.triangleMaterials.resize(triangles.size() / 3, polygonMaterials[polygonIndex]);
+        first += size;
+    }
+
+    // Corners without a texcoord all share a single (0, 0) entry
+    if (missingTexCoords)
+    {
+        data.texCoords.push_back(XMFLOAT2(0.f, 0.f));
+        const int32_t defaultTexCoord = static_cast<int32_t>(data.texCoords.size());
+        for (auto& corner : triangles)
+        {
+            if (corner.vt == 0)
+                corner.vt = defaultTexCoord;
+        }
+    }
+
+    if (missingNormals)
+    {
+        GenerateNormals(data, triangles);
+    }
+
+    data.faces.resize(triangles.size() * 3);
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        data.faces[i * 3 + 0] = static_cast<unsigned int>(triangles[i].v);
+        data.faces[i * 3 + 1] = static_cast<unsigned int>(triangles[i].vt);
+        data.faces[i * 3 + 2] = static_cast<unsigned int>(triangles[i].vn);
+    }
+
+    return true;
+}
+
+void ObjLoader::TriangulatePolygon(const std::vector<XMFLOAT3>& positions, const uint32_t* polygon, size_t count,
+    std::vector<uint32_t>& triangles)
+{
+    if (count < 3)
+    {
+        return;
+    }
+
+    // Newell's method gives a robust normal for the (roughly planar) polygon
+    XMFLOAT3 normal(0.f, 0.f, 0.f);
+    for (size_t i = 0; i < count; i++)
+    {
+        const XMFLOAT3& a = positions[polygon[i]];
+        const XMFLOAT3& b = positions[polygon[(i + 1) % count]];
+        normal.x += (a.y - b.y) * (a.z + b.z);
+        normal.y += (a.z - b.z) * (a.x + b.x);
+        normal.z += (a.x - b.x) * (a.y + b.y);
+    }
+
+    // Project onto the plane that drops the dominant normal axis
+    int axisU = 0, axisV = 1;
+    float sign = normal.z;
+    if (std::fabs(normal.x) >= std::fabs(normal.y) && std::fabs(normal.x) >= std::fabs(normal.z))
+    {
+        axisU = 1; axisV = 2; sign = normal.x;
+    }
+    else if (std::fabs(normal.y) >= std::fabs(normal.z))
+    {
+        axisU = 2; axisV = 0; sign = normal.y;
+    }
+
+    std::vector<XMFLOAT2> projected(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* p = &positions[polygon[i]].x;
+        projected[i] = XMFLOAT2(p[axisU], p[axisV]);
+    }
+    const float orientation = (sign >= 0.f) ? 1.f : -1.f;
+
+    auto cross = [&](size_t a, size_t b, size_t c)
+    {
+        return ((projected[b].x - projected[a].x) * (projected[c].y - projected[a].y) -
+            (projected[b].y - projected[a].y) * (projected[c].x - projected[a].x)) * orientation;
+    };
+
+    std::vector<uint32_t> remaining(count);
+    for (size_t i = 0; i < count; i++)
+        remaining[i] = static_cast<uint32_t>(i);
+
+    while (remaining.size() > 3)
+    {
+        const size_t n = remaining.size();
+        bool clipped = false;
+        for (size_t i = 0; i < n && !clipped; i++)
+        {
+            uint32_t prev = remaining[(i + n - 1) % n];
+            uint32_t cur = remaining[i];
+            uint32_t next = remaining[(i + 1) % n];
+
+            // Reflex or degenerate corners can't be ears
+            if (cross(prev, cur, next) <= 0.f)
+                continue;
+
+            // Nor can corners whose triangle contains another remaining vertex
+            bool contains = false;
+            for (size_t j = 0; j < n && !contains; j++)
+            {
+                uint32_t other = remaining[j];
+                if (other == prev || other == cur || other == next)
+                    continue;
+                contains = cross(prev, cur, other) >= 0.f && cross(cur, next, other) >= 0.f && cross(next, prev, other) >= 0.f;
+            }
+            if (contains)
+                continue;
+
+            triangles.push_back(prev);
+            triangles.push_back(cur);
+            triangles.push_back(next);
+            remaining.erase(remaining.begin() + i);
+            clipped = true;
+        }
+
+        // No ear left means the polygon is self intersecting or degenerate, so fan what remains
+        if (!clipped)
+        {
+            for (size_t i = 1; i + 1 < remaining.size(); i++)
+            {
+                triangles.push_back(remaining[0]);
+                triangles.push_back(remaining[i]);
+                triangles.push_back(remaining[i + 1]);
+            }
+            return;
+        }
+    }
+
+    triangles.push_back(remaining[0]);
+    triangles.push_back(remaining[1]);
+    triangles.push_back(remaining[2]);
+}
+
+bool ObjLoader::ParseFloat(const char*& cursor, const char* end, float& value) noexcept
+{
+    const char* start = SkipBlanks(cursor, end);
+    const char* p = start;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    // Accumulate up to 19 significant digits into an integer mantissa
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+    bool truncated = false;
+
+    while (p < end && IsDigit(*p))
+    {
+        if (significant < 19)
+        {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            if (mantissa)
+                significant++;
+        }
+        else
+        {
+            exponent++;
+            truncated = true;
+        }
+        anyDigits = true;
+        ++p;
+    }
+
+    if (p < end && *p == '.')
+    {
+        ++p;
+        while (p < end && IsDigit(*p))
+        {
+            if (significant < 19)
+            {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                if (mantissa)
+                    significant++;
+                exponent--;
+            }
+            else
+            {
+                truncated = true;
+            }
+            anyDigits = true;
+            ++p;
+        }
+    }
+
+    bool fastPath = anyDigits && !truncated;
+    if (fastPath && p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+        {
+            negativeExponent = (*q == '-');
+            ++q;
+        }
+
+        int explicitExponent = 0;
+        const char* digits = q;
+        while (q < end && IsDigit(*q) && explicitExponent < 10000)
+        {
+            explicitExponent = explicitExponent * 10 + (*q - '0');
+            ++q;
+        }
+
+        if (q == digits || (q < end && IsDigit(*q)))
+        {
+            fastPath = false;
+        }
+        else
+        {
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            p = q;
+        }
+    }
+
+    // Both operands are exact floats, so a single multiply or divide is correctly rounded
+    if (fastPath && mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10)
+    {
+        float result = static_cast<float>(mantissa);
+        result = (exponent < 0) ? result / Pow10[-exponent] : result * Pow10[exponent];
+        value = negative ? -result : result;
+        cursor = p;
+        return true;
+    }
+
+    // Long mantissas, large exponents, inf and nan go through the CRT
+    char buffer[64];
+    size_t length = 0;
+    while (start + length < end && length < sizeof(buffer) - 1 && !IsBlank(start[length]) && start[length] != '\n')
+    {
+        buffer[length] = start[length];
+        length++;
+    }
+    buffer[length] = '\0';
+
+    char* tail = nullptr;
+    float result = strtof(buffer, &tail);
+    if (tail == buffer)
+    {
+        return false;
+    }
+
+    value = result;
+    cursor = start + (tail - buffer);
+    return true;
+}
@@ -0,0 +1,56 @@
+//
+// ObjLoader.h - Multithreaded Wavefront OBJ parser
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace DX
+{
+    // Attribute streams read from an OBJ file.
+    // Faces hold 1-based v/vt/vn index triples, three corners per triangle. Polygons are already
+    // triangulated, relative indices resolved and missing texcoords/normals filled in, so every
+    // index in faces is valid.
+    struct ObjData
+    {
+        std::vector<DirectX::XMFLOAT3> positions;
+        std::vector<DirectX::XMFLOAT2> texCoords;
+        std::vector<DirectX::XMFLOAT3> normals;
+        std::vector<unsigned int> faces;
+
+        // mtllib file names (relative to the OBJ) and usemtl names in order of first use.
+        // triangleMaterials holds one materialNames index per triangle; faces before the
+        // first usemtl use a material with an empty name.
+        std::vector<std::string> materialLibraries;
+        std::vector<std::string> materialNames;
+        std::vector<uint32_t> triangleMaterials;
+
+        void Clear() noexcept;
+    };
+
+    // Memory maps an OBJ file, splits it into line aligned chunks and parses the
+    // v/vt/vn/f records of each chunk as a job of its own before merging the results.
+    //
+    // Faces may use v, v/vt, v//vn or v/vt/vn corners with absolute or negative (relative)
+    // indices, and any number of corners. Polygons are ear clipped into triangles and corners
+    // without a normal get a smooth, area weighted vertex normal.
+    class ObjLoader
+    {
+    public:
+        // threadCount of 0 uses every thread of the job system (small files always parse on one thread).
+        static bool LoadFile(const char* filename, ObjData& data, unsigned int threadCount = 0);
+        static bool Parse(const char* text, size_t size, ObjData& data, unsigned int threadCount = 0);
+
+        // Ear clips a planar polygon (given as 0-based position indices) into triangles,
+        // appending corner numbers 0..count-1 to triangles, three per triangle.
+        static void TriangulatePolygon(const std::vector<DirectX::XMFLOAT3>& positions, const uint32_t* polygon, size_t count,
+            std::vector<uint32_t>& triangles);
+
+        // Parses a single float starting at cursor (leading blanks are skipped) and advances cursor past it.
+        // Results are bit identical to strtof / scanf("%f").
+        static bool ParseFloat(const char*& cursor, const char* end, float& value) noexcept;
+    };
+}
@@ -0,0 +1,430 @@
+//
+// OcclusionCuller.cpp - Software depth rasterizer for culling draws hidden behind large occluders
+//
+
+#include "pch.h"
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+
+#include <cfloat>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    // Triangles are clipped to the near plane and to a band this many times the screen's half
+    // size, which keeps the edge equations' pixel coordinates small enough to stay exact
+    constexpr float GuardBand = 4.f;
+
+    // Near plane and guard band planes in clip space, a vertex is inside when its dot with the
+    // plane is at least 0. A triangle gains at most one vertex per plane.
+    constexpr int ClipPlaneCount = 5;
+    constexpr int MaxClippedVertices = 3 + ClipPlaneCount;
+    const XMFLOAT4 ClipPlanes[ClipPlaneCount] =
+    {
+        { 0.f, 0.f, 1.f, 0.f },
+        { 1.f, 0.f, 0.f, GuardBand },
+        { -1.f, 0.f, 0.f, GuardBand },
+        { 0.f, 1.f, 0.f, GuardBand },
+        { 0.f, -1.f, 0.f, GuardBand }
+    };
+
+    inline float PlaneDistance(const XMFLOAT4& plane, const XMFLOAT4& v) noexcept
+    {
+        return plane.x * v.x + plane.y * v.y + plane.z * v.z + plane.w * v.w;
+    }
+
+    // True when all three vertices are outside the same view frustum plane
+    bool IsOutsideFrustum(const XMFLOAT4* clip) noexcept
+    {
+        int outside[6] = {};
+        for (int i = 0; i < 3; i++)
+        {
+            const XMFLOAT4& v = clip[i];
+            outside[0] += v.x < -v.w;
+            outside[1] += v.x > v.w;
+            outside[2] += v.y < -v.w;
+            outside[3] += v.y > v.w;
+            outside[4] += v.z < 0.f;
+            outside[5] += v.z > v.w;
+        }
+        return std::find(outside, outside + 6, 3) != outside + 6;
+    }
+}
+
+OcclusionCuller::OcclusionCuller() noexcept :
+    m_width(0),
+    m_height(0),
+    m_tilesX(0),
+    m_tilesY(0),
+    m_viewProjection{},
+    m_stats{}
+{
+}
+
+void OcclusionCuller::Resize(uint32_t width, uint32_t height)
+{
+    m_tilesX = (std::max(width, 1u) + TileSize - 1) / TileSize;
+    m_tilesY = (std::max(height, 1u) + TileSize - 1) / TileSize;
+    m_width = m_tilesX * TileSize;
+    m_height = m_tilesY * TileSize;
+    m_depth.assign(size_t(m_width) * m_height, 1.f);
+    m_tileDepth.assign(size_t(m_tilesX) * m_tilesY, 1.f);
+}
+
+void XM_CALLCONV OcclusionCuller::Begin(FXMMATRIX viewProjection)
+{
+    XMStoreFloat4x4(&m_viewProjection, viewProjection);
+    std::fill(m_depth.begin(), m_depth.end(), 1.f);
+    std::fill(m_tileDepth.begin(), m_tileDepth.end(), 1.f);
+    m_clipVertices.clear();
+    m_indices.clear();
+    m_stats = {};
+}
+
+void XM_CALLCONV OcclusionCuller::AddOccluder(const XMFLOAT3* positions, const uint32_t* indices, size_t indexCount,
+    FXMMATRIX world)
+{
+    // Only the vertices the triangles use are transformed
+    const uint32_t base = static_cast<uint32_t>(m_clipVertices.size());
+    uint32_t vertexCount = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        vertexCount = std::max(vertexCount, indices[i] + 1);
+    }
+
+    const XMMATRIX worldViewProjection = XMMatrixMultiply(world, XMLoadFloat4x4(&m_viewProjection));
+    m_clipVertices.resize(base + vertexCount);
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        XMStoreFloat4(&m_clipVertices[base + i], XMVector3Transform(XMLoadFloat3(&positions[i]), worldViewProjection));
+    }
+
+    m_indices.reserve(m_indices.size() + indexCount);
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        m_indices.push_back(base + indices[i]);
+    }
+    m_stats.occluderTriangles += static_cast<uint32_t>(indexCount / 3);
+}
+
+void OcclusionCuller::Rasterize(unsigned int threadCount)
+{
+    if (m_width == 0)
+    {
+        return;
+    }
+
+    m_triangles.clear();
+    for (size_t i = 0; i + 2 < m_indices.size(); i += 3)
+    {
+        const XMFLOAT4 clip[3] = { m_clipVertices[m_indices[i]], m_clipVertices[m_indices[i + 1]], m_clipVertices[m_indices[i + 2]] };
+        SetupTriangle(clip);
+    }
+    m_stats.rasterizedTriangles = static_cast<uint32_t>(m_triangles.size());
+
+    JobSystem& jobs = JobSystem::Get();
+    if (threadCount == 0)
+    {
+        threadCount = jobs.GetThreadCount();
+    }
+    const size_t bandCount = std::max<size_t>(1, std::min<size_t>({ threadCount, m_tilesY, m_triangles.size() / MinTrianglesPerJob }));
+
+    // Bands are whole tile rows, each job owns its rows of the buffer. The calling thread draws
+    // its share of the bands while it waits for the jobs.
+    auto bandBegin = [this, bandCount](size_t band)
+    {
+        return static_cast<uint32_t>(m_tilesY * band / bandCount * TileSize);
+    };
+    jobs.ParallelFor(bandCount, 1, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            RasterizeBand(bandBegin(i), bandBegin(i + 1));
+        }
+    });
+}
+
+bool XM_CALLCONV OcclusionCuller::IsVisible(FXMVECTOR center, FXMVECTOR extents)
+{
+    m_stats.testedBounds++;
+    if (m_width == 0)
+    {
+        return true;
+    }
+
+    // Screen rectangle and nearest depth of the eight corners. The nearest point of a box is
+    // always one of its corners.
+    const XMMATRIX viewProjection = XMLoadFloat4x4(&m_viewProjection);
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearest = FLT_MAX;
+    for (int i = 0; i < 8; i++)
+    {
+        const XMVECTOR sign = XMVectorSet(i & 1 ? 1.f : -1.f, i & 2 ? 1.f : -1.f, i & 4 ? 1.f : -1.f, 0.f);
+        XMFLOAT4 clip;
+        XMStoreFloat4(&clip, XMVector3Transform(XMVectorMultiplyAdd(extents, sign, center), viewProjection));
+
+        // Boxes reaching through the near plane are too close to judge
+        if (clip.z < 0.f || clip.w <= 0.f)
+        {
+            return true;
+        }
+
+        const float invW = 1.f / clip.w;
+        const float x = (clip.x * invW * 0.5f + 0.5f) * m_width;
+        const float y = (0.5f - clip.y * invW * 0.5f) * m_height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, clip.z * invW);
+    }
+
+    // Every pixel the rectangle touches, however little, and one more all around. Occluders
+    // cover whole pixels whose centers they cover, so a box seen past an occluder's edge may
+    // only show in the next pixel over.
+    const int x0 = static_cast<int>(std::floor(std::max(minX - 1.f, 0.f)));
+    const int y0 = static_cast<int>(std::floor(std::max(minY - 1.f, 0.f)));
+    const int x1 = static_cast<int>(std::ceil(std::min(maxX + 1.f, float(m_width)))) - 1;
+    const int y1 = static_cast<int>(std::ceil(std::min(maxY + 1.f, float(m_height)))) - 1;
+    if (x0 > x1 || y0 > y1)
+    {
+        // Off screen, which is the frustum culler's call
+        return true;
+    }
+
+    for (int tileY = y0 / static_cast<int>(TileSize); tileY <= y1 / static_cast<int>(TileSize); tileY++)
+    {
+        for (int tileX = x0 / static_cast<int>(TileSize); tileX <= x1 / static_cast<int>(TileSize); tileX++)
+        {
+            // The whole tile is nearer than the box
+            if (nearest > m_tileDepth[size_t(tileY) * m_tilesX + tileX])
+                continue;
+
+            const int rowBegin = std::max(y0, tileY * static_cast<int>(TileSize));
+            const int rowEnd = std::min(y1 + 1, (tileY + 1) * static_cast<int>(TileSize));
+            const int columnBegin = std::max(x0, tileX * static_cast<int>(TileSize));
+            const int columnEnd = std::min(x1 + 1, (tileX + 1) * static_cast<int>(TileSize));
+            for (int y = rowBegin; y < rowEnd; y++)
+            {
+                const float* row = &m_depth[size_t(y) * m_width];
+                for (int x = columnBegin; x < columnEnd; x++)
+                {
+                    if (row[x] >= nearest)
+                        return true;
+                }
+            }
+        }
+    }
+
+    m_stats.occludedBounds++;
+    return false;
+}
+
+// Clips a clip space triangle to the near plane and the guard band, then adds the pieces
+void OcclusionCuller::SetupTriangle(const XMFLOAT4* clip)
+{
+    if (IsOutsideFrustum(clip))
+    {
+        return;
+    }
+
+    XMFLOAT4 polygon[2][MaxClippedVertices];
+    int count = 3;
+    std::copy(clip, clip + 3, polygon[0]);
+
+    // Sutherland-Hodgman, only against the planes some vertex is behind
+    int current = 0;
+    for (int p = 0; p < ClipPlaneCount; p++)
+    {
+        const XMFLOAT4& plane = ClipPlanes[p];
+        const XMFLOAT4* input = polygon[current];
+        bool clipped = false;
+        for (int i = 0; i < count; i++)
+        {
+            clipped |= PlaneDistance(plane, input[i]) < 0.f;
+        }
+        if (!clipped)
+            continue;
+
+        XMFLOAT4* output = polygon[current ^ 1];
+        int outputCount = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const XMFLOAT4& a = input[i];
+            const XMFLOAT4& b = input[(i + 1) % count];
+            const float distanceA = PlaneDistance(plane, a);
+            const float distanceB = PlaneDistance(plane, b);
+            if (distanceA >= 0.f)
+            {
+                output[outputCount++] = a;
+            }
+            if ((distanceA >= 0.f) != (distanceB >= 0.f))
+            {
+                // Always from the inside end, so both triangles sharing the edge cut it at the same point
+                const XMFLOAT4& from = distanceA >= 0.f ? a : b;
+                const XMFLOAT4& to = distanceA >= 0.f ? b : a;
+                const float distanceFrom = distanceA >= 0.f ? distanceA : distanceB;
+                const float distanceTo = distanceA >= 0.f ? distanceB : distanceA;
+                const float t = distanceFrom / (distanceFrom - distanceTo);
+                output[outputCount++] = XMFLOAT4(from.x + (to.x - from.x) * t, from.y + (to.y - from.y) * t,
+                    from.z + (to.z - from.z) * t, from.w + (to.w - from.w) * t);
+            }
+        }
+        count = outputCount;
+        current ^= 1;
+        if (count < 3)
+            return;
+    }
+
+    // Pixel coordinates with y down, and z / w
+    XMFLOAT3 screen[MaxClippedVertices];
+    for (int i = 0; i < count; i++)
+    {
+        const XMFLOAT4& v = polygon[current][i];
+        const float invW = 1.f / v.w;
+        screen[i] = XMFLOAT3((v.x * invW * 0.5f + 0.5f) * m_width, (0.5f - v.y * invW * 0.5f) * m_height, v.z * invW);
+    }
+
+    for (int i = 1; i + 1 < count; i++)
+    {
+        const XMFLOAT3 triangle[3] = { screen[0], screen[i], screen[i + 1] };
+        AddScreenTriangle(triangle);
+    }
+}
+
+void OcclusionCuller::AddScreenTriangle(const XMFLOAT3* screen)
+{
+    // Pixels whose centers are inside the triangle's bounds
+    const float minX = std::min({ screen[0].x, screen[1].x, screen[2].x });
+    const float maxX = std::max({ screen[0].x, screen[1].x, screen[2].x });
+    const float minY = std::min({ screen[0].y, screen[1].y, screen[2].y });
+    const float maxY = std::max({ screen[0].y, screen[1].y, screen[2].y });
+
+    Triangle triangle;
+    triangle.minX = std::max(0, static_cast<int>(std::ceil(minX - 0.5f)));
+    triangle.minY = std::max(0, static_cast<int>(std::ceil(minY - 0.5f)));
+    triangle.maxX = std::min(static_cast<int>(m_width) - 1, static_cast<int>(std::floor(maxX - 0.5f)));
+    triangle.maxY = std::min(static_cast<int>(m_height) - 1, static_cast<int>(std::floor(maxY - 0.5f)));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+    {
+        return;
+    }
+
+    // Edge i is the one opposite vertex i, zero along the edge and growing towards the vertex.
+    // Two triangles sharing an edge compute exactly opposite values for it, so every pixel center
+    // along the edge is covered by at least one of them.
+    float edgeOffset[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const XMFLOAT3& a = screen[(i + 1) % 3];
+        const XMFLOAT3& b = screen[(i + 2) % 3];
+        triangle.edgeX[i] = a.y - b.y;
+        triangle.edgeY[i] = b.x - a.x;
+        edgeOffset[i] = a.x * b.y - a.y * b.x;
+    }
+
+    // Either winding is drawn, the edges are flipped so that inside is positive
+    float area = triangle.edgeX[0] * screen[0].x + triangle.edgeY[0] * screen[0].y + edgeOffset[0];
+    if (area == 0.f)
+    {
+        return;
+    }
+    if (area < 0.f)
+    {
+        area = -area;
+        for (int i = 0; i < 3; i++)
+        {
+            triangle.edgeX[i] = -triangle.edgeX[i];
+            triangle.edgeY[i] = -triangle.edgeY[i];
+            edgeOffset[i] = -edgeOffset[i];
+        }
+    }
+
+    // Depth is the barycentric blend of the vertex depths, a plane over the screen
+    const float invArea = 1.f / area;
+    triangle.depthX = (triangle.edgeX[0] * screen[0].z + triangle.edgeX[1] * screen[1].z + triangle.edgeX[2] * screen[2].z) * invArea;
+    triangle.depthY = (triangle.edgeY[0] * screen[0].z + triangle.edgeY[1] * screen[1].z + triangle.edgeY[2] * screen[2].z) * invArea;
+    const float depthOffset = (edgeOffset[0] * screen[0].z + edgeOffset[1] * screen[1].z + edgeOffset[2] * screen[2].z) * invArea;
+
+    // Evaluated at pixel (x, y), give the edges at the pixel's center and the farthest depth
+    // anywhere in the pixel
+    for (int i = 0; i < 3; i++)
+    {
+        triangle.edgeOffset[i] = edgeOffset[i] + 0.5f * triangle.edgeX[i] + 0.5f * triangle.edgeY[i];
+    }
+    triangle.depthOffset = depthOffset + std::max(triangle.depthX, 0.f) + std::max(triangle.depthY, 0.f);
+
+    m_triangles.push_back(triangle);
+}
+
+void OcclusionCuller::RasterizeBand(uint32_t firstRow, uint32_t endRow)
+{
+    const XMVECTOR zero = XMVectorZero();
+    const XMVECTOR four = XMVectorReplicate(4.f);
+
+    for (const Triangle& triangle : m_triangles)
+    {
+        const int y0 = std::max(triangle.minY, static_cast<int>(firstRow));
+        const int y1 = std::min(triangle.maxY, static_cast<int>(endRow) - 1);
+        if (y0 > y1)
+            continue;
+
+        // Spans start on a multiple of four pixels, the buffer width is one too
+        const int x0 = triangle.minX & ~3;
+        const XMVECTOR startX = XMVectorSet(float(x0), float(x0 + 1), float(x0 + 2), float(x0 + 3));
+        const XMVECTOR edgeX0 = XMVectorReplicate(triangle.edgeX[0]);
+        const XMVECTOR edgeX1 = XMVectorReplicate(triangle.edgeX[1]);
+        const XMVECTOR edgeX2 = XMVectorReplicate(triangle.edgeX[2]);
+        const XMVECTOR depthX = XMVectorReplicate(triangle.depthX);
+
+        for (int y = y0; y <= y1; y++)
+        {
+            // Row values are computed afresh and the pixel x advances exactly, so no error adds up
+            const float fy = float(y);
+            const XMVECTOR rowEdge0 = XMVectorReplicate(triangle.edgeY[0] * fy + triangle.edgeOffset[0]);
+            const XMVECTOR rowEdge1 = XMVectorReplicate(triangle.edgeY[1] * fy + triangle.edgeOffset[1]);
+            const XMVECTOR rowEdge2 = XMVectorReplicate(triangle.edgeY[2] * fy + triangle.edgeOffset[2]);
+            const XMVECTOR rowDepth = XMVectorReplicate(triangle.depthY * fy + triangle.depthOffset);
+
+            float* row = &m_depth[size_t(y) * m_width];
+            XMVECTOR x = startX;
+            for (int column = x0; column <= triangle.maxX; column += 4)
+            {
+                XMVECTOR covered = XMVectorGreaterOrEqual(XMVectorMultiplyAdd(x, edgeX0, rowEdge0), zero);
+                covered = XMVectorAndInt(covered, XMVectorGreaterOrEqual(XMVectorMultiplyAdd(x, edgeX1, rowEdge1), zero));
+                covered = XMVectorAndInt(covered, XMVectorGreaterOrEqual(XMVectorMultiplyAdd(x, edgeX2, rowEdge2), zero));
+
+                XMFLOAT4* pixels = reinterpret_cast<XMFLOAT4*>(row + column);
+                const XMVECTOR depth = XMLoadFloat4(pixels);
+                const XMVECTOR nearer = XMVectorMin(depth, XMVectorMultiplyAdd(x, depthX, rowDepth));
+                XMStoreFloat4(pixels, XMVectorSelect(depth, nearer, covered));
+
+                x = XMVectorAdd(x, four);
+            }
+        }
+    }
+
+    // Farthest depth of each tile in the band, two four pixel loads per tile row
+    static_assert(TileSize == 8, "Tile rows are read as two vectors");
+    for (uint32_t tileY = firstRow / TileSize; tileY < endRow / TileSize; tileY++)
+    {
+        for (uint32_t tileX = 0; tileX < m_tilesX; tileX++)
+        {
+            const float* pixels = &m_depth[size_t(tileY) * TileSize * m_width + tileX * TileSize];
+            XMVECTOR farthest = XMVectorMax(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(pixels)),
+                XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(pixels + 4)));
+            for (uint32_t y = 1; y < TileSize; y++)
+            {
+                const float* row = pixels + size_t(y) * m_width;
+                farthest = XMVectorMax(farthest, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row)));
+                farthest = XMVectorMax(farthest, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row + 4)));
+            }
+
+            XMFLOAT4 lanes;
+            XMStoreFloat4(&lanes, farthest);
+            m_tileDepth[size_t(tileY) * m_tilesX + tileX] = std::max(std::max(lanes.x, lanes.y), std::max(lanes.z, lanes.w));
+        }
+    }
+}
@@ -0,0 +1,94 @@
+//
+// OcclusionCuller.h - Software depth rasterizer for culling draws hidden behind large occluders
+//
+
+#pragma once
+
+#include <vector>
+
+namespace DX
+{
+    struct OcclusionCullStats
+    {
+        uint32_t occluderTriangles;     // Added this frame
+        uint32_t rasterizedTriangles;   // Left after clipping and dropping those off screen or without area
+        uint32_t testedBounds;
+        uint32_t occludedBounds;
+    };
+
+    // Draws a few simplified occluder meshes into a small depth buffer on the CPU, then tests world
+    // space boxes against it. Depth is D3D's, 0 at the near plane and 1 at the far one, written
+    // four pixels at a time with SIMD. Each 8 x 8 tile also keeps its farthest depth, which decides
+    // most boxes without looking at their pixels. Threads rasterize bands of whole tile rows.
+    //
+    // Occluders write the pixels whose centers they cover, with their farthest depth across the
+    // pixel, and a box counts as hidden only when its nearest depth is behind every pixel within
+    // one of its screen rectangle. A visible box is reported hidden only if all that shows of it
+    // is a sliver in a gap narrower than a pixel of the buffer.
+    class OcclusionCuller
+    {
+    public:
+        static constexpr uint32_t TileSize = 8;
+
+        // Fewer occluder triangles than this per job are rasterized on the calling thread only
+        static constexpr size_t MinTrianglesPerJob = 2048;
+
+        OcclusionCuller() noexcept;
+
+        // Depth buffer size in pixels, rounded up to whole tiles
+        void Resize(uint32_t width, uint32_t height);
+
+        // Clears the buffer and the occluders for a frame seen through viewProjection
+        void XM_CALLCONV Begin(DirectX::FXMMATRIX viewProjection);
+
+        // Object space triangle list drawn at world
+        void XM_CALLCONV AddOccluder(const DirectX::XMFLOAT3* positions, const uint32_t* indices, size_t indexCount,
+            DirectX::FXMMATRIX world);
+
+        // Draws the occluders added since Begin. Up to threadCount bands are drawn as jobs, 0 gives
+        // each thread of the job system one.
+        void Rasterize(unsigned int threadCount = 1);
+
+        // False when the world space box is entirely behind the rasterized occluders
+        bool XM_CALLCONV IsVisible(DirectX::FXMVECTOR center, DirectX::FXMVECTOR extents);
+
+        uint32_t GetWidth() const noexcept { return m_width; }
+        uint32_t GetHeight() const noexcept { return m_height; }
+        const float* GetDepth() const noexcept { return m_depth.data(); }
+        const OcclusionCullStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        // Screen space triangle ready to rasterize. Edges and depth are planes over pixel
+        // coordinates; a pixel is covered when all three edges are at least 0.
+        struct Triangle
+        {
+            float edgeX[3];
+            float edgeY[3];
+            float edgeOffset[3];
+            float depthX;
+            float depthY;
+            float depthOffset;
+            int minX;
+            int minY;
+            int maxX;
+            int maxY;
+        };
+
+        void SetupTriangle(const DirectX::XMFLOAT4* clip);
+        void AddScreenTriangle(const DirectX::XMFLOAT3* screen);
+        void RasterizeBand(uint32_t firstRow, uint32_t endRow);
+
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_tilesX;
+        uint32_t m_tilesY;
+        std::vector<float> m_depth;
+        std::vector<float> m_tileDepth;         // Farthest depth in each tile
+
+        DirectX::XMFLOAT4X4 m_viewProjection;
+        std::vector<DirectX::XMFLOAT4> m_clipVertices;
+        std::vector<uint32_t> m_indices;
+        std::vector<Triangle> m_triangles;
+        OcclusionCullStats m_stats;
+    };
+}
@@ -0,0 +1,293 @@
+//
+// Profiler.cpp - Scoped CPU timers per thread, exported as a Chrome trace and a per zone summary
+//
+
+#include "pch.h"
+#include "Profiler.h"
+
+#include <fstream>
+#include <unordered_map>
+
+using namespace DX;
+
+namespace DX
+{
+    struct ProfileThreadSlot
+    {
+        Profiler::ThreadRing* ring = nullptr;
+
+        ~ProfileThreadSlot()
+        {
+            if (ring)
+            {
+                Profiler::Get().ReleaseRing(ring);
+            }
+        }
+    };
+}
+
+namespace
+{
+    thread_local ProfileThreadSlot t_slot;
+
+    // Copies the last keep items written to a ring of slotCount slots, without the ones the writer
+    // may have overwritten during the copy. The writer fills slot head before it moves head on, so
+    // the item slotCount - 1 behind the last head read may be half written too. A ring with a slot
+    // more than it keeps loses nothing when the writer didn't move on.
+    template <typename T>
+    void CopyRing(const T* items, size_t slotCount, size_t keep, const std::atomic<uint64_t>& head, std::vector<T>& out)
+    {
+        const uint64_t end = head.load(std::memory_order_acquire);
+        const uint64_t begin = end > keep ? end - keep : 0;
+        const size_t first = out.size();
+        for (uint64_t i = begin; i < end; i++)
+        {
+            out.push_back(items[i % slotCount]);
+        }
+
+        const uint64_t after = head.load(std::memory_order_acquire);
+        const uint64_t overwritten = after + 1 > slotCount ? after + 1 - slotCount : 0;
+        if (overwritten > begin)
+        {
+            const size_t dropped = static_cast<size_t>(std::min(overwritten, end) - begin);
+            out.erase(out.begin() + first, out.begin() + first + dropped);
+        }
+    }
+
+    // Zone names are literals, quotes and backslashes are all that needs escaping
+    void WriteJsonString(std::ofstream& outFile, const char* text)
+    {
+        outFile << '"';
+        for (; *text; text++)
+        {
+            if (*text == '"' || *text == '\\')
+            {
+                outFile << '\\';
+            }
+            outFile << *text;
+        }
+        outFile << '"';
+    }
+}
+
+thread_local uint32_t ProfileZone::s_depth = 0;
+
+Profiler::Profiler() noexcept :
+    m_frames(new uint64_t[FrameSlots]),
+    m_frameHead(0)
+{
+}
+
+Profiler& Profiler::Get()
+{
+    static Profiler s_profiler;
+    return s_profiler;
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+    if (!t_slot.ring)
+    {
+        t_slot.ring = AcquireRing();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_threadNames[t_slot.ring->threadId] = name;
+}
+
+void Profiler::MarkFrame() noexcept
+{
+    const uint64_t head = m_frameHead.load(std::memory_order_relaxed);
+    m_frames[head % FrameSlots] = Now();
+    m_frameHead.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::Record(const char* name, uint64_t begin, uint64_t end, uint32_t depth) noexcept
+{
+    ThreadRing* ring = t_slot.ring;
+    if (!ring)
+    {
+        ring = t_slot.ring = AcquireRing();
+    }
+
+    // Only this thread writes the ring, publishing the event is a single store
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    ProfileEvent& event = ring->events[head % EventSlots];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    event.threadId = ring->threadId;
+    event.depth = depth;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+Profiler::ThreadRing* Profiler::AcquireRing()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // A reused ring keeps its older events, they still carry the id of the thread that wrote them
+    const uint32_t threadId = static_cast<uint32_t>(m_threadNames.size());
+    m_threadNames.emplace_back();
+    for (auto& ring : m_rings)
+    {
+        if (!ring->inUse)
+        {
+            ring->inUse = true;
+            ring->threadId = threadId;
+            return ring.get();
+        }
+    }
+
+    m_rings.push_back(std::make_unique<ThreadRing>());
+    ThreadRing* ring = m_rings.back().get();
+    ring->events.reset(new ProfileEvent[EventSlots]);
+    ring->head = 0;
+    ring->threadId = threadId;
+    ring->inUse = true;
+    return ring;
+}
+
+void Profiler::ReleaseRing(ThreadRing* ring)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ring->inUse = false;
+}
+
+void Profiler::Capture(ProfileCapture& capture) const
+{
+    capture.events.clear();
+    capture.frames.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& ring : m_rings)
+        {
+            CopyRing(ring->events.get(), EventSlots, EventsPerThread, ring->head, capture.events);
+        }
+        capture.threadNames = m_threadNames;
+    }
+    CopyRing(m_frames.get(), FrameSlots, FrameCount, m_frameHead, capture.frames);
+
+    std::sort(capture.events.begin(), capture.events.end(), [](const ProfileEvent& a, const ProfileEvent& b)
+    {
+        return a.begin < b.begin;
+    });
+}
+
+bool Profiler::WriteChromeTrace(const char* filename, const ProfileCapture& capture)
+{
+    std::ofstream outFile(filename, std::ios::out | std::ios::trunc);
+    if (!outFile)
+    {
+        return false;
+    }
+
+    // Times are in microseconds from the earliest one captured. Frames get a track of their own
+    // as tid 0, the threads follow from 1.
+    uint64_t origin = UINT64_MAX;
+    if (!capture.frames.empty())
+    {
+        origin = capture.frames.front();
+    }
+    if (!capture.events.empty())
+    {
+        origin = std::min(origin, capture.events.front().begin);
+    }
+    auto microseconds = [origin](uint64_t time)
+    {
+        return static_cast<double>(time - origin) / 1000.0;
+    };
+
+    char line[128];
+    outFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    outFile << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Frames\"}}";
+    for (size_t i = 0; i < capture.threadNames.size(); i++)
+    {
+        if (!capture.threadNames[i].empty())
+        {
+            sprintf_s(line, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":", i + 1);
+            outFile << line;
+            WriteJsonString(outFile, capture.threadNames[i].c_str());
+            outFile << "}}";
+        }
+    }
+    for (size_t i = 0; i + 1 < capture.frames.size(); i++)
+    {
+        sprintf_s(line, ",\n{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+            microseconds(capture.frames[i]), microseconds(capture.frames[i + 1]) - microseconds(capture.frames[i]));
+        outFile << line;
+    }
+    for (const ProfileEvent& event : capture.events)
+    {
+        outFile << ",\n{\"name\":";
+        WriteJsonString(outFile, event.name);
+        sprintf_s(line, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            event.threadId + 1, microseconds(event.begin), microseconds(event.end) - microseconds(event.begin));
+        outFile << line;
+    }
+    outFile << "\n]}\n";
+
+    return outFile.good();
+}
+
+void Profiler::Summarize(const ProfileCapture& capture, std::vector<ProfileZoneStats>& zones)
+{
+    // Only whole frames are summarized, everything when there aren't two frame markers
+    uint64_t begin = 0;
+    uint64_t end = UINT64_MAX;
+    size_t frameCount = 1;
+    if (capture.frames.size() >= 2)
+    {
+        begin = capture.frames.front();
+        end = capture.frames.back();
+        frameCount = capture.frames.size() - 1;
+    }
+
+    std::unordered_map<std::string, std::vector<uint64_t>> durations;
+    for (const ProfileEvent& event : capture.events)
+    {
+        if (event.begin >= begin && event.begin < end)
+        {
+            durations[event.name].push_back(event.end - event.begin);
+        }
+    }
+
+    zones.clear();
+    for (auto& zone : durations)
+    {
+        std::vector<uint64_t>& times = zone.second;
+        std::sort(times.begin(), times.end());
+        uint64_t total = 0;
+        for (uint64_t time : times)
+        {
+            total += time;
+        }
+
+        ProfileZoneStats stats;
+        stats.name = zone.first;
+        stats.count = static_cast<uint32_t>(times.size());
+        stats.minMilliseconds = times.front() / 1e6;
+        stats.averageMilliseconds = total / 1e6 / times.size();
+        stats.p99Milliseconds = times[(times.size() * 99 + 99) / 100 - 1] / 1e6;
+        stats.maxMilliseconds = times.back() / 1e6;
+        stats.perFrameMilliseconds = total / 1e6 / frameCount;
+        zones.push_back(stats);
+    }
+
+    std::sort(zones.begin(), zones.end(), [](const ProfileZoneStats& a, const ProfileZoneStats& b)
+    {
+        return a.perFrameMilliseconds > b.perFrameMilliseconds;
+    });
+}
+
+void Profiler::LogSummary(const std::vector<ProfileZoneStats>& zones)
+{
+    char message[256];
+    sprintf_s(message, "%-32s %8s %9s %9s %9s %9s %10s\n", "Zone", "Count", "Min ms", "Avg ms", "P99 ms", "Max ms", "ms/frame");
+    OutputDebugStringA(message);
+    for (const ProfileZoneStats& zone : zones)
+    {
+        sprintf_s(message, "%-32s %8u %9.3f %9.3f %9.3f %9.3f %10.3f\n", zone.name.c_str(), zone.count,
+            zone.minMilliseconds, zone.averageMilliseconds, zone.p99Milliseconds, zone.maxMilliseconds, zone.perFrameMilliseconds);
+        OutputDebugStringA(message);
+    }
+}
@@ -0,0 +1,154 @@
+//
+// Profiler.h - Scoped CPU timers per thread, exported as a Chrome trace and a per zone summary
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Zones and frame markers are only compiled in when DX_PROFILE is defined (see pch.h, DX_NO_PROFILE
+// turns it off). Without it the macros expand to nothing and the profiler is never touched.
+#ifdef DX_PROFILE
+#define DX_PROFILE_CONCAT_INNER(a, b) a##b
+#define DX_PROFILE_CONCAT(a, b) DX_PROFILE_CONCAT_INNER(a, b)
+#define DX_PROFILE_ZONE(name) DX::ProfileZone DX_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define DX_PROFILE_FRAME() DX::Profiler::Get().MarkFrame()
+#define DX_PROFILE_THREAD(name) DX::Profiler::Get().SetThreadName(name)
+#else
+#define DX_PROFILE_ZONE(name) ((void)0)
+#define DX_PROFILE_FRAME() ((void)0)
+#define DX_PROFILE_THREAD(name) ((void)0)
+#endif
+
+namespace DX
+{
+    // One finished zone. Names are string literals, so only the pointer is kept.
+    struct ProfileEvent
+    {
+        const char* name;
+        uint64_t begin;             // Nanoseconds on the profiler's clock
+        uint64_t end;
+        uint32_t threadId;
+        uint32_t depth;             // Zones open on the thread around this one
+    };
+
+    // Everything still in the rings when it was taken, events sorted by begin
+    struct ProfileCapture
+    {
+        std::vector<ProfileEvent> events;
+        std::vector<uint64_t> frames;           // Begin of each frame, oldest first
+        std::vector<std::string> threadNames;   // By thread id, empty if never named
+    };
+
+    struct ProfileZoneStats
+    {
+        std::string name;
+        uint32_t count;
+        double minMilliseconds;
+        double averageMilliseconds;
+        double p99Milliseconds;
+        double maxMilliseconds;
+        double perFrameMilliseconds;    // Total over the captured frames divided by their count
+    };
+
+    // Each thread writes its zones to a ring of its own, no locks taken after the thread's first
+    // zone. Older events are overwritten once a ring is full, so a capture holds the last
+    // EventsPerThread zones of every thread. Rings of threads that exit are reused by new ones.
+    class Profiler
+    {
+    public:
+        static constexpr size_t EventsPerThread = 16384;
+        static constexpr size_t FrameCount = 1024;
+
+        static Profiler& Get();
+
+        static uint64_t Now() noexcept
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        // Names the calling thread in traces. name is copied.
+        void SetThreadName(const char* name);
+
+        // Starts a frame, call from one thread only
+        void MarkFrame() noexcept;
+
+        // Adds a zone of the calling thread
+        void Record(const char* name, uint64_t begin, uint64_t end, uint32_t depth) noexcept;
+
+        // Copies out what the rings hold. Threads may keep recording meanwhile, events overwritten
+        // while they were copied are dropped.
+        void Capture(ProfileCapture& capture) const;
+
+        // Chrome trace_event JSON, opened by chrome://tracing or ui.perfetto.dev
+        static bool WriteChromeTrace(const char* filename, const ProfileCapture& capture);
+
+        // One row per zone name, slowest total first, over the zones that began in captured frames
+        static void Summarize(const ProfileCapture& capture, std::vector<ProfileZoneStats>& zones);
+        static void LogSummary(const std::vector<ProfileZoneStats>& zones);
+
+    private:
+        // A ring has a slot more than it keeps, for the one a writer may be filling while a
+        // capture copies the others
+        static constexpr size_t EventSlots = EventsPerThread + 1;
+        static constexpr size_t FrameSlots = FrameCount + 1;
+
+        struct ThreadRing
+        {
+            std::unique_ptr<ProfileEvent[]> events;
+            std::atomic<uint64_t> head;         // Events ever written, only the owner writes it
+            uint32_t threadId;
+            bool inUse;                         // Guarded by m_mutex
+        };
+
+        // Thread local handle that gives the ring back when its thread exits
+        friend struct ProfileThreadSlot;
+
+        Profiler() noexcept;
+
+        ThreadRing* AcquireRing();
+        void ReleaseRing(ThreadRing* ring);
+
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<ThreadRing>> m_rings;
+        std::vector<std::string> m_threadNames;
+
+        std::unique_ptr<uint64_t[]> m_frames;
+        std::atomic<uint64_t> m_frameHead;
+    };
+
+    // Times its own scope as a zone named name, which must be a string literal
+    class ProfileZone
+    {
+    public:
+        explicit ProfileZone(const char* name) noexcept :
+            m_name(name),
+            m_depth(s_depth++),
+            m_begin(Profiler::Now())
+        {
+        }
+
+        ~ProfileZone()
+        {
+            const uint64_t end = Profiler::Now();
+            s_depth--;
+            Profiler::Get().Record(m_name, m_begin, end, m_depth);
+        }
+
+        ProfileZone(ProfileZone const&) = delete;
+        ProfileZone& operator= (ProfileZone const&) = delete;
+
+    private:
+        static thread_local uint32_t s_depth;
+
+        const char* m_name;
+        uint32_t m_depth;
+        uint64_t m_begin;
+    };
+}
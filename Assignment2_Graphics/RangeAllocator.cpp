@@ -0,0 +1,137 @@
+//
+// RangeAllocator.cpp - Best fit free list sub-allocator for byte ranges of a larger buffer
+//
+
+#include "pch.h"
+#include "RangeAllocator.h"
+
+using namespace DX;
+
+RangeAllocator::RangeAllocator(uint32_t capacity) :
+    m_capacity(0),
+    m_usedBytes(0)
+{
+    Reset(capacity);
+}
+
+uint32_t RangeAllocator::Allocate(uint32_t size, uint32_t alignment)
+{
+    if (size == 0)
+        return InvalidOffset;
+    alignment = std::max(1u, alignment);
+
+    // Walk up from the smallest range that could hold the size, the first one that still holds it
+    // once the start is aligned is the best fit
+    for (auto it = m_freeBySize.lower_bound({ size, 0 }); it != m_freeBySize.end(); ++it)
+    {
+        const uint32_t rangeOffset = it->second;
+        const uint32_t rangeSize = it->first;
+        const uint64_t aligned = (uint64_t(rangeOffset) + alignment - 1) / alignment * alignment;
+        if (aligned + size > uint64_t(rangeOffset) + rangeSize)
+            continue;
+
+        // The alignment padding goes with the allocation, only the tail returns to the free list
+        RemoveFreeRange(m_freeByOffset.find(rangeOffset));
+        const uint32_t end = static_cast<uint32_t>(aligned) + size;
+        if (end < rangeOffset + rangeSize)
+        {
+            AddFreeRange(end, rangeOffset + rangeSize - end);
+        }
+
+        m_allocations[static_cast<uint32_t>(aligned)] = { rangeOffset, end - rangeOffset };
+        m_usedBytes += end - rangeOffset;
+        return static_cast<uint32_t>(aligned);
+    }
+
+    return InvalidOffset;
+}
+
+void RangeAllocator::Free(uint32_t offset)
+{
+    auto allocation = m_allocations.find(offset);
+    if (allocation == m_allocations.end())
+        return;
+
+    uint32_t rangeOffset = allocation->second.first;
+    uint32_t rangeSize = allocation->second.second;
+    m_usedBytes -= rangeSize;
+    m_allocations.erase(allocation);
+
+    // Merge with the free ranges directly after and before
+    auto next = m_freeByOffset.lower_bound(rangeOffset);
+    if (next != m_freeByOffset.end() && next->first == rangeOffset + rangeSize)
+    {
+        rangeSize += next->second;
+        next = std::next(next);
+        RemoveFreeRange(std::prev(next));
+    }
+    if (next != m_freeByOffset.begin())
+    {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == rangeOffset)
+        {
+            rangeOffset = previous->first;
+            rangeSize += previous->second;
+            RemoveFreeRange(previous);
+        }
+    }
+    AddFreeRange(rangeOffset, rangeSize);
+}
+
+void RangeAllocator::Grow(uint32_t capacity)
+{
+    if (capacity <= m_capacity)
+        return;
+
+    // The new space joins the last free range if that one reaches the old end
+    uint32_t offset = m_capacity;
+    uint32_t size = capacity - m_capacity;
+    if (!m_freeByOffset.empty())
+    {
+        auto last = std::prev(m_freeByOffset.end());
+        if (last->first + last->second == m_capacity)
+        {
+            offset = last->first;
+            size += last->second;
+            RemoveFreeRange(last);
+        }
+    }
+    AddFreeRange(offset, size);
+    m_capacity = capacity;
+}
+
+void RangeAllocator::Reset(uint32_t capacity)
+{
+    m_capacity = capacity;
+    m_usedBytes = 0;
+    m_freeByOffset.clear();
+    m_freeBySize.clear();
+    m_allocations.clear();
+    if (capacity > 0)
+    {
+        AddFreeRange(0, capacity);
+    }
+}
+
+RangeAllocatorStats RangeAllocator::GetStats() const noexcept
+{
+    RangeAllocatorStats stats = {};
+    stats.capacity = m_capacity;
+    stats.usedBytes = m_usedBytes;
+    stats.allocationCount = static_cast<uint32_t>(m_allocations.size());
+    stats.freeRangeCount = static_cast<uint32_t>(m_freeByOffset.size());
+    stats.largestFreeRange = m_freeBySize.empty() ? 0 : m_freeBySize.rbegin()->first;
+    return stats;
+}
+
+void RangeAllocator::AddFreeRange(uint32_t offset, uint32_t size)
+{
+    m_freeByOffset[offset] = size;
+    m_freeBySize.insert({ size, offset });
+}
+
+void RangeAllocator::RemoveFreeRange(std::map<uint32_t, uint32_t>::iterator range)
+{
+    m_freeBySize.erase({ range->second, range->first });
+    m_freeByOffset.erase(range);
+}
@@ -0,0 +1,67 @@
+//
+// RangeAllocator.h - Best fit free list sub-allocator for byte ranges of a larger buffer
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+
+namespace DX
+{
+    struct RangeAllocatorStats
+    {
+        uint32_t capacity;
+        uint32_t usedBytes;             // Including the padding of aligned allocations
+        uint32_t allocationCount;
+        uint32_t freeRangeCount;
+        uint32_t largestFreeRange;
+
+        // 0 when all free space is one range, approaching 1 as it is split into many small ones
+        float GetFragmentation() const noexcept
+        {
+            const uint32_t freeBytes = capacity - usedBytes;
+            return freeBytes > 0 ? 1.f - float(largestFreeRange) / float(freeBytes) : 0.f;
+        }
+
+        float GetOccupancy() const noexcept { return capacity > 0 ? float(usedBytes) / float(capacity) : 0.f; }
+    };
+
+    // Hands out offsets into a range of capacity bytes and takes them back. Free ranges are kept
+    // coalesced, so freeing everything always returns to a single range. Only bookkeeping, the
+    // memory itself belongs to the caller, so this works for GPU buffers as well as CPU arrays.
+    class RangeAllocator
+    {
+    public:
+        static constexpr uint32_t InvalidOffset = 0xFFFFFFFFu;
+
+        explicit RangeAllocator(uint32_t capacity = 0);
+
+        // Smallest free range the aligned allocation fits in. Returns InvalidOffset when none does.
+        uint32_t Allocate(uint32_t size, uint32_t alignment = 1);
+
+        // Returns an offset from Allocate to the free list
+        void Free(uint32_t offset);
+
+        // Extends the range, existing allocations keep their offsets
+        void Grow(uint32_t capacity);
+
+        // Forgets every allocation
+        void Reset(uint32_t capacity);
+
+        uint32_t GetCapacity() const noexcept { return m_capacity; }
+        RangeAllocatorStats GetStats() const noexcept;
+
+    private:
+        void AddFreeRange(uint32_t offset, uint32_t size);
+        void RemoveFreeRange(std::map<uint32_t, uint32_t>::iterator range);
+
+        uint32_t m_capacity;
+        uint32_t m_usedBytes;
+        std::map<uint32_t, uint32_t> m_freeByOffset;            // offset -> size, for coalescing
+        std::set<std::pair<uint32_t, uint32_t>> m_freeBySize;   // (size, offset), for best fit
+        std::map<uint32_t, std::pair<uint32_t, uint32_t>> m_allocations;   // offset -> (range start, range size)
+    };
+}
@@ -0,0 +1,138 @@
+//
+// RenderQueue.cpp - Per frame list of draws ordered by a packed 64 bit sort key
+//
+
+#include "pch.h"
+#include "RenderQueue.h"
+
+using namespace DX;
+
+namespace
+{
+    constexpr uint32_t RadixBits = 8;
+    constexpr uint32_t RadixSize = 1u << RadixBits;
+    constexpr uint32_t RadixPasses = 64 / RadixBits;
+
+    // Field changes between consecutive keys, the first draw counts as a change of everything
+    void CountChanges(const RenderItem* items, size_t count, uint32_t& shaderChanges, uint32_t& textureChanges, uint32_t& meshChanges)
+    {
+        shaderChanges = textureChanges = meshChanges = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint64_t key = items[i].key;
+            const uint64_t previous = i > 0 ? items[i - 1].key : ~key;
+            shaderChanges += RenderQueue::GetShader(key) != RenderQueue::GetShader(previous) ? 1 : 0;
+            textureChanges += RenderQueue::GetTexture(key) != RenderQueue::GetTexture(previous) ? 1 : 0;
+            meshChanges += RenderQueue::GetMesh(key) != RenderQueue::GetMesh(previous) ? 1 : 0;
+        }
+    }
+}
+
+RenderQueue::RenderQueue() noexcept :
+    m_stats{}
+{
+}
+
+uint64_t RenderQueue::MakeKey(RenderPass pass, uint32_t shader, uint32_t texture, uint32_t mesh, float depth) noexcept
+{
+    constexpr uint32_t depthMax = (1u << DepthBits) - 1;
+
+    // Transparent draws go back to front, so their depth is inverted
+    // Rounding near 1 can reach depthMax + 1 in float, which would carry into the mesh field
+    depth = std::min(std::max(depth, 0.f), 1.f);
+    uint32_t quantizedDepth = std::min(static_cast<uint32_t>(depth * float(depthMax) + 0.5f), depthMax);
+    if (pass == RenderPass::Transparent)
+    {
+        quantizedDepth = depthMax - quantizedDepth;
+    }
+
+    return (uint64_t(static_cast<uint32_t>(pass) & ((1u << PassBits) - 1)) << PassShift)
+        | (uint64_t(shader & ((1u << ShaderBits) - 1)) << ShaderShift)
+        | (uint64_t(texture & ((1u << TextureBits) - 1)) << TextureShift)
+        | (uint64_t(mesh & ((1u << MeshBits) - 1)) << MeshShift)
+        | (uint64_t(quantizedDepth) << DepthShift);
+}
+
+void RenderQueue::ResetIds() noexcept
+{
+    m_shaders.clear();
+    m_textures.clear();
+    m_meshes.clear();
+}
+
+void RenderQueue::Reserve(size_t drawCount)
+{
+    m_items.reserve(drawCount);
+    m_scratch.reserve(drawCount);
+}
+
+void RenderQueue::Sort()
+{
+    const size_t count = m_items.size();
+    m_stats = {};
+    m_stats.drawCount = static_cast<uint32_t>(count);
+    CountChanges(m_items.data(), count, m_stats.unsortedShaderChanges, m_stats.unsortedTextureChanges, m_stats.unsortedMeshChanges);
+
+    if (count > 1)
+    {
+        // Every digit's histogram in one read of the keys
+        uint32_t histograms[RadixPasses][RadixSize] = {};
+        for (const RenderItem& item : m_items)
+        {
+            for (uint32_t pass = 0; pass < RadixPasses; pass++)
+            {
+                histograms[pass][(item.key >> (pass * RadixBits)) & (RadixSize - 1)]++;
+            }
+        }
+
+        m_scratch.resize(count);
+        RenderItem* source = m_items.data();
+        RenderItem* destination = m_scratch.data();
+        for (uint32_t pass = 0; pass < RadixPasses; pass++)
+        {
+            uint32_t* histogram = histograms[pass];
+            const uint32_t shift = pass * RadixBits;
+
+            // All keys share this digit, the pass would only copy
+            if (histogram[(source[0].key >> shift) & (RadixSize - 1)] == count)
+                continue;
+
+            uint32_t offset = 0;
+            for (uint32_t digit = 0; digit < RadixSize; digit++)
+            {
+                const uint32_t digitCount = histogram[digit];
+                histogram[digit] = offset;
+                offset += digitCount;
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                destination[histogram[(source[i].key >> shift) & (RadixSize - 1)]++] = source[i];
+            }
+            std::swap(source, destination);
+        }
+
+        // An odd number of passes left the result in the scratch buffer
+        if (source != m_items.data())
+        {
+            m_items.swap(m_scratch);
+        }
+    }
+
+    CountChanges(m_items.data(), count, m_stats.shaderChanges, m_stats.textureChanges, m_stats.meshChanges);
+}
+
+uint32_t RenderQueue::GetId(std::vector<const void*>& ids, const void* resource, uint32_t bits)
+{
+    // A scene has a handful of each, a linear search beats hashing at that size
+    auto it = std::find(ids.begin(), ids.end(), resource);
+    if (it != ids.end())
+        return static_cast<uint32_t>(it - ids.begin());
+
+    const uint32_t last = (1u << bits) - 1;
+    if (ids.size() >= last)
+        return last;
+
+    ids.push_back(resource);
+    return static_cast<uint32_t>(ids.size() - 1);
+}
@@ -0,0 +1,111 @@
+//
+// RenderQueue.h - Per frame list of draws ordered by a packed 64 bit sort key
+//
+
+#pragma once
+
+#include <vector>
+
+namespace DX
+{
+    enum class RenderPass : uint32_t
+    {
+        Opaque,         // Front to back within each state group
+        Transparent     // Back to front
+    };
+
+    // One queued draw. draw is the caller's index into its own table of what to draw.
+    struct RenderItem
+    {
+        uint64_t key;
+        uint32_t draw;
+    };
+
+    // State changes over the last sorted queue, and what the same draws would have cost in
+    // submission order. A change is counted whenever a field differs from the previous draw.
+    struct RenderQueueStats
+    {
+        uint32_t drawCount;
+        uint32_t shaderChanges;
+        uint32_t textureChanges;
+        uint32_t meshChanges;
+        uint32_t unsortedShaderChanges;
+        uint32_t unsortedTextureChanges;
+        uint32_t unsortedMeshChanges;
+
+        uint32_t GetChangesSaved() const noexcept
+        {
+            return (unsortedShaderChanges + unsortedTextureChanges + unsortedMeshChanges) - (shaderChanges + textureChanges + meshChanges);
+        }
+    };
+
+    // Keys pack, from the most significant bit: pass (4 bits), shader (8), texture (12), mesh (16)
+    // and depth (24). Sorting them groups draws by the most expensive state first, and draws of one
+    // mesh with one texture end up next to each other in depth order.
+    //
+    // The queue only deals in keys and indices, it never touches the device, so building and
+    // sorting it can be measured on its own.
+    class RenderQueue
+    {
+    public:
+        static constexpr uint32_t PassBits = 4;
+        static constexpr uint32_t ShaderBits = 8;
+        static constexpr uint32_t TextureBits = 12;
+        static constexpr uint32_t MeshBits = 16;
+        static constexpr uint32_t DepthBits = 24;
+
+        static constexpr uint32_t DepthShift = 0;
+        static constexpr uint32_t MeshShift = DepthShift + DepthBits;
+        static constexpr uint32_t TextureShift = MeshShift + MeshBits;
+        static constexpr uint32_t ShaderShift = TextureShift + TextureBits;
+        static constexpr uint32_t PassShift = ShaderShift + ShaderBits;
+
+        RenderQueue() noexcept;
+
+        // depth is the distance from the camera divided by the far plane, clamped to [0, 1]
+        static uint64_t MakeKey(RenderPass pass, uint32_t shader, uint32_t texture, uint32_t mesh, float depth) noexcept;
+
+        static uint32_t GetPass(uint64_t key) noexcept { return GetField(key, PassShift, PassBits); }
+        static uint32_t GetShader(uint64_t key) noexcept { return GetField(key, ShaderShift, ShaderBits); }
+        static uint32_t GetTexture(uint64_t key) noexcept { return GetField(key, TextureShift, TextureBits); }
+        static uint32_t GetMesh(uint64_t key) noexcept { return GetField(key, MeshShift, MeshBits); }
+
+        // Small ids for the key fields, handed out in first use order and kept between frames so the
+        // sorted order is stable. Past the field's range further resources share its last id, which
+        // only costs grouping. Reset them when the resources are recreated.
+        uint32_t GetShaderId(const void* shader) { return GetId(m_shaders, shader, ShaderBits); }
+        uint32_t GetTextureId(const void* texture) { return GetId(m_textures, texture, TextureBits); }
+        uint32_t GetMeshId(const void* mesh) { return GetId(m_meshes, mesh, MeshBits); }
+        void ResetIds() noexcept;
+
+        void Clear() noexcept { m_items.clear(); }
+        void Reserve(size_t drawCount);
+        void Add(uint64_t key, uint32_t draw) { m_items.push_back({ key, draw }); }
+
+        // Least significant digit radix sort of the keys, 8 bits per pass. Passes where every key
+        // has the same digit are skipped, so the unused low depth bits and constant high fields cost
+        // one histogram read. Stable, so equal keys keep their submission order.
+        void Sort();
+
+        const std::vector<RenderItem>& GetItems() const noexcept { return m_items; }
+        size_t GetCount() const noexcept { return m_items.size(); }
+        const RenderQueueStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        static uint32_t GetField(uint64_t key, uint32_t shift, uint32_t bits) noexcept
+        {
+            return static_cast<uint32_t>(key >> shift) & ((1u << bits) - 1);
+        }
+
+        static uint32_t GetId(std::vector<const void*>& ids, const void* resource, uint32_t bits);
+
+        std::vector<RenderItem> m_items;
+        std::vector<RenderItem> m_scratch;
+
+        std::vector<const void*> m_shaders;
+        std::vector<const void*> m_textures;
+        std::vector<const void*> m_meshes;
+
+        RenderQueueStats m_stats;
+    };
+}
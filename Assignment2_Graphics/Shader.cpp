@@ -11,11 +11,9 @@ Shader::~Shader()
 {
 }
 
-bool Shader::InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename)
+bool Shader::InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename, DX::VertexFormat format, bool instanced)
 {
-	D3D11_BUFFER_DESC	matrixBufferDesc;
 	D3D11_SAMPLER_DESC	samplerDesc;
-	D3D11_BUFFER_DESC	lightBufferDesc;
 
 	//LOAD SHADER:	VERTEX
 	auto vertexShaderBuffer = DX::ReadData(vsFilename);
@@ -34,12 +32,51 @@ bool Shader::InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psF
 		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 	};
 
-	// Get a count of the elements in the layout.
-	unsigned int numElements;
-	numElements = sizeof(polygonLayout) / sizeof(polygonLayout[0]);
+	// Quantized variant, matching DX::QuantizedVertex: 16-bit positions within the mesh bounds,
+	// octahedral normals and half float UVs. Decoding happens in light_quantized_vs.
+	D3D11_INPUT_ELEMENT_DESC quantizedLayout[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+
+	// Per instance world matrix, one row per element, read from the instance buffer in slot 1
+	D3D11_INPUT_ELEMENT_DESC instanceLayout[] = {
+		{ "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+	};
+
+	const D3D11_INPUT_ELEMENT_DESC* vertexLayout = polygonLayout;
+	unsigned int vertexElements = sizeof(polygonLayout) / sizeof(polygonLayout[0]);
+	if (format == DX::VertexFormat::Quantized)
+	{
+		vertexLayout = quantizedLayout;
+		vertexElements = sizeof(quantizedLayout) / sizeof(quantizedLayout[0]);
+	}
+
+	D3D11_INPUT_ELEMENT_DESC layout[8];
+	unsigned int numElements = 0;
+	for (unsigned int i = 0; i < vertexElements; i++)
+	{
+		layout[numElements++] = vertexLayout[i];
+	}
+	if (instanced)
+	{
+		for (unsigned int i = 0; i < sizeof(instanceLayout) / sizeof(instanceLayout[0]); i++)
+		{
+			layout[numElements++] = instanceLayout[i];
+		}
+	}
 
 	// Create the vertex input layout.
-	device->CreateInputLayout(polygonLayout, numElements, vertexShaderBuffer.data(), vertexShaderBuffer.size(), &m_layout);
+	result = device->CreateInputLayout(layout, numElements, vertexShaderBuffer.data(), vertexShaderBuffer.size(), &m_layout);
+	if (result != S_OK)
+	{
+		//the layout doesn't match the shader's inputs
+		return false;
+	}
 	
 
 	//LOAD SHADER:	PIXEL
@@ -51,31 +88,6 @@ bool Shader::InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psF
 		return false;
 	}
 
-	// Setup the description of the dynamic matrix constant buffer that is in the vertex shader.
-	matrixBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	matrixBufferDesc.ByteWidth = sizeof(MatrixBufferType);
-	matrixBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	matrixBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	matrixBufferDesc.MiscFlags = 0;
-	matrixBufferDesc.StructureByteStride = 0;
-
-	// Create the constant buffer pointer so we can access the vertex shader constant buffer from within this class.
-	device->CreateBuffer(&matrixBufferDesc, NULL, &m_matrixBuffer);
-
-
-	// Setup light buffer
-	// Setup the description of the light dynamic constant buffer that is in the pixel shader.
-	// Note that ByteWidth always needs to be a multiple of 16 if using D3D11_BIND_CONSTANT_BUFFER or CreateBuffer will fail.
-	lightBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	lightBufferDesc.ByteWidth = sizeof(LightBufferType);
-	lightBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	lightBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	lightBufferDesc.MiscFlags = 0;
-	lightBufferDesc.StructureByteStride = 0;
-
-	// Create the constant buffer pointer so we can access the vertex shader constant buffer from within this class.
-	device->CreateBuffer(&lightBufferDesc, NULL, &m_lightBuffer);
-
 	// Create a texture sampler state description.
 	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
@@ -97,46 +109,35 @@ bool Shader::InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psF
 	return true;
 }
 
-bool Shader::SetShaderParameters(ID3D11DeviceContext * context, DirectX::SimpleMath::Matrix * world, DirectX::SimpleMath::Matrix * view, DirectX::SimpleMath::Matrix * projection, Light *sceneLight1, ID3D11ShaderResourceView* texture1)
+void Shader::FillFrameBuffer(FrameBufferType& frame, DirectX::FXMMATRIX view, DirectX::CXMMATRIX projection, Light *sceneLight1, const DirectX::SimpleMath::Vector3& cameraPosition)
 {
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-	MatrixBufferType* dataPtr;
-	LightBufferType* lightPtr;
-	//SkyboxBufferType* skyboxPtr;
-	DirectX::SimpleMath::Matrix  tworld, tview, tproj;
-
 	// Transpose the matrices to prepare them for the shader.
-	tworld = world->Transpose();
-	tview = view->Transpose();
-	tproj = projection->Transpose();
-	context->Map(m_matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	dataPtr = (MatrixBufferType*)mappedResource.pData;
-	dataPtr->world = tworld;// worldMatrix;
-	dataPtr->view = tview;
-	dataPtr->projection = tproj;
-	context->Unmap(m_matrixBuffer, 0);
-	context->VSSetConstantBuffers(0, 1, &m_matrixBuffer);	//note the first variable is the mapped buffer ID.  Corresponding to what you set in the VS
-
-	context->Map(m_lightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	lightPtr = (LightBufferType*)mappedResource.pData;
-	lightPtr->ambient = sceneLight1->getAmbientColour();
-	lightPtr->diffuse = sceneLight1->getDiffuseColour();	
-	lightPtr->position = sceneLight1->getPosition();  
-	lightPtr->padding = 0.0f;
-	context->Unmap(m_lightBuffer, 0);
-	context->PSSetConstantBuffers(0, 1, &m_lightBuffer);	//note the first variable is the mapped buffer ID.  Corresponding to what you set in the PS
+	DirectX::XMStoreFloat4x4(&frame.viewProjection, DirectX::XMMatrixTranspose(DirectX::XMMatrixMultiply(view, projection)));
+	frame.ambient = sceneLight1->getAmbientColour();
+	frame.diffuse = sceneLight1->getDiffuseColour();
+	frame.lightPosition = sceneLight1->getPosition();
+	frame.padding0 = 0.0f;
+	frame.cameraPosition = cameraPosition;
+	frame.padding1 = 0.0f;
+}
+
+void Shader::FillObjectBuffer(ObjectBufferType& object, DirectX::FXMMATRIX world, DirectX::CXMMATRIX viewProjection)
+{
+	DirectX::XMStoreFloat4x4(&object.world, DirectX::XMMatrixTranspose(world));
+	DirectX::XMStoreFloat4x4(&object.worldViewProjection, DirectX::XMMatrixTranspose(DirectX::XMMatrixMultiply(world, viewProjection)));
+}
 
+void Shader::SetTexture(ID3D11DeviceContext * context, ID3D11ShaderResourceView* texture1)
+{
 	//pass the desired texture to the pixel shader.
 	context->PSSetShaderResources(0, 1, &texture1);
-
-	return false;
 }
 
 void Shader::EnableShader(ID3D11DeviceContext * context)
 {
-	context->IASetInputLayout(m_layout);							//set the input layout for the shader to match out geometry
+	context->IASetInputLayout(m_layout.Get());							//set the input layout for the shader to match out geometry
 	context->VSSetShader(m_vertexShader.Get(), 0, 0);				//turn on vertex shader
 	context->PSSetShader(m_pixelShader.Get(), 0, 0);				//turn on pixel shader
 	// Set the sampler state in the pixel shader.
-	context->PSSetSamplers(0, 1, &m_sampleState);
+	context->PSSetSamplers(0, 1, m_sampleState.GetAddressOf());
 }
@@ -2,6 +2,7 @@
 
 #include "DeviceResources.h"
 #include "Light.h"
+#include "MeshQuantizer.h"
 
 //Class from which we create all shader objects used by the framework
 //This single class can be expanded to accomodate shaders of all different types with different parameters
@@ -13,46 +14,58 @@ public:
 
 	//we could extend this to load in only a vertex shader, only a pixel shader etc.  or specialised init for Geometry or domain shader. 
 	//All the methods here simply create new versions corresponding to your needs
-	bool InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename);		//Loads the Vert / pixel Shader pair
-	bool SetShaderParameters(ID3D11DeviceContext * context, DirectX::SimpleMath::Matrix  *world, DirectX::SimpleMath::Matrix  *view, DirectX::SimpleMath::Matrix  *projection, Light *sceneLight1, ID3D11ShaderResourceView* texture1);
+	bool InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename,
+		DX::VertexFormat format = DX::VertexFormat::Standard,		//Loads the Vert / pixel Shader pair, with the input layout for the given vertex format
+		bool instanced = false);									//instanced adds a world matrix per instance from vertex buffer slot 1 (see light_instanced_vs)
+	//Constants are uploaded by the render queue (see Game::UploadConstants), which fills its own
+	//buffers with the Fill methods below. Only textures are set here.
+	void SetTexture(ID3D11DeviceContext * context, ID3D11ShaderResourceView* texture1);
 	void EnableShader(ID3D11DeviceContext * context);
 
-private:
-	//standard matrix buffer supplied to all shaders
-	struct MatrixBufferType
+	//per frame buffer, bound to register b0 of both shaders (see light_common.hlsli). Matrices are stored transposed for the shader.
+	struct FrameBufferType
 	{
-		DirectX::XMMATRIX world;
-		DirectX::XMMATRIX view;
-		DirectX::XMMATRIX projection;
+		DirectX::XMFLOAT4X4 viewProjection;
+		DirectX::SimpleMath::Vector4 ambient;
+		DirectX::SimpleMath::Vector4 diffuse;
+		DirectX::SimpleMath::Vector3 lightPosition;
+		float padding0;
+		DirectX::SimpleMath::Vector3 cameraPosition;
+		float padding1;
 	};
 
-	//buffer for information of a single light
-	struct LightBufferType
+	//per object buffer, bound to register b1 of the vertex shader. World view projection is combined on the CPU.
+	struct ObjectBufferType
 	{
-		DirectX::SimpleMath::Vector4 ambient;
-		DirectX::SimpleMath::Vector4 diffuse;
-		DirectX::SimpleMath::Vector3 position;
-		float padding;
+		DirectX::XMFLOAT4X4 world;
+		DirectX::XMFLOAT4X4 worldViewProjection;
 	};
 
-	//buffer to pass in camera world Position
-	struct CameraBufferType
+	//cluster lookup for the point lights, bound to register b3 of the pixel shader (b1 and b2 hold the vertex shaders' object and quantization constants)
+	struct ClusterBufferType
 	{
-		DirectX::SimpleMath::Vector3 cameraPosition;
-		float padding;
+		DirectX::XMFLOAT4 viewDepthPlane;
+		DirectX::XMFLOAT2 tileScale;
+		float depthScale;
+		float depthBias;
+		uint32_t clusterCount[3];
+		uint32_t padding;
 	};
 
-	struct SkyboxBufferType
+	//colour of the material a draw range uses, bound to register b4 of the pixel shader for each range (see ModelClass::Render)
+	struct MaterialBufferType
 	{
-		XMFLOAT4X4 gWorldViewProj;
+		DirectX::XMFLOAT4 color;		//Kd, and the dissolve d as alpha
 	};
 
+	static void FillFrameBuffer(FrameBufferType& frame, DirectX::FXMMATRIX view, DirectX::CXMMATRIX projection, Light *sceneLight1, const DirectX::SimpleMath::Vector3& cameraPosition);
+	static void FillObjectBuffer(ObjectBufferType& object, DirectX::FXMMATRIX world, DirectX::CXMMATRIX viewProjection);
+
+private:
 	//Shaders
 	Microsoft::WRL::ComPtr<ID3D11VertexShader>								m_vertexShader;
 	Microsoft::WRL::ComPtr<ID3D11PixelShader>								m_pixelShader;
-	ID3D11InputLayout*														m_layout;
-	ID3D11Buffer*															m_matrixBuffer;
-	ID3D11SamplerState*														m_sampleState;
-	ID3D11Buffer*															m_lightBuffer;
+	Microsoft::WRL::ComPtr<ID3D11InputLayout>								m_layout;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState>								m_sampleState;
 };
 
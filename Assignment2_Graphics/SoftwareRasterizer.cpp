@@ -0,0 +1,738 @@
+//
+// SoftwareRasterizer.cpp - Tile based CPU renderer for the lit, textured scene and its skybox
+//
+
+#include "pch.h"
+#include "SoftwareRasterizer.h"
+#include "JobSystem.h"
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    // Triangles are clipped to the near plane and to a band this many times the screen's half
+    // size, which keeps the edge equations' pixel coordinates small enough to stay exact
+    constexpr float GuardBand = 4.f;
+
+    // Near plane and guard band planes in clip space, a vertex is inside when its dot with the
+    // plane is at least 0. A triangle gains at most one vertex per plane.
+    constexpr int ClipPlaneCount = 5;
+    constexpr int MaxClippedVertices = 3 + ClipPlaneCount;
+    const XMFLOAT4 ClipPlanes[ClipPlaneCount] =
+    {
+        { 0.f, 0.f, 1.f, 0.f },
+        { 1.f, 0.f, 0.f, GuardBand },
+        { -1.f, 0.f, 0.f, GuardBand },
+        { 0.f, 1.f, 0.f, GuardBand },
+        { 0.f, -1.f, 0.f, GuardBand }
+    };
+
+    inline float PlaneDistance(const XMFLOAT4& plane, const XMFLOAT4& v) noexcept
+    {
+        return plane.x * v.x + plane.y * v.y + plane.z * v.z + plane.w * v.w;
+    }
+
+    // True when all three vertices are outside the same view frustum plane
+    bool IsOutsideFrustum(const XMFLOAT4& a, const XMFLOAT4& b, const XMFLOAT4& c) noexcept
+    {
+        int outside[6] = {};
+        for (const XMFLOAT4* v : { &a, &b, &c })
+        {
+            outside[0] += v->x < -v->w;
+            outside[1] += v->x > v->w;
+            outside[2] += v->y < -v->w;
+            outside[3] += v->y > v->w;
+            outside[4] += v->z < 0.f;
+            outside[5] += v->z > v->w;
+        }
+        return std::find(outside, outside + 6, 3) != outside + 6;
+    }
+
+    // Runs work(0) to work(count - 1) as jobs, the calling thread taking its share while it waits
+    template <typename Work>
+    void RunAsJobs(JobSystem& jobs, size_t count, const Work& work)
+    {
+        jobs.ParallelFor(count, 1, [&work](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; i++)
+            {
+                work(i);
+            }
+        });
+    }
+
+    // Blends two 8 bit RGBA texels, weight 0 to 256 towards b, two channels per multiply
+    inline uint32_t LerpTexel(uint32_t a, uint32_t b, uint32_t weight) noexcept
+    {
+        const uint32_t inverse = 256 - weight;
+        const uint32_t redBlue = (((a & 0x00ff00ff) * inverse + (b & 0x00ff00ff) * weight) >> 8) & 0x00ff00ff;
+        const uint32_t greenAlpha = ((((a >> 8) & 0x00ff00ff) * inverse + ((b >> 8) & 0x00ff00ff) * weight) >> 8) & 0x00ff00ff;
+        return redBlue | (greenAlpha << 8);
+    }
+
+    // Bilinear lookup at texel coordinates x, y, with texel centers on whole numbers, weighted with
+    // 8 bits of subtexel precision like D3D's filtering. Coordinates past the edges wrap around, or
+    // clamp for cube map faces.
+    uint32_t SampleBilinear(const uint32_t* texels, uint32_t width, uint32_t height, float x, float y, bool wrap) noexcept
+    {
+        const float floorX = std::floor(x);
+        const float floorY = std::floor(y);
+        const uint32_t weightX = static_cast<uint32_t>((x - floorX) * 256.f);
+        const uint32_t weightY = static_cast<uint32_t>((y - floorY) * 256.f);
+        int x0 = static_cast<int>(floorX);
+        int y0 = static_cast<int>(floorY);
+        int x1 = x0 + 1;
+        int y1 = y0 + 1;
+
+        const int w = static_cast<int>(width);
+        const int h = static_cast<int>(height);
+        if (wrap)
+        {
+            x0 = x0 < 0 ? x0 + w : x0;
+            y0 = y0 < 0 ? y0 + h : y0;
+            x1 = x1 >= w ? x1 - w : x1;
+            y1 = y1 >= h ? y1 - h : y1;
+        }
+        else
+        {
+            x0 = std::min(std::max(x0, 0), w - 1);
+            y0 = std::min(std::max(y0, 0), h - 1);
+            x1 = std::min(std::max(x1, 0), w - 1);
+            y1 = std::min(std::max(y1, 0), h - 1);
+        }
+
+        const uint32_t* row0 = texels + size_t(y0) * width;
+        const uint32_t* row1 = texels + size_t(y1) * width;
+        return LerpTexel(LerpTexel(row0[x0], row0[x1], weightX), LerpTexel(row1[x0], row1[x1], weightX), weightY);
+    }
+
+    // Like a wrapping D3D linear sampler on a texture without mips
+    uint32_t SampleTexture(const SoftwareTexture& texture, float u, float v) noexcept
+    {
+        // Wrapped into [0, 1) first so large coordinates keep their precision, NaN reads the corner
+        u -= std::floor(u);
+        v -= std::floor(v);
+        u = u >= 0.f && u < 1.f ? u : 0.f;
+        v = v >= 0.f && v < 1.f ? v : 0.f;
+        return SampleBilinear(texture.GetTexels(), texture.GetWidth(), texture.GetHeight(),
+            u * texture.GetWidth() - 0.5f, v * texture.GetHeight() - 0.5f, true);
+    }
+
+    // Picks the face of the direction's major axis, with the face coordinates D3D uses
+    uint32_t SampleCube(const SoftwareTexture& cube, float x, float y, float z) noexcept
+    {
+        const float absX = std::abs(x);
+        const float absY = std::abs(y);
+        const float absZ = std::abs(z);
+        uint32_t face;
+        float s, t, major;
+        if (absX >= absY && absX >= absZ)
+        {
+            face = x >= 0.f ? 0 : 1;
+            s = x >= 0.f ? -z : z;
+            t = -y;
+            major = absX;
+        }
+        else if (absY >= absZ)
+        {
+            face = y >= 0.f ? 2 : 3;
+            s = x;
+            t = y >= 0.f ? z : -z;
+            major = absY;
+        }
+        else
+        {
+            face = z >= 0.f ? 4 : 5;
+            s = z >= 0.f ? x : -x;
+            t = -y;
+            major = absZ;
+        }
+        if (!(major > 0.f))
+        {
+            return cube.GetTexels(face)[0];
+        }
+
+        const float scale = 0.5f / major;
+        return SampleBilinear(cube.GetTexels(face), cube.GetWidth(), cube.GetHeight(),
+            (s * scale + 0.5f) * cube.GetWidth() - 0.5f, (t * scale + 0.5f) * cube.GetHeight() - 0.5f, false);
+    }
+}
+
+SoftwareRasterizer::SoftwareRasterizer() noexcept :
+    m_width(0),
+    m_height(0),
+    m_tilesX(0),
+    m_tilesY(0),
+    m_viewProjection{},
+    m_light{},
+    m_sky(nullptr),
+    m_clearColor(0),
+    m_skyDirection{},
+    m_skyStepX{},
+    m_skyStepY{},
+    m_cullMode(SoftwareCull::Clockwise),
+    m_triangleCount(0),
+    m_nextTile(0),
+    m_stats{}
+{
+}
+
+void SoftwareRasterizer::Resize(uint32_t width, uint32_t height)
+{
+    m_width = width;
+    m_height = height;
+    m_tilesX = (std::max(width, 1u) + TileSize - 1) / TileSize;
+    m_tilesY = (std::max(height, 1u) + TileSize - 1) / TileSize;
+    m_color.assign(size_t(m_tilesX) * m_tilesY * TileSize * TileSize, 0);
+    m_depth.assign(m_color.size(), 1.f);
+}
+
+void XM_CALLCONV SoftwareRasterizer::Begin(FXMMATRIX view, CXMMATRIX projection, const SoftwareLight& light,
+    const SoftwareTexture* sky, uint32_t clearColor)
+{
+    const XMMATRIX viewProjection = XMMatrixMultiply(view, projection);
+    XMStoreFloat4x4(&m_viewProjection, viewProjection);
+    m_light = light;
+    m_sky = sky && sky->IsCube() ? sky : nullptr;
+    m_clearColor = clearColor;
+
+    // The sky is drawn as if infinitely far away, along the direction from the camera through
+    // each pixel's center on the far plane. That direction is linear across the screen.
+    const XMMATRIX inverseViewProjection = XMMatrixInverse(nullptr, viewProjection);
+    const XMVECTOR camera = XMMatrixInverse(nullptr, view).r[3];
+    auto pixelDirection = [&](float x, float y)
+    {
+        const float ndcX = (x + 0.5f) / std::max(m_width, 1u) * 2.f - 1.f;
+        const float ndcY = 1.f - (y + 0.5f) / std::max(m_height, 1u) * 2.f;
+        return XMVectorSubtract(XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.f, 1.f), inverseViewProjection), camera);
+    };
+    const XMVECTOR origin = pixelDirection(0.f, 0.f);
+    XMStoreFloat3(&m_skyDirection, origin);
+    XMStoreFloat3(&m_skyStepX, XMVectorSubtract(pixelDirection(1.f, 0.f), origin));
+    XMStoreFloat3(&m_skyStepY, XMVectorSubtract(pixelDirection(0.f, 1.f), origin));
+
+    m_draws.clear();
+    m_vertices.clear();
+    m_triangleCount = 0;
+    m_stats = {};
+}
+
+void XM_CALLCONV SoftwareRasterizer::DrawMesh(const MeshVertex* vertices, const uint32_t* indices, size_t indexCount,
+    FXMMATRIX world, const SoftwareTexture* texture, const XMFLOAT4& color)
+{
+    indexCount -= indexCount % 3;
+    if (indexCount == 0)
+    {
+        return;
+    }
+
+    // Only the range of vertices the triangles use is transformed
+    const auto range = std::minmax_element(indices, indices + indexCount);
+
+    Draw draw;
+    draw.vertices = vertices;
+    draw.indices = indices;
+    draw.indexCount = indexCount;
+    draw.firstVertex = static_cast<uint32_t>(m_vertices.size());
+    draw.minIndex = *range.first;
+    draw.vertexCount = *range.second - *range.first + 1;
+    draw.firstTriangle = m_triangleCount;
+    XMStoreFloat4x4(&draw.world, world);
+    draw.texture = texture && !texture->IsEmpty() ? texture : nullptr;
+    draw.color = color;
+    m_draws.push_back(draw);
+
+    m_vertices.resize(m_vertices.size() + draw.vertexCount);
+    m_triangleCount += static_cast<uint32_t>(indexCount / 3);
+    m_stats.draws++;
+    m_stats.triangles += static_cast<uint32_t>(indexCount / 3);
+}
+
+void SoftwareRasterizer::Render(unsigned int threadCount)
+{
+    if (m_width == 0 || m_height == 0)
+    {
+        return;
+    }
+
+    JobSystem& jobs = JobSystem::Get();
+    if (threadCount == 0)
+    {
+        threadCount = jobs.GetThreadCount();
+    }
+
+    // Vertices, split evenly whichever draws they belong to
+    const size_t vertexCount = m_vertices.size();
+    const size_t vertexJobs = std::max<size_t>(1, std::min<size_t>(threadCount, vertexCount / MinVerticesPerJob));
+    RunAsJobs(jobs, vertexJobs, [this, vertexCount, vertexJobs](size_t i)
+    {
+        TransformVertices(vertexCount * i / vertexJobs, vertexCount * (i + 1) / vertexJobs);
+    });
+
+    // Triangles, each job binning a contiguous range into its own lists
+    const size_t tileCount = size_t(m_tilesX) * m_tilesY;
+    const size_t binCount = std::max<size_t>(1, std::min<size_t>(threadCount, m_triangleCount / MinTrianglesPerJob));
+    if (m_bins.size() < binCount)
+    {
+        m_bins.resize(binCount);
+    }
+    for (size_t i = 0; i < binCount; i++)
+    {
+        Bin& bin = m_bins[i];
+        bin.triangles.clear();
+        bin.tiles.resize(tileCount);
+        for (std::vector<uint32_t>& tile : bin.tiles)
+        {
+            tile.clear();
+        }
+        bin.stats = {};
+    }
+    const size_t triangleCount = m_triangleCount;
+    RunAsJobs(jobs, binCount, [this, triangleCount, binCount](size_t i)
+    {
+        SetupTriangles(triangleCount * i / binCount, triangleCount * (i + 1) / binCount, m_bins[i]);
+    });
+
+    // Tiles, handed out one at a time so jobs that draw cheap ones take more
+    const size_t tileJobs = std::min<size_t>(threadCount, tileCount);
+    std::vector<SoftwareRasterStats> tileStats(tileJobs, SoftwareRasterStats{});
+    m_nextTile = 0;
+    RunAsJobs(jobs, tileJobs, [this, binCount, &tileStats](size_t i)
+    {
+        ShadeTiles(binCount, tileStats[i]);
+    });
+
+    for (size_t i = 0; i < binCount; i++)
+    {
+        m_stats.rasterizedTriangles += m_bins[i].stats.rasterizedTriangles;
+        m_stats.binnedTriangles += m_bins[i].stats.binnedTriangles;
+    }
+    for (const SoftwareRasterStats& stats : tileStats)
+    {
+        m_stats.shadedPixels += stats.shadedPixels;
+        m_stats.skyPixels += stats.skyPixels;
+    }
+}
+
+// What light_vs computes, in the same space: clip position, texture coordinates, the normal turned
+// by the world matrix and normalized, and the world position
+void SoftwareRasterizer::TransformVertices(size_t begin, size_t end)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    const XMMATRIX viewProjection = XMLoadFloat4x4(&m_viewProjection);
+    auto draw = std::upper_bound(m_draws.begin(), m_draws.end(), static_cast<uint32_t>(begin),
+        [](uint32_t vertex, const Draw& d) { return vertex < d.firstVertex; }) - 1;
+    size_t vertex = begin;
+    while (vertex < end)
+    {
+        const XMMATRIX world = XMLoadFloat4x4(&draw->world);
+        const XMMATRIX worldViewProjection = XMMatrixMultiply(world, viewProjection);
+        const size_t drawEnd = std::min<size_t>(end, draw->firstVertex + draw->vertexCount);
+        for (; vertex < drawEnd; vertex++)
+        {
+            const MeshVertex& source = draw->vertices[draw->minIndex + (vertex - draw->firstVertex)];
+            ClipVertex& output = m_vertices[vertex];
+            const XMVECTOR position = XMLoadFloat3(&source.position);
+            XMStoreFloat4(&output.clip, XMVector3Transform(position, worldViewProjection));
+            output.attributes[0] = source.texture.x;
+            output.attributes[1] = source.texture.y;
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(&output.attributes[2]),
+                XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&source.normal), world)));
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(&output.attributes[5]), XMVector3TransformCoord(position, world));
+        }
+        ++draw;
+    }
+}
+
+void SoftwareRasterizer::SetupTriangles(size_t begin, size_t end, Bin& bin)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    auto draw = std::upper_bound(m_draws.begin(), m_draws.end(), static_cast<uint32_t>(begin),
+        [](uint32_t triangle, const Draw& d) { return triangle < d.firstTriangle; }) - 1;
+    size_t triangle = begin;
+    while (triangle < end)
+    {
+        const size_t drawEnd = std::min<size_t>(end, draw->firstTriangle + draw->indexCount / 3);
+        const ClipVertex* vertices = m_vertices.data() + draw->firstVertex - draw->minIndex;
+        for (; triangle < drawEnd; triangle++)
+        {
+            const uint32_t* indices = draw->indices + (triangle - draw->firstTriangle) * 3;
+            const ClipVertex corners[3] = { vertices[indices[0]], vertices[indices[1]], vertices[indices[2]] };
+            ClipTriangle(corners, *draw, bin);
+        }
+        ++draw;
+    }
+}
+
+// Clips a triangle to the near plane and the guard band, then adds the pieces
+void SoftwareRasterizer::ClipTriangle(const ClipVertex* triangle, const Draw& draw, Bin& bin)
+{
+    if (IsOutsideFrustum(triangle[0].clip, triangle[1].clip, triangle[2].clip))
+    {
+        return;
+    }
+
+    ClipVertex polygon[2][MaxClippedVertices];
+    int count = 3;
+    std::copy(triangle, triangle + 3, polygon[0]);
+
+    // Sutherland-Hodgman, only against the planes some vertex is behind
+    int current = 0;
+    for (int p = 0; p < ClipPlaneCount; p++)
+    {
+        const XMFLOAT4& plane = ClipPlanes[p];
+        const ClipVertex* input = polygon[current];
+        bool clipped = false;
+        for (int i = 0; i < count; i++)
+        {
+            clipped |= PlaneDistance(plane, input[i].clip) < 0.f;
+        }
+        if (!clipped)
+            continue;
+
+        ClipVertex* output = polygon[current ^ 1];
+        int outputCount = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const ClipVertex& a = input[i];
+            const ClipVertex& b = input[(i + 1) % count];
+            const float distanceA = PlaneDistance(plane, a.clip);
+            const float distanceB = PlaneDistance(plane, b.clip);
+            if (distanceA >= 0.f)
+            {
+                output[outputCount++] = a;
+            }
+            if ((distanceA >= 0.f) != (distanceB >= 0.f))
+            {
+                // Always from the inside end, so both triangles sharing the edge cut it at the same point
+                const ClipVertex& from = distanceA >= 0.f ? a : b;
+                const ClipVertex& to = distanceA >= 0.f ? b : a;
+                const float distanceFrom = distanceA >= 0.f ? distanceA : distanceB;
+                const float distanceTo = distanceA >= 0.f ? distanceB : distanceA;
+                const float t = distanceFrom / (distanceFrom - distanceTo);
+                ClipVertex& cut = output[outputCount++];
+                XMStoreFloat4(&cut.clip, XMVectorLerp(XMLoadFloat4(&from.clip), XMLoadFloat4(&to.clip), t));
+                for (int k = 0; k < AttributeCount; k++)
+                {
+                    cut.attributes[k] = from.attributes[k] + (to.attributes[k] - from.attributes[k]) * t;
+                }
+            }
+        }
+        count = outputCount;
+        current ^= 1;
+        if (count < 3)
+            return;
+    }
+
+    for (int i = 1; i + 1 < count; i++)
+    {
+        const ClipVertex* fan[3] = { &polygon[current][0], &polygon[current][i], &polygon[current][i + 1] };
+        AddTriangle(fan, draw, bin);
+    }
+}
+
+void SoftwareRasterizer::AddTriangle(const ClipVertex* const* vertices, const Draw& draw, Bin& bin)
+{
+    // Pixel coordinates with y down, z / w and 1 / w
+    float screenX[3], screenY[3], screenZ[3], invW[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const XMFLOAT4& clip = vertices[i]->clip;
+        invW[i] = 1.f / clip.w;
+        screenX[i] = (clip.x * invW[i] * 0.5f + 0.5f) * m_width;
+        screenY[i] = (0.5f - clip.y * invW[i] * 0.5f) * m_height;
+        screenZ[i] = clip.z * invW[i];
+    }
+
+    // Pixels whose centers are inside the triangle's bounds
+    Triangle triangle;
+    triangle.minX = std::max(0, static_cast<int>(std::ceil(std::min({ screenX[0], screenX[1], screenX[2] }) - 0.5f)));
+    triangle.minY = std::max(0, static_cast<int>(std::ceil(std::min({ screenY[0], screenY[1], screenY[2] }) - 0.5f)));
+    triangle.maxX = std::min(static_cast<int>(m_width) - 1, static_cast<int>(std::floor(std::max({ screenX[0], screenX[1], screenX[2] }) - 0.5f)));
+    triangle.maxY = std::min(static_cast<int>(m_height) - 1, static_cast<int>(std::floor(std::max({ screenY[0], screenY[1], screenY[2] }) - 0.5f)));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+    {
+        return;
+    }
+
+    // Edge i is the one opposite vertex i, zero along the edge and growing towards the vertex
+    float edgeOffset[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const int a = (i + 1) % 3;
+        const int b = (i + 2) % 3;
+        triangle.edgeX[i] = screenY[a] - screenY[b];
+        triangle.edgeY[i] = screenX[b] - screenX[a];
+        edgeOffset[i] = screenX[a] * screenY[b] - screenY[a] * screenX[b];
+    }
+
+    // Positive area is clockwise on screen. The edges are flipped so that inside is positive.
+    float area = triangle.edgeX[0] * screenX[0] + triangle.edgeY[0] * screenY[0] + edgeOffset[0];
+    if (area == 0.f || (m_cullMode == SoftwareCull::Clockwise && area > 0.f) ||
+        (m_cullMode == SoftwareCull::CounterClockwise && area < 0.f))
+    {
+        return;
+    }
+    if (area < 0.f)
+    {
+        area = -area;
+        for (int i = 0; i < 3; i++)
+        {
+            triangle.edgeX[i] = -triangle.edgeX[i];
+            triangle.edgeY[i] = -triangle.edgeY[i];
+            edgeOffset[i] = -edgeOffset[i];
+        }
+    }
+
+    // Every value is the barycentric blend of its vertex values, a plane over the screen, moved so
+    // that evaluating it at pixel (x, y) gives the value at the pixel's center
+    const float invArea = 1.f / area;
+    auto setPlane = [&](const float* values, float* plane)
+    {
+        plane[0] = (triangle.edgeX[0] * values[0] + triangle.edgeX[1] * values[1] + triangle.edgeX[2] * values[2]) * invArea;
+        plane[1] = (triangle.edgeY[0] * values[0] + triangle.edgeY[1] * values[1] + triangle.edgeY[2] * values[2]) * invArea;
+        plane[2] = (edgeOffset[0] * values[0] + edgeOffset[1] * values[1] + edgeOffset[2] * values[2]) * invArea
+            + 0.5f * plane[0] + 0.5f * plane[1];
+    };
+    setPlane(screenZ, triangle.depth);
+    setPlane(invW, triangle.invW);
+    for (int k = 0; k < AttributeCount; k++)
+    {
+        const float values[3] = { vertices[0]->attributes[k] * invW[0], vertices[1]->attributes[k] * invW[1], vertices[2]->attributes[k] * invW[2] };
+        setPlane(values, triangle.attributes[k]);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        triangle.edgeOffset[i] = edgeOffset[i] + 0.5f * triangle.edgeX[i] + 0.5f * triangle.edgeY[i];
+    }
+    triangle.draw = &draw;
+
+    const uint32_t index = static_cast<uint32_t>(bin.triangles.size());
+    bin.triangles.push_back(triangle);
+    bin.stats.rasterizedTriangles++;
+    for (int tileY = triangle.minY / static_cast<int>(TileSize); tileY <= triangle.maxY / static_cast<int>(TileSize); tileY++)
+    {
+        for (int tileX = triangle.minX / static_cast<int>(TileSize); tileX <= triangle.maxX / static_cast<int>(TileSize); tileX++)
+        {
+            bin.tiles[size_t(tileY) * m_tilesX + tileX].push_back(index);
+            bin.stats.binnedTriangles++;
+        }
+    }
+}
+
+void SoftwareRasterizer::ShadeTiles(size_t binCount, SoftwareRasterStats& stats)
+{
+    const uint32_t tileCount = m_tilesX * m_tilesY;
+    const uint32_t pitch = GetPitch();
+    for (uint32_t tile = m_nextTile++; tile < tileCount; tile = m_nextTile++)
+    {
+        const int tileX = static_cast<int>(tile % m_tilesX);
+        const int tileY = static_cast<int>(tile / m_tilesX);
+        for (uint32_t y = 0; y < TileSize; y++)
+        {
+            const size_t row = (size_t(tileY) * TileSize + y) * pitch + size_t(tileX) * TileSize;
+            std::fill_n(m_color.begin() + row, TileSize, m_clearColor);
+            std::fill_n(m_depth.begin() + row, TileSize, 1.f);
+        }
+
+        for (size_t i = 0; i < binCount; i++)
+        {
+            const Bin& bin = m_bins[i];
+            for (uint32_t triangle : bin.tiles[tile])
+            {
+                RasterizeTriangle(bin.triangles[triangle], tileX, tileY, stats);
+            }
+        }
+
+        if (m_sky)
+        {
+            DrawSky(tileX, tileY, stats);
+        }
+    }
+}
+
+// What light_ps computes for the pixels of the triangle within one tile, four at a time: ambient
+// plus diffuse from the light position, saturated, times the texture and the material colour
+void SoftwareRasterizer::RasterizeTriangle(const Triangle& triangle, int tileX, int tileY, SoftwareRasterStats& stats)
+{
+    // Tiles are whole multiples of four pixels, so spans starting on a multiple of four stay in the tile
+    const int x0 = std::max(triangle.minX, tileX * static_cast<int>(TileSize)) & ~3;
+    const int x1 = std::min(triangle.maxX, (tileX + 1) * static_cast<int>(TileSize) - 1);
+    const int y0 = std::max(triangle.minY, tileY * static_cast<int>(TileSize));
+    const int y1 = std::min(triangle.maxY, (tileY + 1) * static_cast<int>(TileSize) - 1);
+    const uint32_t pitch = GetPitch();
+
+    const XMVECTOR zero = XMVectorZero();
+    const XMVECTOR four = XMVectorReplicate(4.f);
+    const XMVECTOR startX = XMVectorSet(float(x0), float(x0 + 1), float(x0 + 2), float(x0 + 3));
+    const XMVECTOR edgeX0 = XMVectorReplicate(triangle.edgeX[0]);
+    const XMVECTOR edgeX1 = XMVectorReplicate(triangle.edgeX[1]);
+    const XMVECTOR edgeX2 = XMVectorReplicate(triangle.edgeX[2]);
+    const XMVECTOR depthX = XMVectorReplicate(triangle.depth[0]);
+    const XMVECTOR invWX = XMVectorReplicate(triangle.invW[0]);
+    XMVECTOR attributeX[AttributeCount];
+    for (int k = 0; k < AttributeCount; k++)
+    {
+        attributeX[k] = XMVectorReplicate(triangle.attributes[k][0]);
+    }
+
+    const XMVECTOR lightX = XMVectorReplicate(m_light.position.x);
+    const XMVECTOR lightY = XMVectorReplicate(m_light.position.y);
+    const XMVECTOR lightZ = XMVectorReplicate(m_light.position.z);
+    const XMVECTOR ambient = XMLoadFloat4(&m_light.ambient);
+    const XMVECTOR diffuse = XMLoadFloat4(&m_light.diffuse);
+    const XMVECTOR ambientR = XMVectorSplatX(ambient), ambientG = XMVectorSplatY(ambient), ambientB = XMVectorSplatZ(ambient), ambientA = XMVectorSplatW(ambient);
+    const XMVECTOR diffuseR = XMVectorSplatX(diffuse), diffuseG = XMVectorSplatY(diffuse), diffuseB = XMVectorSplatZ(diffuse), diffuseA = XMVectorSplatW(diffuse);
+    const SoftwareTexture* texture = triangle.draw->texture;
+    const XMVECTOR material = XMLoadFloat4(&triangle.draw->color);
+    const XMVECTOR materialR = XMVectorSplatX(material), materialG = XMVectorSplatY(material), materialB = XMVectorSplatZ(material), materialA = XMVectorSplatW(material);
+
+    // Texel channels are masked in place and scaled down to 0 to 1
+    const XMVECTOR redMask = XMVectorSetInt(0x000000ff, 0x000000ff, 0x000000ff, 0x000000ff);
+    const XMVECTOR greenMask = XMVectorSetInt(0x0000ff00, 0x0000ff00, 0x0000ff00, 0x0000ff00);
+    const XMVECTOR blueMask = XMVectorSetInt(0x00ff0000, 0x00ff0000, 0x00ff0000, 0x00ff0000);
+    const XMVECTOR alphaMask = XMVectorSetInt(0xff000000, 0xff000000, 0xff000000, 0xff000000);
+    const XMVECTOR unpackRed = XMVectorReplicate(1.f / 255.f);
+    const XMVECTOR unpackGreen = XMVectorReplicate(1.f / (255.f * 256.f));
+    const XMVECTOR unpackBlue = XMVectorReplicate(1.f / (255.f * 65536.f));
+    const XMVECTOR unpackAlpha = XMVectorReplicate(1.f / (255.f * 16777216.f));
+
+    // Channels are rounded to whole numbers, then blue, green and red are summed exactly in a
+    // float and alpha converted on its own
+    const XMVECTOR scale255 = XMVectorReplicate(255.f);
+    const XMVECTOR half = XMVectorReplicate(0.5f);
+    const XMVECTOR shift8 = XMVectorReplicate(256.f);
+    const XMVECTOR shift16 = XMVectorReplicate(65536.f);
+    const XMVECTOR shift24 = XMVectorReplicate(16777216.f);
+
+    for (int y = y0; y <= y1; y++)
+    {
+        const float fy = float(y);
+        const XMVECTOR rowEdge0 = XMVectorReplicate(triangle.edgeY[0] * fy + triangle.edgeOffset[0]);
+        const XMVECTOR rowEdge1 = XMVectorReplicate(triangle.edgeY[1] * fy + triangle.edgeOffset[1]);
+        const XMVECTOR rowEdge2 = XMVectorReplicate(triangle.edgeY[2] * fy + triangle.edgeOffset[2]);
+        const XMVECTOR rowDepth = XMVectorReplicate(triangle.depth[1] * fy + triangle.depth[2]);
+        const XMVECTOR rowInvW = XMVectorReplicate(triangle.invW[1] * fy + triangle.invW[2]);
+        XMVECTOR rowAttribute[AttributeCount];
+        for (int k = 0; k < AttributeCount; k++)
+        {
+            rowAttribute[k] = XMVectorReplicate(triangle.attributes[k][1] * fy + triangle.attributes[k][2]);
+        }
+
+        float* depthRow = &m_depth[size_t(y) * pitch];
+        uint32_t* colorRow = &m_color[size_t(y) * pitch];
+        XMVECTOR x = startX;
+        for (int column = x0; column <= x1; column += 4, x = XMVectorAdd(x, four))
+        {
+            XMVECTOR mask = XMVectorGreaterOrEqual(XMVectorMultiplyAdd(x, edgeX0, rowEdge0), zero);
+            mask = XMVectorAndInt(mask, XMVectorGreaterOrEqual(XMVectorMultiplyAdd(x, edgeX1, rowEdge1), zero));
+            mask = XMVectorAndInt(mask, XMVectorGreaterOrEqual(XMVectorMultiplyAdd(x, edgeX2, rowEdge2), zero));
+
+            XMFLOAT4* depthPixels = reinterpret_cast<XMFLOAT4*>(depthRow + column);
+            const XMVECTOR storedDepth = XMLoadFloat4(depthPixels);
+            const XMVECTOR depth = XMVectorMultiplyAdd(x, depthX, rowDepth);
+            mask = XMVectorAndInt(mask, XMVectorLess(depth, storedDepth));
+
+            uint32_t lanes[4];
+            XMStoreInt4(lanes, mask);
+            if ((lanes[0] | lanes[1] | lanes[2] | lanes[3]) == 0)
+                continue;
+            stats.shadedPixels += (lanes[0] & 1) + (lanes[1] & 1) + (lanes[2] & 1) + (lanes[3] & 1);
+
+            // Perspective correct attributes
+            const XMVECTOR w = XMVectorReciprocal(XMVectorMultiplyAdd(x, invWX, rowInvW));
+            XMVECTOR attribute[AttributeCount];
+            for (int k = 0; k < AttributeCount; k++)
+            {
+                attribute[k] = XMVectorMultiply(XMVectorMultiplyAdd(x, attributeX[k], rowAttribute[k]), w);
+            }
+
+            // The interpolated normal is used as it is, like light_ps does
+            const XMVECTOR toPixelX = XMVectorSubtract(attribute[5], lightX);
+            const XMVECTOR toPixelY = XMVectorSubtract(attribute[6], lightY);
+            const XMVECTOR toPixelZ = XMVectorSubtract(attribute[7], lightZ);
+            const XMVECTOR invLength = XMVectorReciprocalSqrt(XMVectorMultiplyAdd(toPixelX, toPixelX,
+                XMVectorMultiplyAdd(toPixelY, toPixelY, XMVectorMultiply(toPixelZ, toPixelZ))));
+            const XMVECTOR facing = XMVectorMultiplyAdd(attribute[2], toPixelX,
+                XMVectorMultiplyAdd(attribute[3], toPixelY, XMVectorMultiply(attribute[4], toPixelZ)));
+            const XMVECTOR intensity = XMVectorSaturate(XMVectorNegate(XMVectorMultiply(facing, invLength)));
+
+            XMVECTOR red = XMVectorSaturate(XMVectorMultiplyAdd(diffuseR, intensity, ambientR));
+            XMVECTOR green = XMVectorSaturate(XMVectorMultiplyAdd(diffuseG, intensity, ambientG));
+            XMVECTOR blue = XMVectorSaturate(XMVectorMultiplyAdd(diffuseB, intensity, ambientB));
+            XMVECTOR alpha = XMVectorSaturate(XMVectorMultiplyAdd(diffuseA, intensity, ambientA));
+
+            if (texture)
+            {
+                // Texels are fetched lane by lane, then split into one vector per channel
+                XMFLOAT4 u, v;
+                XMStoreFloat4(&u, attribute[0]);
+                XMStoreFloat4(&v, attribute[1]);
+                const float* us = &u.x;
+                const float* vs = &v.x;
+                uint32_t texels[4];
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    texels[lane] = lanes[lane] ? SampleTexture(*texture, us[lane], vs[lane]) : 0;
+                }
+                const XMVECTOR packed = XMLoadInt4(texels);
+                red = XMVectorMultiply(red, XMVectorMultiply(XMConvertVectorUIntToFloat(XMVectorAndInt(packed, redMask), 0), unpackRed));
+                green = XMVectorMultiply(green, XMVectorMultiply(XMConvertVectorUIntToFloat(XMVectorAndInt(packed, greenMask), 0), unpackGreen));
+                blue = XMVectorMultiply(blue, XMVectorMultiply(XMConvertVectorUIntToFloat(XMVectorAndInt(packed, blueMask), 0), unpackBlue));
+                alpha = XMVectorMultiply(alpha, XMVectorMultiply(XMConvertVectorUIntToFloat(XMVectorAndInt(packed, alphaMask), 0), unpackAlpha));
+            }
+            red = XMVectorMultiply(red, materialR);
+            green = XMVectorMultiply(green, materialG);
+            blue = XMVectorMultiply(blue, materialB);
+            alpha = XMVectorMultiply(alpha, materialA);
+
+            auto quantize = [&](FXMVECTOR channel)
+            {
+                return XMVectorTruncate(XMVectorMultiplyAdd(channel, scale255, half));
+            };
+            const XMVECTOR low = XMVectorMultiplyAdd(quantize(blue), shift16, XMVectorMultiplyAdd(quantize(green), shift8, quantize(red)));
+            const XMVECTOR color = XMVectorOrInt(XMConvertVectorFloatToUInt(low, 0),
+                XMConvertVectorFloatToUInt(XMVectorMultiply(quantize(alpha), shift24), 0));
+
+            XMStoreFloat4(depthPixels, XMVectorSelect(storedDepth, depth, mask));
+            uint32_t* colorPixels = colorRow + column;
+            XMStoreInt4(colorPixels, XMVectorSelect(XMLoadInt4(colorPixels), color, mask));
+        }
+    }
+}
+
+// Fills the pixels of a tile that no triangle reached with the cube map seen along their direction
+void SoftwareRasterizer::DrawSky(int tileX, int tileY, SoftwareRasterStats& stats)
+{
+    const uint32_t pitch = GetPitch();
+    for (uint32_t y = 0; y < TileSize; y++)
+    {
+        const uint32_t pixelY = tileY * TileSize + y;
+        const size_t row = size_t(pixelY) * pitch;
+        for (uint32_t x = 0; x < TileSize; x++)
+        {
+            const uint32_t pixelX = tileX * TileSize + x;
+            if (m_depth[row + pixelX] < 1.f)
+            {
+                continue;
+            }
+
+            const float fx = float(pixelX);
+            const float fy = float(pixelY);
+            m_color[row + pixelX] = SampleCube(*m_sky,
+                m_skyDirection.x + m_skyStepX.x * fx + m_skyStepY.x * fy,
+                m_skyDirection.y + m_skyStepX.y * fx + m_skyStepY.y * fy,
+                m_skyDirection.z + m_skyStepX.z * fx + m_skyStepY.z * fy);
+            stats.skyPixels++;
+        }
+    }
+}
@@ -0,0 +1,170 @@
+//
+// SoftwareRasterizer.h - Tile based CPU renderer for the lit, textured scene and its skybox
+//
+
+#pragma once
+
+#include "MeshData.h"
+#include "SoftwareTexture.h"
+
+#include <atomic>
+#include <vector>
+
+namespace DX
+{
+    // The scene light of light_ps, ambient plus diffuse from a point
+    struct SoftwareLight
+    {
+        DirectX::XMFLOAT4 ambient;
+        DirectX::XMFLOAT4 diffuse;
+        DirectX::XMFLOAT3 position;
+        float padding;
+    };
+
+    // Which screen winding is discarded, named like DirectX::CommonStates
+    enum class SoftwareCull
+    {
+        None,
+        Clockwise,
+        CounterClockwise
+    };
+
+    struct SoftwareRasterStats
+    {
+        uint32_t draws;
+        uint32_t triangles;             // Submitted
+        uint32_t rasterizedTriangles;   // Left after culling and clipping, a clipped triangle may count more than once
+        uint32_t binnedTriangles;       // Summed over the tiles each one touches
+        uint32_t shadedPixels;          // Passed the depth test, a pixel covered twice counts twice
+        uint32_t skyPixels;
+    };
+
+    // Draws what light_vs, light_ps and the skybox effect draw on the GPU, without a device: meshes
+    // lit by the ambient and diffuse scene light and textured with bilinear, wrapping lookups,
+    // depth tested, over a cube map sky.
+    //
+    // Draws are only recorded until Render, which runs in three steps, each split into jobs:
+    // vertices are transformed, then triangles are clipped, set up as planes over the screen and
+    // binned into TileSize square tiles, then whole tiles are cleared, rasterized and shaded four
+    // pixels at a time with SIMD. Each job bins into its own lists and every tile reads them in
+    // job order, so triangles are always drawn in submission order.
+    class SoftwareRasterizer
+    {
+    public:
+        static constexpr uint32_t TileSize = 32;
+
+        // Fewer vertices or triangles than these per job are processed on the calling thread only
+        static constexpr size_t MinVerticesPerJob = 4096;
+        static constexpr size_t MinTrianglesPerJob = 2048;
+
+        SoftwareRasterizer() noexcept;
+
+        // Target size in pixels. The buffers are padded to whole tiles, rows are GetPitch apart.
+        void Resize(uint32_t width, uint32_t height);
+
+        // Starts a frame. sky is a cube map drawn wherever no triangle is, or null to leave those
+        // pixels at clearColor, 8 bit RGBA with red in the lowest byte.
+        void XM_CALLCONV Begin(DirectX::FXMMATRIX view, DirectX::CXMMATRIX projection, const SoftwareLight& light,
+            const SoftwareTexture* sky, uint32_t clearColor = 0xff000000);
+
+        // Default Clockwise, like the game's rasterizer state
+        void SetCullMode(SoftwareCull cullMode) noexcept { m_cullMode = cullMode; }
+
+        // Triangle list drawn at world, its texture multiplied by color like light_ps does with the
+        // material's. The vertices and texture must stay alive until Render, a null texture reads as white.
+        void XM_CALLCONV DrawMesh(const MeshVertex* vertices, const uint32_t* indices, size_t indexCount,
+            DirectX::FXMMATRIX world, const SoftwareTexture* texture, const DirectX::XMFLOAT4& color);
+
+        // Draws everything since Begin. Each step runs as up to threadCount jobs, 0 gives each
+        // thread of the job system one.
+        void Render(unsigned int threadCount = 1);
+
+        uint32_t GetWidth() const noexcept { return m_width; }
+        uint32_t GetHeight() const noexcept { return m_height; }
+        uint32_t GetPitch() const noexcept { return m_tilesX * TileSize; }
+        const uint32_t* GetColor() const noexcept { return m_color.data(); }
+        const float* GetDepth() const noexcept { return m_depth.data(); }
+        const SoftwareRasterStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        // Attributes interpolated across triangles: texture coordinates, world normal and world position
+        static constexpr int AttributeCount = 8;
+
+        struct Draw
+        {
+            const MeshVertex* vertices;
+            const uint32_t* indices;
+            size_t indexCount;
+            uint32_t firstVertex;       // Of the draw's vertices in m_vertices, those below minIndex are skipped
+            uint32_t minIndex;
+            uint32_t vertexCount;
+            uint32_t firstTriangle;
+            DirectX::XMFLOAT4X4 world;
+            const SoftwareTexture* texture;
+            DirectX::XMFLOAT4 color;
+        };
+
+        struct ClipVertex
+        {
+            DirectX::XMFLOAT4 clip;
+            float attributes[AttributeCount];
+        };
+
+        // Screen space triangle ready to rasterize, every value a plane over pixel coordinates
+        // evaluated at pixel centers. A pixel is covered when all three edges are at least 0.
+        // Attributes are divided by w so they interpolate linearly, 1 / w brings them back.
+        struct Triangle
+        {
+            float edgeX[3];
+            float edgeY[3];
+            float edgeOffset[3];
+            float depth[3];             // x, y and offset, like the two below
+            float invW[3];
+            float attributes[AttributeCount][3];
+            int minX;
+            int minY;
+            int maxX;
+            int maxY;
+            const Draw* draw;
+        };
+
+        // What one job set up and binned
+        struct Bin
+        {
+            std::vector<Triangle> triangles;
+            std::vector<std::vector<uint32_t>> tiles;      // Triangles touching each tile
+            SoftwareRasterStats stats;
+        };
+
+        void TransformVertices(size_t begin, size_t end);
+        void SetupTriangles(size_t begin, size_t end, Bin& bin);
+        void ClipTriangle(const ClipVertex* triangle, const Draw& draw, Bin& bin);
+        void AddTriangle(const ClipVertex* const* vertices, const Draw& draw, Bin& bin);
+        void ShadeTiles(size_t binCount, SoftwareRasterStats& stats);
+        void RasterizeTriangle(const Triangle& triangle, int tileX, int tileY, SoftwareRasterStats& stats);
+        void DrawSky(int tileX, int tileY, SoftwareRasterStats& stats);
+
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_tilesX;
+        uint32_t m_tilesY;
+        std::vector<uint32_t> m_color;
+        std::vector<float> m_depth;
+
+        DirectX::XMFLOAT4X4 m_viewProjection;
+        SoftwareLight m_light;
+        const SoftwareTexture* m_sky;
+        uint32_t m_clearColor;
+        DirectX::XMFLOAT3 m_skyDirection;       // World direction through pixel (0, 0), and its steps
+        DirectX::XMFLOAT3 m_skyStepX;           // one pixel right and one pixel down
+        DirectX::XMFLOAT3 m_skyStepY;
+        SoftwareCull m_cullMode;
+
+        std::vector<Draw> m_draws;
+        std::vector<ClipVertex> m_vertices;
+        uint32_t m_triangleCount;
+        std::vector<Bin> m_bins;
+        std::atomic<uint32_t> m_nextTile;
+        SoftwareRasterStats m_stats;
+    };
+}
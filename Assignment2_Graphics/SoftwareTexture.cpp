@@ -0,0 +1,368 @@
+//
+// SoftwareTexture.cpp - CPU copy of a texture for the software rasterizer, read from DDS files
+//
+
+#include "pch.h"
+#include "SoftwareTexture.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <fstream>
+
+using namespace DX;
+
+namespace
+{
+    constexpr uint32_t DdsMagic = 0x20534444;          // "DDS "
+    constexpr size_t DdsHeaderSize = 4 + 124;
+    constexpr size_t Dx10HeaderSize = 20;
+
+    constexpr uint32_t PixelFormatFourCC = 0x4;
+    constexpr uint32_t PixelFormatRgb = 0x40;
+    constexpr uint32_t Caps2CubeMap = 0x200;
+    constexpr uint32_t Dx10MiscCube = 0x4;
+
+    constexpr uint32_t MakeFourCC(char a, char b, char c, char d) noexcept
+    {
+        return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+    }
+
+    // How the texels of a level are stored
+    enum class DdsLayout
+    {
+        Unsupported,
+        Rgba,           // 32 bits per texel, channels found with the masks below
+        Bc1,
+        Bc2,
+        Bc3
+    };
+
+    struct DdsFormat
+    {
+        DdsLayout layout;
+        uint32_t masks[4];      // Red, green, blue and alpha bits of an uncompressed texel, alpha may be 0
+    };
+
+    uint32_t ReadUInt32(const uint8_t* data) noexcept
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    DdsFormat GetDxgiFormat(uint32_t dxgiFormat) noexcept
+    {
+        switch (dxgiFormat)
+        {
+        case 28: case 29:       // R8G8B8A8_UNORM, _SRGB
+            return { DdsLayout::Rgba, { 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000 } };
+        case 87: case 91:       // B8G8R8A8_UNORM, _SRGB
+            return { DdsLayout::Rgba, { 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 } };
+        case 88: case 93:       // B8G8R8X8_UNORM, _SRGB
+            return { DdsLayout::Rgba, { 0x00ff0000, 0x0000ff00, 0x000000ff, 0 } };
+        case 71: case 72:
+            return { DdsLayout::Bc1, {} };
+        case 74: case 75:
+            return { DdsLayout::Bc2, {} };
+        case 77: case 78:
+            return { DdsLayout::Bc3, {} };
+        default:
+            return { DdsLayout::Unsupported, {} };
+        }
+    }
+
+    size_t GetLevelSize(DdsLayout layout, uint32_t width, uint32_t height) noexcept
+    {
+        if (layout == DdsLayout::Rgba)
+        {
+            return size_t(width) * height * 4;
+        }
+        const size_t blockSize = layout == DdsLayout::Bc1 ? 8 : 16;
+        return size_t((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+    }
+
+    // Scales a masked channel to 8 bits, a missing channel reads as opaque
+    uint32_t ExtractChannel(uint32_t texel, uint32_t mask) noexcept
+    {
+        if (mask == 0)
+        {
+            return 0xff;
+        }
+        uint32_t shift = 0;
+        while (((mask >> shift) & 1) == 0)
+        {
+            shift++;
+        }
+        const uint32_t maximum = mask >> shift;
+        return ((texel & mask) >> shift) * 255 / maximum;
+    }
+
+    uint32_t PackRgba(uint32_t r, uint32_t g, uint32_t b, uint32_t a) noexcept
+    {
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    uint32_t Expand565(uint16_t color) noexcept
+    {
+        const uint32_t r = (color >> 11) & 31;
+        const uint32_t g = (color >> 5) & 63;
+        const uint32_t b = color & 31;
+        return PackRgba((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 0xff);
+    }
+
+    uint32_t BlendRgba(uint32_t a, uint32_t b, uint32_t weightA, uint32_t weightB, uint32_t total) noexcept
+    {
+        uint32_t result = 0;
+        for (uint32_t shift = 0; shift < 32; shift += 8)
+        {
+            const uint32_t channel = (((a >> shift) & 0xff) * weightA + ((b >> shift) & 0xff) * weightB) / total;
+            result |= channel << shift;
+        }
+        return result;
+    }
+
+    // Colours of one BC1 style block. BC2 and BC3 always use four colours.
+    void DecodeColorBlock(const uint8_t* block, bool allowTransparent, uint32_t* texels) noexcept
+    {
+        const uint16_t color0 = uint16_t(block[0] | (block[1] << 8));
+        const uint16_t color1 = uint16_t(block[2] | (block[3] << 8));
+        uint32_t palette[4];
+        palette[0] = Expand565(color0);
+        palette[1] = Expand565(color1);
+        if (color0 > color1 || !allowTransparent)
+        {
+            palette[2] = BlendRgba(palette[0], palette[1], 2, 1, 3);
+            palette[3] = BlendRgba(palette[0], palette[1], 1, 2, 3);
+        }
+        else
+        {
+            palette[2] = BlendRgba(palette[0], palette[1], 1, 1, 2);
+            palette[3] = 0;
+        }
+
+        const uint32_t indices = ReadUInt32(block + 4);
+        for (int i = 0; i < 16; i++)
+        {
+            texels[i] = palette[(indices >> (2 * i)) & 3];
+        }
+    }
+
+    void DecodeBc3Alpha(const uint8_t* block, uint32_t* texels) noexcept
+    {
+        uint32_t alpha[8];
+        alpha[0] = block[0];
+        alpha[1] = block[1];
+        if (alpha[0] > alpha[1])
+        {
+            for (uint32_t i = 1; i < 7; i++)
+            {
+                alpha[i + 1] = (alpha[0] * (7 - i) + alpha[1] * i) / 7;
+            }
+        }
+        else
+        {
+            for (uint32_t i = 1; i < 5; i++)
+            {
+                alpha[i + 1] = (alpha[0] * (5 - i) + alpha[1] * i) / 5;
+            }
+            alpha[6] = 0;
+            alpha[7] = 255;
+        }
+
+        uint64_t indices = 0;
+        for (int i = 0; i < 6; i++)
+        {
+            indices |= uint64_t(block[2 + i]) << (8 * i);
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            texels[i] = (texels[i] & 0x00ffffff) | (alpha[(indices >> (3 * i)) & 7] << 24);
+        }
+    }
+
+    void DecodeLevel(const DdsFormat& format, const uint8_t* source, uint32_t width, uint32_t height, uint32_t* texels) noexcept
+    {
+        if (format.layout == DdsLayout::Rgba)
+        {
+            for (size_t i = 0; i < size_t(width) * height; i++)
+            {
+                const uint32_t texel = ReadUInt32(source + i * 4);
+                texels[i] = PackRgba(ExtractChannel(texel, format.masks[0]), ExtractChannel(texel, format.masks[1]),
+                    ExtractChannel(texel, format.masks[2]), ExtractChannel(texel, format.masks[3]));
+            }
+            return;
+        }
+
+        const size_t blockSize = format.layout == DdsLayout::Bc1 ? 8 : 16;
+        for (uint32_t blockY = 0; blockY < (height + 3) / 4; blockY++)
+        {
+            for (uint32_t blockX = 0; blockX < (width + 3) / 4; blockX++)
+            {
+                uint32_t block[16];
+                if (format.layout == DdsLayout::Bc1)
+                {
+                    DecodeColorBlock(source, true, block);
+                }
+                else
+                {
+                    DecodeColorBlock(source + 8, false, block);
+                    if (format.layout == DdsLayout::Bc2)
+                    {
+                        for (int i = 0; i < 16; i++)
+                        {
+                            const uint32_t alpha = (source[i / 2] >> (4 * (i & 1))) & 15;
+                            block[i] = (block[i] & 0x00ffffff) | ((alpha * 17) << 24);
+                        }
+                    }
+                    else
+                    {
+                        DecodeBc3Alpha(source, block);
+                    }
+                }
+                source += blockSize;
+
+                // Blocks hang over the edge of textures that aren't multiples of four
+                for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++)
+                {
+                    for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++)
+                    {
+                        texels[size_t(blockY * 4 + y) * width + blockX * 4 + x] = block[y * 4 + x];
+                    }
+                }
+            }
+        }
+    }
+}
+
+SoftwareTexture::SoftwareTexture() noexcept :
+    m_width(0),
+    m_height(0),
+    m_faceCount(0)
+{
+}
+
+bool SoftwareTexture::LoadDds(const char* filename)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        return false;
+    }
+    return LoadDds(file.GetData(), file.GetSize());
+}
+
+bool SoftwareTexture::LoadDds(const void* data, size_t size)
+{
+    m_width = m_height = m_faceCount = 0;
+    m_texels.clear();
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (size < DdsHeaderSize || ReadUInt32(bytes) != DdsMagic)
+    {
+        return false;
+    }
+
+    const uint32_t height = ReadUInt32(bytes + 12);
+    const uint32_t width = ReadUInt32(bytes + 16);
+    const uint32_t mipCount = std::max(1u, ReadUInt32(bytes + 28));
+    const uint32_t pixelFlags = ReadUInt32(bytes + 80);
+    const uint32_t fourCC = ReadUInt32(bytes + 84);
+    const uint32_t caps2 = ReadUInt32(bytes + 112);
+
+    DdsFormat format = { DdsLayout::Unsupported, {} };
+    uint32_t faceCount = caps2 & Caps2CubeMap ? 6 : 1;
+    size_t offset = DdsHeaderSize;
+    if ((pixelFlags & PixelFormatFourCC) && fourCC == MakeFourCC('D', 'X', '1', '0'))
+    {
+        if (size < DdsHeaderSize + Dx10HeaderSize)
+        {
+            return false;
+        }
+        format = GetDxgiFormat(ReadUInt32(bytes + DdsHeaderSize));
+        faceCount = ReadUInt32(bytes + DdsHeaderSize + 8) & Dx10MiscCube ? 6 : 1;
+        offset += Dx10HeaderSize;
+    }
+    else if (pixelFlags & PixelFormatFourCC)
+    {
+        if (fourCC == MakeFourCC('D', 'X', 'T', '1'))
+            format.layout = DdsLayout::Bc1;
+        else if (fourCC == MakeFourCC('D', 'X', 'T', '2') || fourCC == MakeFourCC('D', 'X', 'T', '3'))
+            format.layout = DdsLayout::Bc2;
+        else if (fourCC == MakeFourCC('D', 'X', 'T', '4') || fourCC == MakeFourCC('D', 'X', 'T', '5'))
+            format.layout = DdsLayout::Bc3;
+    }
+    else if ((pixelFlags & PixelFormatRgb) && ReadUInt32(bytes + 88) == 32)
+    {
+        format.layout = DdsLayout::Rgba;
+        for (int i = 0; i < 4; i++)
+        {
+            format.masks[i] = ReadUInt32(bytes + 92 + 4 * i);
+        }
+    }
+
+    if (format.layout == DdsLayout::Unsupported || width == 0 || height == 0)
+    {
+        return false;
+    }
+
+    // Each face is followed by its own mip chain, only the top level is kept
+    size_t faceSize = 0;
+    for (uint32_t level = 0; level < mipCount; level++)
+    {
+        faceSize += GetLevelSize(format.layout, std::max(1u, width >> level), std::max(1u, height >> level));
+    }
+    if (offset + faceSize * faceCount > size)
+    {
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_faceCount = faceCount;
+    m_texels.resize(size_t(width) * height * faceCount);
+    for (uint32_t face = 0; face < faceCount; face++)
+    {
+        DecodeLevel(format, bytes + offset + face * faceSize, width, height, m_texels.data() + size_t(face) * width * height);
+    }
+    return true;
+}
+
+bool SoftwareTexture::WriteTga(const char* filename, uint32_t width, uint32_t height, const uint32_t* pixels, uint32_t pitch)
+{
+    if (width == 0 || height == 0 || width > 0xffff || height > 0xffff)
+    {
+        return false;
+    }
+
+    std::ofstream outFile(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!outFile)
+    {
+        return false;
+    }
+
+    // Uncompressed true colour, 8 bits of alpha, rows from the top
+    uint8_t header[18] = {};
+    header[2] = 2;
+    header[12] = uint8_t(width);
+    header[13] = uint8_t(width >> 8);
+    header[14] = uint8_t(height);
+    header[15] = uint8_t(height >> 8);
+    header[16] = 32;
+    header[17] = 0x28;
+    outFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    std::vector<uint8_t> row(size_t(width) * 4);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const uint32_t* source = pixels + size_t(y) * pitch;
+        for (uint32_t x = 0; x < width; x++)
+        {
+            row[x * 4 + 0] = uint8_t(source[x] >> 16);
+            row[x * 4 + 1] = uint8_t(source[x] >> 8);
+            row[x * 4 + 2] = uint8_t(source[x]);
+            row[x * 4 + 3] = uint8_t(source[x] >> 24);
+        }
+        outFile.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+    }
+    return static_cast<bool>(outFile);
+}
@@ -0,0 +1,39 @@
+//
+// SoftwareTexture.h - CPU copy of a texture for the software rasterizer, read from DDS files
+//
+
+#pragma once
+
+#include <vector>
+
+namespace DX
+{
+    // Top mip level of a 2D texture or of the six faces of a cube map, as 8 bit RGBA texels with red
+    // in the lowest byte. Faces are in D3D order: +X, -X, +Y, -Y, +Z, -Z.
+    class SoftwareTexture
+    {
+    public:
+        SoftwareTexture() noexcept;
+
+        // Reads uncompressed 32 bit RGBA or BGRA DDS files and BC1, BC2 and BC3 compressed ones.
+        // Returns false for anything else, leaving the texture empty.
+        bool LoadDds(const char* filename);
+        bool LoadDds(const void* data, size_t size);
+
+        // Writes rows of 8 bit RGBA pixels, pitch apart, as an uncompressed 32 bit TGA image
+        static bool WriteTga(const char* filename, uint32_t width, uint32_t height, const uint32_t* pixels, uint32_t pitch);
+
+        bool IsEmpty() const noexcept { return m_texels.empty(); }
+        bool IsCube() const noexcept { return m_faceCount == 6; }
+        uint32_t GetWidth() const noexcept { return m_width; }
+        uint32_t GetHeight() const noexcept { return m_height; }
+        uint32_t GetFaceCount() const noexcept { return m_faceCount; }
+        const uint32_t* GetTexels(uint32_t face = 0) const noexcept { return m_texels.data() + size_t(face) * m_width * m_height; }
+
+    private:
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_faceCount;
+        std::vector<uint32_t> m_texels;     // Faces one after another
+    };
+}
@@ -4,40 +4,48 @@
 
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
-#include <exception>
 
 
 namespace DX
 {
+    // Spread of the most recent frame times, in seconds
+    struct FrameTimeStats
+    {
+        uint32_t frameCount;        // Frames measured, at most StepTimer::FrameHistorySize
+        double averageSeconds;
+        double p50Seconds;
+        double p95Seconds;
+        double p99Seconds;
+        double maxSeconds;
+    };
+
     // Helper class for animation and simulation timing.
     class StepTimer
     {
     public:
-        StepTimer() noexcept(false) :
+        // Frame times kept for GetFrameTimeStats and GetFrameTimeHistogram
+        static constexpr uint32_t FrameHistorySize = 1024;
+
+        StepTimer() noexcept :
+            m_lastTime(Clock::now()),
+            m_maxDelta(TicksPerSecond / 10),
             m_elapsedTicks(0),
             m_totalTicks(0),
             m_leftOverTicks(0),
             m_frameCount(0),
             m_framesPerSecond(0),
             m_framesThisSecond(0),
-            m_qpcSecondCounter(0),
+            m_secondCounter(0),
+            m_frameTimes{},
+            m_frameTimeCount(0),
+            m_frameTimeStats{},
             m_isFixedTimeStep(false),
             m_targetElapsedTicks(TicksPerSecond / 60)
         {
-            if (!QueryPerformanceFrequency(&m_qpcFrequency))
-            {
-                throw std::exception();
-            }
-
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception();
-            }
-
-            // Initialize max delta to 1/10 of a second.
-            m_qpcMaxDelta = static_cast<uint64_t>(m_qpcFrequency.QuadPart / 10);
         }
 
         // Get elapsed time since the previous Update call.
@@ -54,6 +62,23 @@ namespace DX
         // Get the current framerate.
         uint32_t GetFramesPerSecond() const noexcept { return m_framesPerSecond; }
 
+        // Get the spread of the last FrameHistorySize times between Tick calls, unclamped.
+        // Refreshed along with the framerate, once a second.
+        const FrameTimeStats& GetFrameTimeStats() const noexcept { return m_frameTimeStats; }
+
+        // Counts the same frame times into bucketCount buckets bucketSeconds wide, the last
+        // bucket also takes everything longer.
+        void GetFrameTimeHistogram(uint32_t* counts, uint32_t bucketCount, double bucketSeconds) const noexcept
+        {
+            std::fill_n(counts, bucketCount, 0u);
+            const uint32_t count = std::min(m_frameTimeCount, FrameHistorySize);
+            for (uint32_t i = 0; i < count && bucketCount > 0; i++)
+            {
+                const double bucket = TicksToSeconds(m_frameTimes[i]) / bucketSeconds;
+                counts[bucket < bucketCount - 1 ? static_cast<uint32_t>(bucket) : bucketCount - 1]++;
+            }
+        }
+
         // Set whether to use fixed or variable timestep mode.
         void SetFixedTimeStep(bool isFixedTimestep) noexcept { m_isFixedTimeStep = isFixedTimestep; }
 
@@ -71,46 +96,36 @@ namespace DX
         // call this to avoid having the fixed timestep logic attempt a set of catch-up
         // Update calls.
 
-        void ResetElapsedTime()
+        void ResetElapsedTime() noexcept
         {
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception();
-            }
+            m_lastTime = Clock::now();
 
             m_leftOverTicks = 0;
             m_framesPerSecond = 0;
             m_framesThisSecond = 0;
-            m_qpcSecondCounter = 0;
+            m_secondCounter = 0;
         }
 
         // Update timer state, calling the specified Update function the appropriate number of times.
         template<typename TUpdate>
         void Tick(const TUpdate& update)
         {
-            // Query the current time.
-            LARGE_INTEGER currentTime;
-
-            if (!QueryPerformanceCounter(&currentTime))
-            {
-                throw std::exception();
-            }
+            // Query the current time. The steady clock is QueryPerformanceCounter on Windows and
+            // clock_gettime(CLOCK_MONOTONIC) on Linux.
+            const Clock::time_point currentTime = Clock::now();
 
-            uint64_t timeDelta = static_cast<uint64_t>(currentTime.QuadPart - m_qpcLastTime.QuadPart);
+            uint64_t timeDelta = static_cast<uint64_t>(std::chrono::duration_cast<Ticks>(currentTime - m_lastTime).count());
 
-            m_qpcLastTime = currentTime;
-            m_qpcSecondCounter += timeDelta;
+            m_lastTime = currentTime;
+            m_secondCounter += timeDelta;
+            m_frameTimes[m_frameTimeCount++ % FrameHistorySize] = timeDelta;
 
             // Clamp excessively large time deltas (e.g. after paused in the debugger).
-            if (timeDelta > m_qpcMaxDelta)
+            if (timeDelta > m_maxDelta)
             {
-                timeDelta = m_qpcMaxDelta;
+                timeDelta = m_maxDelta;
             }
 
-            // Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
-            timeDelta *= TicksPerSecond;
-            timeDelta /= static_cast<uint64_t>(m_qpcFrequency.QuadPart);
-
             uint32_t lastFrameCount = m_frameCount;
 
             if (m_isFixedTimeStep)
@@ -158,19 +173,52 @@ namespace DX
                 m_framesThisSecond++;
             }
 
-            if (m_qpcSecondCounter >= static_cast<uint64_t>(m_qpcFrequency.QuadPart))
+            if (m_secondCounter >= TicksPerSecond)
             {
                 m_framesPerSecond = m_framesThisSecond;
                 m_framesThisSecond = 0;
-                m_qpcSecondCounter %= static_cast<uint64_t>(m_qpcFrequency.QuadPart);
+                m_secondCounter %= TicksPerSecond;
+                UpdateFrameTimeStats();
             }
         }
 
     private:
-        // Source timing data uses QPC units.
-        LARGE_INTEGER m_qpcFrequency;
-        LARGE_INTEGER m_qpcLastTime;
-        uint64_t m_qpcMaxDelta;
+        using Clock = std::chrono::steady_clock;
+        using Ticks = std::chrono::duration<int64_t, std::ratio<1, TicksPerSecond>>;
+
+        // Percentiles are read from a sorted copy of the history, the nearest rank at or above
+        void UpdateFrameTimeStats() noexcept
+        {
+            uint64_t sorted[FrameHistorySize];
+            const uint32_t count = std::min(m_frameTimeCount, FrameHistorySize);
+            if (count == 0)
+            {
+                return;
+            }
+            std::copy_n(m_frameTimes, count, sorted);
+            std::sort(sorted, sorted + count);
+
+            uint64_t total = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                total += sorted[i];
+            }
+            auto percentile = [&sorted, count](uint32_t percent)
+            {
+                return TicksToSeconds(sorted[(count * percent + 99) / 100 - 1]);
+            };
+
+            m_frameTimeStats.frameCount = count;
+            m_frameTimeStats.averageSeconds = TicksToSeconds(total) / count;
+            m_frameTimeStats.p50Seconds = percentile(50);
+            m_frameTimeStats.p95Seconds = percentile(95);
+            m_frameTimeStats.p99Seconds = percentile(99);
+            m_frameTimeStats.maxSeconds = TicksToSeconds(sorted[count - 1]);
+        }
+
+        // Source timing data comes from the steady clock.
+        Clock::time_point m_lastTime;
+        uint64_t m_maxDelta;
 
         // Derived timing data uses a canonical tick format.
         uint64_t m_elapsedTicks;
@@ -181,7 +229,12 @@ namespace DX
         uint32_t m_frameCount;
         uint32_t m_framesPerSecond;
         uint32_t m_framesThisSecond;
-        uint64_t m_qpcSecondCounter;
+        uint64_t m_secondCounter;
+
+        // Members for tracking the spread of frame times, a ring of the last FrameHistorySize.
+        uint64_t m_frameTimes[FrameHistorySize];
+        uint32_t m_frameTimeCount;
+        FrameTimeStats m_frameTimeStats;
 
         // Members for configuring fixed timestep mode.
         bool m_isFixedTimeStep;
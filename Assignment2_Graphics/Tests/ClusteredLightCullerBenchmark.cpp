@@ -0,0 +1,66 @@
+//
+// ClusteredLightCullerBenchmark.cpp - Light assignment time per frame on the game's cluster grid
+//
+//   ClusteredLightCullerBenchmark [lightCount]
+//
+// 1,000 lights unless told otherwise, crowded towards the camera, assigned to 16 x 9 x 24 clusters
+// on one thread and on every thread of the job system.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "ClusteredLightCuller.h"
+#include "JobSystem.h"
+
+#include <cstdlib>
+#include <random>
+
+using namespace DirectX;
+using namespace DX;
+
+int main(int argc, char** argv)
+{
+    const size_t lightCount = argc > 1 ? size_t(strtoul(argv[1], nullptr, 10)) : 1000;
+    const float fieldOfView = XMConvertToRadians(70.f);
+    const float aspectRatio = 16.f / 9.f;
+    const float farPlane = 100.f;
+
+    const XMMATRIX view = XMMatrixLookToRH(XMVectorSet(1.f, 2.f, -3.f, 1.f), XMVectorSet(std::sin(0.5f), 0.f, std::cos(0.5f), 0.f),
+        XMVectorSet(0.f, 1.f, 0.f, 0.f));
+    const XMMATRIX inverseView = XMMatrixInverse(nullptr, view);
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::vector<PointLight> lights(lightCount);
+    const float scaleY = std::tan(fieldOfView * 0.5f) * 1.3f;
+    for (PointLight& light : lights)
+    {
+        const float depth = 0.05f + unit(random) * unit(random) * 60.f;
+        const XMVECTOR viewPosition = XMVectorSet((unit(random) * 2.f - 1.f) * scaleY * aspectRatio * depth,
+            (unit(random) * 2.f - 1.f) * scaleY * depth, -depth, 1.f);
+        XMStoreFloat3(&light.position, XMVector3TransformCoord(viewPosition, inverseView));
+        light.radius = 0.3f + unit(random) * 2.7f;
+        light.color = XMFLOAT3(1.f, 1.f, 1.f);
+        light.intensity = 1.f;
+    }
+
+    ClusteredLightCuller culler;
+    culler.SetGrid(16, 9, 24);
+    culler.SetProjection(XMMatrixPerspectiveFovRH(fieldOfView, aspectRatio, 0.01f, farPlane), 0.1f, farPlane);
+
+    printf("ClusteredLightCullerBenchmark, %zu lights, 16x9x24 clusters, %u threads\n", lightCount, JobSystem::Get().GetThreadCount());
+    const int repeats = 200;
+    for (unsigned int threadCount : { 1u, 0u })
+    {
+        Tests::Stopwatch stopwatch;
+        for (int repeat = 0; repeat < repeats; repeat++)
+        {
+            culler.Cull(lights.data(), lights.size(), view, threadCount);
+        }
+        const LightClusterStats& stats = culler.GetStats();
+        printf("  %-11s: %.3f ms per frame, %u visible, %u sphere tests, %u indices, at most %u per cluster\n",
+            threadCount == 1 ? "1 thread" : "all threads", stopwatch.GetSeconds() * 1000.0 / repeats, stats.visibleLights,
+            stats.clusterTests, stats.lightIndices, stats.maxClusterLights);
+    }
+    return 0;
+}
@@ -0,0 +1,265 @@
+//
+// ClusteredLightCullerTests.cpp - Cluster light lists against brute force lighting of sampled points
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "ClusteredLightCuller.h"
+
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    // The game's grid and projection
+    const uint32_t TilesX = 16;
+    const uint32_t TilesY = 9;
+    const uint32_t Slices = 24;
+    const float GridNear = 0.1f;
+    const float NearPlane = 0.01f;
+    const float FarPlane = 100.f;
+    const float FieldOfView = XMConvertToRadians(70.f);
+    const float AspectRatio = 16.f / 9.f;
+
+    XMMATRIX GetProjection()
+    {
+        return XMMatrixPerspectiveFovRH(FieldOfView, AspectRatio, NearPlane, FarPlane);
+    }
+
+    XMMATRIX GetRandomView()
+    {
+        const float yaw = Random(0.f, XM_2PI);
+        return XMMatrixLookToRH(XMVectorSet(Random(-10.f, 10.f), Random(0.f, 3.f), Random(-10.f, 10.f), 1.f),
+            XMVectorSet(std::sin(yaw), Random(-0.3f, 0.3f), std::cos(yaw), 0.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+    }
+
+    // World space point seen at screen position u, v, 0-1 across and down, and view depth
+    XMVECTOR XM_CALLCONV GetWorldPoint(FXMMATRIX inverseView, float u, float v, float depth)
+    {
+        const float scaleY = std::tan(FieldOfView * 0.5f);
+        const XMVECTOR viewPoint = XMVectorSet((u * 2.f - 1.f) * scaleY * AspectRatio * depth, (1.f - v * 2.f) * scaleY * depth, -depth, 1.f);
+        return XMVector3TransformCoord(viewPoint, inverseView);
+    }
+
+    // Lights spread through the view, denser near the camera, some partly or wholly behind it or
+    // past the far plane
+    std::vector<PointLight> GetRandomLights(FXMMATRIX inverseView, size_t count)
+    {
+        std::vector<PointLight> lights(count);
+        for (PointLight& light : lights)
+        {
+            const float depth = Random(-3.f, 1.f) + Random(0.f, 1.f) * Random(0.f, 1.f) * (FarPlane + 20.f);
+            XMStoreFloat3(&light.position, GetWorldPoint(inverseView, Random(-0.2f, 1.2f), Random(-0.2f, 1.2f), depth));
+            light.radius = Random(0.3f, 3.f);
+            light.color = XMFLOAT3(1.f, 1.f, 1.f);
+            light.intensity = 1.f;
+        }
+        return lights;
+    }
+
+    // Lists are contiguous in cluster order, in light order, and the stats add up
+    void CheckLists(const ClusteredLightCuller& culler, size_t lightCount)
+    {
+        const std::vector<LightCluster>& clusters = culler.GetClusters();
+        const std::vector<uint32_t>& indices = culler.GetLightIndices();
+        DX_CHECK(clusters.size() == size_t(culler.GetTilesX()) * culler.GetTilesY() * culler.GetSliceCount());
+
+        bool valid = true;
+        uint32_t next = 0;
+        uint32_t maxCount = 0;
+        for (const LightCluster& cluster : clusters)
+        {
+            valid = valid && cluster.offset == next;
+            for (uint32_t i = 0; i < cluster.count && cluster.offset + i < indices.size(); i++)
+            {
+                valid = valid && indices[cluster.offset + i] < lightCount;
+                valid = valid && (i == 0 || indices[cluster.offset + i - 1] < indices[cluster.offset + i]);
+            }
+            next = cluster.offset + cluster.count;
+            maxCount = std::max(maxCount, cluster.count);
+        }
+        DX_CHECK(valid);
+        DX_CHECK(next == indices.size());
+
+        const LightClusterStats& stats = culler.GetStats();
+        DX_CHECK(stats.lightCount == lightCount);
+        DX_CHECK(stats.lightIndices == indices.size());
+        DX_CHECK(stats.maxClusterLights == maxCount);
+        DX_CHECK(stats.visibleLights <= lightCount);
+    }
+
+    bool IsListed(const ClusteredLightCuller& culler, uint32_t cluster, uint32_t light)
+    {
+        const LightCluster& list = culler.GetClusters()[cluster];
+        const uint32_t* first = culler.GetLightIndices().data() + list.offset;
+        return std::binary_search(first, first + list.count, light);
+    }
+
+    // Every light reaching a point is in the list of the cluster a pixel there looks up, the way
+    // light_ps.hlsl finds it from the pixel and its view depth. Returns how many light and point
+    // pairs were checked.
+    size_t CheckLighting(const ClusteredLightCuller& culler, const std::vector<PointLight>& lights, FXMMATRIX view, int sampleCount)
+    {
+        const XMMATRIX inverseView = XMMatrixInverse(nullptr, view);
+        size_t litPairs = 0;
+        size_t missing = 0;
+        for (int sample = 0; sample < sampleCount; sample++)
+        {
+            const float u = Random(0.f, 1.f);
+            const float v = Random(0.f, 1.f);
+            const float depth = sample % 2 ? NearPlane * std::pow(FarPlane / NearPlane, Random(0.f, 1.f)) : Random(NearPlane, FarPlane);
+            const XMVECTOR point = GetWorldPoint(inverseView, u, v, depth);
+            const uint32_t tileX = std::min(uint32_t(u * float(TilesX)), TilesX - 1);
+            const uint32_t tileY = std::min(uint32_t(v * float(TilesY)), TilesY - 1);
+            const uint32_t cluster = culler.GetClusterIndex(tileX, tileY, culler.GetSlice(depth));
+            for (uint32_t i = 0; i < lights.size(); i++)
+            {
+                const float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(point, XMLoadFloat3(&lights[i].position))));
+                if (distance <= lights[i].radius)
+                {
+                    litPairs++;
+                    missing += IsListed(culler, cluster, i) ? 0 : 1;
+                }
+            }
+        }
+        DX_CHECK(missing == 0);
+        return litPairs;
+    }
+
+    // Listed lights reach their cluster's frustum piece, give or take the box around it: a light is
+    // never listed where its sphere is clear of the cluster's view space bounds
+    void CheckTightness(const ClusteredLightCuller& culler, const std::vector<PointLight>& lights, FXMMATRIX view)
+    {
+        const float scaleY = std::tan(FieldOfView * 0.5f);
+        const float scaleX = scaleY * AspectRatio;
+        const float logRange = std::log(FarPlane / GridNear);
+        size_t loose = 0;
+        for (uint32_t s = 0; s < Slices; s++)
+        {
+            const float nearDepth = s == 0 ? 0.f : GridNear * std::exp(logRange * float(s) / float(Slices)) * 0.99f;
+            const float farDepth = GridNear * std::exp(logRange * float(s + 1) / float(Slices)) * 1.01f;
+            for (uint32_t y = 0; y < TilesY; y++)
+            {
+                for (uint32_t x = 0; x < TilesX; x++)
+                {
+                    const float ndcX[2] = { float(x) / float(TilesX) * 2.f - 1.f, float(x + 1) / float(TilesX) * 2.f - 1.f };
+                    const float ndcY[2] = { 1.f - float(y + 1) / float(TilesY) * 2.f, 1.f - float(y) / float(TilesY) * 2.f };
+                    const XMFLOAT3 boundsMin(std::min(ndcX[0] * scaleX * farDepth, ndcX[0] * scaleX * nearDepth),
+                        std::min(ndcY[0] * scaleY * farDepth, ndcY[0] * scaleY * nearDepth), nearDepth);
+                    const XMFLOAT3 boundsMax(std::max(ndcX[1] * scaleX * farDepth, ndcX[1] * scaleX * nearDepth),
+                        std::max(ndcY[1] * scaleY * farDepth, ndcY[1] * scaleY * nearDepth), farDepth);
+
+                    const LightCluster& list = culler.GetClusters()[culler.GetClusterIndex(x, y, s)];
+                    for (uint32_t i = 0; i < list.count; i++)
+                    {
+                        const PointLight& light = lights[culler.GetLightIndices()[list.offset + i]];
+                        XMFLOAT3 center;
+                        XMStoreFloat3(&center, XMVector3Transform(XMLoadFloat3(&light.position), view));
+                        center.z = -center.z;
+                        const float dx = center.x - std::max(boundsMin.x, std::min(center.x, boundsMax.x));
+                        const float dy = center.y - std::max(boundsMin.y, std::min(center.y, boundsMax.y));
+                        const float dz = center.z - std::max(boundsMin.z, std::min(center.z, boundsMax.z));
+                        const float reach = light.radius * 1.01f;
+                        loose += dx * dx + dy * dy + dz * dz > reach * reach ? 1 : 0;
+                    }
+                }
+            }
+        }
+        DX_CHECK(loose == 0);
+    }
+
+    void TestRandomViews()
+    {
+        ClusteredLightCuller culler;
+        culler.SetGrid(TilesX, TilesY, Slices);
+        culler.SetProjection(GetProjection(), GridNear, FarPlane);
+        size_t litPairs = 0;
+        for (int round = 0; round < 6; round++)
+        {
+            const XMMATRIX view = GetRandomView();
+            const std::vector<PointLight> lights = GetRandomLights(XMMatrixInverse(nullptr, view), round == 0 ? 1 : 200 * round);
+            culler.Cull(lights.data(), lights.size(), view);
+            CheckLists(culler, lights.size());
+            litPairs += CheckLighting(culler, lights, view, 5000);
+            CheckTightness(culler, lights, view);
+
+            // Jobs split the slices between them, the lists don't change
+            const std::vector<LightCluster> clusters = culler.GetClusters();
+            const std::vector<uint32_t> indices = culler.GetLightIndices();
+            culler.Cull(lights.data(), lights.size(), view, 0);
+            bool same = culler.GetLightIndices() == indices;
+            for (size_t c = 0; c < clusters.size(); c++)
+            {
+                same = same && clusters[c].offset == culler.GetClusters()[c].offset && clusters[c].count == culler.GetClusters()[c].count;
+            }
+            DX_CHECK(same);
+            printf("  %4zu lights: %4u visible, %5u indices, at most %u per cluster\n", lights.size(), culler.GetStats().visibleLights,
+                culler.GetStats().lightIndices, culler.GetStats().maxClusterLights);
+        }
+        DX_CHECK(litPairs > 0);
+        printf("  %zu lit points checked\n", litPairs);
+    }
+
+    void TestEdgeCases()
+    {
+        ClusteredLightCuller culler;
+        culler.SetGrid(TilesX, TilesY, Slices);
+        culler.SetProjection(GetProjection(), GridNear, FarPlane);
+        const XMMATRIX view = XMMatrixIdentity();
+
+        // Behind the camera, past the far plane, or without a radius, a light is in no cluster
+        const PointLight outside[3] = {
+            { XMFLOAT3(0.f, 0.f, 5.f), 2.f, XMFLOAT3(1.f, 1.f, 1.f), 1.f },
+            { XMFLOAT3(0.f, 0.f, -FarPlane - 3.f), 2.f, XMFLOAT3(1.f, 1.f, 1.f), 1.f },
+            { XMFLOAT3(0.f, 0.f, -5.f), 0.f, XMFLOAT3(1.f, 1.f, 1.f), 1.f } };
+        culler.Cull(outside, 3, view);
+        CheckLists(culler, 3);
+        DX_CHECK(culler.GetStats().visibleLights == 0);
+        DX_CHECK(culler.GetLightIndices().empty());
+
+        // A light around the camera reaches the whole near end of the grid
+        const PointLight around = { XMFLOAT3(0.f, 0.f, 0.f), 1.f, XMFLOAT3(1.f, 1.f, 1.f), 1.f };
+        culler.Cull(&around, 1, view);
+        CheckLists(culler, 1);
+        bool everyTile = true;
+        for (uint32_t y = 0; y < TilesY; y++)
+        {
+            for (uint32_t x = 0; x < TilesX; x++)
+            {
+                everyTile = everyTile && IsListed(culler, culler.GetClusterIndex(x, y, 0), 0);
+            }
+        }
+        DX_CHECK(everyTile);
+        DX_CHECK(culler.GetSlice(0.f) == 0 && culler.GetSlice(FarPlane * 10.f) == Slices - 1);
+
+        // No lights, and a grid changed after the projection
+        culler.Cull(nullptr, 0, view);
+        CheckLists(culler, 0);
+        culler.SetGrid(4, 2, 3);
+        culler.Cull(&around, 1, view);
+        CheckLists(culler, 1);
+        DX_CHECK(culler.GetClusters().size() == 24);
+
+        bool threw = false;
+        try
+        {
+            culler.SetProjection(GetProjection(), FarPlane, GridNear);
+        }
+        catch (const std::invalid_argument&)
+        {
+            threw = true;
+        }
+        DX_CHECK(threw);
+    }
+}
+
+int main()
+{
+    SeedRandom(7);
+    TestRandomViews();
+    TestEdgeCases();
+
+    return Tests::Finish("ClusteredLightCullerTests");
+}
@@ -0,0 +1,188 @@
+//
+// CommandListBenchmark.cpp - The game's frame building path run headless, from culling to replayed commands
+//
+//   CommandListBenchmark [drawCount]
+//
+// 10,000 draws of 20 meshes sharing 8 textures unless told otherwise. Each frame they are frustum
+// culled, queued, sorted, batched and recorded the way Game::SubmitDraws does it, then replayed
+// into a NullCommandBackend, on one thread and on every thread of the job system. The frame is built
+// with instancing and again without it, where every visible draw is recorded as its own call.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "CommandList.h"
+#include "FrustumCuller.h"
+#include "InstanceBatcher.h"
+#include "JobSystem.h"
+
+#include <cstdlib>
+#include <random>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    struct SceneDraw
+    {
+        const void* shader;
+        const void* instancedShader;
+        const void* texture;
+        const void* mesh;
+        int32_t lod;
+        bool cullClusters;
+    };
+
+    struct Scene
+    {
+        std::vector<SceneDraw> draws;
+        std::vector<uint32_t> variants;
+        std::vector<uint32_t> uninstanced;
+        std::vector<XMFLOAT4X4> worlds;
+        std::vector<uint64_t> keys;
+    };
+
+    // Game::RecordDraws without Direct3D: state is set only when it changes within a buffer, and
+    // each draw that isn't instanced binds its own constants block
+    void RecordDraws(CommandBuffer& commands, size_t begin, size_t end, const Scene& scene, const RenderQueue& queue,
+        const InstanceBatcher& batcher, const XMFLOAT4X4& viewProjection)
+    {
+        commands.SetView(viewProjection, XMFLOAT3(0.f, 2.f, 0.f));
+        const std::vector<RenderItem>& items = queue.GetItems();
+        const std::vector<InstanceBatch>& batches = batcher.GetBatches();
+        const void* boundShader = nullptr;
+        const void* boundTexture = nullptr;
+        for (size_t b = begin; b < end; b++)
+        {
+            const InstanceBatch& batch = batches[b];
+            const bool instanced = batch.firstInstance != InstanceBatcher::NotInstanced;
+            const uint32_t drawCount = instanced ? 1 : batch.itemCount;
+            for (uint32_t i = 0; i < drawCount; i++)
+            {
+                const uint32_t drawIndex = items[batch.firstItem + i].draw;
+                const SceneDraw& draw = scene.draws[drawIndex];
+                const void* shader = instanced ? draw.instancedShader : draw.shader;
+                if (shader != boundShader)
+                {
+                    commands.SetPipeline(shader);
+                    boundShader = shader;
+                }
+                if (draw.texture != boundTexture)
+                {
+                    commands.SetTexture(0, draw.texture);
+                    boundTexture = draw.texture;
+                }
+
+                if (instanced)
+                {
+                    commands.DrawMesh(draw.mesh, draw.lod, batch.itemCount, batch.firstInstance);
+                }
+                else
+                {
+                    commands.SetConstants(1, uint32_t(batch.firstItem + i));
+                    if (draw.cullClusters)
+                    {
+                        commands.DrawMeshClusters(draw.mesh, scene.worlds[drawIndex]);
+                    }
+                    else
+                    {
+                        commands.DrawMesh(draw.mesh, draw.lod);
+                    }
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t drawCount = argc > 1 ? size_t(strtoul(argv[1], nullptr, 10)) : 10000;
+    const int shaders[4] = {};
+    const int textures[8] = {};
+    const int meshes[20] = {};
+
+    // Draws spread over 200 x 200 units around the camera, the nearest at full detail
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    const XMVECTOR eye = XMVectorSet(0.f, 2.f, 0.f, 1.f);
+    const XMMATRIX viewProjection = XMMatrixMultiply(XMMatrixLookToLH(eye, XMVectorSet(0.f, 0.f, 1.f, 0.f), XMVectorSet(0.f, 1.f, 0.f, 0.f)),
+        XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, 0.01f, 100.f));
+    XMFLOAT4X4 storedViewProjection;
+    XMStoreFloat4x4(&storedViewProjection, viewProjection);
+
+    Scene scene;
+    FrustumCuller frustumCuller;
+    RenderQueue queue;
+    frustumCuller.Reserve(drawCount);
+    queue.Reserve(drawCount);
+    for (size_t i = 0; i < drawCount; i++)
+    {
+        const uint32_t mesh = random() % 20;
+        const float x = unit(random) * 200.f - 100.f;
+        const float z = unit(random) * 200.f - 100.f;
+        const XMVECTOR position = XMVectorSet(x, 0.f, z, 1.f);
+        const float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(position, eye)));
+        const int32_t lod = distance < 20.f ? 0 : (distance < 50.f ? 1 : 2);
+        const bool cullClusters = mesh == 0 && lod == 0;
+        const bool instancing = !cullClusters;
+        scene.draws.push_back({ &shaders[mesh % 2], &shaders[2 + mesh % 2], &textures[mesh % 8], &meshes[mesh], lod, cullClusters });
+        scene.variants.push_back(instancing ? uint32_t(lod) : InstanceBatcher::NoInstancing);
+        scene.uninstanced.push_back(uint32_t(InstanceBatcher::NoInstancing));
+        scene.worlds.emplace_back();
+        XMStoreFloat4x4(&scene.worlds.back(), XMMatrixTranslation(x, 0.f, z));
+        frustumCuller.Add(XMVectorAdd(position, XMVectorSet(0.f, 1.f, 0.f, 0.f)), XMVectorSet(1.f, 1.f, 1.f, 0.f));
+        scene.keys.push_back(RenderQueue::MakeKey(RenderPass::Opaque, queue.GetShaderId(&shaders[mesh % 2]),
+            queue.GetTextureId(&textures[mesh % 8]), queue.GetMeshId(&meshes[mesh]), std::min(distance / 100.f, 1.f)));
+    }
+
+    printf("CommandListBenchmark, %zu draws, %u threads\n", drawCount, JobSystem::Get().GetThreadCount());
+    InstanceBatcher batcher;
+    CommandList commandList;
+    NullCommandBackend backend;
+    const int frames = 200;
+    for (int pass = 0; pass < 4; pass++)
+    {
+        const unsigned int threadCount = pass % 2 == 0 ? 1 : 0;
+        const std::vector<uint32_t>& variants = pass < 2 ? scene.variants : scene.uninstanced;
+        double seconds[4] = {};
+        for (int frame = 0; frame < frames; frame++)
+        {
+            Tests::Stopwatch stopwatch;
+            frustumCuller.Cull(viewProjection, threadCount);
+            queue.Clear();
+            for (uint32_t draw : frustumCuller.GetVisible())
+            {
+                queue.Add(scene.keys[draw], draw);
+            }
+            seconds[0] += stopwatch.GetSeconds();
+
+            stopwatch.Restart();
+            queue.Sort();
+            batcher.Build(queue.GetItems().data(), queue.GetCount(), variants.data(), scene.worlds.data());
+            seconds[1] += stopwatch.GetSeconds();
+
+            stopwatch.Restart();
+            commandList.Record(batcher.GetBatches().size(), threadCount, [&](CommandBuffer& commands, size_t begin, size_t end)
+            {
+                RecordDraws(commands, begin, end, scene, queue, batcher, storedViewProjection);
+            });
+            seconds[2] += stopwatch.GetSeconds();
+
+            stopwatch.Restart();
+            backend.Reset();
+            commandList.Execute(backend);
+            seconds[3] += stopwatch.GetSeconds();
+        }
+
+        const CommandStats& stats = backend.GetStats();
+        printf("  %s, %s: %u visible, %u commands in %zu buffers, %u draws of %u instances\n", pass < 2 ? "instanced" : "not instanced",
+            threadCount == 1 ? "1 thread" : "all threads",
+            frustumCuller.GetStats().visibleCount, stats.commands, commandList.GetBufferCount(),
+            stats.typeCounts[size_t(CommandType::DrawMesh)] + stats.typeCounts[size_t(CommandType::DrawMeshClusters)], stats.instances);
+        printf("    cull and queue %.1f us, sort and batch %.1f us, record %.1f us, replay %.1f us, total %.1f us per frame\n",
+            seconds[0] * 1e6 / frames, seconds[1] * 1e6 / frames, seconds[2] * 1e6 / frames, seconds[3] * 1e6 / frames,
+            (seconds[0] + seconds[1] + seconds[2] + seconds[3]) * 1e6 / frames);
+    }
+    return 0;
+}
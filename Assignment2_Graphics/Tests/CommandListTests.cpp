@@ -0,0 +1,230 @@
+//
+// CommandListTests.cpp - Command packing, parallel recording order and the null backend's counts
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "CommandList.h"
+#include "JobSystem.h"
+
+#include <cstring>
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    // Stand ins for the resources a backend would bind, only their addresses matter
+    int s_resources[64];
+
+    const void* GetResource(size_t i)
+    {
+        return &s_resources[i % 64];
+    }
+
+    XMFLOAT4X4 GetMatrix(uint32_t seed)
+    {
+        XMFLOAT4X4 matrix;
+        float* values = &matrix._11;
+        for (int i = 0; i < 16; i++)
+        {
+            values[i] = float(seed * 16 + uint32_t(i));
+        }
+        return matrix;
+    }
+
+    // Records one command chosen by kind, with fields that follow from seed
+    void RecordCommand(CommandBuffer& commands, uint32_t kind, uint32_t seed)
+    {
+        switch (kind % 6)
+        {
+        case 0: commands.SetPipeline(GetResource(seed)); break;
+        case 1: commands.SetTexture(seed % 4, GetResource(seed + 1)); break;
+        case 2: commands.SetConstants(seed % 3, seed); break;
+        case 3: commands.SetView(GetMatrix(seed), XMFLOAT3(float(seed), 1.f, 2.f)); break;
+        case 4: commands.DrawMesh(GetResource(seed + 2), int32_t(seed % 3) - 1, seed % 5, seed / 2); break;
+        default: commands.DrawMeshClusters(GetResource(seed + 3), GetMatrix(seed)); break;
+        }
+    }
+
+    // The fields RecordCommand wrote, read back from the header
+    bool IsRecorded(const CommandHeader& header, uint32_t kind, uint32_t seed)
+    {
+        switch (kind % 6)
+        {
+        case 0:
+        {
+            const SetPipelineCommand& command = CommandBuffer::As<SetPipelineCommand>(header);
+            return header.type == CommandType::SetPipeline && header.size == sizeof(command) && command.pipeline == GetResource(seed);
+        }
+        case 1:
+        {
+            const SetTextureCommand& command = CommandBuffer::As<SetTextureCommand>(header);
+            return header.type == CommandType::SetTexture && header.size == sizeof(command) && command.slot == seed % 4 &&
+                command.texture == GetResource(seed + 1);
+        }
+        case 2:
+        {
+            const SetConstantsCommand& command = CommandBuffer::As<SetConstantsCommand>(header);
+            return header.type == CommandType::SetConstants && header.size == sizeof(command) && command.slot == seed % 3 && command.block == seed;
+        }
+        case 3:
+        {
+            const SetViewCommand& command = CommandBuffer::As<SetViewCommand>(header);
+            const XMFLOAT4X4 matrix = GetMatrix(seed);
+            return header.type == CommandType::SetView && header.size == sizeof(command) &&
+                memcmp(&command.viewProjection, &matrix, sizeof(matrix)) == 0 && command.cameraPosition.x == float(seed);
+        }
+        case 4:
+        {
+            const DrawMeshCommand& command = CommandBuffer::As<DrawMeshCommand>(header);
+            return header.type == CommandType::DrawMesh && header.size == sizeof(command) && command.mesh == GetResource(seed + 2) &&
+                command.lod == int32_t(seed % 3) - 1 && command.instanceCount == seed % 5 && command.firstInstance == seed / 2;
+        }
+        default:
+        {
+            const DrawMeshClustersCommand& command = CommandBuffer::As<DrawMeshClustersCommand>(header);
+            const XMFLOAT4X4 matrix = GetMatrix(seed);
+            return header.type == CommandType::DrawMeshClusters && header.size == sizeof(command) && command.mesh == GetResource(seed + 3) &&
+                memcmp(&command.world, &matrix, sizeof(matrix)) == 0;
+        }
+        }
+    }
+
+    // Random commands read back in order with their fields, across the buffer growing and being reused
+    void TestCommandBuffer()
+    {
+        CommandBuffer commands;
+        for (int round = 0; round < 50; round++)
+        {
+            commands.Clear();
+            const size_t count = RandomIndex(2000);
+            std::vector<uint32_t> kinds(count);
+            std::vector<uint32_t> seeds(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                kinds[i] = RandomIndex(6);
+                seeds[i] = RandomIndex(1000);
+                RecordCommand(commands, kinds[i], seeds[i]);
+            }
+            DX_CHECK(commands.GetCommandCount() == count);
+            DX_CHECK(commands.GetSize() % 8 == 0);
+
+            size_t next = 0;
+            size_t bytes = 0;
+            bool valid = true;
+            commands.ForEach([&](const CommandHeader& header)
+            {
+                valid = valid && next < count && header.size % 8 == 0 && reinterpret_cast<uintptr_t>(&header) % 8 == 0 &&
+                    IsRecorded(header, kinds[next], seeds[next]);
+                bytes += header.size;
+                next++;
+            });
+            DX_CHECK(valid);
+            DX_CHECK(next == count);
+            DX_CHECK(bytes == commands.GetSize());
+        }
+    }
+
+    // Each item records a draw of its own mesh, with its constants before it
+    void RecordItems(CommandBuffer& commands, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            commands.SetConstants(1, uint32_t(i));
+            if (i % 7 == 0)
+            {
+                commands.DrawMeshClusters(GetResource(i), GetMatrix(uint32_t(i)));
+            }
+            else
+            {
+                commands.DrawMesh(GetResource(i), int32_t(i % 3), i % 5 == 0 ? 4 : 0, uint32_t(i));
+            }
+        }
+    }
+
+    // Recording split between jobs replays the same stream as one buffer, and every count adds up
+    void TestRecordOrder()
+    {
+        const size_t itemCounts[] = { 0, 1, CommandList::MinItemsPerJob - 1, CommandList::MinItemsPerJob, 1000, 10000 };
+        for (size_t itemCount : itemCounts)
+        {
+            CommandList single;
+            single.Record(itemCount, 1, RecordItems);
+            NullCommandBackend expected(true);
+            single.Execute(expected);
+            DX_CHECK(single.GetBufferCount() == 1);
+
+            for (unsigned int threadCount : { 2u, 3u, 8u, 0u })
+            {
+                CommandList list;
+                // Each job only touches the counts of its own range, so they need no locking
+                std::vector<uint8_t> recordCounts(itemCount, 0);
+                list.Record(itemCount, threadCount, [&recordCounts](CommandBuffer& commands, size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        recordCounts[i]++;
+                    }
+                    RecordItems(commands, begin, end);
+                });
+                DX_CHECK(std::count(recordCounts.begin(), recordCounts.end(), uint8_t(1)) == ptrdiff_t(itemCount));
+
+                const size_t wanted = threadCount == 0 ? JobSystem::Get().GetThreadCount() : threadCount;
+                DX_CHECK(list.GetBufferCount() == std::max<size_t>(1, std::min<size_t>(wanted, itemCount / CommandList::MinItemsPerJob)));
+
+                NullCommandBackend backend(true);
+                list.Execute(backend);
+                DX_CHECK(backend.GetRecorded() == expected.GetRecorded());
+                DX_CHECK(memcmp(&backend.GetStats(), &expected.GetStats(), sizeof(CommandStats)) == 0);
+            }
+
+            // Plain draws count once, instanced ones by their instances
+            size_t instances = 0;
+            for (size_t i = 0; i < itemCount; i++)
+            {
+                instances += i % 7 != 0 && i % 5 == 0 ? 4 : 1;
+            }
+            const CommandStats& stats = expected.GetStats();
+            DX_CHECK(stats.commands == itemCount * 2);
+            DX_CHECK(stats.typeCounts[size_t(CommandType::SetConstants)] == itemCount);
+            DX_CHECK(stats.typeCounts[size_t(CommandType::DrawMesh)] + stats.typeCounts[size_t(CommandType::DrawMeshClusters)] == itemCount);
+            DX_CHECK(stats.instances == instances);
+            DX_CHECK(stats.bytes == expected.GetRecorded().size());
+        }
+    }
+
+    // The backend adds up buffers until it is reset, and copies only when asked to
+    void TestNullBackend()
+    {
+        CommandBuffer commands;
+        RecordItems(commands, 0, 100);
+        NullCommandBackend counting;
+        counting.Execute(commands);
+        counting.Execute(commands);
+        DX_CHECK(counting.GetStats().commands == 400);
+        DX_CHECK(counting.GetStats().bytes == commands.GetSize() * 2);
+        DX_CHECK(counting.GetRecorded().empty());
+
+        counting.Reset();
+        DX_CHECK(counting.GetStats().commands == 0 && counting.GetStats().instances == 0);
+
+        NullCommandBackend recording(true);
+        recording.Execute(commands);
+        recording.Execute(CommandBuffer());
+        DX_CHECK(recording.GetRecorded().size() == commands.GetSize());
+        recording.Reset();
+        DX_CHECK(recording.GetRecorded().empty());
+    }
+}
+
+int main()
+{
+    SeedRandom(20);
+    TestCommandBuffer();
+    TestRecordOrder();
+    TestNullBackend();
+
+    return Tests::Finish("CommandListTests");
+}
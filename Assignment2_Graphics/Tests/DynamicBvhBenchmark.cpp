@@ -0,0 +1,123 @@
+//
+// DynamicBvhBenchmark.cpp - Build, update and query times of the BVH over a dense forest
+//
+//   DynamicBvhBenchmark [objectCount]
+//
+// 100,000 tree sized boxes scattered over 400 x 400 units unless told otherwise.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "DynamicBvh.h"
+
+#include <cstdlib>
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    void PrintStats(const char* name, double seconds, const DynamicBvh& bvh)
+    {
+        const DynamicBvhStats stats = bvh.GetStats();
+        printf("  %-28s %9.2f ms, height %u, area ratio %.1f\n", name, seconds * 1000.0, stats.height, stats.areaRatio);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t objectCount = argc > 1 ? size_t(strtoul(argv[1], nullptr, 10)) : 100000;
+    const float extent = 200.f;
+    printf("DynamicBvhBenchmark, %zu objects\n", objectCount);
+    SeedRandom(1234);
+
+    std::vector<Box> boxes;
+    for (size_t i = 0; i < objectCount; i++)
+    {
+        boxes.push_back(GetRandomGroundBox(extent));
+    }
+
+    DynamicBvh bvh;
+    bvh.Reserve(objectCount);
+    std::vector<uint32_t> proxies(objectCount);
+    Tests::Stopwatch stopwatch;
+    for (size_t i = 0; i < objectCount; i++)
+    {
+        proxies[i] = bvh.Insert(boxes[i].boundsMin, boxes[i].boundsMax, uint32_t(i));
+    }
+    PrintStats("insert", stopwatch.GetSeconds(), bvh);
+
+    stopwatch.Restart();
+    bvh.Rebuild();
+    PrintStats("rebuild", stopwatch.GetSeconds(), bvh);
+
+    // A tenth of the objects drift within the margin, one in a hundred jumps far enough to reinsert
+    stopwatch.Restart();
+    int reinserted = 0;
+    for (size_t i = 0; i < objectCount; i += 10)
+    {
+        const float dx = i % 100 == 0 ? 20.f : 0.05f;
+        boxes[i].boundsMin.x += dx;
+        boxes[i].boundsMax.x += dx;
+        reinserted += bvh.Move(proxies[i], boxes[i].boundsMin, boxes[i].boundsMax) ? 1 : 0;
+    }
+    PrintStats("move 10% (1% far)", stopwatch.GetSeconds(), bvh);
+    printf("    %d reinserted\n", reinserted);
+
+    // Everything moves a little, then one refit
+    stopwatch.Restart();
+    for (size_t i = 0; i < objectCount; i++)
+    {
+        boxes[i].boundsMin.y += 0.3f;
+        boxes[i].boundsMax.y += 0.3f;
+        bvh.SetBounds(proxies[i], boxes[i].boundsMin, boxes[i].boundsMax);
+    }
+    bvh.Refit();
+    PrintStats("set bounds and refit all", stopwatch.GetSeconds(), bvh);
+
+    std::vector<uint32_t> results;
+    results.reserve(objectCount);
+
+    const int frustumQueries = 200;
+    std::vector<XMMATRIX> viewProjections;
+    for (int q = 0; q < frustumQueries; q++)
+    {
+        const float yaw = Random(0.f, XM_2PI);
+        const XMMATRIX view = XMMatrixLookToLH(XMVectorSet(Random(-extent, extent), 2.f, Random(-extent, extent), 1.f),
+            XMVectorSet(std::sin(yaw), 0.f, std::cos(yaw), 0.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+        viewProjections.push_back(XMMatrixMultiply(view, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, 0.01f, 100.f)));
+    }
+    size_t visible = 0;
+    stopwatch.Restart();
+    for (const XMMATRIX& viewProjection : viewProjections)
+    {
+        results.clear();
+        bvh.QueryFrustum(viewProjection, results);
+        visible += results.size();
+    }
+    printf("  %-28s %9.2f us, %zu visible\n", "frustum query", stopwatch.GetSeconds() * 1e6 / frustumQueries, visible / frustumQueries);
+
+    const int pointQueries = 10000;
+    size_t found = 0;
+    stopwatch.Restart();
+    for (int q = 0; q < pointQueries; q++)
+    {
+        results.clear();
+        bvh.QuerySphere(XMVectorSet(Random(-extent, extent), 1.f, Random(-extent, extent), 0.f), 5.f, results);
+        found += results.size();
+    }
+    printf("  %-28s %9.2f us, %zu found\n", "sphere query, radius 5", stopwatch.GetSeconds() * 1e6 / pointQueries, found / pointQueries);
+
+    int hits = 0;
+    stopwatch.Restart();
+    for (int q = 0; q < pointQueries; q++)
+    {
+        uint32_t userData;
+        float distance;
+        hits += bvh.RayCast(XMVectorSet(Random(-extent, extent), 1.5f, Random(-extent, extent), 0.f),
+            XMVectorSet(Random(-1.f, 1.f), 0.f, Random(-1.f, 1.f), 0.f), 100.f, userData, distance) ? 1 : 0;
+    }
+    printf("  %-28s %9.2f us, %d%% hit\n", "ray cast, 100 units", stopwatch.GetSeconds() * 1e6 / pointQueries, hits * 100 / pointQueries);
+    return 0;
+}
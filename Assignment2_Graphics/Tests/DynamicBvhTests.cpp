@@ -0,0 +1,258 @@
+//
+// DynamicBvhTests.cpp - BVH queries against brute force over random insert/remove/move/refit/rebuild sequences
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "DynamicBvh.h"
+
+#include <stdexcept>
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    // A box in the tree, or one that was removed from it
+    struct TrackedBox : Box
+    {
+        explicit TrackedBox(const Box& box) : Box(box), alive(true) {}
+
+        bool alive;
+    };
+
+    XMMATRIX GetRandomViewProjection(float extent)
+    {
+        const float yaw = Random(0.f, XM_2PI);
+        const XMMATRIX view = XMMatrixLookToLH(XMVectorSet(Random(-extent, extent), Random(0.f, 10.f), Random(-extent, extent), 1.f),
+            XMVectorSet(std::sin(yaw), 0.f, std::cos(yaw), 0.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+        return XMMatrixMultiply(view, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, 0.01f, 100.f));
+    }
+
+    // Box against the six clip planes of a row vector view projection matrix
+    bool IsInFrustum(FXMMATRIX viewProjection, const Box& box)
+    {
+        const XMMATRIX columns = XMMatrixTranspose(viewProjection);
+        const XMVECTOR planes[6] = { columns.r[2], XMVectorAdd(columns.r[3], columns.r[0]), XMVectorSubtract(columns.r[3], columns.r[0]),
+            XMVectorAdd(columns.r[3], columns.r[1]), XMVectorSubtract(columns.r[3], columns.r[1]), XMVectorSubtract(columns.r[3], columns.r[2]) };
+        const XMVECTOR center = GetCenter(box);
+        const XMVECTOR extents = GetExtents(box);
+        for (const XMVECTOR& plane : planes)
+        {
+            const float distance = XMVectorGetX(XMVector3Dot(plane, center)) + XMVectorGetW(plane);
+            const float radius = XMVectorGetX(XMVector3Dot(XMVectorAbs(plane), extents));
+            if (distance + radius < 0.f)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool IsInSphere(const XMFLOAT3& center, float radius, const Box& box)
+    {
+        const float dx = center.x - std::max(box.boundsMin.x, std::min(center.x, box.boundsMax.x));
+        const float dy = center.y - std::max(box.boundsMin.y, std::min(center.y, box.boundsMax.y));
+        const float dz = center.z - std::max(box.boundsMin.z, std::min(center.z, box.boundsMax.z));
+        return dx * dx + dy * dy + dz * dz <= radius * radius;
+    }
+
+    void CheckQueries(const DynamicBvh& bvh, const std::vector<TrackedBox>& boxes, const std::vector<uint32_t>& proxies, int queryCount, float extent)
+    {
+        size_t alive = 0;
+        bool userData = true;
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            alive += boxes[i].alive ? 1 : 0;
+            userData = userData && (!boxes[i].alive || bvh.GetUserData(proxies[i]) == i);
+        }
+        DX_CHECK(bvh.GetObjectCount() == alive);
+        DX_CHECK(userData);
+
+        std::vector<uint32_t> results;
+        std::vector<uint32_t> expected;
+        for (int q = 0; q < queryCount; q++)
+        {
+            const XMMATRIX viewProjection = GetRandomViewProjection(extent);
+            results.clear();
+            bvh.QueryFrustum(viewProjection, results);
+            expected.clear();
+            for (size_t i = 0; i < boxes.size(); i++)
+            {
+                if (boxes[i].alive && IsInFrustum(viewProjection, boxes[i]))
+                {
+                    expected.push_back(uint32_t(i));
+                }
+            }
+            std::sort(results.begin(), results.end());
+            DX_CHECK(results == expected);
+
+            const XMFLOAT3 center(Random(-extent, extent), Random(0.f, 5.f), Random(-extent, extent));
+            const float radius = Random(0.f, extent * 0.3f);
+            results.clear();
+            bvh.QuerySphere(XMLoadFloat3(&center), radius, results);
+            expected.clear();
+            for (size_t i = 0; i < boxes.size(); i++)
+            {
+                if (boxes[i].alive && IsInSphere(center, radius, boxes[i]))
+                {
+                    expected.push_back(uint32_t(i));
+                }
+            }
+            std::sort(results.begin(), results.end());
+            DX_CHECK(results == expected);
+
+            // Some rays run parallel to an axis, where the slab test divides by zero
+            const XMFLOAT3 origin(Random(-extent, extent), Random(0.f, 8.f), Random(-extent, extent));
+            XMFLOAT3 direction(Random(-1.f, 1.f), Random(-0.3f, 0.1f), Random(-1.f, 1.f));
+            direction.y = q % 7 == 0 ? 0.f : direction.y;
+            direction.x = q % 11 == 0 ? 0.f : direction.x;
+            const float maxDistance = Random(1.f, extent * 2.f);
+            float nearest = maxDistance;
+            bool expectHit = false;
+            for (size_t i = 0; i < boxes.size(); i++)
+            {
+                float distance;
+                if (boxes[i].alive && RayHitsBox(origin, direction, 0.f, nearest, boxes[i], distance) && (!expectHit || distance < nearest))
+                {
+                    nearest = distance;
+                    expectHit = true;
+                }
+            }
+            uint32_t hitUserData = 0;
+            float hitDistance = 0.f;
+            const bool hit = bvh.RayCast(XMLoadFloat3(&origin), XMLoadFloat3(&direction), maxDistance, hitUserData, hitDistance);
+            DX_CHECK(hit == expectHit);
+            DX_CHECK(!hit || !expectHit || hitDistance == nearest);
+        }
+    }
+
+    void Insert(DynamicBvh& bvh, std::vector<TrackedBox>& boxes, std::vector<uint32_t>& proxies, const Box& box)
+    {
+        boxes.emplace_back(box);
+        proxies.push_back(bvh.Insert(box.boundsMin, box.boundsMax, uint32_t(boxes.size() - 1)));
+    }
+
+    void TestRandomOperations()
+    {
+        const float extent = 30.f;
+        for (int trial = 0; trial < 40; trial++)
+        {
+            DynamicBvh bvh(trial % 3 == 0 ? 0.f : 0.2f);
+            std::vector<TrackedBox> boxes;
+            std::vector<uint32_t> proxies;
+            const int objectCount = 1 + trial * 13;
+            for (int i = 0; i < objectCount; i++)
+            {
+                Insert(bvh, boxes, proxies, GetRandomGroundBox(extent));
+            }
+            CheckQueries(bvh, boxes, proxies, 20, extent);
+
+            // Removes, inserts and moves both within the margin and far enough to reinsert
+            for (int operation = 0; operation < objectCount * 3; operation++)
+            {
+                const size_t i = RandomIndex(boxes.size());
+                const int kind = int(RandomIndex(5));
+                if (kind == 0 && boxes[i].alive)
+                {
+                    bvh.Remove(proxies[i]);
+                    boxes[i].alive = false;
+                }
+                else if (kind == 1)
+                {
+                    Insert(bvh, boxes, proxies, GetRandomGroundBox(extent));
+                }
+                else if (boxes[i].alive)
+                {
+                    const float scale = kind == 4 ? 10.f : 1.f;
+                    const float dx = Random(-1.f, 1.f) * scale;
+                    const float dz = Random(-1.f, 1.f) * scale;
+                    boxes[i].boundsMin.x += dx;
+                    boxes[i].boundsMax.x += dx;
+                    boxes[i].boundsMin.z += dz;
+                    boxes[i].boundsMax.z += dz;
+                    bvh.Move(proxies[i], boxes[i].boundsMin, boxes[i].boundsMax);
+                }
+            }
+            CheckQueries(bvh, boxes, proxies, 20, extent);
+
+            for (size_t i = 0; i < boxes.size(); i++)
+            {
+                if (boxes[i].alive)
+                {
+                    const float dx = Random(-3.f, 3.f);
+                    boxes[i].boundsMin.x += dx;
+                    boxes[i].boundsMax.x += dx;
+                    bvh.SetBounds(proxies[i], boxes[i].boundsMin, boxes[i].boundsMax);
+                }
+            }
+            bvh.Refit();
+            CheckQueries(bvh, boxes, proxies, 20, extent);
+
+            bvh.Rebuild();
+            CheckQueries(bvh, boxes, proxies, 20, extent);
+
+            // The rebuilt tree keeps taking updates
+            for (int i = 0; i < 20; i++)
+            {
+                Insert(bvh, boxes, proxies, GetRandomGroundBox(extent));
+            }
+            for (size_t i = 0; i < boxes.size(); i += 3)
+            {
+                if (boxes[i].alive)
+                {
+                    bvh.Remove(proxies[i]);
+                    boxes[i].alive = false;
+                }
+            }
+            CheckQueries(bvh, boxes, proxies, 20, extent);
+
+            // Removing a proxy twice is a caller bug the tree reports
+            for (size_t i = 0; i < boxes.size(); i++)
+            {
+                if (boxes[i].alive)
+                {
+                    bvh.Remove(proxies[i]);
+                    boxes[i].alive = false;
+                    bool threw = false;
+                    try
+                    {
+                        bvh.Remove(proxies[i]);
+                    }
+                    catch (const std::out_of_range&)
+                    {
+                        threw = true;
+                    }
+                    DX_CHECK(threw);
+                    break;
+                }
+            }
+            CheckQueries(bvh, boxes, proxies, 5, extent);
+        }
+    }
+
+    // Inserting in sorted order is the worst case for an unbalanced tree
+    void TestSortedInsertion()
+    {
+        DynamicBvh bvh;
+        for (int i = 0; i < 100000; i++)
+        {
+            bvh.Insert(XMFLOAT3(float(i), 0.f, 0.f), XMFLOAT3(float(i) + 0.5f, 1.f, 1.f), uint32_t(i));
+        }
+        const DynamicBvhStats stats = bvh.GetStats();
+        DX_CHECK(stats.objectCount == 100000);
+        DX_CHECK(stats.nodeCount == 2 * 100000 - 1);
+        DX_CHECK(stats.height <= 40);
+        printf("  100,000 sorted inserts: height %u, area ratio %.1f\n", stats.height, stats.areaRatio);
+    }
+}
+
+int main()
+{
+    SeedRandom(1234);
+    TestRandomOperations();
+    TestSortedInsertion();
+
+    return Tests::Finish("DynamicBvhTests");
+}
@@ -0,0 +1,97 @@
+//
+// FrameLimiterBenchmark.cpp - How far apart FrameLimiter really releases frames, and what StepTimer makes of them
+//
+//   FrameLimiterBenchmark [framesPerSecond] [seconds]
+//
+// Holds a loop to 30, 60, 144 and 240 frames per second, or only the rate given, for 3 seconds each
+// unless told otherwise. Every frame busies the thread for 20 to 70% of the interval, the way the
+// game's update and render would. The error of each interval between releases is reported against
+// the target, along with how many landed within 100 us, and StepTimer's own spread and histogram of
+// the same frames.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "FrameLimiter.h"
+#include "StepTimer.h"
+
+#include <cstdlib>
+#include <random>
+
+using namespace DX;
+
+namespace
+{
+    void MeasureJitter(double framesPerSecond, double seconds)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        const double target = 1.0 / framesPerSecond;
+        const int frames = std::max(int(seconds * framesPerSecond), 2);
+        FrameLimiter limiter;
+        limiter.SetTargetSeconds(target);
+        StepTimer timer;
+        std::mt19937 random(1);
+        std::uniform_real_distribution<double> work(0.2 * target, 0.7 * target);
+
+        std::vector<double> errors;
+        Clock::time_point last;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            limiter.Wait();
+            const Clock::time_point now = Clock::now();
+            if (frame > 0)
+            {
+                errors.push_back(std::abs(std::chrono::duration<double>(now - last).count() - target));
+            }
+            last = now;
+            timer.Tick([] {});
+
+            const Clock::time_point end = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(work(random)));
+            while (Clock::now() < end)
+            {
+            }
+        }
+
+        std::sort(errors.begin(), errors.end());
+        const size_t within = size_t(std::upper_bound(errors.begin(), errors.end(), 100e-6) - errors.begin());
+        const FrameLimiterStats& stats = limiter.GetStats();
+        printf("  %.0f fps, %d frames: interval error p50 %.1f us, p99 %.1f us, max %.1f us, %.2f%% within 100 us, %u late\n",
+            framesPerSecond, frames, errors[errors.size() / 2] * 1e6, errors[errors.size() * 99 / 100] * 1e6, errors.back() * 1e6,
+            100.0 * within / errors.size(), stats.lateFrames);
+        printf("    sleeps expected to take up to %.3f ms, latest release %.1f us after its deadline\n",
+            stats.sleepEstimateSeconds * 1e3, stats.maxErrorSeconds * 1e6);
+
+        const FrameTimeStats& times = timer.GetFrameTimeStats();
+        printf("    StepTimer: %u fps, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms over %u frames\n", timer.GetFramesPerSecond(),
+            times.p50Seconds * 1e3, times.p95Seconds * 1e3, times.p99Seconds * 1e3, times.maxSeconds * 1e3, times.frameCount);
+
+        // Buckets a tenth of the target wide, centred on it
+        uint32_t counts[20];
+        timer.GetFrameTimeHistogram(counts, 20, target / 10.0);
+        printf("    histogram by tenths of the target:");
+        for (uint32_t count : counts)
+        {
+            printf(" %u", count);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const double seconds = argc > 2 ? strtod(argv[2], nullptr) : 3.0;
+    printf("FrameLimiterBenchmark, %.1f seconds per rate\n", seconds);
+    if (argc > 1)
+    {
+        MeasureJitter(strtod(argv[1], nullptr), seconds);
+    }
+    else
+    {
+        for (double framesPerSecond : { 30.0, 60.0, 144.0, 240.0 })
+        {
+            MeasureJitter(framesPerSecond, seconds);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+//
+// FrustumCullerBenchmark.cpp - Boxes culled a millisecond, on one thread and on every thread of the job system
+//
+//   FrustumCullerBenchmark [boundsCount]
+//
+// A million boxes unless told otherwise, scattered 200 units around a camera looking down +z with
+// a 45 degree field of view, so about a tenth of them are visible.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+
+#include <cstdlib>
+#include <random>
+
+using namespace DirectX;
+using namespace DX;
+
+int main(int argc, char** argv)
+{
+    const size_t boundsCount = argc > 1 ? size_t(strtoul(argv[1], nullptr, 10)) : 1000000;
+
+    std::mt19937 random(15);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    FrustumCuller culler;
+    culler.Reserve(boundsCount);
+    for (size_t i = 0; i < boundsCount; i++)
+    {
+        culler.Add(XMVectorSet(unit(random) * 400.f - 200.f, unit(random) * 20.f - 10.f, unit(random) * 400.f - 200.f, 1.f),
+            XMVectorReplicate(.2f + unit(random)));
+    }
+    const XMMATRIX viewProjection = XMMatrixMultiply(XMMatrixLookToLH(XMVectorSet(0.f, 2.f, 0.f, 1.f), XMVectorSet(0.f, 0.f, 1.f, 0.f),
+        XMVectorSet(0.f, 1.f, 0.f, 0.f)), XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, .01f, 150.f));
+
+#if defined(__AVX__) && !defined(_XM_NO_INTRINSICS_)
+    const char* path = "AVX, 8 boxes a test";
+#else
+    const char* path = "SSE, 4 boxes a test";
+#endif
+    printf("FrustumCullerBenchmark, %zu boxes, %s, %u threads\n", boundsCount, path, JobSystem::Get().GetThreadCount());
+    for (unsigned int threadCount : { 1u, 0u })
+    {
+        // Best of the runs, the first warms the visible list
+        culler.Cull(viewProjection, threadCount);
+        double best = 1e30;
+        for (int run = 0; run < 20; run++)
+        {
+            Tests::Stopwatch stopwatch;
+            culler.Cull(viewProjection, threadCount);
+            best = std::min(best, stopwatch.GetSeconds());
+        }
+        printf("  %-11s: %.3f ms, %.2f M boxes a millisecond, %u visible\n", threadCount == 1 ? "1 thread" : "all threads", best * 1000.0,
+            boundsCount / (best * 1000.0) / 1e6, culler.GetStats().visibleCount);
+    }
+    return 0;
+}
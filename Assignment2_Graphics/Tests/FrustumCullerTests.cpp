@@ -0,0 +1,190 @@
+//
+// FrustumCullerTests.cpp - Visible lists against the box corners in clip space, thread splits and Arvo's bounds
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "FrustumCuller.h"
+
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    enum class Expected { Visible, Culled, Either };
+
+    // A box is outside the frustum when all its corners are outside one clip plane, the same test
+    // the culler makes with the planes. Boxes within a rounding margin of that either way can go
+    // either way.
+    Expected Classify(const XMFLOAT4X4& viewProjection, const XMFLOAT3& center, const XMFLOAT3& extents)
+    {
+        double largest[6] = { -1e30, -1e30, -1e30, -1e30, -1e30, -1e30 };
+        for (int corner = 0; corner < 8; corner++)
+        {
+            const double p[3] = {
+                double(center.x) + ((corner & 1) ? extents.x : -extents.x),
+                double(center.y) + ((corner & 2) ? extents.y : -extents.y),
+                double(center.z) + ((corner & 4) ? extents.z : -extents.z) };
+            double clip[4];
+            for (int c = 0; c < 4; c++)
+            {
+                clip[c] = p[0] * viewProjection.m[0][c] + p[1] * viewProjection.m[1][c] + p[2] * viewProjection.m[2][c] + viewProjection.m[3][c];
+            }
+            const double planes[6] = { clip[2], clip[3] + clip[0], clip[3] - clip[0], clip[3] + clip[1], clip[3] - clip[1], clip[3] - clip[2] };
+            for (int plane = 0; plane < 6; plane++)
+            {
+                largest[plane] = std::max(largest[plane], planes[plane]);
+            }
+        }
+
+        const double margin = 1e-3;
+        bool ambiguous = false;
+        for (double value : largest)
+        {
+            if (value < -margin)
+            {
+                return Expected::Culled;
+            }
+            ambiguous = ambiguous || value <= margin;
+        }
+        return ambiguous ? Expected::Either : Expected::Visible;
+    }
+
+    // Random cameras over random boxes, some around the camera and some far past the far plane
+    void TestVisibility()
+    {
+        size_t visibleCount = 0;
+        size_t culledCount = 0;
+        for (int view = 0; view < 50; view++)
+        {
+            const XMVECTOR eye = XMVectorSet(Random(-20.f, 20.f), Random(-5.f, 5.f), Random(-20.f, 20.f), 1.f);
+            const XMVECTOR direction = XMVector3Normalize(XMVectorSet(Random(-1.f, 1.f), Random(-.5f, .5f), Random(-1.f, 1.f), 0.f));
+            const XMMATRIX viewProjection = XMMatrixMultiply(XMMatrixLookToLH(eye, direction, XMVectorSet(0.f, 1.f, 0.f, 0.f)),
+                XMMatrixPerspectiveFovLH(Random(.5f, 1.5f), Random(1.f, 2.5f), Random(.01f, 1.f), Random(30.f, 100.f)));
+            XMFLOAT4X4 storedViewProjection;
+            XMStoreFloat4x4(&storedViewProjection, viewProjection);
+
+            FrustumCuller culler;
+            std::vector<XMFLOAT3> centers;
+            std::vector<XMFLOAT3> extents;
+            const size_t count = 1 + RandomIndex(3000);
+            for (size_t i = 0; i < count; i++)
+            {
+                const float size = i % 50 == 0 ? Random(20.f, 200.f) : Random(.01f, 5.f);
+                centers.push_back(XMFLOAT3(Random(-150.f, 150.f), Random(-30.f, 30.f), Random(-150.f, 150.f)));
+                extents.push_back(XMFLOAT3(size * Random(.1f, 1.f), size * Random(.1f, 1.f), size * Random(.1f, 1.f)));
+                DX_CHECK(culler.Add(XMLoadFloat3(&centers.back()), XMLoadFloat3(&extents.back())) == i);
+            }
+            culler.Cull(viewProjection);
+            DX_CHECK(culler.GetCount() == count);
+
+            const std::vector<uint32_t>& visible = culler.GetVisible();
+            DX_CHECK(std::is_sorted(visible.begin(), visible.end()));
+            DX_CHECK(std::adjacent_find(visible.begin(), visible.end()) == visible.end());
+            DX_CHECK(culler.GetStats().boundsCount == count && culler.GetStats().visibleCount == visible.size());
+
+            std::vector<bool> reported(count, false);
+            for (uint32_t index : visible)
+            {
+                if (DX_CHECK(index < count))
+                {
+                    reported[index] = true;
+                }
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                const Expected expected = Classify(storedViewProjection, centers[i], extents[i]);
+                if (expected != Expected::Either)
+                {
+                    DX_CHECK(reported[i] == (expected == Expected::Visible));
+                    visibleCount += expected == Expected::Visible ? 1 : 0;
+                    culledCount += expected == Expected::Culled ? 1 : 0;
+                }
+            }
+        }
+        DX_CHECK(visibleCount > 1000 && culledCount > 1000);
+    }
+
+    // Splitting the boxes between jobs gives the same list, whatever the count past a whole block
+    void TestThreads()
+    {
+        const XMMATRIX viewProjection = XMMatrixMultiply(XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.f, 0.f, 1.f, 0.f),
+            XMVectorSet(0.f, 1.f, 0.f, 0.f)), XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, .1f, 100.f));
+        for (size_t count : { size_t(0), size_t(1), size_t(7), size_t(8), size_t(9), FrustumCuller::MinBoundsPerJob * 3 + 5 })
+        {
+            FrustumCuller single;
+            FrustumCuller split;
+            split.Reserve(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                const XMVECTOR center = XMVectorSet(Random(-100.f, 100.f), Random(-10.f, 10.f), Random(-100.f, 100.f), 1.f);
+                const XMVECTOR extents = XMVectorReplicate(Random(.1f, 2.f));
+                single.Add(center, extents);
+                split.Add(center, extents);
+            }
+            single.Cull(viewProjection, 1);
+            for (unsigned int threadCount : { 3u, 0u })
+            {
+                split.Cull(viewProjection, threadCount);
+                DX_CHECK(split.GetVisible() == single.GetVisible());
+            }
+        }
+
+        // Set moves a box in place, and Clear empties the culler for the next frame
+        FrustumCuller culler;
+        const uint32_t index = culler.Add(XMVectorSet(0.f, 0.f, -50.f, 1.f), XMVectorReplicate(1.f));
+        culler.Cull(viewProjection);
+        DX_CHECK(culler.GetVisible().empty());
+        culler.Set(index, XMVectorSet(0.f, 0.f, 50.f, 1.f), XMVectorReplicate(1.f));
+        culler.Cull(viewProjection);
+        DX_CHECK(culler.GetVisible().size() == 1 && culler.GetVisible()[0] == index);
+        culler.Clear();
+        culler.Cull(viewProjection);
+        DX_CHECK(culler.GetCount() == 0 && culler.GetVisible().empty());
+    }
+
+    // The world box is the tightest one around the eight transformed corners
+    void TestTransformBounds()
+    {
+        for (int round = 0; round < 1000; round++)
+        {
+            const XMVECTOR center = XMVectorSet(Random(-5.f, 5.f), Random(-5.f, 5.f), Random(-5.f, 5.f), 1.f);
+            const XMVECTOR extents = XMVectorSet(Random(0.f, 3.f), Random(0.f, 3.f), Random(0.f, 3.f), 0.f);
+            const XMMATRIX world = XMMatrixMultiply(XMMatrixMultiply(XMMatrixScaling(Random(.1f, 4.f), Random(.1f, 4.f), Random(.1f, 4.f)),
+                XMMatrixMultiply(XMMatrixMultiply(XMMatrixRotationZ(Random(-XM_PI, XM_PI)), XMMatrixRotationX(Random(-XM_PI, XM_PI))),
+                XMMatrixRotationY(Random(-XM_PI, XM_PI)))),
+                XMMatrixTranslation(Random(-50.f, 50.f), Random(-50.f, 50.f), Random(-50.f, 50.f)));
+
+            XMVECTOR worldCenter;
+            XMVECTOR worldExtents;
+            FrustumCuller::TransformBounds(center, extents, world, worldCenter, worldExtents);
+
+            XMVECTOR cornerMin = XMVectorReplicate(1e30f);
+            XMVECTOR cornerMax = XMVectorReplicate(-1e30f);
+            for (int corner = 0; corner < 8; corner++)
+            {
+                const XMVECTOR sign = XMVectorSet((corner & 1) ? 1.f : -1.f, (corner & 2) ? 1.f : -1.f, (corner & 4) ? 1.f : -1.f, 0.f);
+                const XMVECTOR point = XMVector3Transform(XMVectorMultiplyAdd(sign, extents, center), world);
+                cornerMin = XMVectorMin(cornerMin, point);
+                cornerMax = XMVectorMax(cornerMax, point);
+            }
+            XMFLOAT3 minimumError;
+            XMFLOAT3 maximumError;
+            XMStoreFloat3(&minimumError, XMVectorAbs(XMVectorSubtract(XMVectorSubtract(worldCenter, worldExtents), cornerMin)));
+            XMStoreFloat3(&maximumError, XMVectorAbs(XMVectorSubtract(XMVectorAdd(worldCenter, worldExtents), cornerMax)));
+            DX_CHECK(std::max({ minimumError.x, minimumError.y, minimumError.z, maximumError.x, maximumError.y, maximumError.z }) < 1e-3f);
+        }
+    }
+}
+
+int main()
+{
+    SeedRandom(15);
+    TestVisibility();
+    TestThreads();
+    TestTransformBounds();
+
+    return Tests::Finish("FrustumCullerTests");
+}
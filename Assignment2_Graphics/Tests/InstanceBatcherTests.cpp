@@ -0,0 +1,165 @@
+//
+// InstanceBatcherTests.cpp - Render queue ordering and instanced batch grouping over random queues
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "InstanceBatcher.h"
+
+#include <cstring>
+#include <random>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    const uint64_t StateMask = ~((uint64_t(1) << RenderQueue::MeshShift) - 1);
+
+    bool CanJoin(const RenderItem& a, const RenderItem& b, const std::vector<uint32_t>& variants)
+    {
+        return ((a.key ^ b.key) & StateMask) == 0 && variants[a.draw] == variants[b.draw] && variants[a.draw] != InstanceBatcher::NoInstancing;
+    }
+
+    // Sorting orders the keys and keeps submission order between equal keys
+    void CheckSorted(const RenderQueue& queue, size_t drawCount)
+    {
+        const std::vector<RenderItem>& items = queue.GetItems();
+        DX_CHECK(items.size() == drawCount);
+        bool sorted = true;
+        std::vector<uint8_t> seen(drawCount, 0);
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            if (i > 0)
+            {
+                sorted = sorted && (items[i - 1].key < items[i].key || (items[i - 1].key == items[i].key && items[i - 1].draw < items[i].draw));
+            }
+            sorted = sorted && items[i].draw < drawCount && !seen[items[i].draw];
+            if (items[i].draw < drawCount)
+            {
+                seen[items[i].draw] = 1;
+            }
+        }
+        DX_CHECK(sorted);
+    }
+
+    // Batches cover the queue in order, each is a longest run of draws that can share a call, and
+    // only runs of at least minInstances are instanced, with their worlds packed in queue order
+    void CheckBatches(const InstanceBatcher& batcher, const std::vector<RenderItem>& items, const std::vector<uint32_t>& variants,
+        const std::vector<XMFLOAT4X4>& worlds, uint32_t minInstances)
+    {
+        size_t next = 0;
+        uint32_t drawCalls = 0;
+        uint32_t instanceCount = 0;
+        bool valid = true;
+        for (const InstanceBatch& batch : batcher.GetBatches())
+        {
+            valid = valid && batch.firstItem == next && batch.itemCount > 0 && batch.firstItem + batch.itemCount <= items.size();
+            if (!valid)
+            {
+                break;
+            }
+
+            const RenderItem& first = items[batch.firstItem];
+            for (uint32_t i = 1; i < batch.itemCount; i++)
+            {
+                valid = valid && CanJoin(first, items[batch.firstItem + i], variants);
+            }
+            const size_t end = batch.firstItem + batch.itemCount;
+            valid = valid && (end == items.size() || !CanJoin(first, items[end], variants));
+
+            const bool instanced = batch.itemCount >= std::max(minInstances, 2u);
+            valid = valid && instanced == (batch.firstInstance != InstanceBatcher::NotInstanced);
+            if (instanced && batch.firstInstance + batch.itemCount <= batcher.GetInstances().size())
+            {
+                for (uint32_t i = 0; i < batch.itemCount; i++)
+                {
+                    valid = valid && memcmp(&batcher.GetInstances()[batch.firstInstance + i], &worlds[items[batch.firstItem + i].draw], sizeof(XMFLOAT4X4)) == 0;
+                }
+                drawCalls++;
+                instanceCount += batch.itemCount;
+            }
+            else
+            {
+                valid = valid && !instanced;
+                drawCalls += batch.itemCount;
+            }
+            next = end;
+        }
+        DX_CHECK(valid);
+        DX_CHECK(next == items.size());
+
+        const InstanceBatchStats& stats = batcher.GetStats();
+        DX_CHECK(stats.drawCount == items.size());
+        DX_CHECK(stats.drawCalls == drawCalls);
+        DX_CHECK(stats.instanceCount == instanceCount);
+        DX_CHECK(batcher.GetInstances().size() == instanceCount);
+    }
+
+    void TestRandomQueues()
+    {
+        std::mt19937 random(9);
+        RenderQueue queue;
+        InstanceBatcher batcher;
+        for (int round = 0; round < 3000; round++)
+        {
+            const size_t drawCount = random() % 200;
+            std::vector<uint32_t> variants(drawCount);
+            std::vector<XMFLOAT4X4> worlds(drawCount);
+            queue.Clear();
+            for (size_t i = 0; i < drawCount; i++)
+            {
+                variants[i] = random() % 5 == 0 ? InstanceBatcher::NoInstancing : random() % 2;
+                XMStoreFloat4x4(&worlds[i], XMMatrixTranslation(float(i), 0.f, 0.f));
+                queue.Add(RenderQueue::MakeKey(RenderPass::Opaque, random() % 2, random() % 3, random() % 4, float(random() % 100) / 100.f), uint32_t(i));
+            }
+            queue.Sort();
+            CheckSorted(queue, drawCount);
+
+            const uint32_t minInstances = random() % 5;
+            batcher.Build(queue.GetItems().data(), drawCount, variants.data(), worlds.data(), minInstances);
+            CheckBatches(batcher, queue.GetItems(), variants, worlds, minInstances);
+        }
+    }
+
+    // The campsite's repeats: the crop four times, the mushroom group and both halves of the simple
+    // tree twice each, among three single draws. Thirteen draws become seven calls.
+    void TestCampsite()
+    {
+        const int meshes[7] = {};
+        const int texture = 0;
+        const int shader = 0;
+        const int drawMeshes[13] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 5, 6 };
+
+        RenderQueue queue;
+        std::vector<uint32_t> variants(13, 0);
+        std::vector<XMFLOAT4X4> worlds(13);
+        for (uint32_t i = 0; i < 13; i++)
+        {
+            XMStoreFloat4x4(&worlds[i], XMMatrixTranslation(float(i), 0.f, 0.f));
+            queue.Add(RenderQueue::MakeKey(RenderPass::Opaque, queue.GetShaderId(&shader), queue.GetTextureId(&texture),
+                queue.GetMeshId(&meshes[drawMeshes[i]]), float(13 - i) / 13.f), i);
+        }
+        queue.Sort();
+
+        InstanceBatcher batcher;
+        batcher.Build(queue.GetItems().data(), queue.GetCount(), variants.data(), worlds.data());
+        CheckBatches(batcher, queue.GetItems(), variants, worlds, 2);
+        DX_CHECK(batcher.GetStats().instancedBatches == 4);
+        DX_CHECK(batcher.GetStats().instanceCount == 10);
+        DX_CHECK(batcher.GetStats().drawCalls == 7);
+
+        // Opaque draws of one mesh are instanced nearest first
+        const InstanceBatch& crops = batcher.GetBatches()[0];
+        DX_CHECK(crops.itemCount == 4 && crops.firstInstance == 0);
+        DX_CHECK(batcher.GetInstances()[0]._41 == 3.f && batcher.GetInstances()[3]._41 == 0.f);
+    }
+}
+
+int main()
+{
+    TestRandomQueues();
+    TestCampsite();
+
+    return Tests::Finish("InstanceBatcherTests");
+}
@@ -0,0 +1,109 @@
+//
+// JobSystemBenchmark.cpp - Cost of a job against a thread, and a parallel loop scaling from 1 to 64 threads
+//
+//   JobSystemBenchmark [maxThreads]
+//
+// For pools of 1, 2, 4, 8, 16, 32 and 64 threads, up to maxThreads when given, times creating,
+// running and waiting on 4,000 empty children of one parent, and a ParallelFor over a million
+// items of a few hundred nanoseconds each with the game's grain of 256 and with no grain at all.
+// Pools larger than the machine's hardware threads show what oversubscription costs.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "JobSystem.h"
+
+#include <cstdlib>
+#include <thread>
+
+using namespace DX;
+
+namespace
+{
+    volatile uint64_t s_sink;
+
+    // Best of five, in nanoseconds per job
+    double MeasureSpawn(JobSystem& jobs, int jobCount)
+    {
+        double best = 1e30;
+        for (int round = 0; round < 5; round++)
+        {
+            Tests::Stopwatch stopwatch;
+            Job* parent = jobs.Create([] {});
+            for (int i = 0; i < jobCount; i++)
+            {
+                jobs.Run(jobs.Create([] {}, parent));
+            }
+            jobs.Run(parent);
+            jobs.Wait(parent);
+            best = std::min(best, stopwatch.GetSeconds() * 1e9 / jobCount);
+        }
+        return best;
+    }
+
+    // Nanoseconds to start and join a thread, what a job saves
+    double MeasureThreadStart(int threadCount)
+    {
+        Tests::Stopwatch stopwatch;
+        for (int i = 0; i < threadCount; i++)
+        {
+            std::thread thread([] {});
+            thread.join();
+        }
+        return stopwatch.GetSeconds() * 1e9 / threadCount;
+    }
+
+    // Best of three, in milliseconds
+    double MeasureLoop(JobSystem& jobs, size_t count, size_t minGrain)
+    {
+        double best = 1e30;
+        for (int round = 0; round < 3; round++)
+        {
+            Tests::Stopwatch stopwatch;
+            std::atomic<uint64_t> total(0);
+            jobs.ParallelFor(count, minGrain, [&](size_t begin, size_t end)
+            {
+                uint64_t sum = 0;
+                for (size_t i = begin; i < end; i++)
+                {
+                    uint64_t x = i;
+                    for (int k = 0; k < 64; k++)
+                    {
+                        x = x * 6364136223846793005ull + 1442695040888963407ull;
+                    }
+                    sum += x;
+                }
+                total += sum;
+            });
+            s_sink = total;
+            best = std::min(best, stopwatch.GetSeconds() * 1000.0);
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const uint32_t maxThreads = argc > 1 ? uint32_t(strtoul(argv[1], nullptr, 10)) : 64;
+    printf("JobSystemBenchmark, %u hardware threads\n", std::thread::hardware_concurrency());
+    printf("  std::thread start and join: %.0f ns\n", MeasureThreadStart(2000));
+
+    double singleThreadMs = 0.0;
+    for (uint32_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+    {
+        JobSystem jobs(threadCount - 1);
+
+        // Give the workers time to start and go to sleep, as they would be between frames
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        const double spawnNs = MeasureSpawn(jobs, 4000);
+        const double loopMs = MeasureLoop(jobs, 1 << 20, 256);
+        const double finestLoopMs = MeasureLoop(jobs, 1 << 20, 1);
+        singleThreadMs = threadCount == 1 ? loopMs : singleThreadMs;
+
+        const JobSystemStats stats = jobs.GetStats();
+        printf("  %2u threads: job %6.1f ns, 1M item loop %7.2f ms (%4.1fx), no grain %7.2f ms, %llu stolen, %llu sleeps\n", threadCount,
+            spawnNs, loopMs, singleThreadMs / loopMs, finestLoopMs, static_cast<unsigned long long>(stats.jobsStolen),
+            static_cast<unsigned long long>(stats.sleeps));
+    }
+    return 0;
+}
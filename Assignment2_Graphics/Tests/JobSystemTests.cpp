@@ -0,0 +1,201 @@
+//
+// JobSystemTests.cpp - Parallel loops, job trees, affinity and threads outside the pool, at several pool sizes
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "JobSystem.h"
+
+#include <thread>
+
+using namespace DX;
+
+namespace
+{
+    // Adds up the Fibonacci number of n from a tree of jobs, each level waiting on its own children
+    // from inside a job
+    struct Fibonacci
+    {
+        JobSystem* system;
+        int n;
+        std::atomic<uint64_t>* sum;
+
+        void operator()() const
+        {
+            if (n < 2)
+            {
+                sum->fetch_add(uint64_t(n));
+                return;
+            }
+            Job* parent = system->Create([] {});
+            system->Run(system->Create(Fibonacci{ system, n - 1, sum }, parent));
+            system->Run(system->Create(Fibonacci{ system, n - 2, sum }, parent));
+            system->Run(parent);
+            system->Wait(parent);
+        }
+    };
+
+    // Every index is covered once by ranges inside the count, however the count splits
+    void TestParallelFor(JobSystem& jobs)
+    {
+        for (size_t count : { 0, 1, 7, 100, 1000, 100000, 1000003 })
+        {
+            std::vector<std::atomic<uint8_t>> hits(count);
+            for (std::atomic<uint8_t>& hit : hits)
+            {
+                hit = 0;
+            }
+            std::atomic<bool> badRange(false);
+            jobs.ParallelFor(count, 1, [&](size_t begin, size_t end)
+            {
+                if (begin >= end || end > count)
+                {
+                    badRange = true;
+                    return;
+                }
+                for (size_t i = begin; i < end; i++)
+                {
+                    hits[i]++;
+                }
+            });
+            DX_CHECK(!badRange);
+            DX_CHECK(std::all_of(hits.begin(), hits.end(), [](const std::atomic<uint8_t>& hit) { return hit == 1; }));
+        }
+
+        // Uneven work, one index in 64 takes thousands of times longer than the rest
+        std::atomic<uint64_t> total(0);
+        jobs.ParallelFor(4096, 1, [&](size_t begin, size_t end)
+        {
+            uint64_t sum = 0;
+            for (size_t i = begin; i < end; i++)
+            {
+                volatile uint64_t busy = 0;
+                for (size_t k = 0; k < (i % 64 == 0 ? 20000u : 10u); k++)
+                {
+                    busy = busy + k;
+                }
+                sum += i;
+            }
+            total += sum;
+        });
+        DX_CHECK(total == 4096ull * 4095 / 2);
+
+        // A grain larger than the count runs it all at once on the calling thread
+        const uint32_t caller = jobs.GetThreadIndex();
+        std::atomic<int> calls(0);
+        std::atomic<uint32_t> ranOn(JobSystem::AnyThread);
+        jobs.ParallelFor(1000, 5000, [&](size_t begin, size_t end)
+        {
+            calls++;
+            ranOn = jobs.GetThreadIndex();
+            DX_CHECK(begin == 0 && end == 1000);
+        });
+        DX_CHECK(calls == 1);
+        DX_CHECK(ranOn == caller);
+    }
+
+    // A parent waits for every child, and children may create and wait on jobs of their own
+    void TestJobTrees(JobSystem& jobs)
+    {
+        std::atomic<uint64_t> fibonacci(0);
+        Job* root = jobs.Create(Fibonacci{ &jobs, 18, &fibonacci });
+        jobs.Run(root);
+        jobs.Wait(root);
+        DX_CHECK(fibonacci == 2584);
+
+        std::atomic<int> done(0);
+        Job* parent = jobs.Create([] {});
+        for (int i = 0; i < 1000; i++)
+        {
+            jobs.Run(jobs.Create([&done] { done++; }, parent));
+        }
+        jobs.Run(parent);
+        jobs.Wait(parent);
+        DX_CHECK(done == 1000);
+
+        // More jobs than a thread's ring holds, waited on now and then, wrap it many times over
+        for (int i = 0; i < 20000; i++)
+        {
+            Job* job = jobs.Create([] {});
+            jobs.Run(job);
+            if (i % 3000 == 0)
+            {
+                jobs.Wait(job);
+            }
+        }
+        Job* last = jobs.Create([] {});
+        jobs.Run(last);
+        jobs.Wait(last);
+    }
+
+    // Jobs given a thread run on it, whether that is a worker or the thread outside the pool
+    void TestAffinity(JobSystem& jobs)
+    {
+        const uint32_t caller = jobs.GetThreadIndex();
+        DX_CHECK(caller >= jobs.GetWorkerCount());
+        DX_CHECK(jobs.GetThreadIndex() == caller);
+
+        for (uint32_t thread = 0; thread <= jobs.GetWorkerCount(); thread++)
+        {
+            const uint32_t wanted = thread < jobs.GetWorkerCount() ? thread : caller;
+            std::atomic<uint32_t> ranOn(JobSystem::AnyThread);
+            Job* job = jobs.Create([&ranOn, &jobs] { ranOn = jobs.GetThreadIndex(); });
+            jobs.Run(job, wanted);
+            jobs.Wait(job);
+            DX_CHECK(ranOn == wanted);
+        }
+    }
+
+    // Threads outside the pool queue loops at the same time, then exit and leave their queues to
+    // the next ones
+    void TestExternalThreads(JobSystem& jobs)
+    {
+        for (int generation = 0; generation < 3; generation++)
+        {
+            std::vector<std::thread> threads;
+            std::atomic<uint64_t> sum(0);
+            for (int t = 0; t < 4; t++)
+            {
+                threads.emplace_back([&]()
+                {
+                    jobs.ParallelFor(50000, 16, [&](size_t begin, size_t end)
+                    {
+                        uint64_t rangeSum = 0;
+                        for (size_t i = begin; i < end; i++)
+                        {
+                            rangeSum += i;
+                        }
+                        sum += rangeSum;
+                    });
+                });
+            }
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+            DX_CHECK(sum == 4ull * 50000 * 49999 / 2);
+        }
+    }
+}
+
+int main()
+{
+    for (uint32_t workerCount : { 0u, 1u, 3u, 8u })
+    {
+        JobSystem jobs(workerCount);
+        DX_CHECK(jobs.GetWorkerCount() == workerCount);
+        DX_CHECK(jobs.GetThreadCount() == workerCount + 1);
+
+        TestParallelFor(jobs);
+        TestJobTrees(jobs);
+        TestAffinity(jobs);
+        TestExternalThreads(jobs);
+
+        const JobSystemStats stats = jobs.GetStats();
+        printf("  %u workers: %llu jobs run, %llu stolen, %llu sleeps\n", workerCount, static_cast<unsigned long long>(stats.jobsRun),
+            static_cast<unsigned long long>(stats.jobsStolen), static_cast<unsigned long long>(stats.sleeps));
+        DX_CHECK(workerCount > 0 || stats.jobsStolen == 0);
+    }
+
+    return Tests::Finish("JobSystemTests");
+}
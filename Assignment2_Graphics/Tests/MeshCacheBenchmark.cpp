@@ -0,0 +1,103 @@
+//
+// MeshCacheBenchmark.cpp - Loading the game's models from their .meshbin against parsing and processing the OBJ
+//
+//   MeshCacheBenchmark model.obj...
+//
+// The parse is every step ModelClass runs without a cache. The cache load opens the .meshbin, checks
+// it against the OBJ and its MTL libraries and copies out what ModelClass keeps, with the vertices and
+// indices read once as the buffer upload would. Caches are written next to the models as the game does.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "TestMeshes.h"
+#include "MeshCache.h"
+
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    // Best of the runs, in milliseconds
+    template <typename Load>
+    double Measure(int runs, Load load)
+    {
+        double best = 1e30;
+        for (int run = 0; run < runs; run++)
+        {
+            Stopwatch stopwatch;
+            if (!load())
+            {
+                return 0.0;
+            }
+            best = std::min(best, stopwatch.GetSeconds() * 1000.0);
+        }
+        return best;
+    }
+
+    bool LoadCache(const char* filename, MeshData& mesh, uint64_t& checksum)
+    {
+        MeshCache cache;
+        if (!cache.Open(filename))
+        {
+            return false;
+        }
+        const MeshCacheHeader& header = cache.GetHeader();
+        mesh.materials.assign(cache.GetMaterials(), cache.GetMaterials() + header.materialCount);
+        mesh.subsets.assign(cache.GetSubsets(), cache.GetSubsets() + header.subsetCount);
+        mesh.lods.assign(cache.GetLods(), cache.GetLods() + header.lodCount);
+        mesh.meshlets.assign(cache.GetMeshlets(), cache.GetMeshlets() + header.meshletCount);
+        mesh.meshletVertices.assign(cache.GetMeshletVertices(), cache.GetMeshletVertices() + header.meshletVertexCount);
+        mesh.meshletTriangles.assign(cache.GetMeshletTriangles(), cache.GetMeshletTriangles() + header.meshletTriangleCount);
+
+        const uint64_t* words = static_cast<const uint64_t*>(cache.GetVertices());
+        const uint64_t byteCount = header.indexOffset + uint64_t(header.indexCount) * header.indexStride - header.vertexOffset;
+        for (uint64_t i = 0; i < byteCount / sizeof(uint64_t); i++)
+        {
+            checksum += words[i];
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    printf("MeshCacheBenchmark\n");
+    double parseTotal = 0.0;
+    double cacheTotal = 0.0;
+    uint64_t checksum = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* filename = argv[i];
+        std::vector<std::string> libraries;
+        MeshData parsed;
+        const double parseMs = Measure(5, [&]
+        {
+            parsed = MeshData();
+            return LoadModel(filename, parsed, libraries);
+        });
+        if (parseMs <= 0.0 || !MeshCache::Write(filename, parsed, libraries))
+        {
+            fprintf(stderr, "  can't load or cache %s\n", filename);
+            continue;
+        }
+
+        MeshData cached;
+        const double cacheMs = Measure(50, [&] { return LoadCache(filename, cached, checksum); });
+        if (cacheMs <= 0.0)
+        {
+            fprintf(stderr, "  can't open the cache of %s\n", filename);
+            continue;
+        }
+        parseTotal += parseMs;
+        cacheTotal += cacheMs;
+        printf("  %-24s %6zu vertices %7zu indices over every LOD: parse %8.3f ms, cache %7.3f ms, %6.1fx\n", GetFileName(filename),
+            parsed.vertices.size(), parsed.indices.size(), parseMs, cacheMs, parseMs / cacheMs);
+    }
+    if (cacheTotal > 0.0)
+    {
+        printf("  all models: parse %.3f ms, cache %.3f ms, %.1fx (checksum %llx)\n", parseTotal, cacheTotal, parseTotal / cacheTotal,
+            static_cast<unsigned long long>(checksum));
+    }
+    return 0;
+}
@@ -0,0 +1,229 @@
+//
+// MeshCacheTests.cpp - What makes a written .meshbin stale and what doesn't
+//
+//   MeshCacheTests model.obj
+//
+// The model and its MTL libraries are copied to the working directory, which must not be the
+// model's own folder, and changed there one input at a time. The copies are removed afterwards.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "TestMeshes.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    std::string ReadFile(const std::string& filename)
+    {
+        MappedFile file;
+        if (!file.Open(filename.c_str()))
+        {
+            return std::string();
+        }
+        return std::string(file.GetData(), file.GetSize());
+    }
+
+    bool WriteFile(const std::string& filename, const std::string& contents)
+    {
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (!file)
+        {
+            return false;
+        }
+        const bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        return fclose(file) == 0 && written;
+    }
+
+    uint64_t GetWriteTime(const std::string& filename)
+    {
+        uint64_t size = 0, writeTime = 0;
+        MappedFile::GetFileInfo(filename.c_str(), size, writeTime);
+        return writeTime;
+    }
+
+    // Writes the file until its write time moves on, as an edit a moment later would. Write times
+    // can be as coarse as the file system's clock tick.
+    bool Rewrite(const std::string& filename, const std::string& contents)
+    {
+        const uint64_t writeTime = GetWriteTime(filename);
+        for (int attempt = 0; attempt < 300; attempt++)
+        {
+            if (!WriteFile(filename, contents))
+            {
+                return false;
+            }
+            if (GetWriteTime(filename) != writeTime)
+            {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+    // The same size with one digit changed
+    std::string EditDigit(std::string contents)
+    {
+        const size_t digit = contents.find_first_of("0123456789");
+        if (digit != std::string::npos)
+        {
+            contents[digit] = contents[digit] == '1' ? '2' : '1';
+        }
+        return contents;
+    }
+
+    // Overwrites a field of the written cache, offset from the start of the file
+    template <typename T>
+    bool PatchCache(const std::string& sourceFile, uint64_t offset, T value)
+    {
+        const std::string path = MeshCache::GetCachePath(sourceFile.c_str());
+        std::string contents = ReadFile(path);
+        if (offset + sizeof(T) > contents.size())
+        {
+            return false;
+        }
+        memcpy(&contents[size_t(offset)], &value, sizeof(T));
+        return WriteFile(path, contents);
+    }
+
+    template <typename T>
+    T ReadCache(const std::string& sourceFile, uint64_t offset)
+    {
+        T value = {};
+        const std::string contents = ReadFile(MeshCache::GetCachePath(sourceFile.c_str()));
+        if (offset + sizeof(T) <= contents.size())
+        {
+            memcpy(&value, &contents[size_t(offset)], sizeof(T));
+        }
+        return value;
+    }
+
+    bool IsValid(const std::string& sourceFile)
+    {
+        MeshCache cache;
+        return cache.Open(sourceFile.c_str());
+    }
+
+    void TestInvalidation(const char* modelFile)
+    {
+        // The copies go in the working directory under the model's own name, as the OBJ names its libraries
+        const std::string obj = GetFileName(modelFile);
+        const std::string modelDirectory(modelFile, GetFileName(modelFile) - modelFile);
+        const std::string objContents = ReadFile(modelFile);
+        if (!DX_CHECK(obj != modelFile && !objContents.empty() && WriteFile(obj, objContents)))
+        {
+            return;
+        }
+
+        MeshData mesh;
+        std::vector<std::string> libraries;
+        if (!DX_CHECK(LoadModel(modelFile, mesh, libraries)) || !DX_CHECK(!libraries.empty()))
+        {
+            remove(obj.c_str());
+            return;
+        }
+        const std::string mtl = libraries.front();
+        const std::string mtlContents = ReadFile(modelDirectory + mtl);
+        DX_CHECK(!mtlContents.empty() && WriteFile(mtl, mtlContents));
+
+        // A fresh cache opens and holds the mesh it was written with
+        DX_CHECK(MeshCache::Write(obj.c_str(), mesh, libraries));
+        {
+            MeshCache cache;
+            if (DX_CHECK(cache.Open(obj.c_str())))
+            {
+                const MeshCacheHeader& header = cache.GetHeader();
+                DX_CHECK(header.vertexCount == mesh.vertices.size() && header.indexCount == mesh.indices.size());
+                DX_CHECK(header.materialCount == mesh.materials.size() && header.subsetCount == mesh.subsets.size());
+                DX_CHECK(header.meshletCount == mesh.meshlets.size() && header.dependencyCount == libraries.size());
+                DX_CHECK(memcmp(cache.GetVertices(), mesh.vertices.data(), mesh.vertices.size() * sizeof(MeshVertex)) == 0);
+            }
+        }
+
+        // Another version
+        DX_CHECK(PatchCache(obj, offsetof(MeshCacheHeader, version), MeshCache::Version + 1));
+        DX_CHECK(!IsValid(obj));
+        DX_CHECK(MeshCache::Write(obj.c_str(), mesh, libraries) && IsValid(obj));
+
+        // The OBJ grows, then goes back to what it was with only its write time changed
+        DX_CHECK(Rewrite(obj, objContents + "\n"));
+        DX_CHECK(!IsValid(obj));
+        DX_CHECK(Rewrite(obj, objContents));
+        DX_CHECK(IsValid(obj));
+
+        // The same size with other contents and a new write time
+        DX_CHECK(Rewrite(obj, EditDigit(objContents)));
+        DX_CHECK(!IsValid(obj));
+        DX_CHECK(Rewrite(obj, objContents));
+        DX_CHECK(IsValid(obj));
+
+        // The hash is only read when the write time changed, so a wrong one goes unnoticed until then
+        DX_CHECK(MeshCache::Write(obj.c_str(), mesh, libraries));
+        const uint64_t sourceHash = ReadCache<uint64_t>(obj, offsetof(MeshCacheHeader, sourceHash));
+        DX_CHECK(PatchCache(obj, offsetof(MeshCacheHeader, sourceHash), sourceHash ^ 1));
+        DX_CHECK(IsValid(obj));
+        DX_CHECK(Rewrite(obj, objContents));
+        DX_CHECK(!IsValid(obj));
+
+        // A touch alone keeps the cache
+        DX_CHECK(MeshCache::Write(obj.c_str(), mesh, libraries) && IsValid(obj));
+        DX_CHECK(Rewrite(obj, objContents));
+        DX_CHECK(IsValid(obj));
+
+        // The MTL library through the dependency table: an edit of the same size, a touch, a wrong
+        // recorded hash once its write time changes, deleting it and a missing one appearing
+        DX_CHECK(Rewrite(mtl, EditDigit(mtlContents)));
+        DX_CHECK(!IsValid(obj));
+        DX_CHECK(Rewrite(mtl, mtlContents));
+        DX_CHECK(IsValid(obj));
+        DX_CHECK(Rewrite(mtl, mtlContents));
+        DX_CHECK(IsValid(obj));
+
+        DX_CHECK(MeshCache::Write(obj.c_str(), mesh, libraries));
+        const uint64_t dependencyOffset = ReadCache<uint64_t>(obj, offsetof(MeshCacheHeader, dependencyOffset));
+        const uint64_t dependencyHash = ReadCache<uint64_t>(obj, dependencyOffset + offsetof(MeshCacheDependency, hash));
+        DX_CHECK(strcmp(ReadCache<MeshCacheDependency>(obj, dependencyOffset).name, mtl.c_str()) == 0);
+        DX_CHECK(PatchCache(obj, dependencyOffset + offsetof(MeshCacheDependency, hash), dependencyHash ^ 1));
+        DX_CHECK(IsValid(obj));
+        DX_CHECK(Rewrite(mtl, mtlContents));
+        DX_CHECK(!IsValid(obj));
+
+        DX_CHECK(MeshCache::Write(obj.c_str(), mesh, libraries) && IsValid(obj));
+        DX_CHECK(remove(mtl.c_str()) == 0);
+        DX_CHECK(!IsValid(obj));
+        DX_CHECK(MeshCache::Write(obj.c_str(), mesh, libraries));
+        DX_CHECK(ReadCache<uint64_t>(obj, dependencyOffset + offsetof(MeshCacheDependency, size)) == MeshCacheDependency::MissingFile);
+        DX_CHECK(IsValid(obj));
+        DX_CHECK(WriteFile(mtl, mtlContents));
+        DX_CHECK(!IsValid(obj));
+
+        // A deleted OBJ can't have a valid cache
+        DX_CHECK(MeshCache::Write(obj.c_str(), mesh, libraries) && IsValid(obj));
+        DX_CHECK(remove(obj.c_str()) == 0);
+        DX_CHECK(!IsValid(obj));
+
+        remove(MeshCache::GetCachePath(obj.c_str()).c_str());
+        remove(mtl.c_str());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (DX_CHECK(argc > 1))
+    {
+        TestInvalidation(argv[1]);
+    }
+
+    return Tests::Finish("MeshCacheTests");
+}
@@ -0,0 +1,235 @@
+//
+// MeshOptimizerTests.cpp - Welding and cache/overdraw/fetch reordering over the game's models
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "MeshOptimizer.h"
+#include "MeshWelder.h"
+
+#include <cstring>
+#include <string>
+
+using namespace DX;
+
+namespace
+{
+    bool SameVertex(const MeshVertex& a, const MeshVertex& b)
+    {
+        return memcmp(&a, &b, sizeof(MeshVertex)) == 0;
+    }
+
+    bool VertexLess(const MeshVertex& a, const MeshVertex& b)
+    {
+        return memcmp(&a, &b, sizeof(MeshVertex)) < 0;
+    }
+
+    // The triangles of a subset as the bytes of their vertices, each rotated to start at its
+    // smallest corner so reordering corners without changing winding compares equal
+    std::vector<std::string> GetTriangles(const MeshData& mesh, const MeshSubset& subset)
+    {
+        std::vector<std::string> triangles;
+        for (uint32_t i = subset.firstIndex; i < subset.firstIndex + subset.indexCount; i += 3)
+        {
+            const MeshVertex* corners[3] = { &mesh.vertices[mesh.indices[i]], &mesh.vertices[mesh.indices[i + 1]], &mesh.vertices[mesh.indices[i + 2]] };
+            size_t first = 0;
+            for (size_t c = 1; c < 3; c++)
+            {
+                first = VertexLess(*corners[c], *corners[first]) ? c : first;
+            }
+            std::string triangle;
+            for (size_t c = 0; c < 3; c++)
+            {
+                triangle.append(reinterpret_cast<const char*>(corners[(first + c) % 3]), sizeof(MeshVertex));
+            }
+            triangles.push_back(triangle);
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    void CheckIndices(const MeshData& mesh)
+    {
+        bool inRange = true;
+        for (uint32_t index : mesh.indices)
+        {
+            inRange = inRange && index < mesh.vertices.size();
+        }
+        DX_CHECK(inRange);
+        DX_CHECK(mesh.indices.size() % 3 == 0);
+
+        size_t covered = 0;
+        for (const MeshSubset& subset : mesh.subsets)
+        {
+            DX_CHECK(subset.firstIndex == covered);
+            covered += subset.indexCount;
+        }
+        DX_CHECK(covered == mesh.indices.size());
+    }
+
+    // Every corner of the weld carries exactly the attributes the OBJ face named
+    void CheckWeld(const ObjData& obj, const MeshData& mesh, const WeldStats& stats)
+    {
+        CheckIndices(mesh);
+        DX_CHECK(mesh.indices.size() * 3 == obj.faces.size());
+        DX_CHECK(stats.outputVertices == mesh.vertices.size());
+        DX_CHECK(stats.outputVertices <= stats.inputVertices);
+
+        // Subsets reorder the triangles by material, so corners are matched up per material
+        std::vector<std::vector<MeshVertex>> expected(mesh.subsets.size());
+        std::vector<std::vector<MeshVertex>> welded(mesh.subsets.size());
+        for (size_t s = 0; s < mesh.subsets.size(); s++)
+        {
+            const MeshSubset& subset = mesh.subsets[s];
+            for (uint32_t i = subset.firstIndex; i < subset.firstIndex + subset.indexCount; i++)
+            {
+                welded[s].push_back(mesh.vertices[mesh.indices[i]]);
+            }
+            for (size_t t = 0; t < obj.triangleMaterials.size(); t++)
+            {
+                if (obj.triangleMaterials[t] != subset.materialIndex)
+                {
+                    continue;
+                }
+                for (size_t c = 0; c < 3; c++)
+                {
+                    const unsigned int* corner = &obj.faces[(t * 3 + c) * 3];
+                    MeshVertex vertex;
+                    vertex.position = obj.positions[corner[0] - 1];
+                    vertex.texture = obj.texCoords[corner[1] - 1];
+                    vertex.normal = obj.normals[corner[2] - 1];
+                    expected[s].push_back(vertex);
+                }
+            }
+        }
+
+        bool same = true;
+        for (size_t s = 0; s < mesh.subsets.size(); s++)
+        {
+            same = same && expected[s].size() == welded[s].size();
+            for (size_t i = 0; same && i < welded[s].size(); i++)
+            {
+                same = SameVertex(expected[s][i], welded[s][i]);
+            }
+        }
+        DX_CHECK(same);
+
+        // Exact welding gives one vertex per distinct v/vt/vn triple
+        std::vector<uint64_t> triples;
+        for (size_t i = 0; i < obj.faces.size(); i += 3)
+        {
+            triples.push_back((uint64_t(obj.faces[i]) << 42) | (uint64_t(obj.faces[i + 1]) << 21) | obj.faces[i + 2]);
+        }
+        std::sort(triples.begin(), triples.end());
+        DX_CHECK(size_t(std::unique(triples.begin(), triples.end()) - triples.begin()) == mesh.vertices.size());
+    }
+
+    void TestCorpusFile(const char* filename)
+    {
+        ObjData obj;
+        if (!DX_CHECK(ObjLoader::LoadFile(filename, obj)))
+        {
+            fprintf(stderr, "  %s didn't load\n", filename);
+            return;
+        }
+
+        MeshData mesh;
+        WeldStats stats;
+        MeshWelder::WeldObj(obj, mesh, 0.f, &stats);
+        CheckWeld(obj, mesh, stats);
+
+        MeshData merged;
+        WeldStats mergedStats;
+        MeshWelder::WeldObj(obj, merged, 1e-5f, &mergedStats);
+        CheckIndices(merged);
+        DX_CHECK(merged.vertices.size() <= mesh.vertices.size());
+        DX_CHECK(merged.indices.size() == mesh.indices.size());
+
+        // Reordering keeps every triangle of every subset, with its winding
+        std::vector<std::vector<std::string>> before;
+        for (const MeshSubset& subset : mesh.subsets)
+        {
+            before.push_back(GetTriangles(mesh, subset));
+        }
+        const VertexCacheStats original = MeshOptimizer::AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+        MeshData cacheOnly = mesh;
+        MeshOptimizer::OptimizeVertexCache(cacheOnly.indices, cacheOnly.vertices.size());
+        const VertexCacheStats tipsify = MeshOptimizer::AnalyzeVertexCache(cacheOnly.indices, cacheOnly.vertices.size());
+
+        const size_t vertexCount = mesh.vertices.size();
+        MeshOptimizer::Optimize(mesh);
+        const VertexCacheStats optimized = MeshOptimizer::AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+        CheckIndices(mesh);
+        DX_CHECK(mesh.vertices.size() == vertexCount);
+        DX_CHECK(mesh.subsets.size() == before.size());
+        bool sameTriangles = mesh.subsets.size() == before.size();
+        for (size_t s = 0; sameTriangles && s < before.size(); s++)
+        {
+            sameTriangles = GetTriangles(mesh, mesh.subsets[s]) == before[s];
+        }
+        DX_CHECK(sameTriangles);
+
+        // The cache pass never does worse than the exporter's order, and the overdraw pass gives
+        // back at most its threshold of that
+        DX_CHECK(tipsify.acmr <= original.acmr + 1e-4f);
+        DX_CHECK(optimized.acmr <= std::max(original.acmr, tipsify.acmr * 1.05f) + 1e-4f);
+
+        // After the fetch pass vertices appear in the order the indices first use them
+        uint32_t next = 0;
+        bool firstUseOrder = true;
+        for (uint32_t index : mesh.indices)
+        {
+            firstUseOrder = firstUseOrder && index <= next;
+            next = std::max(next, index + 1);
+        }
+        DX_CHECK(firstUseOrder);
+
+        printf("  %-28s %6zu -> %6zu vertices (%zu with 1e-5 epsilon)  acmr %.3f -> %.3f -> %.3f  atvr %.3f -> %.3f\n",
+            Tests::GetFileName(filename), stats.inputVertices, stats.outputVertices, mergedStats.outputVertices, original.acmr,
+            tipsify.acmr, optimized.acmr, original.atvr, optimized.atvr);
+    }
+
+    // Tipsify on a regular grid should come close to the ideal 0.5 misses per triangle for its cache size
+    void TestGrid()
+    {
+        const uint32_t size = 64;
+        std::vector<uint32_t> indices;
+        for (uint32_t y = 0; y < size; y++)
+        {
+            for (uint32_t x = 0; x < size; x++)
+            {
+                const uint32_t corner = y * (size + 1) + x;
+                indices.insert(indices.end(), { corner, corner + size + 1, corner + 1, corner + 1, corner + size + 1, corner + size + 2 });
+            }
+        }
+
+        // Shuffle triangles so the input order is as bad as it gets
+        std::vector<uint32_t> shuffled;
+        for (size_t t = 0, count = indices.size() / 3; t < count; t++)
+        {
+            const size_t source = (t * 7919) % count;
+            shuffled.insert(shuffled.end(), indices.begin() + source * 3, indices.begin() + source * 3 + 3);
+        }
+
+        const size_t vertexCount = (size + 1) * (size + 1);
+        const VertexCacheStats before = MeshOptimizer::AnalyzeVertexCache(shuffled, vertexCount);
+        MeshOptimizer::OptimizeVertexCache(shuffled, vertexCount);
+        const VertexCacheStats after = MeshOptimizer::AnalyzeVertexCache(shuffled, vertexCount);
+        DX_CHECK(after.acmr < 0.8f);
+        DX_CHECK(after.acmr < before.acmr);
+        printf("  shuffled %ux%u grid           acmr %.3f -> %.3f\n", size, size, before.acmr, after.acmr);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    DX_CHECK(argc > 1);
+    for (int i = 1; i < argc; i++)
+    {
+        TestCorpusFile(argv[i]);
+    }
+    TestGrid();
+
+    return Tests::Finish("MeshOptimizerTests");
+}
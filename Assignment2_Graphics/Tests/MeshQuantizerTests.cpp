@@ -0,0 +1,173 @@
+//
+// MeshQuantizerTests.cpp - Quantized vertex round trips over the game's models, flat meshes and the octahedral poles
+//
+//   MeshQuantizerTests model.obj...
+//
+// Positions must come back within half a 16-bit step of the mesh bounds on each axis, and normals
+// within the 0.03 degrees the quantized format was introduced with.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "TestMeshes.h"
+#include "MeshQuantizer.h"
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    const float MaxNormalDegrees = 0.03f;
+
+    // Half a step of each axis, combined over the three, with room for the float arithmetic
+    float GetPositionBound(const QuantizationParams& params)
+    {
+        const float halfStep = XMVectorGetX(XMVector3Length(XMLoadFloat3(&params.positionScale))) / 65535.f / 2.f;
+        const float magnitude = XMVectorGetX(XMVector3Length(XMLoadFloat3(&params.positionOffset))) +
+            XMVectorGetX(XMVector3Length(XMLoadFloat3(&params.positionScale)));
+        return halfStep * 1.001f + magnitude * 1e-6f;
+    }
+
+    QuantizationStats RoundTrip(const std::vector<MeshVertex>& vertices, QuantizationParams& params)
+    {
+        params = MeshQuantizer::ComputeParams(vertices.data(), vertices.size());
+        std::vector<QuantizedVertex> quantized(vertices.size());
+        MeshQuantizer::Encode(vertices.data(), vertices.size(), params, quantized.data());
+        return MeshQuantizer::Measure(vertices.data(), quantized.data(), vertices.size(), params);
+    }
+
+    void TestCorpusFile(const char* filename)
+    {
+        MeshData mesh;
+        if (!DX_CHECK(LoadModel(filename, mesh)))
+        {
+            return;
+        }
+        QuantizationParams params;
+        const QuantizationStats stats = RoundTrip(mesh.vertices, params);
+        const float bound = GetPositionBound(params);
+        DX_CHECK(stats.maxPositionError <= bound);
+        DX_CHECK(stats.maxNormalError <= MaxNormalDegrees);
+
+        // Half floats keep 11 significant bits
+        float largestTexCoord = 0.f;
+        for (const MeshVertex& vertex : mesh.vertices)
+        {
+            largestTexCoord = std::max(largestTexCoord, std::max(std::fabs(vertex.texture.x), std::fabs(vertex.texture.y)));
+        }
+        DX_CHECK(stats.maxTexCoordError <= std::max(largestTexCoord, 1e-4f) / 2048.f * 1.5f);
+
+        printf("  %s: position %.2e of %.2e, normal %.4f degrees, uv %.2e\n", GetFileName(filename), stats.maxPositionError, bound,
+            stats.maxNormalError, stats.maxTexCoordError);
+    }
+
+    // A mesh flat on one axis has a zero scale there, which decodes to the plane exactly
+    void TestFlatAxis()
+    {
+        std::vector<MeshVertex> vertices(500);
+        for (MeshVertex& vertex : vertices)
+        {
+            vertex.position = XMFLOAT3(Random(-20.f, 20.f), 3.25f, Random(-5.f, 5.f));
+            vertex.normal = XMFLOAT3(0.f, 1.f, 0.f);
+            vertex.texture = XMFLOAT2(Random(0.f, 1.f), Random(0.f, 1.f));
+        }
+        QuantizationParams params;
+        const QuantizationStats stats = RoundTrip(vertices, params);
+        DX_CHECK(params.positionScale.y == 0.f);
+        DX_CHECK(stats.maxPositionError <= GetPositionBound(params));
+        DX_CHECK(stats.maxNormalError <= MaxNormalDegrees);
+
+        std::vector<QuantizedVertex> quantized(vertices.size());
+        std::vector<MeshVertex> decoded(vertices.size());
+        MeshQuantizer::Encode(vertices.data(), vertices.size(), params, quantized.data());
+        MeshQuantizer::Decode(quantized.data(), quantized.size(), params, decoded.data());
+        DX_CHECK(std::all_of(decoded.begin(), decoded.end(), [](const MeshVertex& vertex) { return vertex.position.y == 3.25f; }));
+
+        // A single point is flat on every axis
+        vertices.resize(1);
+        DX_CHECK(RoundTrip(vertices, params).maxPositionError == 0.f);
+    }
+
+    // In degrees, from the sine and the cosine so small angles keep their precision
+    float GetAngle(FXMVECTOR a, FXMVECTOR b)
+    {
+        const XMVECTOR unitA = XMVector3Normalize(a);
+        const XMVECTOR unitB = XMVector3Normalize(b);
+        return XMConvertToDegrees(std::atan2(XMVectorGetX(XMVector3Length(XMVector3Cross(unitA, unitB))), XMVectorGetX(XMVector3Dot(unitA, unitB))));
+    }
+
+    // The poles, where the fold meets the corners of the square, the axes and normals all over the
+    // sphere come back within the bound through the 16-bit encoding
+    void TestNormals()
+    {
+        std::vector<MeshVertex> vertices;
+        const XMFLOAT3 directions[] = { XMFLOAT3(0.f, 0.f, 1.f), XMFLOAT3(0.f, 0.f, -1.f), XMFLOAT3(1.f, 0.f, 0.f), XMFLOAT3(-1.f, 0.f, 0.f),
+            XMFLOAT3(0.f, 1.f, 0.f), XMFLOAT3(0.f, -1.f, 0.f), XMFLOAT3(1e-4f, 0.f, -1.f), XMFLOAT3(-1e-4f, 1e-4f, -1.f), XMFLOAT3(1.f, 1.f, 0.f),
+            XMFLOAT3(1.f, 1.f, -1e-6f), XMFLOAT3(-1.f, -1.f, 1e-6f) };
+        for (const XMFLOAT3& direction : directions)
+        {
+            MeshVertex vertex = {};
+            XMStoreFloat3(&vertex.normal, XMVector3Normalize(XMLoadFloat3(&direction)));
+            vertices.push_back(vertex);
+        }
+        for (int i = 0; i < 100000; i++)
+        {
+            MeshVertex vertex = {};
+            const float z = i % 10 == 0 ? Random(-1.f, -.999f) : Random(-1.f, 1.f);
+            const float angle = Random(-XM_PI, XM_PI);
+            const float radius = std::sqrt(std::max(0.f, 1.f - z * z));
+            vertex.normal = XMFLOAT3(radius * std::cos(angle), radius * std::sin(angle), z);
+            vertices.push_back(vertex);
+        }
+        QuantizationParams params;
+        DX_CHECK(RoundTrip(vertices, params).maxNormalError <= MaxNormalDegrees);
+
+        // The poles go to the centre and the corners of the square, and come back exactly
+        const XMVECTOR up = MeshQuantizer::EncodeOctahedral(XMVectorSet(0.f, 0.f, 1.f, 0.f));
+        const XMVECTOR down = MeshQuantizer::EncodeOctahedral(XMVectorSet(0.f, 0.f, -1.f, 0.f));
+        DX_CHECK(XMVectorGetX(up) == 0.f && XMVectorGetY(up) == 0.f);
+        DX_CHECK(std::fabs(XMVectorGetX(down)) == 1.f && std::fabs(XMVectorGetY(down)) == 1.f);
+        DX_CHECK(GetAngle(MeshQuantizer::DecodeOctahedral(up), XMVectorSet(0.f, 0.f, 1.f, 0.f)) == 0.f);
+        DX_CHECK(GetAngle(MeshQuantizer::DecodeOctahedral(down), XMVectorSet(0.f, 0.f, -1.f, 0.f)) == 0.f);
+        for (float x : { -1.f, 1.f })
+        {
+            for (float y : { -1.f, 1.f })
+            {
+                DX_CHECK(GetAngle(MeshQuantizer::DecodeOctahedral(XMVectorSet(x, y, 0.f, 0.f)), XMVectorSet(0.f, 0.f, -1.f, 0.f)) == 0.f);
+            }
+        }
+
+        // Encoding stays on the square and decoding is its inverse before any rounding
+        float largestAngle = 0.f;
+        bool onSquare = true;
+        for (const MeshVertex& vertex : vertices)
+        {
+            const XMVECTOR normal = XMLoadFloat3(&vertex.normal);
+            const XMVECTOR encoded = MeshQuantizer::EncodeOctahedral(normal);
+            onSquare = onSquare && std::fabs(XMVectorGetX(encoded)) <= 1.f && std::fabs(XMVectorGetY(encoded)) <= 1.f;
+            largestAngle = std::max(largestAngle, GetAngle(MeshQuantizer::DecodeOctahedral(encoded), normal));
+        }
+        DX_CHECK(onSquare);
+        DX_CHECK(largestAngle < 0.001f);
+
+        // A zero normal encodes to the centre rather than to NaN
+        const XMVECTOR zero = MeshQuantizer::EncodeOctahedral(XMVectorZero());
+        DX_CHECK(XMVectorGetX(zero) == 0.f && XMVectorGetY(zero) == 0.f);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    SeedRandom(7);
+    TestFlatAxis();
+    TestNormals();
+
+    DX_CHECK(argc > 1);
+    for (int i = 1; i < argc; i++)
+    {
+        TestCorpusFile(argv[i]);
+    }
+
+    return Tests::Finish("MeshQuantizerTests");
+}
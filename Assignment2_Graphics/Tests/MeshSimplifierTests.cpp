@@ -0,0 +1,275 @@
+//
+// MeshSimplifierTests.cpp - LOD chains of a sphere and the game's models, and LOD selection
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "TestMeshes.h"
+#include "LodSelector.h"
+#include "MeshSimplifier.h"
+#include "MeshWelder.h"
+#include "MtlLoader.h"
+
+#include <cstring>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    const float MaxRelativeError = 0.05f;
+
+    // Distance from p to the closest point of triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+    float GetPointTriangleDistance(const XMFLOAT3& point, const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+    {
+        const XMVECTOR p = XMLoadFloat3(&point);
+        const XMVECTOR va = XMLoadFloat3(&a);
+        const XMVECTOR vb = XMLoadFloat3(&b);
+        const XMVECTOR vc = XMLoadFloat3(&c);
+        const XMVECTOR ab = XMVectorSubtract(vb, va);
+        const XMVECTOR ac = XMVectorSubtract(vc, va);
+        const XMVECTOR ap = XMVectorSubtract(p, va);
+
+        XMVECTOR closest;
+        const float d1 = XMVectorGetX(XMVector3Dot(ab, ap));
+        const float d2 = XMVectorGetX(XMVector3Dot(ac, ap));
+        const XMVECTOR bp = XMVectorSubtract(p, vb);
+        const float d3 = XMVectorGetX(XMVector3Dot(ab, bp));
+        const float d4 = XMVectorGetX(XMVector3Dot(ac, bp));
+        const XMVECTOR cp = XMVectorSubtract(p, vc);
+        const float d5 = XMVectorGetX(XMVector3Dot(ab, cp));
+        const float d6 = XMVectorGetX(XMVector3Dot(ac, cp));
+        const float vcArea = d1 * d4 - d3 * d2;
+        const float vbArea = d5 * d2 - d1 * d6;
+        const float vaArea = d3 * d6 - d5 * d4;
+        if (d1 <= 0.f && d2 <= 0.f)
+        {
+            closest = va;
+        }
+        else if (d3 >= 0.f && d4 <= d3)
+        {
+            closest = vb;
+        }
+        else if (vcArea <= 0.f && d1 >= 0.f && d3 <= 0.f)
+        {
+            closest = XMVectorAdd(va, XMVectorScale(ab, d1 / (d1 - d3)));
+        }
+        else if (d6 >= 0.f && d5 <= d6)
+        {
+            closest = vc;
+        }
+        else if (vbArea <= 0.f && d2 >= 0.f && d6 <= 0.f)
+        {
+            closest = XMVectorAdd(va, XMVectorScale(ac, d2 / (d2 - d6)));
+        }
+        else if (vaArea <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+        {
+            closest = XMVectorAdd(vb, XMVectorScale(XMVectorSubtract(vc, vb), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+        }
+        else
+        {
+            const float denominator = 1.f / (vaArea + vbArea + vcArea);
+            closest = XMVectorAdd(va, XMVectorAdd(XMVectorScale(ab, vbArea * denominator), XMVectorScale(ac, vcArea * denominator)));
+        }
+        return XMVectorGetX(XMVector3Length(XMVectorSubtract(p, closest)));
+    }
+
+    size_t GetLodIndexCount(const MeshData& mesh, const MeshLod& lod)
+    {
+        size_t count = 0;
+        for (uint32_t s = lod.firstSubset; s < lod.firstSubset + lod.subsetCount; s++)
+        {
+            count += mesh.subsets[s].indexCount;
+        }
+        return count;
+    }
+
+    float GetBoundingRadius(const MeshData& mesh)
+    {
+        XMVECTOR minimum = XMVectorReplicate(1e30f);
+        XMVECTOR maximum = XMVectorReplicate(-1e30f);
+        for (const MeshVertex& vertex : mesh.vertices)
+        {
+            minimum = XMVectorMin(minimum, XMLoadFloat3(&vertex.position));
+            maximum = XMVectorMax(maximum, XMLoadFloat3(&vertex.position));
+        }
+        return 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(maximum, minimum)));
+    }
+
+    // Furthest that a sample of the full detail vertices lies from a level's surface
+    float MeasureLodDistance(const MeshData& mesh, const MeshLod& lod, size_t stride)
+    {
+        float furthest = 0.f;
+        const MeshLod& full = mesh.lods[0];
+        for (uint32_t s0 = full.firstSubset; s0 < full.firstSubset + full.subsetCount; s0++)
+        {
+            const MeshSubset& source = mesh.subsets[s0];
+            for (uint32_t i = source.firstIndex; i < source.firstIndex + source.indexCount; i += uint32_t(stride))
+            {
+                const XMFLOAT3& point = mesh.vertices[mesh.indices[i]].position;
+                float nearest = 1e30f;
+                for (uint32_t s = lod.firstSubset; s < lod.firstSubset + lod.subsetCount; s++)
+                {
+                    const MeshSubset& subset = mesh.subsets[s];
+                    for (uint32_t t = subset.firstIndex; t < subset.firstIndex + subset.indexCount; t += 3)
+                    {
+                        nearest = std::min(nearest, GetPointTriangleDistance(point, mesh.vertices[mesh.indices[t]].position,
+                            mesh.vertices[mesh.indices[t + 1]].position, mesh.vertices[mesh.indices[t + 2]].position));
+                    }
+                }
+                furthest = std::max(furthest, nearest);
+            }
+        }
+        return furthest;
+    }
+
+    // Levels after the first index the shared vertices, keep the materials of level 0, get coarser
+    // by at least 10% each and stay within the relative error bound
+    void CheckLods(const MeshData& mesh, const char* name)
+    {
+        if (!DX_CHECK(!mesh.lods.empty()))
+        {
+            return;
+        }
+        const float radius = GetBoundingRadius(mesh);
+
+        std::vector<uint32_t> materials;
+        for (uint32_t s = 0; s < mesh.lods[0].subsetCount; s++)
+        {
+            materials.push_back(mesh.subsets[mesh.lods[0].firstSubset + s].materialIndex);
+        }
+
+        uint32_t nextSubset = 0;
+        size_t previousCount = 0;
+        float previousError = 0.f;
+        bool inRange = true;
+        printf("  %-28s", name);
+        for (size_t l = 0; l < mesh.lods.size(); l++)
+        {
+            const MeshLod& lod = mesh.lods[l];
+            DX_CHECK(lod.firstSubset == nextSubset);
+            nextSubset = lod.firstSubset + lod.subsetCount;
+            DX_CHECK(nextSubset <= mesh.subsets.size());
+
+            for (uint32_t s = lod.firstSubset; s < lod.firstSubset + lod.subsetCount && s < mesh.subsets.size(); s++)
+            {
+                const MeshSubset& subset = mesh.subsets[s];
+                DX_CHECK(std::find(materials.begin(), materials.end(), subset.materialIndex) != materials.end());
+                for (uint32_t i = subset.firstIndex; i < subset.firstIndex + subset.indexCount; i++)
+                {
+                    inRange = inRange && i < mesh.indices.size() && mesh.indices[i] < mesh.vertices.size();
+                }
+            }
+
+            const size_t count = GetLodIndexCount(mesh, lod);
+            if (l == 0)
+            {
+                DX_CHECK(lod.error == 0.f);
+            }
+            else
+            {
+                DX_CHECK(count <= previousCount * 9 / 10);
+                DX_CHECK(lod.error >= previousError);
+                DX_CHECK(lod.error <= MaxRelativeError * radius * 1.0001f);
+            }
+            previousCount = count;
+            previousError = lod.error;
+            printf(" %6zu", count / 3);
+        }
+        DX_CHECK(nextSubset == mesh.subsets.size());
+        DX_CHECK(inRange);
+        printf(" triangles, error %.4f of %.3f radius\n", mesh.lods.back().error, radius);
+    }
+
+    void TestSphere()
+    {
+        MeshData sphere;
+        Tests::BuildSphere(64, sphere);
+        MeshSimplifier::BuildLods(sphere, 4, 0.5f, MaxRelativeError);
+        CheckLods(sphere, "64 segment sphere");
+
+        for (size_t l = 1; l < sphere.lods.size(); l++)
+        {
+            // The sphere's surface stays within a few times the reported error, and triangles
+            // never wrap across the UV seam
+            const MeshLod& lod = sphere.lods[l];
+            const float distance = MeasureLodDistance(sphere, lod, 5);
+            DX_CHECK(distance <= 0.5f * MaxRelativeError * 2.f);
+            float uvSpan = 0.f;
+            const MeshSubset& subset = sphere.subsets[lod.firstSubset];
+            for (uint32_t t = subset.firstIndex; t < subset.firstIndex + subset.indexCount; t += 3)
+            {
+                const float u0 = sphere.vertices[sphere.indices[t]].texture.x;
+                const float u1 = sphere.vertices[sphere.indices[t + 1]].texture.x;
+                const float u2 = sphere.vertices[sphere.indices[t + 2]].texture.x;
+                uvSpan = std::max(uvSpan, std::max(std::fabs(u0 - u1), std::max(std::fabs(u1 - u2), std::fabs(u0 - u2))));
+            }
+            DX_CHECK(uvSpan < 0.5f);
+            printf("    level %zu: error %.4f, measured %.4f, widest uv span %.3f\n", l, lod.error, distance, uvSpan);
+        }
+
+        // A limit on the error alone stops the chain
+        MeshData strict;
+        Tests::BuildSphere(64, strict);
+        MeshSimplifier::BuildLods(strict, 4, 0.5f, 1e-6f);
+        DX_CHECK(strict.lods.size() <= 1);
+    }
+
+    void TestCorpusFile(const char* filename)
+    {
+        ObjData obj;
+        if (!DX_CHECK(ObjLoader::LoadFile(filename, obj)))
+        {
+            fprintf(stderr, "  %s didn't load\n", filename);
+            return;
+        }
+        MeshData mesh;
+        MeshWelder::WeldObj(obj, mesh);
+        MtlLoader::ResolveMaterials(filename, obj, mesh.materials);
+
+        Tests::Stopwatch stopwatch;
+        MeshSimplifier::BuildLods(mesh, 3, 0.5f, MaxRelativeError);
+        const double seconds = stopwatch.GetSeconds();
+        CheckLods(mesh, Tests::GetFileName(filename));
+        if (mesh.lods.size() > 1 && GetLodIndexCount(mesh, mesh.lods.back()) < 3000 * 3)
+        {
+            printf("    measured %.4f in %.2f ms\n", MeasureLodDistance(mesh, mesh.lods.back(), 7), seconds * 1000.0);
+        }
+    }
+
+    // Levels switch coarser only below the hysteresis margin and finer as soon as they're over the threshold
+    void TestLodSelector()
+    {
+        const MeshLod levels[3] = { { 0, 1, 0.f, 0 }, { 1, 1, 0.01f, 0 }, { 2, 1, 0.04f, 0 } };
+        XMFLOAT4X4 projection;
+        memset(&projection, 0, sizeof(projection));
+        projection.m[1][1] = 1.f;
+        const float pixelScale = LodSelector::GetPixelScale(projection, 100.f);
+        DX_CHECK(pixelScale == 50.f);
+
+        // Level 1 is exactly 1 pixel at distance 0.5, level 2 at distance 2
+        LodSelector selector;
+        DX_CHECK(selector.Select(levels, 3, 1.f, 0.1f, pixelScale) == 0);
+        DX_CHECK(selector.Select(levels, 3, 1.f, 0.6f, pixelScale) == 0);
+        DX_CHECK(selector.Select(levels, 3, 1.f, 0.7f, pixelScale) == 1);
+        DX_CHECK(selector.Select(levels, 3, 1.f, 0.6f, pixelScale) == 1);
+        DX_CHECK(selector.Select(levels, 3, 1.f, 0.45f, pixelScale) == 0);
+        DX_CHECK(selector.Select(levels, 3, 1.f, 100.f, pixelScale) == 2);
+        DX_CHECK(selector.Select(levels, 3, 1.f, 2.1f, pixelScale) == 2);
+        DX_CHECK(selector.Select(levels, 3, 1.f, 1.9f, pixelScale) == 1);
+        DX_CHECK(selector.Select(levels, 3, 2.f, 0.9f, pixelScale) == 0);
+        DX_CHECK(selector.Select(levels, 1, 1.f, 100.f, pixelScale) == 0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    TestSphere();
+    for (int i = 1; i < argc; i++)
+    {
+        TestCorpusFile(argv[i]);
+    }
+    TestLodSelector();
+
+    return Tests::Finish("MeshSimplifierTests");
+}
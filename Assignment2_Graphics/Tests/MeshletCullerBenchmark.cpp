@@ -0,0 +1,88 @@
+//
+// MeshletCullerBenchmark.cpp - Clusters culled a millisecond, on one thread and on every thread of the job system
+//
+//   MeshletCullerBenchmark ground_block.obj [sphereSegments]
+//
+// The ground is culled from the game's starting camera, and a generated sphere (1024 segments
+// unless told otherwise, about a million triangles) from a camera a sphere's width from its centre.
+// All of it is in view but only a quarter faces the camera, the rest is left to the cone test.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "TestMeshes.h"
+#include "JobSystem.h"
+#include "MeshletCuller.h"
+
+#include <cstdlib>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    void XM_CALLCONV Measure(const char* name, const MeshData& mesh, FXMMATRIX world, CXMMATRIX viewProjection, FXMVECTOR cameraPosition)
+    {
+        size_t triangleCount = 0;
+        for (const Meshlet& meshlet : mesh.meshlets)
+        {
+            triangleCount += meshlet.triangleCount;
+        }
+        printf("  %s, %zu clusters, %zu triangles\n", name, mesh.meshlets.size(), triangleCount);
+
+        MeshletCuller culler;
+        for (unsigned int threadCount : { 1u, 0u })
+        {
+            // Best of the runs, the first sizes the index lists
+            culler.Cull(mesh.meshlets.data(), mesh.meshlets.size(), mesh.meshletVertices.data(), mesh.meshletTriangles.data(),
+                world, viewProjection, cameraPosition, threadCount);
+            double best = 1e30;
+            for (int run = 0; run < 20; run++)
+            {
+                Tests::Stopwatch stopwatch;
+                culler.Cull(mesh.meshlets.data(), mesh.meshlets.size(), mesh.meshletVertices.data(), mesh.meshletTriangles.data(),
+                    world, viewProjection, cameraPosition, threadCount);
+                best = std::min(best, stopwatch.GetSeconds());
+            }
+            const ClusterCullStats& stats = culler.GetStats();
+            printf("    %-11s: %.3f ms, %.0f clusters a millisecond, %u frustum and %u backface culled, %u triangles drawn\n",
+                threadCount == 1 ? "1 thread" : "all threads", best * 1000.0, mesh.meshlets.size() / (best * 1000.0),
+                stats.frustumCulled, stats.backfaceCulled, stats.triangleCount);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: MeshletCullerBenchmark ground_block.obj [sphereSegments]\n");
+        return 1;
+    }
+    const int segments = argc > 2 ? int(strtoul(argv[2], nullptr, 10)) : 1024;
+
+    MeshData ground;
+    if (!Tests::LoadModel(argv[1], ground))
+    {
+        fprintf(stderr, "%s didn't load\n", argv[1]);
+        return 1;
+    }
+    MeshData sphere;
+    Tests::BuildSphere(segments, sphere);
+    MeshletBuilder::Build(sphere);
+
+    printf("MeshletCullerBenchmark, %u threads\n", JobSystem::Get().GetThreadCount());
+
+    // The game's ground node and starting camera, looking down +z
+    const XMVECTOR eye = XMVectorSet(2.f, -10.f, -1.5f, 1.f);
+    const XMMATRIX groundView = XMMatrixLookToRH(eye, XMVectorSet(0.f, 0.f, 1.f, 0.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+    const XMMATRIX projection = XMMatrixPerspectiveFovRH(XMConvertToRadians(70.f), 16.f / 9.f, .01f, 100.f);
+    Measure(Tests::GetFileName(argv[1]), ground, XMMatrixTranslation(0.f, -10.f, 0.f), XMMatrixMultiply(groundView, projection), eye);
+
+    const XMVECTOR sphereEye = XMVectorSet(0.f, 0.f, -1.f, 1.f);
+    const XMMATRIX sphereView = XMMatrixLookAtRH(sphereEye, XMVectorZero(), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+    char name[64];
+    sprintf_s(name, "%d segment sphere", segments);
+    Measure(name, sphere, XMMatrixIdentity(), XMMatrixMultiply(sphereView, projection), sphereEye);
+    return 0;
+}
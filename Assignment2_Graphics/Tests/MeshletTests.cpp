@@ -0,0 +1,272 @@
+//
+// MeshletTests.cpp - Cluster limits, bounding spheres and normal cones of the game's models and a sphere,
+// and culling split between threads
+//
+//   MeshletTests model.obj...
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "TestMeshes.h"
+#include "MeshletCuller.h"
+
+#include <array>
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    // Material and corners of a triangle, rotated to start at its smallest index so the same
+    // triangle compares equal whichever corner a list starts it on
+    std::array<uint32_t, 4> GetTriangle(uint32_t materialIndex, uint32_t a, uint32_t b, uint32_t c)
+    {
+        if (b < a && b < c)
+        {
+            return { { materialIndex, b, c, a } };
+        }
+        if (c < a && c < b)
+        {
+            return { { materialIndex, c, a, b } };
+        }
+        return { { materialIndex, a, b, c } };
+    }
+
+    // Every cluster is within the limits, its sphere holds its vertices and together the clusters
+    // hold exactly the full detail triangles
+    void CheckClusters(const MeshData& mesh)
+    {
+        DX_CHECK(!mesh.meshlets.empty());
+        bool withinLimits = true;
+        bool inRange = true;
+        bool enclosed = true;
+        std::vector<std::array<uint32_t, 4>> clustered;
+        for (const Meshlet& meshlet : mesh.meshlets)
+        {
+            withinLimits = withinLimits && meshlet.vertexCount <= MeshletBuilder::MaxVertices && meshlet.triangleCount <= MeshletBuilder::MaxTriangles;
+            withinLimits = withinLimits && meshlet.vertexCount >= 3 && meshlet.triangleCount > 0;
+            if (meshlet.vertexOffset + meshlet.vertexCount > mesh.meshletVertices.size() ||
+                meshlet.triangleOffset + meshlet.triangleCount * 3 > mesh.meshletTriangles.size())
+            {
+                inRange = false;
+                continue;
+            }
+
+            const uint32_t* vertices = &mesh.meshletVertices[meshlet.vertexOffset];
+            const uint8_t* triangles = &mesh.meshletTriangles[meshlet.triangleOffset];
+            for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+            {
+                inRange = inRange && vertices[v] < mesh.vertices.size();
+                if (inRange)
+                {
+                    const XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&mesh.vertices[vertices[v]].position), XMLoadFloat3(&meshlet.center));
+                    enclosed = enclosed && XMVectorGetX(XMVector3Length(offset)) <= meshlet.radius * 1.0001f + 1e-6f;
+                }
+            }
+            for (uint32_t i = 0; i < meshlet.triangleCount * 3; i += 3)
+            {
+                inRange = inRange && triangles[i] < meshlet.vertexCount && triangles[i + 1] < meshlet.vertexCount && triangles[i + 2] < meshlet.vertexCount;
+                if (inRange)
+                {
+                    clustered.push_back(GetTriangle(meshlet.materialIndex, vertices[triangles[i]], vertices[triangles[i + 1]], vertices[triangles[i + 2]]));
+                }
+            }
+        }
+        DX_CHECK(withinLimits);
+        DX_CHECK(inRange);
+        DX_CHECK(enclosed);
+
+        std::vector<std::array<uint32_t, 4>> expected;
+        const uint32_t firstSubset = mesh.lods.empty() ? 0 : mesh.lods[0].firstSubset;
+        const uint32_t subsetCount = mesh.lods.empty() ? uint32_t(mesh.subsets.size()) : mesh.lods[0].subsetCount;
+        for (uint32_t s = firstSubset; s < firstSubset + subsetCount; s++)
+        {
+            const MeshSubset& subset = mesh.subsets[s];
+            for (uint32_t i = subset.firstIndex; i < subset.firstIndex + subset.indexCount; i += 3)
+            {
+                expected.push_back(GetTriangle(subset.materialIndex, mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2]));
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        std::sort(clustered.begin(), clustered.end());
+        DX_CHECK(clustered == expected);
+    }
+
+    // A cluster the cone test rejects has no triangle facing the camera. Facing is worked out in
+    // world space from the winding, apart from the culler's object space camera. Returns how many
+    // clusters were rejected and how many were tested past the frustum.
+    void CheckCones(const MeshData& mesh, FXMMATRIX world, CXMMATRIX viewProjection, FXMVECTOR cameraPosition,
+        size_t& backfaceCulled, size_t& tested)
+    {
+        MeshletCuller culler;
+        bool backFacing = true;
+        for (const Meshlet& meshlet : mesh.meshlets)
+        {
+            culler.Cull(&meshlet, 1, mesh.meshletVertices.data(), mesh.meshletTriangles.data(), world, viewProjection, cameraPosition, 1);
+            if (culler.GetStats().frustumCulled != 0)
+            {
+                continue;
+            }
+            tested++;
+            if (culler.GetStats().backfaceCulled == 0)
+            {
+                continue;
+            }
+            backfaceCulled++;
+
+            const uint32_t* vertices = &mesh.meshletVertices[meshlet.vertexOffset];
+            const uint8_t* triangles = &mesh.meshletTriangles[meshlet.triangleOffset];
+            for (uint32_t i = 0; i < meshlet.triangleCount * 3; i += 3)
+            {
+                const XMVECTOR p0 = XMVector3Transform(XMLoadFloat3(&mesh.vertices[vertices[triangles[i]]].position), world);
+                const XMVECTOR p1 = XMVector3Transform(XMLoadFloat3(&mesh.vertices[vertices[triangles[i + 1]]].position), world);
+                const XMVECTOR p2 = XMVector3Transform(XMLoadFloat3(&mesh.vertices[vertices[triangles[i + 2]]].position), world);
+                const XMVECTOR normal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+                const XMVECTOR toCamera = XMVectorSubtract(cameraPosition, p0);
+                const float margin = 1e-4f * XMVectorGetX(XMVector3Length(normal)) * XMVectorGetX(XMVector3Length(toCamera));
+                backFacing = backFacing && XMVectorGetX(XMVector3Dot(normal, toCamera)) <= margin;
+            }
+        }
+        DX_CHECK(backFacing);
+    }
+
+    // Cameras all around the mesh, near and far, under a random rotation, scale and translation
+    void CheckConesFromRandomCameras(const MeshData& mesh, int cameraCount, size_t& backfaceCulled, size_t& tested)
+    {
+        XMVECTOR boundsMin = XMVectorReplicate(1e30f);
+        XMVECTOR boundsMax = XMVectorReplicate(-1e30f);
+        for (const MeshVertex& vertex : mesh.vertices)
+        {
+            boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&vertex.position));
+            boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&vertex.position));
+        }
+        const float radius = std::max(.01f, 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(boundsMax, boundsMin))));
+
+        for (int camera = 0; camera < cameraCount; camera++)
+        {
+            const float scale = Random(.5f, 3.f);
+            const XMMATRIX world = XMMatrixMultiply(XMMatrixMultiply(XMMatrixScaling(scale, scale, scale),
+                XMMatrixMultiply(XMMatrixRotationX(Random(-XM_PI, XM_PI)), XMMatrixRotationY(Random(-XM_PI, XM_PI)))),
+                XMMatrixTranslation(Random(-20.f, 20.f), Random(-20.f, 20.f), Random(-20.f, 20.f)));
+            const XMVECTOR target = XMVector3Transform(XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f), world);
+            const XMVECTOR direction = XMVector3Normalize(XMVectorSet(Random(-1.f, 1.f), Random(-1.f, 1.f), Random(-1.f, 1.f), 0.f));
+            const XMVECTOR eye = XMVectorMultiplyAdd(direction, XMVectorReplicate(radius * scale * Random(.3f, 5.f)), target);
+            const XMMATRIX viewProjection = XMMatrixMultiply(XMMatrixLookAtRH(eye, target, XMVectorSet(0.f, 1.f, 0.f, 0.f)),
+                XMMatrixPerspectiveFovRH(2.5f, 1.f, .001f, 1000.f));
+            CheckCones(mesh, world, viewProjection, eye, backfaceCulled, tested);
+        }
+    }
+
+    void TestCorpusFile(const char* filename, size_t& backfaceCulled, size_t& tested)
+    {
+        MeshData mesh;
+        if (!DX_CHECK(LoadModel(filename, mesh)))
+        {
+            return;
+        }
+        CheckClusters(mesh);
+        CheckConesFromRandomCameras(mesh, 10, backfaceCulled, tested);
+
+        size_t triangleCount = 0;
+        for (const Meshlet& meshlet : mesh.meshlets)
+        {
+            triangleCount += meshlet.triangleCount;
+        }
+        printf("  %s: %zu clusters, %.1f triangles each\n", GetFileName(filename), mesh.meshlets.size(),
+            mesh.meshlets.empty() ? 0.0 : double(triangleCount) / double(mesh.meshlets.size()));
+    }
+
+    // A closed sphere seen from outside loses close to half its clusters to the cone test, none wrongly
+    void TestSphere()
+    {
+        MeshData sphere;
+        BuildSphere(128, sphere);
+        MeshletBuilder::Build(sphere);
+        CheckClusters(sphere);
+
+        size_t backfaceCulled = 0;
+        size_t tested = 0;
+        for (int camera = 0; camera < 10; camera++)
+        {
+            const XMVECTOR eye = XMVectorScale(XMVector3Normalize(XMVectorSet(Random(-1.f, 1.f), Random(-1.f, 1.f), Random(-1.f, 1.f), 0.f)), 20.f);
+            const XMMATRIX viewProjection = XMMatrixMultiply(XMMatrixLookAtRH(eye, XMVectorZero(), XMVectorSet(0.f, 1.f, 0.f, 0.f)),
+                XMMatrixPerspectiveFovRH(.5f, 1.f, .1f, 100.f));
+            CheckCones(sphere, XMMatrixIdentity(), viewProjection, eye, backfaceCulled, tested);
+        }
+        DX_CHECK(tested == sphere.meshlets.size() * 10);
+        DX_CHECK(backfaceCulled > tested / 4);
+        printf("  sphere: %zu clusters, %.0f%% backface culled\n", sphere.meshlets.size(), 100.0 * double(backfaceCulled) / double(tested));
+    }
+
+    bool SameSubsets(const std::vector<MeshSubset>& a, const std::vector<MeshSubset>& b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (a[i].materialIndex != b[i].materialIndex || a[i].firstIndex != b[i].firstIndex || a[i].indexCount != b[i].indexCount)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Splitting the clusters between jobs gives the same draw as culling them on one thread. The
+    // sphere is two materials, one a hemisphere, so draw ranges continue across the split points.
+    void TestThreads()
+    {
+        MeshData sphere;
+        BuildSphere(600, sphere);
+        const uint32_t half = sphere.subsets[0].indexCount / 6 * 3;
+        sphere.subsets = { { 0, 0, half, 0 }, { 1, half, sphere.subsets[0].indexCount - half, 0 } };
+        MeshletBuilder::Build(sphere);
+        DX_CHECK(sphere.meshlets.size() >= MeshletCuller::MinMeshletsPerJob * 3);
+
+        const XMMATRIX world = XMMatrixTranslation(0.f, 0.f, 1.f);
+        for (int camera = 0; camera < 5; camera++)
+        {
+            const XMVECTOR eye = XMVectorSet(Random(-1.f, 1.f), Random(-1.f, 1.f), Random(-1.5f, 0.f), 1.f);
+            const XMMATRIX viewProjection = XMMatrixMultiply(XMMatrixLookToRH(eye, XMVectorSet(Random(-.3f, .3f), Random(-.3f, .3f), 1.f, 0.f),
+                XMVectorSet(0.f, 1.f, 0.f, 0.f)), XMMatrixPerspectiveFovRH(Random(.3f, 1.5f), 16.f / 9.f, .01f, 100.f));
+
+            MeshletCuller single;
+            single.Cull(sphere.meshlets.data(), sphere.meshlets.size(), sphere.meshletVertices.data(), sphere.meshletTriangles.data(),
+                world, viewProjection, eye, 1);
+            DX_CHECK(single.GetStats().clusterCount == sphere.meshlets.size());
+            for (unsigned int threadCount : { 3u, 0u })
+            {
+                MeshletCuller split;
+                split.Cull(sphere.meshlets.data(), sphere.meshlets.size(), sphere.meshletVertices.data(), sphere.meshletTriangles.data(),
+                    world, viewProjection, eye, threadCount);
+                DX_CHECK(split.GetIndices() == single.GetIndices());
+                DX_CHECK(SameSubsets(split.GetSubsets(), single.GetSubsets()));
+                DX_CHECK(split.GetStats().frustumCulled == single.GetStats().frustumCulled);
+                DX_CHECK(split.GetStats().backfaceCulled == single.GetStats().backfaceCulled);
+                DX_CHECK(split.GetStats().triangleCount == single.GetStats().triangleCount);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    SeedRandom(9);
+    TestSphere();
+    TestThreads();
+
+    DX_CHECK(argc > 1);
+    size_t backfaceCulled = 0;
+    size_t tested = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        TestCorpusFile(argv[i], backfaceCulled, tested);
+    }
+    DX_CHECK(backfaceCulled > 0);
+    printf("  models: %zu of %zu clusters in view backface culled\n", backfaceCulled, tested);
+
+    return Tests::Finish("MeshletTests");
+}
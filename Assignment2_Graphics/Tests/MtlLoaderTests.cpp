@@ -0,0 +1,222 @@
+//
+// MtlLoaderTests.cpp - MTL parsing, the material table resolved for each corpus model and its subsets
+//
+//   MtlLoaderTests model.obj...
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "MeshWelder.h"
+#include "MtlLoader.h"
+
+#include <cstring>
+#include <string>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    bool SameColor(const XMFLOAT3& a, float r, float g, float b)
+    {
+        return a.x == r && a.y == g && a.z == b;
+    }
+
+    bool SameProperties(const MeshMaterial& a, const MeshMaterial& b)
+    {
+        return memcmp(&a.ambient, &b.ambient, offsetof(MeshMaterial, reserved) - offsetof(MeshMaterial, ambient)) == 0;
+    }
+
+    bool ParseText(const char* text, std::vector<MeshMaterial>& materials)
+    {
+        return MtlLoader::Parse(text, strlen(text), materials);
+    }
+
+    void WriteFile(const char* filename, const char* text)
+    {
+        FILE* file = fopen(filename, "wb");
+        if (DX_CHECK(file != nullptr))
+        {
+            fwrite(text, 1, strlen(text), file);
+            fclose(file);
+        }
+    }
+
+    void TestParse()
+    {
+        std::vector<MeshMaterial> materials;
+        DX_CHECK(ParseText(
+            "# Blender MTL File\r\n"
+            "Kd 0.5 0.5 0.5\r\n"
+            "\r\n"
+            "newmtl first  \r\n"
+            "\tNs 96.078431\r\n"
+            "Ka 0.1 0.2 0.3\r\n"
+            "Kd 0.4 0.5 0.6\r\n"
+            "Ks 0.25\r\n"
+            "Ke 9 9 9\r\n"
+            "map_Kd first.png\r\n"
+            "d 0.75\r\n"
+            "illum 2\r\n"
+            "newmtl second\n"
+            "Tr 0.25\n"
+            "newmtl a_name_that_is_far_longer_than_the_sixty_three_characters_a_material_holds\n"
+            "Kd 1 0 0", materials));
+        DX_CHECK(materials.size() == 3);
+        if (materials.size() != 3)
+        {
+            return;
+        }
+
+        // Colours before the first newmtl belong to no material, Ke and map_Kd aren't Ks and Kd
+        const MeshMaterial& first = materials[0];
+        DX_CHECK(strcmp(first.name, "first") == 0);
+        DX_CHECK(SameColor(first.ambient, .1f, .2f, .3f));
+        DX_CHECK(SameColor(first.diffuse, .4f, .5f, .6f));
+        DX_CHECK(SameColor(first.specular, .25f, .25f, .25f));
+        DX_CHECK(first.specularPower == 96.078431f);
+        DX_CHECK(first.opacity == .75f);
+
+        // Anything a block doesn't set keeps the default
+        const MeshMaterial defaults = MtlLoader::GetDefaultMaterial("second");
+        DX_CHECK(strcmp(materials[1].name, "second") == 0);
+        DX_CHECK(SameColor(materials[1].diffuse, 1.f, 1.f, 1.f));
+        DX_CHECK(SameColor(materials[1].ambient, defaults.ambient.x, defaults.ambient.y, defaults.ambient.z));
+        DX_CHECK(materials[1].opacity == .75f);
+
+        DX_CHECK(strlen(materials[2].name) == sizeof(materials[2].name) - 1);
+        DX_CHECK(strncmp(materials[2].name, "a_name_that_is_far_longer", 25) == 0);
+        DX_CHECK(SameColor(materials[2].diffuse, 1.f, 0.f, 0.f));
+
+        // Parse appends, and a value that isn't a number fails the file
+        DX_CHECK(ParseText("newmtl third\n", materials) && materials.size() == 4);
+        DX_CHECK(!ParseText("newmtl bad\nKd red\n", materials));
+        DX_CHECK(ParseText("", materials));
+    }
+
+    // Unknown names and missing libraries fall back to the default, and identical materials share an entry
+    void TestResolveFallbacks()
+    {
+        WriteFile("MtlLoaderTests.mtl",
+            "newmtl red\nKd 1 0 0\n"
+            "newmtl alsoRed\nKd 1 0 0\n"
+            "newmtl blue\nKd 0 0 1\n");
+        const char* text =
+            "mtllib MtlLoaderTests.mtl\n"
+            "mtllib missing.mtl\n"
+            "v 0 0 0\nv 1 0 0\nv 0 1 0\n"
+            "f 1 2 3\n"
+            "usemtl red\nf 1 2 3\n"
+            "usemtl blue\nf 1 2 3\n"
+            "usemtl alsoRed\nf 1 2 3\n"
+            "usemtl undefined\nf 1 2 3\n";
+        ObjData obj;
+        if (!DX_CHECK(ObjLoader::Parse(text, strlen(text), obj, 1)))
+        {
+            return;
+        }
+
+        std::vector<MeshMaterial> materials;
+        MtlLoader::ResolveMaterials("./MtlLoaderTests.obj", obj, materials);
+        remove("MtlLoaderTests.mtl");
+
+        // The faces before any usemtl and the undefined name are both white, red is shared
+        DX_CHECK(materials.size() == 3);
+        DX_CHECK(obj.triangleMaterials.size() == 5);
+        if (materials.size() != 3 || obj.triangleMaterials.size() != 5)
+        {
+            return;
+        }
+        const std::vector<uint32_t>& t = obj.triangleMaterials;
+        DX_CHECK(t[0] == t[4]);
+        DX_CHECK(t[1] == t[3]);
+        DX_CHECK(t[0] != t[1] && t[1] != t[2] && t[0] != t[2]);
+        DX_CHECK(SameProperties(materials[t[0]], MtlLoader::GetDefaultMaterial("")));
+        DX_CHECK(SameColor(materials[t[1]].diffuse, 1.f, 0.f, 0.f));
+        DX_CHECK(SameColor(materials[t[2]].diffuse, 0.f, 0.f, 1.f));
+
+        // Welding gives one subset per entry, whatever order the faces came in
+        MeshData mesh;
+        MeshWelder::WeldObj(obj, mesh);
+        DX_CHECK(mesh.subsets.size() == 3);
+        uint32_t covered = 0;
+        for (const MeshSubset& subset : mesh.subsets)
+        {
+            DX_CHECK(subset.firstIndex == covered);
+            DX_CHECK(subset.indexCount == 3 * uint32_t(std::count(t.begin(), t.end(), subset.materialIndex)));
+            covered += subset.indexCount;
+        }
+    }
+
+    // Each triangle ends up with the properties its usemtl name has in the model's libraries
+    void TestCorpusFile(const char* filename)
+    {
+        ObjData obj;
+        if (!DX_CHECK(ObjLoader::LoadFile(filename, obj)))
+        {
+            return;
+        }
+        const std::vector<uint32_t> names = obj.triangleMaterials;
+
+        std::string directory(filename);
+        const size_t separator = directory.find_last_of("/\\");
+        directory.erase(separator == std::string::npos ? 0 : separator + 1);
+        std::vector<MeshMaterial> library;
+        for (const std::string& libraryName : obj.materialLibraries)
+        {
+            DX_CHECK(MtlLoader::LoadFile((directory + libraryName).c_str(), library));
+        }
+
+        std::vector<MeshMaterial> materials;
+        MtlLoader::ResolveMaterials(filename, obj, materials);
+        DX_CHECK(!materials.empty());
+        for (size_t a = 0; a < materials.size(); a++)
+        {
+            for (size_t b = a + 1; b < materials.size(); b++)
+            {
+                DX_CHECK(!SameProperties(materials[a], materials[b]));
+            }
+        }
+
+        bool resolved = true;
+        for (size_t t = 0; t < names.size(); t++)
+        {
+            MeshMaterial expected = MtlLoader::GetDefaultMaterial("");
+            for (const MeshMaterial& candidate : library)
+            {
+                if (obj.materialNames[names[t]] == candidate.name)
+                {
+                    expected = candidate;
+                    break;
+                }
+            }
+            resolved = resolved && obj.triangleMaterials[t] < materials.size() && SameProperties(materials[obj.triangleMaterials[t]], expected);
+        }
+        DX_CHECK(resolved);
+
+        MeshData mesh;
+        MeshWelder::WeldObj(obj, mesh);
+        std::vector<uint32_t> seen;
+        for (const MeshSubset& subset : mesh.subsets)
+        {
+            DX_CHECK(subset.materialIndex < materials.size());
+            DX_CHECK(std::find(seen.begin(), seen.end(), subset.materialIndex) == seen.end());
+            seen.push_back(subset.materialIndex);
+        }
+        printf("  %s: %zu usemtl names, %zu materials, %zu subsets\n", Tests::GetFileName(filename), obj.materialNames.size(),
+            materials.size(), mesh.subsets.size());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    TestParse();
+    TestResolveFallbacks();
+    DX_CHECK(argc > 1);
+    for (int i = 1; i < argc; i++)
+    {
+        TestCorpusFile(argv[i]);
+    }
+
+    return Tests::Finish("MtlLoaderTests");
+}
@@ -0,0 +1,132 @@
+//
+// ObjLoaderBenchmark.cpp - OBJ parsing throughput on the game's models and on a large generated file
+//
+//   ObjLoaderBenchmark [--synthetic-mb N] model.obj...
+//
+// The generated file (500 MB unless --synthetic-mb says otherwise, 0 skips it) is written to the
+// working directory and removed afterwards.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "JobSystem.h"
+#include "MappedFile.h"
+#include "ObjLoader.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+using namespace DX;
+
+namespace
+{
+    const char* const SyntheticFilename = "ObjLoaderBenchmark.obj";
+
+    // Best of a few loads, in seconds
+    double TimeLoad(const char* filename, unsigned int threadCount, int repeats, ObjData& data)
+    {
+        double best = 1e30;
+        for (int i = 0; i < repeats; i++)
+        {
+            Tests::Stopwatch stopwatch;
+            if (!ObjLoader::LoadFile(filename, data, threadCount))
+            {
+                return 0.0;
+            }
+            best = std::min(best, stopwatch.GetSeconds());
+        }
+        return best;
+    }
+
+    void Report(const char* filename, int repeats)
+    {
+        MappedFile file;
+        if (!file.Open(filename))
+        {
+            fprintf(stderr, "  can't open %s\n", filename);
+            return;
+        }
+        const double megabytes = double(file.GetSize()) / (1024.0 * 1024.0);
+        file.Close();
+
+        ObjData data;
+        const double single = TimeLoad(filename, 1, repeats, data);
+        const double threaded = TimeLoad(filename, 0, repeats, data);
+        if (single <= 0.0 || threaded <= 0.0)
+        {
+            fprintf(stderr, "  %s didn't load\n", filename);
+            return;
+        }
+        printf("  %-28s %9.2f MB %8zu triangles %9.1f MB/s (1 thread) %9.1f MB/s (%u threads)\n", Tests::GetFileName(filename),
+            megabytes, data.faces.size() / 9, megabytes / single, megabytes / threaded, JobSystem::Get().GetThreadCount());
+    }
+
+    // A grid of triangles written as an exporter would, until the file reaches the requested size
+    bool WriteSyntheticFile(const char* filename, size_t megabytes)
+    {
+        FILE* file = fopen(filename, "wb");
+        if (!file)
+        {
+            return false;
+        }
+
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> coordinate(-100.f, 100.f);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        const size_t target = megabytes * 1024 * 1024;
+        size_t written = 0;
+        unsigned int vertexCount = 0;
+        char line[256];
+        fputs("mtllib synthetic.mtl\nusemtl synthetic\n", file);
+        while (written < target)
+        {
+            // A block of vertices then the triangles between them, so indices stay local
+            for (int i = 0; i < 3; i++)
+            {
+                int length = snprintf(line, sizeof(line), "v %f %f %f\n", coordinate(random), coordinate(random), coordinate(random));
+                length += snprintf(line + length, sizeof(line) - length, "vt %f %f\n", unit(random), unit(random));
+                length += snprintf(line + length, sizeof(line) - length, "vn %f %f %f\n", unit(random), unit(random), unit(random));
+                fwrite(line, 1, size_t(length), file);
+                written += size_t(length);
+            }
+            vertexCount += 3;
+            const int length = snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\n", vertexCount - 2, vertexCount - 2,
+                vertexCount - 2, vertexCount - 1, vertexCount - 1, vertexCount - 1, vertexCount, vertexCount, vertexCount);
+            fwrite(line, 1, size_t(length), file);
+            written += size_t(length);
+        }
+
+        return fclose(file) == 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t syntheticMegabytes = 500;
+    printf("ObjLoaderBenchmark, %u threads\n", JobSystem::Get().GetThreadCount());
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--synthetic-mb") == 0 && i + 1 < argc)
+        {
+            syntheticMegabytes = size_t(strtoul(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            Report(argv[i], 20);
+        }
+    }
+
+    if (syntheticMegabytes > 0)
+    {
+        if (!WriteSyntheticFile(SyntheticFilename, syntheticMegabytes))
+        {
+            fprintf(stderr, "can't write %s\n", SyntheticFilename);
+            return 1;
+        }
+        Report(SyntheticFilename, 3);
+        remove(SyntheticFilename);
+    }
+
+    return 0;
+}
@@ -0,0 +1,288 @@
+//
+// ObjLoaderTests.cpp - OBJ parsing over the game's models against a reference parser, and the face grammar
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "ObjLoader.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    // What the game's loader did before the memory mapped one: whitespace separated records read
+    // with scanf, and triangles of v/vt/vn corners only. Returns false for anything else.
+    bool ParseReference(const char* filename, ObjData& data)
+    {
+        FILE* file = fopen(filename, "r");
+        if (!file)
+        {
+            return false;
+        }
+
+        bool result = true;
+        char header[128];
+        while (result && fscanf(file, "%127s", header) == 1)
+        {
+            if (strcmp(header, "v") == 0)
+            {
+                XMFLOAT3 position;
+                result = fscanf(file, "%f %f %f", &position.x, &position.y, &position.z) == 3;
+                data.positions.push_back(position);
+            }
+            else if (strcmp(header, "vt") == 0)
+            {
+                XMFLOAT2 texCoord;
+                result = fscanf(file, "%f %f", &texCoord.x, &texCoord.y) == 2;
+                data.texCoords.push_back(texCoord);
+            }
+            else if (strcmp(header, "vn") == 0)
+            {
+                XMFLOAT3 normal;
+                result = fscanf(file, "%f %f %f", &normal.x, &normal.y, &normal.z) == 3;
+                data.normals.push_back(normal);
+            }
+            else if (strcmp(header, "f") == 0)
+            {
+                unsigned int corners[9];
+                result = fscanf(file, "%u/%u/%u %u/%u/%u %u/%u/%u", &corners[0], &corners[1], &corners[2], &corners[3], &corners[4],
+                    &corners[5], &corners[6], &corners[7], &corners[8]) == 9;
+                data.faces.insert(data.faces.end(), corners, corners + 9);
+
+                // A fourth corner is a polygon the old parser misread
+                int c;
+                while (result && (c = fgetc(file)) != EOF && c != '\n')
+                {
+                    result = isspace(c) != 0;
+                }
+            }
+            else
+            {
+                // Comments, groups, materials and smoothing groups take the rest of the line
+                int c;
+                while ((c = fgetc(file)) != EOF && c != '\n')
+                {
+                }
+            }
+        }
+
+        fclose(file);
+        return result;
+    }
+
+    template <typename T>
+    bool SameBits(const std::vector<T>& a, const std::vector<T>& b)
+    {
+        return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+    }
+
+    bool SameData(const ObjData& a, const ObjData& b)
+    {
+        return SameBits(a.positions, b.positions) && SameBits(a.texCoords, b.texCoords) && SameBits(a.normals, b.normals) &&
+            a.faces == b.faces && a.materialLibraries == b.materialLibraries && a.materialNames == b.materialNames &&
+            a.triangleMaterials == b.triangleMaterials;
+    }
+
+    // Every index in range, one material per triangle
+    void CheckConsistent(const ObjData& data)
+    {
+        DX_CHECK(data.faces.size() % 9 == 0);
+        const size_t counts[3] = { data.positions.size(), data.texCoords.size(), data.normals.size() };
+        bool inRange = true;
+        for (size_t i = 0; i < data.faces.size(); i++)
+        {
+            inRange = inRange && data.faces[i] >= 1 && data.faces[i] <= counts[i % 3];
+        }
+        DX_CHECK(inRange);
+        DX_CHECK(data.triangleMaterials.size() == data.faces.size() / 9);
+        bool materialsInRange = true;
+        for (uint32_t material : data.triangleMaterials)
+        {
+            materialsInRange = materialsInRange && material < std::max<size_t>(data.materialNames.size(), 1);
+        }
+        DX_CHECK(materialsInRange);
+    }
+
+    bool ParseText(const char* text, ObjData& data)
+    {
+        return ObjLoader::Parse(text, strlen(text), data, 1);
+    }
+
+    float GetTriangleArea(const ObjData& data, size_t triangle)
+    {
+        const XMFLOAT3& a = data.positions[data.faces[triangle * 9] - 1];
+        const XMFLOAT3& b = data.positions[data.faces[triangle * 9 + 3] - 1];
+        const XMFLOAT3& c = data.positions[data.faces[triangle * 9 + 6] - 1];
+        const XMVECTOR cross = XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&b), XMLoadFloat3(&a)), XMVectorSubtract(XMLoadFloat3(&c), XMLoadFloat3(&a)));
+        return 0.5f * XMVectorGetX(XMVector3Length(cross));
+    }
+
+    void TestCorpusFile(const char* filename)
+    {
+        ObjData loaded;
+        if (!DX_CHECK(ObjLoader::LoadFile(filename, loaded, 1)))
+        {
+            fprintf(stderr, "  %s didn't load\n", filename);
+            return;
+        }
+        CheckConsistent(loaded);
+        DX_CHECK(!loaded.faces.empty());
+
+        // Where a model is all triangles of v/vt/vn corners the old parser reads it too, and the two
+        // must agree to the bit
+        ObjData reference;
+        const bool triangles = ParseReference(filename, reference);
+        if (triangles)
+        {
+            DX_CHECK(SameBits(loaded.positions, reference.positions));
+            DX_CHECK(SameBits(loaded.texCoords, reference.texCoords));
+            DX_CHECK(SameBits(loaded.normals, reference.normals));
+            DX_CHECK(loaded.faces == reference.faces);
+        }
+
+        // The chunks parsed as jobs merge into what one thread reads
+        ObjData threaded;
+        DX_CHECK(ObjLoader::LoadFile(filename, threaded, 0));
+        DX_CHECK(SameData(loaded, threaded));
+
+        // Windows line endings and a last line without one read the same
+        MappedFile file;
+        DX_CHECK(file.Open(filename));
+        std::string text;
+        for (size_t i = 0; i < file.GetSize(); i++)
+        {
+            if (file.GetData()[i] == '\n')
+            {
+                text += '\r';
+            }
+            text += file.GetData()[i];
+        }
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+        {
+            text.pop_back();
+        }
+        ObjData crlf;
+        DX_CHECK(ObjLoader::Parse(text.data(), text.size(), crlf, 1));
+        DX_CHECK(SameData(loaded, crlf));
+
+        printf("  %-28s %6zu positions %6zu triangles %2zu materials%s\n", Tests::GetFileName(filename), loaded.positions.size(),
+            loaded.faces.size() / 9, loaded.materialNames.size(), triangles ? ", matches the old parser" : "");
+    }
+
+    void TestFaceGrammar()
+    {
+        // Polygons of any size are split into triangles, missing texcoords and normals filled in
+        ObjData quad;
+        DX_CHECK(ParseText("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nf 1 2 3 4\n", quad));
+        DX_CHECK(quad.faces.size() == 2 * 9);
+        DX_CHECK(!quad.texCoords.empty() && !quad.normals.empty());
+        CheckConsistent(quad);
+        for (size_t i = 0; i < quad.normals.size(); i++)
+        {
+            DX_CHECK(std::fabs(quad.normals[i].z) > 0.999f);
+        }
+
+        // Negative indices count back from the last attribute read so far
+        ObjData relative;
+        DX_CHECK(ParseText("v 0 0 0\nv 1 0 0\nv 1 1 0\nvn 0 0 1\nf -3//-1 -2//-1 -1//-1 # comment\n", relative));
+        DX_CHECK(relative.faces.size() == 9);
+        CheckConsistent(relative);
+        if (relative.faces.size() == 9)
+        {
+            DX_CHECK(relative.faces[0] == 1 && relative.faces[3] == 2 && relative.faces[6] == 3);
+            DX_CHECK(relative.faces[2] == 1 && relative.faces[5] == 1 && relative.faces[8] == 1);
+        }
+
+        ObjData texturedOnly;
+        DX_CHECK(ParseText("v 0 0 0\nv 1 0 0\nv 1 1 0\nvt 0 0\nvt 1 0\nvt 1 1\nf 1/1 2/2 3/3\n", texturedOnly));
+        DX_CHECK(texturedOnly.faces.size() == 9);
+        CheckConsistent(texturedOnly);
+        if (texturedOnly.faces.size() == 9)
+        {
+            DX_CHECK(texturedOnly.faces[1] == 1 && texturedOnly.faces[4] == 2 && texturedOnly.faces[7] == 3);
+        }
+
+        // A concave polygon is ear clipped, its triangles cover exactly its area (3 here)
+        ObjData concave;
+        DX_CHECK(ParseText("v 0 0 0\nv 2 0 0\nv 2 2 0\nv 1 1 0\nv 0 2 0\nf 1 2 3 4 5\n", concave));
+        DX_CHECK(concave.faces.size() == 3 * 9);
+        float area = 0.f;
+        for (size_t i = 0; i < concave.faces.size() / 9; i++)
+        {
+            area += GetTriangleArea(concave, i);
+        }
+        DX_CHECK(std::fabs(area - 3.f) < 1e-5f);
+
+        // Records the game doesn't use are skipped, usemtl splits the triangles by material
+        ObjData materials;
+        DX_CHECK(ParseText("mtllib scene.mtl\no thing\ng group\ns 1\nv 0 0 0\nv 1 0 0\nv 1 1 0\n\nf 1 2 3\nusemtl wood\nf 3 2 1\nusemtl stone\nf 1 3 2\nusemtl wood\nf 2 1 3\n", materials));
+        CheckConsistent(materials);
+        DX_CHECK(materials.materialLibraries.size() == 1 && materials.materialLibraries[0] == "scene.mtl");
+        DX_CHECK(materials.faces.size() == 4 * 9);
+        if (materials.triangleMaterials.size() == 4)
+        {
+            const std::vector<std::string>& names = materials.materialNames;
+            DX_CHECK(names[materials.triangleMaterials[1]] == "wood");
+            DX_CHECK(names[materials.triangleMaterials[2]] == "stone");
+            DX_CHECK(materials.triangleMaterials[3] == materials.triangleMaterials[1]);
+            DX_CHECK(names[materials.triangleMaterials[0]].empty());
+        }
+
+        // Indices that point at nothing fail the file rather than read out of bounds
+        ObjData invalid;
+        DX_CHECK(!ParseText("v 0 0 0\nv 1 0 0\nv 1 1 0\nf 0 1 2\n", invalid));
+        DX_CHECK(!ParseText("v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4\n", invalid));
+        DX_CHECK(!ParseText("v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1/2 2/2 3/2\n", invalid));
+        DX_CHECK(!ParseText("v 0 0 0\nv 1 0 0\nv 1 1 0\nf -4 -3 -2\n", invalid));
+    }
+
+    // Decimal strings in the forms OBJ exporters write, which must read as strtof reads them
+    void TestParseFloat()
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<double> mantissa(-0.5, 0.5);
+        int mismatches = 0;
+        for (int i = 0; i < 200000; i++)
+        {
+            char text[64];
+            const double value = mantissa(random) * std::pow(10.0, int(random() % 8) - 3);
+            snprintf(text, sizeof(text), (random() % 4) ? "%.*f" : "%.*e", int(random() % 9), value);
+
+            const char* cursor = text;
+            float parsed = 0.f;
+            const bool ok = ObjLoader::ParseFloat(cursor, text + strlen(text), parsed);
+            const float expected = strtof(text, nullptr);
+            if (!ok || memcmp(&parsed, &expected, sizeof(float)) != 0 || cursor != text + strlen(text))
+            {
+                if (mismatches++ < 5)
+                {
+                    fprintf(stderr, "  ParseFloat(\"%s\") gave %.9g, strtof %.9g\n", text, parsed, expected);
+                }
+            }
+        }
+        DX_CHECK(mismatches == 0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    DX_CHECK(argc > 1);
+    for (int i = 1; i < argc; i++)
+    {
+        TestCorpusFile(argv[i]);
+    }
+    TestFaceGrammar();
+    TestParseFloat();
+
+    return Tests::Finish("ObjLoaderTests");
+}
@@ -0,0 +1,128 @@
+//
+// OcclusionCullerBenchmark.cpp - Occluder rasterization and box test times per frame over a campsite
+//
+//   OcclusionCullerBenchmark occluder.obj...
+//
+// Each model given is placed four times around the camera at full detail, as ModelClass hands it
+// to the culler, and 2,000 boxes are tested against them, at the game's 256 x 128 buffer and at
+// 512 x 256, on one thread and on every thread of the job system. Frames with fewer triangles than
+// OcclusionCuller::MinTrianglesPerJob are drawn on the calling thread either way.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "JobSystem.h"
+#include "MeshWelder.h"
+#include "OcclusionCuller.h"
+
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    struct Occluder
+    {
+        std::vector<XMFLOAT3> positions;
+        std::vector<uint32_t> indices;
+    };
+
+    struct Placement
+    {
+        size_t occluder;
+        XMFLOAT4X4 world;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: OcclusionCullerBenchmark occluder.obj...\n");
+        return 1;
+    }
+    SeedRandom(99);
+
+    std::vector<Occluder> occluders;
+    for (int i = 1; i < argc; i++)
+    {
+        ObjData obj;
+        if (!ObjLoader::LoadFile(argv[i], obj))
+        {
+            fprintf(stderr, "%s didn't load\n", argv[i]);
+            return 1;
+        }
+        MeshData mesh;
+        MeshWelder::WeldObj(obj, mesh);
+        occluders.emplace_back();
+        for (const MeshVertex& vertex : mesh.vertices)
+        {
+            occluders.back().positions.push_back(vertex.position);
+        }
+        occluders.back().indices = mesh.indices;
+    }
+
+    std::vector<Placement> placements;
+    for (size_t i = 0; i < occluders.size() * 4; i++)
+    {
+        Placement placement;
+        placement.occluder = i % occluders.size();
+        XMStoreFloat4x4(&placement.world, XMMatrixMultiply(XMMatrixMultiply(XMMatrixScaling(3.f, 3.f, 3.f),
+            XMMatrixRotationY(Random(0.f, XM_2PI))), XMMatrixTranslation(Random(-15.f, 15.f), 0.f, Random(-5.f, 25.f))));
+        placements.push_back(placement);
+    }
+
+    const int boxCount = 2000;
+    std::vector<XMFLOAT3> centers;
+    std::vector<XMFLOAT3> extents;
+    for (int i = 0; i < boxCount; i++)
+    {
+        const float size = Random(0.2f, 1.f);
+        centers.push_back(XMFLOAT3(Random(-20.f, 20.f), Random(0.f, 3.f), Random(-5.f, 40.f)));
+        extents.push_back(XMFLOAT3(size, size, size));
+    }
+
+    const XMMATRIX view = XMMatrixLookToLH(XMVectorSet(0.f, 1.7f, -12.f, 1.f), XMVectorSet(std::sin(0.1f), 0.f, std::cos(0.1f), 0.f),
+        XMVectorSet(0.f, 1.f, 0.f, 0.f));
+    const XMMATRIX viewProjection = XMMatrixMultiply(view, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, 0.01f, 100.f));
+
+    printf("OcclusionCullerBenchmark, %zu occluders, %d boxes, %u threads\n", placements.size(), boxCount, JobSystem::Get().GetThreadCount());
+    const uint32_t sizes[2][2] = { { 256, 128 }, { 512, 256 } };
+    for (const uint32_t* size : sizes)
+    {
+        for (unsigned int threadCount : { 1u, 0u })
+        {
+            OcclusionCuller culler;
+            culler.Resize(size[0], size[1]);
+            const int frames = 200;
+            double rasterizeSeconds = 0.0;
+            double testSeconds = 0.0;
+            int hidden = 0;
+            for (int frame = 0; frame < frames; frame++)
+            {
+                Tests::Stopwatch stopwatch;
+                culler.Begin(viewProjection);
+                for (const Placement& placement : placements)
+                {
+                    const Occluder& occluder = occluders[placement.occluder];
+                    culler.AddOccluder(occluder.positions.data(), occluder.indices.data(), occluder.indices.size(), XMLoadFloat4x4(&placement.world));
+                }
+                culler.Rasterize(threadCount);
+                rasterizeSeconds += stopwatch.GetSeconds();
+
+                stopwatch.Restart();
+                hidden = 0;
+                for (int i = 0; i < boxCount; i++)
+                {
+                    hidden += culler.IsVisible(XMLoadFloat3(&centers[i]), XMLoadFloat3(&extents[i])) ? 0 : 1;
+                }
+                testSeconds += stopwatch.GetSeconds();
+            }
+            printf("  %ux%u, %-11s: %u triangles drawn in %.3f ms, boxes tested in %.3f ms per frame, %d hidden\n", size[0], size[1],
+                threadCount == 1 ? "1 thread" : "all threads", culler.GetStats().rasterizedTriangles, rasterizeSeconds * 1000.0 / frames,
+                testSeconds * 1000.0 / frames, hidden);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,354 @@
+//
+// OcclusionCullerTests.cpp - Occlusion results against a supersampled ray cast of the same scene
+//
+//   OcclusionCullerTests occluder.obj...
+//
+// The occluders are the full detail meshes of the models given, as ModelClass hands them to the
+// culler, scattered in front of the camera on a ground slab.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "MeshWelder.h"
+#include "OcclusionCuller.h"
+
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    const float NearPlane = 0.01f;
+    const float FarPlane = 100.f;
+    const float FieldOfView = XM_PIDIV4;
+
+    struct Camera
+    {
+        XMFLOAT3 eye;
+        float yaw;
+        float aspect;
+
+        XMVECTOR GetForward() const { return XMVectorSet(std::sin(yaw), 0.f, std::cos(yaw), 0.f); }
+        XMVECTOR GetRight() const { return XMVectorSet(std::cos(yaw), 0.f, -std::sin(yaw), 0.f); }
+
+        XMMATRIX GetViewProjection() const
+        {
+            const XMMATRIX view = XMMatrixLookToLH(XMLoadFloat3(&eye), GetForward(), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+            return XMMatrixMultiply(view, XMMatrixPerspectiveFovLH(FieldOfView, aspect, NearPlane, FarPlane));
+        }
+
+        // Through a point of the screen given in 0-1 across and down. The direction is 1 long in view
+        // z, so distances along it are view depths.
+        XMFLOAT3 GetRayDirection(float u, float v) const
+        {
+            const float scaleY = std::tan(FieldOfView * 0.5f);
+            const XMVECTOR direction = XMVectorAdd(GetForward(), XMVectorAdd(XMVectorScale(GetRight(), (u * 2.f - 1.f) * scaleY * aspect),
+                XMVectorSet(0.f, (1.f - v * 2.f) * scaleY, 0.f, 0.f)));
+            XMFLOAT3 result;
+            XMStoreFloat3(&result, direction);
+            return result;
+        }
+    };
+
+    // World space triangle list with a bounding sphere to skip it quickly
+    struct Occluder
+    {
+        std::vector<XMFLOAT3> positions;
+        std::vector<uint32_t> indices;
+        XMFLOAT3 center;
+        float radius;
+    };
+
+    Occluder MakeOccluder(const std::vector<XMFLOAT3>& positions, const std::vector<uint32_t>& indices, FXMMATRIX world)
+    {
+        Occluder occluder;
+        occluder.indices = indices;
+        XMVECTOR minimum = XMVectorReplicate(1e30f);
+        XMVECTOR maximum = XMVectorReplicate(-1e30f);
+        for (const XMFLOAT3& position : positions)
+        {
+            const XMVECTOR transformed = XMVector3TransformCoord(XMLoadFloat3(&position), world);
+            XMFLOAT3 stored;
+            XMStoreFloat3(&stored, transformed);
+            occluder.positions.push_back(stored);
+            minimum = XMVectorMin(minimum, transformed);
+            maximum = XMVectorMax(maximum, transformed);
+        }
+        XMStoreFloat3(&occluder.center, XMVectorScale(XMVectorAdd(minimum, maximum), 0.5f));
+        occluder.radius = 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(maximum, minimum)));
+        return occluder;
+    }
+
+    Occluder MakeBoxOccluder(const Box& box)
+    {
+        std::vector<XMFLOAT3> corners;
+        for (int i = 0; i < 8; i++)
+        {
+            corners.push_back(XMFLOAT3(i & 1 ? box.boundsMax.x : box.boundsMin.x, i & 2 ? box.boundsMax.y : box.boundsMin.y,
+                i & 4 ? box.boundsMax.z : box.boundsMin.z));
+        }
+        const uint32_t faces[6][4] = { { 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 } };
+        std::vector<uint32_t> indices;
+        for (const uint32_t* face : faces)
+        {
+            indices.insert(indices.end(), { face[0], face[1], face[2], face[0], face[2], face[3] });
+        }
+        return MakeOccluder(corners, indices, XMMatrixIdentity());
+    }
+
+    bool RayHitsSphere(const XMFLOAT3& origin, const XMFLOAT3& direction, const XMFLOAT3& center, float radius)
+    {
+        const XMVECTOR d = XMLoadFloat3(&direction);
+        const XMVECTOR toCenter = XMVectorSubtract(XMLoadFloat3(&center), XMLoadFloat3(&origin));
+        const float along = XMVectorGetX(XMVector3Dot(toCenter, d)) / XMVectorGetX(XMVector3Dot(d, d));
+        const XMVECTOR closest = XMVectorSubtract(toCenter, XMVectorScale(d, std::max(along, 0.f)));
+        return XMVectorGetX(XMVector3Dot(closest, closest)) <= radius * radius;
+    }
+
+    // Moller-Trumbore in double, so the reference doesn't miss along shared edges
+    bool RayHitsTriangle(const XMFLOAT3& o, const XMFLOAT3& d, const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c, float& distance)
+    {
+        const double e1[3] = { double(b.x) - a.x, double(b.y) - a.y, double(b.z) - a.z };
+        const double e2[3] = { double(c.x) - a.x, double(c.y) - a.y, double(c.z) - a.z };
+        const double p[3] = { d.y * e2[2] - d.z * e2[1], d.z * e2[0] - d.x * e2[2], d.x * e2[1] - d.y * e2[0] };
+        const double determinant = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (std::fabs(determinant) < 1e-12)
+        {
+            return false;
+        }
+        const double inverse = 1.0 / determinant;
+        const double t[3] = { double(o.x) - a.x, double(o.y) - a.y, double(o.z) - a.z };
+        const double u = (t[0] * p[0] + t[1] * p[1] + t[2] * p[2]) * inverse;
+        if (u < 0.0 || u > 1.0)
+        {
+            return false;
+        }
+        const double q[3] = { t[1] * e1[2] - t[2] * e1[1], t[2] * e1[0] - t[0] * e1[2], t[0] * e1[1] - t[1] * e1[0] };
+        const double v = (d.x * q[0] + d.y * q[1] + d.z * q[2]) * inverse;
+        if (v < 0.0 || u + v > 1.0)
+        {
+            return false;
+        }
+        distance = float((e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse);
+        return true;
+    }
+
+    bool IsVisible(OcclusionCuller& culler, const Box& box)
+    {
+        return culler.IsVisible(GetCenter(box), GetExtents(box));
+    }
+
+    void TestSimpleCases()
+    {
+        OcclusionCuller culler;
+        culler.Resize(256, 128);
+        const Camera camera = { XMFLOAT3(0.f, 0.f, 0.f), 0.f, 2.f };
+
+        // A wall 10 units ahead hides what's behind it only
+        culler.Begin(camera.GetViewProjection());
+        const Occluder wall = MakeBoxOccluder({ XMFLOAT3(-20.f, -20.f, 10.f), XMFLOAT3(20.f, 20.f, 11.f) });
+        culler.AddOccluder(wall.positions.data(), wall.indices.data(), wall.indices.size(), XMMatrixIdentity());
+        culler.Rasterize();
+        DX_CHECK(!culler.IsVisible(XMVectorSet(0.f, 0.f, 20.f, 0.f), XMVectorSet(1.f, 1.f, 1.f, 0.f)));
+        DX_CHECK(culler.IsVisible(XMVectorSet(0.f, 0.f, 5.f, 0.f), XMVectorSet(1.f, 1.f, 1.f, 0.f)));
+        DX_CHECK(culler.IsVisible(XMVectorSet(0.f, 0.f, 0.f, 0.f), XMVectorSet(1.f, 1.f, 1.f, 0.f)));
+        DX_CHECK(culler.IsVisible(XMVectorSet(0.f, 0.f, 11.5f, 0.f), XMVectorSet(1.f, 1.f, 1.5f, 0.f)));
+        DX_CHECK(culler.GetStats().occluderTriangles == 12);
+
+        // Ground that reaches behind the camera is clipped at the near plane, not dropped
+        culler.Begin(camera.GetViewProjection());
+        const Occluder ground = MakeBoxOccluder({ XMFLOAT3(-500.f, -2.f, -500.f), XMFLOAT3(500.f, -1.f, 500.f) });
+        culler.AddOccluder(ground.positions.data(), ground.indices.data(), ground.indices.size(), XMMatrixIdentity());
+        culler.Rasterize();
+        DX_CHECK(!culler.IsVisible(XMVectorSet(3.f, -5.f, 20.f, 0.f), XMVectorSet(1.f, 1.f, 1.f, 0.f)));
+        DX_CHECK(culler.IsVisible(XMVectorSet(3.f, 0.f, 20.f, 0.f), XMVectorSet(1.f, 0.5f, 1.f, 0.f)));
+        DX_CHECK(culler.GetStats().rasterizedTriangles > 0);
+    }
+
+    // Full detail occluder meshes from the models, as ModelClass::CreateOccluder extracts them
+    void LoadOccluderMeshes(int count, char** filenames, std::vector<std::vector<XMFLOAT3>>& positions, std::vector<std::vector<uint32_t>>& indices)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            ObjData obj;
+            if (!DX_CHECK(ObjLoader::LoadFile(filenames[i], obj)))
+            {
+                fprintf(stderr, "  %s didn't load\n", filenames[i]);
+                continue;
+            }
+            MeshData mesh;
+            MeshWelder::WeldObj(obj, mesh);
+            positions.emplace_back();
+            for (const MeshVertex& vertex : mesh.vertices)
+            {
+                positions.back().push_back(vertex.position);
+            }
+            indices.push_back(mesh.indices);
+        }
+    }
+
+    // A box the culler hides may still show in the reference, but only through gaps narrower than a
+    // pixel of the depth buffer: no buffer pixel may see it at every one of its samples.
+    void TestAgainstReference(int modelCount, char** models)
+    {
+        std::vector<std::vector<XMFLOAT3>> meshPositions;
+        std::vector<std::vector<uint32_t>> meshIndices;
+        LoadOccluderMeshes(modelCount, models, meshPositions, meshIndices);
+
+        const uint32_t sizes[2][3] = { { 256, 128, 3 }, { 512, 256, 2 } };     // Width, height, samples per pixel across
+        size_t culledTotals[2] = {};
+        size_t hiddenTotals[2] = {};
+        for (int scene = 0; scene < 8; scene++)
+        {
+            const Camera camera = { XMFLOAT3(Random(-5.f, 5.f), Random(0.5f, 3.f), Random(-5.f, 5.f)), Random(0.f, XM_2PI), 2.f };
+
+            std::vector<Occluder> occluders;
+            for (size_t m = 0; m < meshPositions.size() * 2; m++)
+            {
+                const float distance = Random(3.f, 15.f);
+                const float angle = camera.yaw + Random(-0.5f, 0.5f);
+                const XMMATRIX world = XMMatrixMultiply(XMMatrixMultiply(XMMatrixScaling(3.f, 3.f, 3.f), XMMatrixRotationY(Random(0.f, XM_2PI))),
+                    XMMatrixTranslation(camera.eye.x + std::sin(angle) * distance, -1.f, camera.eye.z + std::cos(angle) * distance));
+                occluders.push_back(MakeOccluder(meshPositions[m % meshPositions.size()], meshIndices[m % meshPositions.size()], world));
+            }
+            occluders.push_back(MakeBoxOccluder({ XMFLOAT3(-300.f, -2.f, -300.f), XMFLOAT3(300.f, -1.f, 300.f) }));
+            if (scene % 3 == 0)
+            {
+                // Right under the camera and partly behind it
+                occluders.push_back(MakeBoxOccluder({ XMFLOAT3(camera.eye.x - 0.3f, camera.eye.y - 3.f, camera.eye.z - 0.3f),
+                    XMFLOAT3(camera.eye.x + 0.3f, camera.eye.y - 0.05f, camera.eye.z + 0.3f) }));
+            }
+
+            std::vector<Box> boxes;
+            for (int b = 0; b < 200; b++)
+            {
+                const float distance = Random(1.f, 40.f);
+                const float angle = camera.yaw + Random(-0.7f, 0.7f);
+                const float x = camera.eye.x + std::sin(angle) * distance;
+                const float z = camera.eye.z + std::cos(angle) * distance;
+                const float y = Random(-3.f, 4.f);
+                const float size = Random(0.05f, 1.2f);
+                boxes.push_back({ XMFLOAT3(x - size, y - size, z - size), XMFLOAT3(x + size, y + size * 2.f, z + size) });
+            }
+
+            for (size_t s = 0; s < 2; s++)
+            {
+                const uint32_t* size = sizes[s];
+                OcclusionCuller culler;
+                culler.Resize(size[0], size[1]);
+                culler.Begin(camera.GetViewProjection());
+                for (const Occluder& occluder : occluders)
+                {
+                    culler.AddOccluder(occluder.positions.data(), occluder.indices.data(), occluder.indices.size(), XMMatrixIdentity());
+                }
+                culler.Rasterize(0);
+
+                std::vector<size_t> hidden;
+                for (size_t b = 0; b < boxes.size(); b++)
+                {
+                    if (!IsVisible(culler, boxes[b]))
+                    {
+                        hidden.push_back(b);
+                    }
+                }
+
+                // Samples of each buffer pixel that see each hidden box, and every box seen at all
+                const uint32_t samples = size[2];
+                std::vector<uint8_t> seen(boxes.size(), 0);
+                std::vector<uint32_t> pixelSamples(hidden.size());
+                size_t fullySeenPixels = 0;
+                const XMFLOAT3& origin = camera.eye;
+                for (uint32_t y = 0; y < size[1]; y++)
+                {
+                    for (uint32_t x = 0; x < size[0]; x++)
+                    {
+                        std::fill(pixelSamples.begin(), pixelSamples.end(), 0u);
+                        for (uint32_t sample = 0; sample < samples * samples; sample++)
+                        {
+                            const float u = (float(x) + (float(sample % samples) + 0.5f) / float(samples)) / float(size[0]);
+                            const float v = (float(y) + (float(sample / samples) + 0.5f) / float(samples)) / float(size[1]);
+                            const XMFLOAT3 direction = camera.GetRayDirection(u, v);
+
+                            float nearestOccluder = FarPlane;
+                            for (const Occluder& occluder : occluders)
+                            {
+                                if (!RayHitsSphere(origin, direction, occluder.center, occluder.radius))
+                                {
+                                    continue;
+                                }
+                                for (size_t t = 0; t < occluder.indices.size(); t += 3)
+                                {
+                                    float distance;
+                                    if (RayHitsTriangle(origin, direction, occluder.positions[occluder.indices[t]], occluder.positions[occluder.indices[t + 1]],
+                                        occluder.positions[occluder.indices[t + 2]], distance) && distance >= NearPlane && distance < nearestOccluder)
+                                    {
+                                        nearestOccluder = distance;
+                                    }
+                                }
+                            }
+
+                            for (size_t b = 0; b < boxes.size(); b++)
+                            {
+                                float distance;
+                                if (RayHitsBox(origin, direction, NearPlane, FarPlane, boxes[b], distance) && distance < nearestOccluder)
+                                {
+                                    seen[b] = 1;
+                                }
+                            }
+                            for (size_t h = 0; h < hidden.size(); h++)
+                            {
+                                float distance;
+                                if (RayHitsBox(origin, direction, NearPlane, FarPlane, boxes[hidden[h]], distance) && distance < nearestOccluder)
+                                {
+                                    pixelSamples[h]++;
+                                }
+                            }
+                        }
+                        for (uint32_t count : pixelSamples)
+                        {
+                            fullySeenPixels += count == samples * samples ? 1 : 0;
+                        }
+                    }
+                }
+                DX_CHECK(fullySeenPixels == 0);
+
+                size_t referenceHidden = 0;
+                size_t slivers = 0;
+                for (size_t b = 0; b < boxes.size(); b++)
+                {
+                    referenceHidden += seen[b] ? 0 : 1;
+                }
+                for (size_t b : hidden)
+                {
+                    slivers += seen[b] ? 1 : 0;
+                }
+                culledTotals[s] += hidden.size() - slivers;
+                hiddenTotals[s] += referenceHidden;
+                printf("  scene %d at %ux%u: %3zu of %3zu hidden boxes culled, %zu through sub-pixel gaps, %u of %u occluder triangles drawn\n",
+                    scene, size[0], size[1], hidden.size() - slivers, referenceHidden, slivers, culler.GetStats().rasterizedTriangles,
+                    culler.GetStats().occluderTriangles);
+            }
+        }
+
+        // Being conservative costs the boxes hidden only by several occluders together or seen past
+        // an edge by less than a pixel, but most of what is hidden is still found
+        for (size_t s = 0; s < 2; s++)
+        {
+            DX_CHECK(culledTotals[s] * 10 >= hiddenTotals[s] * 6);
+            printf("  %ux%u: %zu of %zu hidden boxes culled\n", sizes[s][0], sizes[s][1], culledTotals[s], hiddenTotals[s]);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    SeedRandom(99);
+    TestSimpleCases();
+    if (DX_CHECK(argc > 1))
+    {
+        TestAgainstReference(argc - 1, argv + 1);
+    }
+
+    return Tests::Finish("OcclusionCullerTests");
+}
@@ -0,0 +1,452 @@
+//
+// ProfilerTests.cpp - Zone nesting, ring overflow and torn slots, the Chrome trace and the per zone summary
+//
+// Built twice, as in the game and with DX_NO_PROFILE, where the zone macros must record nothing.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "Profiler.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace DX;
+
+namespace
+{
+    // Runs work on a thread of its own, so it gets a ring of its own, and returns that thread's id
+    // in captures
+    template <typename Work>
+    uint32_t RunOnThread(const char* name, Work work)
+    {
+        uint32_t threadId = 0;
+        std::thread thread([&]
+        {
+            Profiler::Get().SetThreadName(name);
+            ProfileCapture capture;
+            Profiler::Get().Capture(capture);
+            threadId = uint32_t(std::find(capture.threadNames.rbegin(), capture.threadNames.rend(), name).base() - capture.threadNames.begin()) - 1;
+            work();
+        });
+        thread.join();
+        return threadId;
+    }
+
+    std::vector<ProfileEvent> GetThreadEvents(uint32_t threadId)
+    {
+        ProfileCapture capture;
+        Profiler::Get().Capture(capture);
+        std::vector<ProfileEvent> events;
+        for (const ProfileEvent& event : capture.events)
+        {
+            if (event.threadId == threadId)
+            {
+                events.push_back(event);
+            }
+        }
+        return events;
+    }
+
+#ifdef DX_PROFILE
+    const ProfileEvent* FindEvent(const std::vector<ProfileEvent>& events, const char* name)
+    {
+        for (const ProfileEvent& event : events)
+        {
+            if (strcmp(event.name, name) == 0)
+            {
+                return &event;
+            }
+        }
+        return nullptr;
+    }
+#endif
+
+    // Each zone's depth is the number of zones open around it, and it lies inside its parent
+    void TestNesting()
+    {
+        const uint32_t threadId = RunOnThread("ProfilerTests nesting", []
+        {
+            DX_PROFILE_ZONE("Outer");
+            {
+                DX_PROFILE_ZONE("Middle");
+                {
+                    DX_PROFILE_ZONE("Inner");
+                }
+            }
+            DX_PROFILE_ZONE("Second");
+        });
+        const std::vector<ProfileEvent> events = GetThreadEvents(threadId);
+
+#ifdef DX_PROFILE
+        const ProfileEvent* outer = FindEvent(events, "Outer");
+        const ProfileEvent* middle = FindEvent(events, "Middle");
+        const ProfileEvent* inner = FindEvent(events, "Inner");
+        const ProfileEvent* second = FindEvent(events, "Second");
+        DX_CHECK(events.size() == 4);
+        if (!DX_CHECK(outer && middle && inner && second))
+        {
+            return;
+        }
+        DX_CHECK(outer->depth == 0 && middle->depth == 1 && inner->depth == 2 && second->depth == 1);
+        DX_CHECK(outer->begin <= middle->begin && middle->begin <= inner->begin && inner->end <= middle->end && middle->end <= outer->end);
+        DX_CHECK(middle->end <= second->begin && second->end <= outer->end);
+#else
+        DX_CHECK(events.empty());
+#endif
+    }
+
+    // A full ring holds exactly the last EventsPerThread events, in order
+    void TestOverflow()
+    {
+        const size_t recordCount = Profiler::EventsPerThread * 3 + 123;
+        const uint32_t threadId = RunOnThread("ProfilerTests overflow", [recordCount]
+        {
+            for (size_t i = 0; i < recordCount; i++)
+            {
+                Profiler::Get().Record("Overflow", i, i + 1, 0);
+            }
+        });
+        const std::vector<ProfileEvent> events = GetThreadEvents(threadId);
+        DX_CHECK(events.size() == Profiler::EventsPerThread);
+        bool last = true;
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            last = last && events[i].begin == recordCount - Profiler::EventsPerThread + i;
+        }
+        DX_CHECK(last);
+
+        // A ring that isn't full holds everything
+        const uint32_t shortId = RunOnThread("ProfilerTests short", []
+        {
+            for (uint64_t i = 0; i < 100; i++)
+            {
+                Profiler::Get().Record("Short", i, i + 1, 0);
+            }
+        });
+        DX_CHECK(GetThreadEvents(shortId).size() == 100);
+    }
+
+    // Captures taken while a thread records never hold an event it was part way through writing.
+    // Every event the writer records is consistent with its begin, so a torn one shows.
+    void TestTornSlots()
+    {
+        static const char* const names[] = { "Torn 0", "Torn 1", "Torn 2" };
+        std::atomic<bool> stop(false);
+        std::atomic<uint32_t> writerId(~0u);
+        std::thread writer([&]
+        {
+            Profiler::Get().SetThreadName("ProfilerTests torn");
+            ProfileCapture capture;
+            Profiler::Get().Capture(capture);
+            writerId = uint32_t(std::find(capture.threadNames.rbegin(), capture.threadNames.rend(), "ProfilerTests torn").base() - capture.threadNames.begin()) - 1;
+            for (uint64_t i = 0; !stop; i++)
+            {
+                Profiler::Get().Record(names[i % 3], i, i * 3 + 7, uint32_t(i % 5));
+            }
+        });
+        while (writerId == ~0u)
+        {
+            std::this_thread::yield();
+        }
+
+        ProfileCapture capture;
+        bool consistent = true;
+        bool contiguous = true;
+        size_t largest = 0;
+        Tests::Stopwatch stopwatch;
+        for (int round = 0; round < 2000 || stopwatch.GetSeconds() < 0.2; round++)
+        {
+            Profiler::Get().Capture(capture);
+            std::vector<ProfileEvent> events;
+            for (const ProfileEvent& event : capture.events)
+            {
+                if (event.threadId == writerId)
+                {
+                    events.push_back(event);
+                }
+            }
+            for (size_t i = 0; i < events.size(); i++)
+            {
+                const ProfileEvent& event = events[i];
+                consistent = consistent && event.end == event.begin * 3 + 7 && event.name == names[event.begin % 3] && event.depth == event.begin % 5;
+                contiguous = contiguous && (i == 0 || event.begin == events[i - 1].begin + 1);
+            }
+            largest = std::max(largest, events.size());
+        }
+        stop = true;
+        writer.join();
+        DX_CHECK(consistent);
+        DX_CHECK(contiguous);
+        DX_CHECK(largest <= Profiler::EventsPerThread);
+    }
+
+    // Just enough of a JSON parser to check the trace parses and read its events back
+    struct JsonValue
+    {
+        enum Type { Null, Bool, Number, String, Array, Object } type = Null;
+        double number = 0.0;
+        std::string text;
+        std::vector<JsonValue> items;
+        std::map<std::string, JsonValue> members;
+    };
+
+    class JsonParser
+    {
+    public:
+        explicit JsonParser(const std::string& text) : m_text(text), m_position(0) {}
+
+        bool ParseDocument(JsonValue& value)
+        {
+            if (!ParseValue(value))
+            {
+                return false;
+            }
+            SkipSpace();
+            return m_position == m_text.size();
+        }
+
+    private:
+        void SkipSpace()
+        {
+            while (m_position < m_text.size() && strchr(" \t\r\n", m_text[m_position]))
+            {
+                m_position++;
+            }
+        }
+
+        bool Consume(char c)
+        {
+            SkipSpace();
+            if (m_position < m_text.size() && m_text[m_position] == c)
+            {
+                m_position++;
+                return true;
+            }
+            return false;
+        }
+
+        bool ParseString(std::string& out)
+        {
+            if (!Consume('"'))
+            {
+                return false;
+            }
+            while (m_position < m_text.size() && m_text[m_position] != '"')
+            {
+                char c = m_text[m_position++];
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    return false;
+                }
+                if (c == '\\')
+                {
+                    if (m_position == m_text.size() || !strchr("\"\\/bfnrt", m_text[m_position]))
+                    {
+                        return false;
+                    }
+                    c = m_text[m_position++];
+                }
+                out.push_back(c);
+            }
+            return Consume('"');
+        }
+
+        bool ParseValue(JsonValue& value)
+        {
+            SkipSpace();
+            if (m_position == m_text.size())
+            {
+                return false;
+            }
+            const char c = m_text[m_position];
+            if (c == '{')
+            {
+                value.type = JsonValue::Object;
+                m_position++;
+                if (Consume('}'))
+                {
+                    return true;
+                }
+                do
+                {
+                    std::string name;
+                    if (!ParseString(name) || !Consume(':') || !ParseValue(value.members[name]))
+                    {
+                        return false;
+                    }
+                } while (Consume(','));
+                return Consume('}');
+            }
+            if (c == '[')
+            {
+                value.type = JsonValue::Array;
+                m_position++;
+                if (Consume(']'))
+                {
+                    return true;
+                }
+                do
+                {
+                    value.items.emplace_back();
+                    if (!ParseValue(value.items.back()))
+                    {
+                        return false;
+                    }
+                } while (Consume(','));
+                return Consume(']');
+            }
+            if (c == '"')
+            {
+                value.type = JsonValue::String;
+                return ParseString(value.text);
+            }
+            for (const char* word : { "true", "false", "null" })
+            {
+                if (m_text.compare(m_position, strlen(word), word) == 0)
+                {
+                    value.type = word[0] == 'n' ? JsonValue::Null : JsonValue::Bool;
+                    m_position += strlen(word);
+                    return true;
+                }
+            }
+            const char* begin = m_text.c_str() + m_position;
+            char* end = nullptr;
+            value.type = JsonValue::Number;
+            value.number = strtod(begin, &end);
+            m_position += size_t(end - begin);
+            return end != begin && (c == '-' || (c >= '0' && c <= '9'));
+        }
+
+        const std::string m_text;
+        size_t m_position;
+    };
+
+    // The trace is valid JSON with a frame track, the thread names escaped and one complete event
+    // per zone, in microseconds from the earliest time
+    void TestChromeTrace()
+    {
+        const char* const threadName = "Quote \" and backslash \\ in a name";
+        ProfileCapture capture;
+        capture.frames = { 1000000, 17000000, 33000000 };
+        capture.threadNames = { "", threadName };
+        capture.events.push_back({ "Zone \"quoted\"", 500000, 1500000, 1, 0 });
+        capture.events.push_back({ "Other", 2000000, 2250000, 0, 1 });
+
+        const char* const filename = "ProfilerTests.json";
+        if (!DX_CHECK(Profiler::WriteChromeTrace(filename, capture)))
+        {
+            return;
+        }
+        std::ifstream inFile(filename);
+        std::stringstream text;
+        text << inFile.rdbuf();
+        inFile.close();
+        remove(filename);
+
+        JsonValue document;
+        JsonParser parser(text.str());
+        if (!DX_CHECK(parser.ParseDocument(document)) || !DX_CHECK(document.type == JsonValue::Object))
+        {
+            return;
+        }
+        const JsonValue& events = document.members["traceEvents"];
+        DX_CHECK(events.type == JsonValue::Array);
+        size_t frames = 0;
+        size_t zones = 0;
+        bool named = false;
+        for (const JsonValue& event : events.items)
+        {
+            auto member = [&event](const char* name) -> const JsonValue&
+            {
+                static const JsonValue missing = JsonValue();
+                auto it = event.members.find(name);
+                return it == event.members.end() ? missing : it->second;
+            };
+            const std::string& phase = member("ph").text;
+            const double tid = member("tid").number;
+            if (phase == "M")
+            {
+                auto args = member("args").members.find("name");
+                named = named || (tid == 2.0 && args != member("args").members.end() && args->second.text == threadName);
+            }
+            else if (phase == "X" && member("name").text == "Frame")
+            {
+                DX_CHECK(tid == 0.0);
+                DX_CHECK(member("dur").number == 16000.0);
+                frames++;
+            }
+            else if (phase == "X")
+            {
+                const std::string& name = member("name").text;
+                DX_CHECK(name == "Zone \"quoted\"" || name == "Other");
+                DX_CHECK(tid == (name == "Other" ? 1.0 : 2.0));
+                DX_CHECK(member("ts").number == (name == "Other" ? 1500.0 : 0.0));
+                DX_CHECK(member("dur").number == (name == "Other" ? 250.0 : 1000.0));
+                zones++;
+            }
+        }
+        DX_CHECK(named);
+        DX_CHECK(frames == 2);
+        DX_CHECK(zones == 2);
+    }
+
+    // p99 is the nearest rank, the smallest time at least 99% of the zones take no longer than.
+    // Only zones that began inside the captured frames count.
+    void TestSummary()
+    {
+        ProfileCapture capture;
+        capture.frames = { 1000000000, 2000000000, 3000000000 };
+        for (uint64_t i = 1; i <= 200; i++)
+        {
+            capture.events.push_back({ "Even", 1000000000 + i, 1000000000 + i + i * 1000000, 0, 0 });
+        }
+        capture.events.push_back({ "Single", 2500000000, 2500000000 + 5000000, 0, 0 });
+        capture.events.push_back({ "Single", 500000000, 900000000, 0, 0 });
+        capture.events.push_back({ "Single", 3000000000, 3900000000, 0, 0 });
+
+        std::vector<ProfileZoneStats> zones;
+        Profiler::Summarize(capture, zones);
+        if (!DX_CHECK(zones.size() == 2))
+        {
+            return;
+        }
+        const ProfileZoneStats& even = zones[0];
+        DX_CHECK(even.name == "Even");
+        DX_CHECK(even.count == 200);
+        DX_CHECK(even.minMilliseconds == 1.0 && even.maxMilliseconds == 200.0);
+        DX_CHECK(even.p99Milliseconds == 198.0);
+        DX_CHECK(std::fabs(even.averageMilliseconds - 100.5) < 1e-9);
+        DX_CHECK(std::fabs(even.perFrameMilliseconds - 200.0 * 201.0 / 2.0 / 2.0) < 1e-6);
+
+        const ProfileZoneStats& single = zones[1];
+        DX_CHECK(single.name == "Single");
+        DX_CHECK(single.count == 1);
+        DX_CHECK(single.p99Milliseconds == 5.0 && single.minMilliseconds == 5.0 && single.maxMilliseconds == 5.0);
+
+        // With 100 zones p99 is the 99th
+        capture.events.resize(100);
+        Profiler::Summarize(capture, zones);
+        DX_CHECK(zones.size() == 1 && zones[0].p99Milliseconds == 99.0);
+    }
+}
+
+int main()
+{
+    TestNesting();
+    TestOverflow();
+    TestTornSlots();
+    TestChromeTrace();
+    TestSummary();
+
+#ifdef DX_PROFILE
+    return Tests::Finish("ProfilerTests");
+#else
+    return Tests::Finish("ProfilerTests (DX_NO_PROFILE)");
+#endif
+}
@@ -0,0 +1,152 @@
+//
+// RangeAllocatorTests.cpp - Random allocate/free/grow sequences against a byte ownership map
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "RangeAllocator.h"
+
+#include <random>
+
+using namespace DX;
+
+namespace
+{
+    struct Allocation
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    // Live allocations never overlap, respect their alignment and stay inside the capacity, and
+    // freeing everything leaves a single free range
+    void TestRandomSequences()
+    {
+        std::mt19937 random(3);
+        for (int round = 0; round < 200; round++)
+        {
+            const uint32_t initialCapacity = 1000 + random() % 100000;
+            RangeAllocator allocator(initialCapacity);
+            std::vector<uint8_t> owned(initialCapacity * 4, 0);
+            std::vector<Allocation> live;
+            bool valid = true;
+
+            for (int step = 0; step < 2000 && valid; step++)
+            {
+                if (random() % 3 || live.empty())
+                {
+                    const uint32_t size = 1 + random() % (initialCapacity / 20);
+                    uint32_t alignment = 1u << (random() % 6);
+                    if (random() % 7 == 0)
+                    {
+                        alignment = 3 + random() % 30;
+                    }
+
+                    const uint32_t offset = allocator.Allocate(size, alignment);
+                    if (offset == RangeAllocator::InvalidOffset)
+                    {
+                        const uint32_t capacity = allocator.GetCapacity() + random() % initialCapacity;
+                        if (random() % 4 == 0 && capacity <= owned.size())
+                        {
+                            allocator.Grow(capacity);
+                        }
+                        continue;
+                    }
+
+                    valid = DX_CHECK(offset % alignment == 0) && DX_CHECK(offset + size <= allocator.GetCapacity());
+                    for (uint32_t i = offset; valid && i < offset + size; i++)
+                    {
+                        valid = DX_CHECK(owned[i] == 0);
+                        owned[i] = 1;
+                    }
+                    live.push_back({ offset, size });
+                }
+                else
+                {
+                    const size_t index = random() % live.size();
+                    std::fill(owned.begin() + live[index].offset, owned.begin() + live[index].offset + live[index].size, uint8_t(0));
+                    allocator.Free(live[index].offset);
+                    live[index] = live.back();
+                    live.pop_back();
+                }
+
+                const RangeAllocatorStats stats = allocator.GetStats();
+                uint64_t liveBytes = 0;
+                for (const Allocation& allocation : live)
+                {
+                    liveBytes += allocation.size;
+                }
+                valid = valid && DX_CHECK(stats.allocationCount == live.size()) && DX_CHECK(stats.usedBytes >= liveBytes) &&
+                    DX_CHECK(stats.largestFreeRange <= stats.capacity - stats.usedBytes) &&
+                    DX_CHECK(stats.GetFragmentation() >= 0.f && stats.GetFragmentation() <= 1.f);
+            }
+
+            for (const Allocation& allocation : live)
+            {
+                allocator.Free(allocation.offset);
+            }
+            const RangeAllocatorStats stats = allocator.GetStats();
+            DX_CHECK(stats.usedBytes == 0);
+            DX_CHECK(stats.freeRangeCount == 1);
+            DX_CHECK(stats.largestFreeRange == allocator.GetCapacity());
+            DX_CHECK(stats.GetFragmentation() == 0.f);
+        }
+    }
+
+    void TestEdgeCases()
+    {
+        RangeAllocator allocator(100);
+        DX_CHECK(allocator.Allocate(0) == RangeAllocator::InvalidOffset);
+        DX_CHECK(allocator.Allocate(101) == RangeAllocator::InvalidOffset);
+        DX_CHECK(allocator.Allocate(100) == 0);
+        DX_CHECK(allocator.Allocate(1) == RangeAllocator::InvalidOffset);
+
+        // Offsets that were never handed out are ignored
+        allocator.Free(5);
+        DX_CHECK(allocator.GetStats().allocationCount == 1);
+
+        // Growing appends a free range that a new allocation can use
+        allocator.Grow(150);
+        DX_CHECK(allocator.Allocate(50) == 100);
+        DX_CHECK(allocator.GetStats().GetOccupancy() == 1.f);
+
+        allocator.Reset(64);
+        DX_CHECK(allocator.GetStats().allocationCount == 0);
+        DX_CHECK(allocator.GetStats().largestFreeRange == 64);
+    }
+
+    // The smallest range that fits is used, leaving large holes for large requests
+    void TestBestFit()
+    {
+        RangeAllocator allocator(1000);
+        const uint32_t small = allocator.Allocate(100);
+        allocator.Allocate(10);
+        const uint32_t large = allocator.Allocate(500);
+        allocator.Allocate(10);
+        allocator.Free(small);
+        allocator.Free(large);
+        DX_CHECK(allocator.Allocate(90) == small);
+        DX_CHECK(allocator.Allocate(400) == large);
+
+        // Neighbouring ranges coalesce whichever order they're freed in
+        RangeAllocator coalescing(300);
+        const uint32_t a = coalescing.Allocate(100);
+        const uint32_t b = coalescing.Allocate(100);
+        const uint32_t c = coalescing.Allocate(100);
+        coalescing.Free(a);
+        coalescing.Free(c);
+        DX_CHECK(coalescing.GetStats().freeRangeCount == 2);
+        coalescing.Free(b);
+        DX_CHECK(coalescing.GetStats().freeRangeCount == 1);
+        DX_CHECK(coalescing.Allocate(300) == 0);
+    }
+}
+
+int main()
+{
+    TestRandomSequences();
+    TestEdgeCases();
+    TestBestFit();
+
+    return Tests::Finish("RangeAllocatorTests");
+}
@@ -0,0 +1,171 @@
+//
+// RenderQueueTests.cpp - Sort keys, the radix sort against std::stable_sort, draw order by pass and state changes
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "RenderQueue.h"
+
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    uint32_t GetDepth(uint64_t key)
+    {
+        return static_cast<uint32_t>(key >> RenderQueue::DepthShift) & ((1u << RenderQueue::DepthBits) - 1);
+    }
+
+    // Changes counted the plain way, the first draw changes everything
+    uint32_t CountChanges(const std::vector<RenderItem>& items, uint32_t (*getField)(uint64_t))
+    {
+        uint32_t changes = 0;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            changes += i == 0 || getField(items[i].key) != getField(items[i - 1].key) ? 1 : 0;
+        }
+        return changes;
+    }
+
+    // Every field reads back as given, and depths at and past the ends stay in the depth field.
+    // A depth of 1 used to round up to 2^24 and carry into the mesh.
+    void TestKeys()
+    {
+        for (int round = 0; round < 1000; round++)
+        {
+            const RenderPass pass = RandomIndex(2) == 0 ? RenderPass::Opaque : RenderPass::Transparent;
+            const uint32_t shader = RandomIndex(1u << RenderQueue::ShaderBits);
+            const uint32_t texture = RandomIndex(1u << RenderQueue::TextureBits);
+            const uint32_t mesh = RandomIndex(1u << RenderQueue::MeshBits);
+            const uint64_t key = RenderQueue::MakeKey(pass, shader, texture, mesh, Random(0.f, 1.f));
+            DX_CHECK(RenderQueue::GetPass(key) == static_cast<uint32_t>(pass));
+            DX_CHECK(RenderQueue::GetShader(key) == shader);
+            DX_CHECK(RenderQueue::GetTexture(key) == texture);
+            DX_CHECK(RenderQueue::GetMesh(key) == mesh);
+        }
+
+        const uint32_t depthMax = (1u << RenderQueue::DepthBits) - 1;
+        for (RenderPass pass : { RenderPass::Opaque, RenderPass::Transparent })
+        {
+            for (float depth : { 1.f, 0.99999994f, 0.9999999f, 1.5f, 0.f, -1.f })
+            {
+                const uint64_t key = RenderQueue::MakeKey(pass, 3, 5, 7, depth);
+                DX_CHECK(RenderQueue::GetMesh(key) == 7 && RenderQueue::GetTexture(key) == 5 && RenderQueue::GetShader(key) == 3);
+                DX_CHECK(RenderQueue::GetPass(key) == static_cast<uint32_t>(pass));
+            }
+            const bool opaque = pass == RenderPass::Opaque;
+            DX_CHECK(GetDepth(RenderQueue::MakeKey(pass, 0, 0, 0, 1.f)) == (opaque ? depthMax : 0));
+            DX_CHECK(GetDepth(RenderQueue::MakeKey(pass, 0, 0, 0, 0.f)) == (opaque ? 0 : depthMax));
+        }
+
+        // Ids past a field's range share the last one
+        RenderQueue queue;
+        std::vector<int> shaders(300);
+        for (size_t i = 0; i < shaders.size(); i++)
+        {
+            DX_CHECK(queue.GetShaderId(&shaders[i]) == std::min<uint32_t>(uint32_t(i), (1u << RenderQueue::ShaderBits) - 1));
+        }
+        DX_CHECK(queue.GetShaderId(&shaders[0]) == 0);
+        queue.ResetIds();
+        DX_CHECK(queue.GetShaderId(&shaders[5]) == 0);
+    }
+
+    // Random queues, some with fields every draw shares so the sort skips digits, come out as
+    // std::stable_sort orders them, with the state changes counted before and after
+    void TestSort()
+    {
+        RenderQueue queue;
+        for (int round = 0; round < 200; round++)
+        {
+            const size_t count = round < 4 ? size_t(round) : 1 + RandomIndex(round % 10 == 0 ? 20000 : 300);
+            const uint32_t shaderCount = 1 + RandomIndex(round % 3 == 0 ? 1 : 8);
+            const uint32_t textureCount = 1 + RandomIndex(round % 5 == 0 ? 1 : 100);
+            const uint32_t meshCount = 1 + RandomIndex(round % 7 == 0 ? 1 : 1000);
+            queue.Clear();
+            std::vector<RenderItem> expected;
+            for (size_t i = 0; i < count; i++)
+            {
+                const RenderPass pass = RandomIndex(4) == 0 ? RenderPass::Transparent : RenderPass::Opaque;
+                const float depth = round % 4 == 0 ? 0.5f : Random(0.f, 1.f);
+                const uint64_t key = RenderQueue::MakeKey(pass, RandomIndex(shaderCount), RandomIndex(textureCount), RandomIndex(meshCount), depth);
+                queue.Add(key, uint32_t(i));
+                expected.push_back({ key, uint32_t(i) });
+            }
+            const uint32_t unsortedShaderChanges = CountChanges(expected, RenderQueue::GetShader);
+            const uint32_t unsortedTextureChanges = CountChanges(expected, RenderQueue::GetTexture);
+            const uint32_t unsortedMeshChanges = CountChanges(expected, RenderQueue::GetMesh);
+            std::stable_sort(expected.begin(), expected.end(), [](const RenderItem& a, const RenderItem& b) { return a.key < b.key; });
+
+            queue.Sort();
+            const std::vector<RenderItem>& items = queue.GetItems();
+            bool same = items.size() == expected.size();
+            for (size_t i = 0; same && i < items.size(); i++)
+            {
+                same = items[i].key == expected[i].key && items[i].draw == expected[i].draw;
+            }
+            DX_CHECK(same);
+
+            const RenderQueueStats& stats = queue.GetStats();
+            DX_CHECK(stats.drawCount == count);
+            DX_CHECK(stats.unsortedShaderChanges == unsortedShaderChanges);
+            DX_CHECK(stats.unsortedTextureChanges == unsortedTextureChanges);
+            DX_CHECK(stats.unsortedMeshChanges == unsortedMeshChanges);
+            DX_CHECK(stats.shaderChanges == CountChanges(expected, RenderQueue::GetShader));
+            DX_CHECK(stats.textureChanges == CountChanges(expected, RenderQueue::GetTexture));
+            DX_CHECK(stats.meshChanges == CountChanges(expected, RenderQueue::GetMesh));
+            DX_CHECK(stats.shaderChanges <= stats.unsortedShaderChanges);
+        }
+    }
+
+    // Opaque draws come first, front to back within a state group, then transparent ones back to front
+    void TestPassOrder()
+    {
+        RenderQueue queue;
+        std::vector<float> depths;
+        for (uint32_t i = 0; i < 1000; i++)
+        {
+            const RenderPass pass = i % 3 == 0 ? RenderPass::Transparent : RenderPass::Opaque;
+            depths.push_back(Random(0.f, 1.f));
+            queue.Add(RenderQueue::MakeKey(pass, i % 2, 0, 0, depths.back()), i);
+        }
+        queue.Sort();
+
+        const std::vector<RenderItem>& items = queue.GetItems();
+        bool passOrder = true;
+        bool opaqueFrontToBack = true;
+        bool transparentBackToFront = true;
+        for (size_t i = 1; i < items.size(); i++)
+        {
+            const RenderItem& previous = items[i - 1];
+            const RenderItem& item = items[i];
+            passOrder = passOrder && RenderQueue::GetPass(previous.key) <= RenderQueue::GetPass(item.key);
+            if (RenderQueue::GetPass(item.key) != RenderQueue::GetPass(previous.key) || RenderQueue::GetShader(item.key) != RenderQueue::GetShader(previous.key))
+            {
+                continue;
+            }
+            if (item.draw % 3 == 0)
+            {
+                transparentBackToFront = transparentBackToFront && depths[previous.draw] >= depths[item.draw];
+            }
+            else
+            {
+                opaqueFrontToBack = opaqueFrontToBack && depths[previous.draw] <= depths[item.draw];
+            }
+        }
+        DX_CHECK(passOrder);
+        DX_CHECK(opaqueFrontToBack);
+        DX_CHECK(transparentBackToFront);
+        DX_CHECK(RenderQueue::GetPass(items.front().key) == static_cast<uint32_t>(RenderPass::Opaque));
+        DX_CHECK(RenderQueue::GetPass(items.back().key) == static_cast<uint32_t>(RenderPass::Transparent));
+    }
+}
+
+int main()
+{
+    SeedRandom(13);
+    TestKeys();
+    TestSort();
+    TestPassOrder();
+
+    return Tests::Finish("RenderQueueTests");
+}
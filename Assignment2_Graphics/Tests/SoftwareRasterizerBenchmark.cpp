@@ -0,0 +1,203 @@
+//
+// SoftwareRasterizerBenchmark.cpp - The campsite drawn headless by the software renderer, timed and written out
+//
+//   SoftwareRasterizerBenchmark gameDirectory
+//
+// Loads the campsite's models and textures from the game's Models and Textures folders, lays them
+// out like the game's scene and draws it at 800 x 600 and at 4K, on one thread and on every thread
+// of the job system. Each size is written to the working directory as campsite_WxH.tga. Textures
+// that aren't there draw white, and a missing sky cube map is replaced by a generated gradient.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "JobSystem.h"
+#include "MeshWelder.h"
+#include "SoftwareRasterizer.h"
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    struct Placement
+    {
+        const char* model;
+        const char* texture;
+        XMFLOAT3 position;
+        float yaw;
+        float scale;
+    };
+
+    // World positions of the game's scene graph nodes
+    const Placement CampsitePlacements[] = {
+        { "ground_block", "Grass_Base_Color", XMFLOAT3(0.f, -10.f, 0.f), 0.f, 1.f },
+        { "platform_grass", "Rock_Base_Color", XMFLOAT3(1.2f, -10.4f, 3.2f), -.5f, 2.f },
+        { "tent_smallClosed", "red-fabric", XMFLOAT3(1.2f, -10.25f, 3.3f), 1.2f, 1.f },
+        { "tree_simple_top", "Stylized_Leaves", XMFLOAT3(2.2f, -10.35f, 5.2f), 0.f, 1.f },
+        { "tree_simple_trunk", "Wood_Bark", XMFLOAT3(2.2f, -10.35f, 5.2f), 0.f, 1.f },
+        { "mushroom_tanTall", "Mushroom_Top", XMFLOAT3(2.f, -10.35f, 5.15f), 0.f, 1.f },
+        { "mushroom_redGroup", "Mushroom_Top", XMFLOAT3(2.4f, -10.35f, 4.8f), 0.f, 1.f },
+        { "stump_round", "Wood_Bark", XMFLOAT3(1.7f, -10.35f, 4.8f), 0.f, 1.f },
+        { "crop", "bamboo_tex", XMFLOAT3(-.2f, -10.35f, 3.2f), 0.f, .5f },
+        { "crop", "bamboo_tex", XMFLOAT3(-.2f, -10.35f, 3.f), 0.f, .5f },
+        { "crop", "bamboo_tex", XMFLOAT3(-.2f, -10.35f, 2.8f), 0.f, .5f },
+        { "crop", "bamboo_tex", XMFLOAT3(-.2f, -10.35f, 2.6f), 0.f, .5f },
+        { "canoe", "Wood_Grain", XMFLOAT3(.65f, -10.35f, 1.3f), .5f, 1.f },
+        { "canoe_paddle", "Wood_Grain", XMFLOAT3(1.f, -10.35f, 1.3f), .5f, 1.f },
+        { "log", "Wood_Bark", XMFLOAT3(2.6f, -10.35f, 2.4f), .87f, 1.f },
+        { "campfire_logs", "Wood_Bark", XMFLOAT3(2.4f, -10.35f, 2.8f), .87f, 1.f },
+        { "tree_simple_top", "Stylized_Leaves", XMFLOAT3(3.4f, -10.35f, 4.2f), 0.f, 1.f },
+        { "tree_simple_trunk", "Wood_Bark", XMFLOAT3(3.4f, -10.35f, 4.2f), 0.f, 1.f },
+        { "tree_dark_top", "Stylized_Leaves", XMFLOAT3(3.f, -10.35f, 4.3f), 0.f, 1.f },
+        { "tree_dark_trunk", "Wood_Bark", XMFLOAT3(3.f, -10.35f, 4.3f), 0.f, 1.f },
+    };
+
+    // Uncompressed 32 bit DDS cube map, blue above the horizon fading to brown below it
+    std::vector<uint8_t> MakeSkyDds(uint32_t size)
+    {
+        std::vector<uint8_t> dds(128 + size_t(size) * size * 4 * 6, 0);
+        auto write = [&dds](size_t offset, uint32_t value)
+        {
+            memcpy(&dds[offset], &value, sizeof(value));
+        };
+        write(0, 0x20534444);       // "DDS "
+        write(4, 124);
+        write(12, size);
+        write(16, size);
+        write(28, 1);
+        write(76, 32);
+        write(80, 0x41);            // RGB with alpha
+        write(88, 32);
+        write(92, 0x00ff0000);
+        write(96, 0x0000ff00);
+        write(100, 0x000000ff);
+        write(104, 0xff000000);
+        write(112, 0xfe00);         // Cube map with all six faces
+        for (uint32_t face = 0; face < 6; face++)
+        {
+            for (uint32_t y = 0; y < size; y++)
+            {
+                const uint32_t red = face == 3 ? 90 : 70;
+                const uint32_t green = face == 3 ? 70 : 130 + y * 60 / size;
+                const uint32_t blue = face == 3 ? 40 : 230 - y * 60 / size;
+                for (uint32_t x = 0; x < size; x++)
+                {
+                    write(128 + ((size_t(face) * size + y) * size + x) * 4, 0xff000000 | (red << 16) | (green << 8) | blue);
+                }
+            }
+        }
+        return dds;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: SoftwareRasterizerBenchmark gameDirectory\n");
+        return 1;
+    }
+    const std::string directory = std::string(argv[1]) + "/";
+
+    // Each model and texture is loaded once, however many times it is placed
+    std::map<std::string, MeshData> meshes;
+    std::map<std::string, std::unique_ptr<SoftwareTexture>> textures;
+    size_t triangles = 0;
+    for (const Placement& placement : CampsitePlacements)
+    {
+        if (meshes.find(placement.model) == meshes.end())
+        {
+            ObjData obj;
+            const std::string filename = directory + "Models/" + placement.model + ".obj";
+            if (!ObjLoader::LoadFile(filename.c_str(), obj))
+            {
+                fprintf(stderr, "%s didn't load\n", filename.c_str());
+                return 1;
+            }
+            MeshWelder::WeldObj(obj, meshes[placement.model]);
+        }
+        if (textures.find(placement.texture) == textures.end())
+        {
+            std::unique_ptr<SoftwareTexture> texture = std::make_unique<SoftwareTexture>();
+            const std::string filename = directory + "Textures/" + placement.texture + ".dds";
+            if (!texture->LoadDds(filename.c_str()))
+            {
+                printf("  %s.dds isn't there, drawn white\n", placement.texture);
+                texture.reset();
+            }
+            textures[placement.texture] = std::move(texture);
+        }
+        triangles += meshes[placement.model].indices.size() / 3;
+    }
+
+    SoftwareTexture sky;
+    if (!sky.LoadDds((directory + "Textures/skybox3.dds").c_str()))
+    {
+        const std::vector<uint8_t> dds = MakeSkyDds(256);
+        sky.LoadDds(dds.data(), dds.size());
+    }
+
+    std::vector<XMFLOAT4X4> worlds;
+    for (const Placement& placement : CampsitePlacements)
+    {
+        worlds.emplace_back();
+        XMStoreFloat4x4(&worlds.back(), XMMatrixMultiply(XMMatrixMultiply(XMMatrixScaling(placement.scale, placement.scale, placement.scale),
+            XMMatrixRotationY(placement.yaw)), XMMatrixTranslation(placement.position.x, placement.position.y, placement.position.z)));
+    }
+
+    const SoftwareLight light = { XMFLOAT4(.3f, .3f, .3f, 1.f), XMFLOAT4(1.f, 1.f, 1.f, 1.f), XMFLOAT3(-20.f, 10.f, -15.f), 0.f };
+    const XMMATRIX view = XMMatrixLookAtRH(XMVectorSet(2.f, -9.5f, -1.5f, 1.f), XMVectorSet(2.f, -10.f, 3.f, 1.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+
+    printf("SoftwareRasterizerBenchmark, %zu draws of %zu triangles, %u threads\n", worlds.size(), triangles, JobSystem::Get().GetThreadCount());
+    const uint32_t sizes[2][2] = { { 800, 600 }, { 3840, 2160 } };
+    for (const uint32_t* size : sizes)
+    {
+        SoftwareRasterizer rasterizer;
+        rasterizer.Resize(size[0], size[1]);
+        const XMMATRIX projection = XMMatrixPerspectiveFovRH(XMConvertToRadians(70.f), float(size[0]) / float(size[1]), 0.01f, 100.f);
+        for (unsigned int threadCount : { 1u, 0u })
+        {
+            auto drawFrame = [&]()
+            {
+                rasterizer.Begin(view, projection, light, &sky);
+                for (size_t i = 0; i < worlds.size(); i++)
+                {
+                    const MeshData& mesh = meshes[CampsitePlacements[i].model];
+                    rasterizer.DrawMesh(mesh.vertices.data(), mesh.indices.data(), mesh.indices.size(), XMLoadFloat4x4(&worlds[i]),
+                        textures[CampsitePlacements[i].texture].get(), XMFLOAT4(1.f, 1.f, 1.f, 1.f));
+                }
+                rasterizer.Render(threadCount);
+            };
+
+            // The first frame sizes the buffers, the rest are timed
+            drawFrame();
+            const int frames = size[0] > 1000 ? 5 : 20;
+            Tests::Stopwatch stopwatch;
+            for (int frame = 0; frame < frames; frame++)
+            {
+                drawFrame();
+            }
+            const double seconds = stopwatch.GetSeconds() / frames;
+            const SoftwareRasterStats& stats = rasterizer.GetStats();
+            printf("  %ux%u, %-11s: %.2f ms (%.1f fps), %u of %u triangles drawn, %u binned, %u pixels shaded, %u sky\n", size[0], size[1],
+                threadCount == 1 ? "1 thread" : "all threads", seconds * 1000.0, 1.0 / seconds, stats.rasterizedTriangles, stats.triangles,
+                stats.binnedTriangles, stats.shadedPixels, stats.skyPixels);
+        }
+
+        char filename[64];
+        snprintf(filename, sizeof(filename), "campsite_%ux%u.tga", size[0], size[1]);
+        if (!SoftwareTexture::WriteTga(filename, rasterizer.GetWidth(), rasterizer.GetHeight(), rasterizer.GetColor(), rasterizer.GetPitch()))
+        {
+            fprintf(stderr, "could not write %s\n", filename);
+            return 1;
+        }
+        printf("  written to %s\n", filename);
+    }
+    return 0;
+}
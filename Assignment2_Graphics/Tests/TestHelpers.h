@@ -0,0 +1,158 @@
+//
+// TestHelpers.h - Checks, timing, random numbers and boxes shared by the test and benchmark executables
+//
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+
+// Reports a condition that doesn't hold and carries on, so one run lists every failure
+#define DX_CHECK(condition) DX::Tests::Check(!!(condition), #condition, __FILE__, __LINE__)
+
+namespace DX
+{
+    namespace Tests
+    {
+        inline int& GetFailureCount() noexcept
+        {
+            static int s_failures = 0;
+            return s_failures;
+        }
+
+        inline bool Check(bool passed, const char* condition, const char* file, int line)
+        {
+            if (!passed)
+            {
+                fprintf(stderr, "%s(%d): check failed: %s\n", file, line, condition);
+                GetFailureCount()++;
+            }
+            return passed;
+        }
+
+        // Prints the outcome and returns main's exit code
+        inline int Finish(const char* name)
+        {
+            const int failures = GetFailureCount();
+            printf("%s: %s (%d failed checks)\n", name, failures == 0 ? "passed" : "FAILED", failures);
+            return failures == 0 ? 0 : 1;
+        }
+
+        // File name without its directories, for output
+        inline const char* GetFileName(const char* path) noexcept
+        {
+            const char* name = path;
+            for (const char* c = path; *c; c++)
+            {
+                if (*c == '/' || *c == '\\')
+                {
+                    name = c + 1;
+                }
+            }
+            return name;
+        }
+
+        class Stopwatch
+        {
+        public:
+            Stopwatch() noexcept : m_start(std::chrono::steady_clock::now()) {}
+
+            void Restart() noexcept { m_start = std::chrono::steady_clock::now(); }
+            double GetSeconds() const noexcept
+            {
+                return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+            }
+
+        private:
+            std::chrono::steady_clock::time_point m_start;
+        };
+
+        // One generator per executable, main seeds it so each run draws the same numbers
+        inline std::mt19937& GetRandom() noexcept
+        {
+            static std::mt19937 s_random;
+            return s_random;
+        }
+
+        inline void SeedRandom(uint32_t seed)
+        {
+            GetRandom().seed(seed);
+        }
+
+        inline float Random(float minimum, float maximum)
+        {
+            return std::uniform_real_distribution<float>(minimum, maximum)(GetRandom());
+        }
+
+        // 0 to count - 1
+        inline uint32_t RandomIndex(size_t count)
+        {
+            return static_cast<uint32_t>(GetRandom()() % count);
+        }
+
+        struct Box
+        {
+            DirectX::XMFLOAT3 boundsMin;
+            DirectX::XMFLOAT3 boundsMax;
+        };
+
+        inline DirectX::XMVECTOR GetCenter(const Box& box) noexcept
+        {
+            return DirectX::XMVectorScale(DirectX::XMVectorAdd(DirectX::XMLoadFloat3(&box.boundsMin), DirectX::XMLoadFloat3(&box.boundsMax)), 0.5f);
+        }
+
+        inline DirectX::XMVECTOR GetExtents(const Box& box) noexcept
+        {
+            return DirectX::XMVectorScale(DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&box.boundsMax), DirectX::XMLoadFloat3(&box.boundsMin)), 0.5f);
+        }
+
+        // A tree or tent sized box standing somewhere on the ground
+        inline Box GetRandomGroundBox(float extent)
+        {
+            const float x = Random(-extent, extent);
+            const float z = Random(-extent, extent);
+            const float y = Random(0.f, 2.f);
+            const float size = Random(0.3f, 2.f);
+            const float height = Random(1.f, 6.f);
+            return { DirectX::XMFLOAT3(x - size, y, z - size), DirectX::XMFLOAT3(x + size, y + height, z + size) };
+        }
+
+        // Slab test over the part of the ray from minDistance to maxDistance, with the same arithmetic as
+        // DynamicBvh::RayCast. distance is where the ray enters the box, or minDistance when it starts inside.
+        inline bool RayHitsBox(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float minDistance, float maxDistance,
+            const Box& box, float& distance)
+        {
+            float nearest = minDistance;
+            float furthest = maxDistance;
+            const float* o = &origin.x;
+            const float* d = &direction.x;
+            const float* minimum = &box.boundsMin.x;
+            const float* maximum = &box.boundsMax.x;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (d[axis] == 0.f)
+                {
+                    if (o[axis] < minimum[axis] || o[axis] > maximum[axis])
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+                const float inverse = 1.f / d[axis];
+                const float t0 = (minimum[axis] - o[axis]) * inverse;
+                const float t1 = (maximum[axis] - o[axis]) * inverse;
+                nearest = std::max(nearest, std::min(t0, t1));
+                furthest = std::min(furthest, std::max(t0, t1));
+                if (nearest > furthest)
+                {
+                    return false;
+                }
+            }
+            distance = nearest;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+//
+// TestMeshes.h - Meshes shared by the test and benchmark executables: the game's models prepared as
+// ModelClass prepares them, and a generated UV sphere of any size
+//
+
+#pragma once
+
+#include "MeshData.h"
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshWelder.h"
+#include "MtlLoader.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace DX
+{
+    namespace Tests
+    {
+        // Welded, with levels of detail, reordered and clustered, the steps of ModelClass::LoadModel.
+        // materialLibraries gets the OBJ's mtllib names, the dependencies ModelClass writes its cache with.
+        inline bool LoadModel(const char* filename, MeshData& mesh, std::vector<std::string>& materialLibraries)
+        {
+            ObjData obj;
+            if (!ObjLoader::LoadFile(filename, obj))
+            {
+                return false;
+            }
+            materialLibraries = obj.materialLibraries;
+            std::vector<MeshMaterial> materials;
+            MtlLoader::ResolveMaterials(filename, obj, materials);
+            MeshWelder::WeldObj(obj, mesh);
+            mesh.materials.swap(materials);
+            MeshSimplifier::BuildLods(mesh);
+            MeshOptimizer::Optimize(mesh);
+            MeshletBuilder::Build(mesh);
+            return true;
+        }
+
+        inline bool LoadModel(const char* filename, MeshData& mesh)
+        {
+            std::vector<std::string> materialLibraries;
+            return LoadModel(filename, mesh, materialLibraries);
+        }
+
+        // A UV sphere of radius 0.5 with outward counter-clockwise faces, split along its seam like an
+        // exported one. The pole rows are fans so no triangle is degenerate. About segments squared triangles.
+        inline void BuildSphere(int segments, MeshData& mesh)
+        {
+            const int rings = segments / 2;
+            const float pi = 3.14159265f;
+            for (int ring = 0; ring <= rings; ring++)
+            {
+                const float latitude = float(ring) * pi / float(rings) - 0.5f * pi;
+                for (int segment = 0; segment <= segments; segment++)
+                {
+                    const float longitude = float(segment) * 2.f * pi / float(segments);
+                    MeshVertex vertex;
+                    vertex.normal = DirectX::XMFLOAT3(std::cos(latitude) * std::cos(longitude), std::sin(latitude), std::cos(latitude) * std::sin(longitude));
+                    vertex.position = DirectX::XMFLOAT3(vertex.normal.x * 0.5f, vertex.normal.y * 0.5f, vertex.normal.z * 0.5f);
+                    vertex.texture = DirectX::XMFLOAT2(float(segment) / float(segments), 1.f - float(ring) / float(rings));
+                    mesh.vertices.push_back(vertex);
+                }
+            }
+
+            const uint32_t stride = uint32_t(segments + 1);
+            for (int ring = 0; ring < rings; ring++)
+            {
+                for (int segment = 0; segment < segments; segment++)
+                {
+                    const uint32_t a = uint32_t(ring) * stride + uint32_t(segment);
+                    const uint32_t b = a + 1;
+                    const uint32_t c = a + stride;
+                    const uint32_t d = c + 1;
+                    if (ring > 0)
+                    {
+                        mesh.indices.insert(mesh.indices.end(), { a, c, b });
+                    }
+                    if (ring < rings - 1)
+                    {
+                        mesh.indices.insert(mesh.indices.end(), { b, c, d });
+                    }
+                }
+            }
+            mesh.subsets.push_back({ 0, 0, uint32_t(mesh.indices.size()), 0 });
+        }
+    }
+}
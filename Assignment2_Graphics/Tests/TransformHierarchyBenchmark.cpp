@@ -0,0 +1,80 @@
+//
+// TransformHierarchyBenchmark.cpp - Update of a large hierarchy with every node, no node and a few nodes changed
+//
+//   TransformHierarchyBenchmark [nodeCount] [dirtyCount]
+//
+// 100,000 nodes unless told otherwise, a tenth of them roots and the rest children of a random
+// earlier node. The partial update changes 100 random nodes, which also recomputes their subtrees.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "TransformHierarchy.h"
+
+#include <cstdlib>
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    // Best of the runs in milliseconds, the changes are made before each run's stopwatch starts
+    template <typename Change>
+    double Measure(TransformHierarchy& hierarchy, Change change, size_t& updated)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 20; run++)
+        {
+            change();
+            Stopwatch stopwatch;
+            updated = hierarchy.Update();
+            best = std::min(best, stopwatch.GetSeconds() * 1000.0);
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const uint32_t nodeCount = argc > 1 ? uint32_t(strtoul(argv[1], nullptr, 10)) : 100000;
+    const uint32_t dirtyCount = argc > 2 ? uint32_t(strtoul(argv[2], nullptr, 10)) : 100;
+
+    SeedRandom(12);
+    TransformHierarchy hierarchy;
+    hierarchy.Reserve(nodeCount);
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        const uint32_t parent = i == 0 || RandomIndex(10) == 0 ? TransformHierarchy::NoParent : RandomIndex(i);
+        hierarchy.AddNode(parent, XMVectorSet(Random(-10.f, 10.f), Random(-10.f, 10.f), Random(-10.f, 10.f), 0.f),
+            XMQuaternionNormalize(XMVectorSet(Random(-1.f, 1.f), Random(-1.f, 1.f), Random(-1.f, 1.f), 1.f)));
+    }
+    hierarchy.Update();
+
+    printf("TransformHierarchyBenchmark, %u nodes\n", nodeCount);
+    size_t updated = 0;
+    const double fullMs = Measure(hierarchy, [&]
+    {
+        for (uint32_t i = 0; i < nodeCount; i++)
+        {
+            hierarchy.SetLocalScale(i, XMVectorReplicate(Random(.9f, 1.1f)));
+        }
+    }, updated);
+    printf("  every node changed: %8.3f ms, %6.1f ns a node, %zu updated\n", fullMs, fullMs * 1e6 / nodeCount, updated);
+
+    const double idleMs = Measure(hierarchy, [] {}, updated);
+    printf("  nothing changed   : %8.3f ms, %6.1f ns a node, %zu updated\n", idleMs, idleMs * 1e6 / nodeCount, updated);
+
+    size_t totalUpdated = 0;
+    const double dirtyMs = Measure(hierarchy, [&]
+    {
+        totalUpdated += updated;
+        for (uint32_t i = 0; i < dirtyCount; i++)
+        {
+            hierarchy.SetLocalPosition(RandomIndex(nodeCount), XMVectorSet(Random(-10.f, 10.f), 0.f, Random(-10.f, 10.f), 0.f));
+        }
+    }, updated);
+    printf("  %u nodes changed : %8.3f ms, %6.1f ns a node, about %zu updated with their subtrees\n", dirtyCount, dirtyMs,
+        dirtyMs * 1e6 / nodeCount, (totalUpdated + updated) / 20);
+    return 0;
+}
@@ -0,0 +1,239 @@
+//
+// TransformHierarchyTests.cpp - Cached world matrices against recomputing every node from its chain of parents
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "TransformHierarchy.h"
+
+using namespace DirectX;
+using namespace DX;
+using namespace DX::Tests;
+
+namespace
+{
+    struct Matrix
+    {
+        double m[4][4];
+    };
+
+    Matrix Multiply(const Matrix& a, const Matrix& b)
+    {
+        Matrix result = {};
+        for (int row = 0; row < 4; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    result.m[row][column] += a.m[row][k] * b.m[k][column];
+                }
+            }
+        }
+        return result;
+    }
+
+    // The local transforms the test gave each node, kept apart from the hierarchy
+    struct Node
+    {
+        uint32_t parent;
+        XMFLOAT3 position;
+        XMFLOAT4 rotation;
+        XMFLOAT3 scale;
+    };
+
+    // Scale, then rotation, then translation, in doubles and the row vector convention
+    Matrix GetLocal(const Node& node)
+    {
+        const double x = node.rotation.x, y = node.rotation.y, z = node.rotation.z, w = node.rotation.w;
+        const double rotation[3][3] = {
+            { 1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w) },
+            { 2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w) },
+            { 2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y) } };
+        const double scale[3] = { node.scale.x, node.scale.y, node.scale.z };
+        Matrix local = {};
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 3; column++)
+            {
+                local.m[row][column] = scale[row] * rotation[row][column];
+            }
+        }
+        local.m[3][0] = node.position.x;
+        local.m[3][1] = node.position.y;
+        local.m[3][2] = node.position.z;
+        local.m[3][3] = 1.0;
+        return local;
+    }
+
+    // Walks up to the root every time, nothing cached
+    Matrix GetWorld(const std::vector<Node>& nodes, uint32_t index)
+    {
+        Matrix world = GetLocal(nodes[index]);
+        for (uint32_t parent = nodes[index].parent; parent != TransformHierarchy::NoParent; parent = nodes[parent].parent)
+        {
+            world = Multiply(world, GetLocal(nodes[parent]));
+        }
+        return world;
+    }
+
+    bool IsInSubtree(const std::vector<Node>& nodes, uint32_t index, const std::vector<bool>& changed)
+    {
+        for (uint32_t node = index; node != TransformHierarchy::NoParent; node = nodes[node].parent)
+        {
+            if (changed[node])
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void CheckWorlds(const TransformHierarchy& hierarchy, const std::vector<Node>& nodes)
+    {
+        DX_CHECK(hierarchy.GetNodeCount() == nodes.size());
+        double largestError = 0.0;
+        for (uint32_t i = 0; i < nodes.size(); i++)
+        {
+            const Matrix expected = GetWorld(nodes, i);
+            const XMFLOAT4X4& world = hierarchy.GetWorld(i);
+            for (int row = 0; row < 4; row++)
+            {
+                for (int column = 0; column < 4; column++)
+                {
+                    const double error = std::fabs(world.m[row][column] - expected.m[row][column]) / (1.0 + std::fabs(expected.m[row][column]));
+                    largestError = std::max(largestError, error);
+                }
+            }
+        }
+        DX_CHECK(largestError < 1e-4);
+    }
+
+    XMVECTOR RandomPosition()
+    {
+        return XMVectorSet(Random(-10.f, 10.f), Random(-10.f, 10.f), Random(-10.f, 10.f), 0.f);
+    }
+
+    XMVECTOR RandomRotation()
+    {
+        return XMQuaternionNormalize(XMVectorSet(Random(-1.f, 1.f), Random(-1.f, 1.f), Random(-1.f, 1.f), Random(.1f, 1.f)));
+    }
+
+    XMVECTOR RandomScale()
+    {
+        return XMVectorSet(Random(.8f, 1.25f), Random(.8f, 1.25f), Random(.8f, 1.25f), 0.f);
+    }
+
+    uint32_t Add(TransformHierarchy& hierarchy, std::vector<Node>& nodes, uint32_t parent)
+    {
+        Node node;
+        node.parent = parent;
+        XMStoreFloat3(&node.position, RandomPosition());
+        XMStoreFloat4(&node.rotation, RandomRotation());
+        XMStoreFloat3(&node.scale, RandomScale());
+        nodes.push_back(node);
+        return hierarchy.AddNode(parent, XMLoadFloat3(&node.position), XMLoadFloat4(&node.rotation), XMLoadFloat3(&node.scale));
+    }
+
+    // A forest of random trees and one long chain, changed a few nodes at a time. Update recomputes
+    // exactly the changed nodes and their descendants, and every world matrix matches.
+    void TestUpdate()
+    {
+        TransformHierarchy hierarchy;
+        std::vector<Node> nodes;
+        for (uint32_t i = 0; i < 2000; i++)
+        {
+            const uint32_t parent = i == 0 || RandomIndex(10) == 0 ? TransformHierarchy::NoParent : RandomIndex(i);
+            DX_CHECK(Add(hierarchy, nodes, parent) == i);
+            DX_CHECK(hierarchy.GetParent(i) == parent);
+        }
+        for (uint32_t i = 0; i < 100; i++)
+        {
+            Add(hierarchy, nodes, i == 0 ? TransformHierarchy::NoParent : uint32_t(nodes.size() - 1));
+        }
+        DX_CHECK(hierarchy.Update() == nodes.size());
+        CheckWorlds(hierarchy, nodes);
+        DX_CHECK(hierarchy.Update() == 0);
+
+        for (int round = 0; round < 50; round++)
+        {
+            std::vector<bool> changed(nodes.size(), false);
+            const size_t changeCount = 1 + RandomIndex(round % 10 == 0 ? 200 : 5);
+            for (size_t c = 0; c < changeCount; c++)
+            {
+                const uint32_t node = RandomIndex(nodes.size());
+                changed[node] = true;
+                switch (RandomIndex(3))
+                {
+                case 0:
+                    XMStoreFloat3(&nodes[node].position, RandomPosition());
+                    hierarchy.SetLocalPosition(node, XMLoadFloat3(&nodes[node].position));
+                    break;
+                case 1:
+                    XMStoreFloat4(&nodes[node].rotation, RandomRotation());
+                    hierarchy.SetLocalRotation(node, XMLoadFloat4(&nodes[node].rotation));
+                    break;
+                default:
+                    XMStoreFloat3(&nodes[node].scale, RandomScale());
+                    hierarchy.SetLocalScale(node, XMLoadFloat3(&nodes[node].scale));
+                    break;
+                }
+            }
+
+            // Nodes added between updates are computed by the next one
+            if (round % 7 == 0)
+            {
+                changed.push_back(true);
+                Add(hierarchy, nodes, RandomIndex(nodes.size()));
+            }
+
+            size_t expectedCount = 0;
+            for (uint32_t i = 0; i < nodes.size(); i++)
+            {
+                expectedCount += IsInSubtree(nodes, i, changed) ? 1 : 0;
+            }
+            DX_CHECK(hierarchy.Update() == expectedCount);
+            CheckWorlds(hierarchy, nodes);
+            DX_CHECK(hierarchy.Update() == 0);
+        }
+    }
+
+    // A parent has to exist before its children, and a refused node leaves the hierarchy as it was
+    void TestAddOrder()
+    {
+        TransformHierarchy hierarchy;
+        const uint32_t root = hierarchy.AddNode(TransformHierarchy::NoParent, XMVectorSet(1.f, 2.f, 3.f, 0.f));
+        for (uint32_t parent : { 1u, 2u, 100u })
+        {
+            bool threw = false;
+            try
+            {
+                hierarchy.AddNode(parent, XMVectorZero());
+            }
+            catch (const std::out_of_range&)
+            {
+                threw = true;
+            }
+            DX_CHECK(threw);
+            DX_CHECK(hierarchy.GetNodeCount() == 1);
+        }
+
+        const uint32_t child = hierarchy.AddNode(root, XMVectorSet(1.f, 0.f, 0.f, 0.f));
+        DX_CHECK(child == 1 && hierarchy.GetParent(child) == root);
+        DX_CHECK(hierarchy.Update() == 2);
+        DX_CHECK(hierarchy.GetWorld(child)._41 == 2.f && hierarchy.GetWorld(child)._42 == 2.f && hierarchy.GetWorld(child)._43 == 3.f);
+
+        hierarchy.Clear();
+        DX_CHECK(hierarchy.GetNodeCount() == 0 && hierarchy.Update() == 0);
+        DX_CHECK(hierarchy.AddNode(TransformHierarchy::NoParent, XMVectorZero()) == 0);
+    }
+}
+
+int main()
+{
+    SeedRandom(12);
+    TestUpdate();
+    TestAddOrder();
+
+    return Tests::Finish("TransformHierarchyTests");
+}
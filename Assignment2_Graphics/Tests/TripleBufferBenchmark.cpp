@@ -0,0 +1,193 @@
+//
+// TripleBufferBenchmark.cpp - Snapshot hand off rate, and frames per second with Update on its own thread or not
+//
+//   TripleBufferBenchmark [seconds]
+//
+// First a writer publishes snapshots the size of the game's, 27 world matrices and 408 point lights
+// both current and previous, as fast as it can while a reader takes them. Then a frame loop is run
+// for each split of update, render and present time below, 2 seconds each unless told otherwise:
+// serially, Update then Render the way Game::Tick does it on the window's thread, and pipelined, with
+// Update stepping back to back on an UpdateThread while Render blends the newest snapshot. Work is
+// a busy wait on the clock, present a sleep.
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "ClusteredLightCuller.h"
+#include "TripleBuffer.h"
+#include "UpdateThread.h"
+
+#include <cstdlib>
+#include <thread>
+
+using namespace DirectX;
+using namespace DX;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct SimulationState
+    {
+        XMFLOAT3 cameraPosition;
+        std::vector<XMFLOAT4X4> worlds;
+        std::vector<PointLight> pointLights;
+    };
+
+    struct FrameSnapshot
+    {
+        SimulationState previous;
+        SimulationState current;
+        Clock::time_point published;
+        double stepSeconds;
+    };
+
+    void BusyWait(double seconds)
+    {
+        const Clock::time_point end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        while (Clock::now() < end)
+        {
+        }
+    }
+
+    // Stands in for Game::Update, the world moves with the simulation time
+    struct Simulation
+    {
+        SimulationState state;
+        SimulationState previous;
+        double time = 0.0;
+
+        Simulation()
+        {
+            state.worlds.resize(27);
+            state.pointLights.resize(51 * 8);
+        }
+
+        void Update(double workSeconds)
+        {
+            previous = state;
+            time += 1.0 / 60.0;
+            BusyWait(workSeconds);
+            state.cameraPosition = XMFLOAT3(float(time), 0.f, 0.f);
+            for (size_t i = 0; i < state.worlds.size(); i++)
+            {
+                XMStoreFloat4x4(&state.worlds[i], XMMatrixTranslation(float(time + double(i)), 0.f, 0.f));
+            }
+            for (PointLight& light : state.pointLights)
+            {
+                light.intensity = float(time);
+            }
+        }
+    };
+
+    void Publish(TripleBuffer<FrameSnapshot>& snapshots, const Simulation& simulation, double stepSeconds)
+    {
+        FrameSnapshot& snapshot = snapshots.GetWriteBuffer();
+        snapshot.previous = simulation.previous;
+        snapshot.current = simulation.state;
+        snapshot.published = Clock::now();
+        snapshot.stepSeconds = stepSeconds;
+        snapshots.Publish();
+    }
+
+    void MeasureHandOff(double seconds)
+    {
+        TripleBuffer<FrameSnapshot> snapshots;
+        Simulation simulation;
+        std::atomic<bool> done(false);
+        uint64_t publishes = 0;
+        std::thread writer([&]()
+        {
+            while (!done)
+            {
+                Publish(snapshots, simulation, 0.0);
+                publishes++;
+            }
+        });
+
+        uint64_t acquires = 0;
+        Tests::Stopwatch stopwatch;
+        while (stopwatch.GetSeconds() < seconds)
+        {
+            acquires += snapshots.Acquire() ? 1 : 0;
+        }
+        done = true;
+        writer.join();
+        printf("  hand off: %.0f snapshots published and %.0f taken a second\n", publishes / seconds, acquires / seconds);
+    }
+
+    // Frames and updates a second of one split of the frame's time, in milliseconds
+    void MeasureFrames(double updateMs, double renderMs, double presentMs, bool pipelined, double seconds)
+    {
+        TripleBuffer<FrameSnapshot> snapshots;
+        Simulation simulation;
+        UpdateThread thread;
+        if (pipelined)
+        {
+            thread.Start(0.0, [&]()
+            {
+                simulation.Update(updateMs / 1000.0);
+                Publish(snapshots, simulation, 1.0 / 60.0);
+            });
+        }
+
+        std::vector<XMFLOAT4X4> worlds;
+        uint64_t frames = 0;
+        uint64_t serialUpdates = 0;
+        bool hasSnapshot = false;
+        Tests::Stopwatch stopwatch;
+        while (stopwatch.GetSeconds() < seconds)
+        {
+            if (!pipelined)
+            {
+                simulation.Update(updateMs / 1000.0);
+                serialUpdates++;
+                Publish(snapshots, simulation, 0.0);
+            }
+            hasSnapshot = snapshots.Acquire() || hasSnapshot;
+            if (!hasSnapshot)
+            {
+                continue;
+            }
+
+            // Blend the way Game::ApplySnapshot does, then render and present
+            const FrameSnapshot& snapshot = snapshots.GetReadBuffer();
+            const float t = snapshot.stepSeconds > 0.0 ?
+                float(std::min(1.0, std::chrono::duration<double>(Clock::now() - snapshot.published).count() / snapshot.stepSeconds)) : 1.f;
+            worlds.resize(snapshot.current.worlds.size());
+            for (size_t i = 0; i < worlds.size(); i++)
+            {
+                const XMFLOAT4X4& from = i < snapshot.previous.worlds.size() ? snapshot.previous.worlds[i] : snapshot.current.worlds[i];
+                const XMFLOAT4X4& to = snapshot.current.worlds[i];
+                for (int k = 0; k < 16; k++)
+                {
+                    (&worlds[i]._11)[k] = (&from._11)[k] + ((&to._11)[k] - (&from._11)[k]) * t;
+                }
+            }
+            BusyWait(renderMs / 1000.0);
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(presentMs));
+            frames++;
+        }
+        const double elapsed = stopwatch.GetSeconds();
+        thread.Stop();
+
+        const uint64_t updates = pipelined ? thread.GetStepCount() : serialUpdates;
+        printf("  %-9s update %4.1f ms, render %4.1f ms, present %4.1f ms: %6.1f frames and %6.1f updates a second\n",
+            pipelined ? "pipelined" : "serial", updateMs, renderMs, presentMs, frames / elapsed, updates / elapsed);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const double seconds = argc > 1 ? strtod(argv[1], nullptr) : 2.0;
+    printf("TripleBufferBenchmark, %u hardware threads\n", std::thread::hardware_concurrency());
+    MeasureHandOff(seconds);
+
+    const double splits[][3] = { { 4.0, 4.0, 2.0 }, { 8.0, 4.0, 4.0 }, { 2.0, 8.0, 4.0 }, { 8.0, 8.0, 0.0 } };
+    for (const double* split : splits)
+    {
+        MeasureFrames(split[0], split[1], split[2], false, seconds);
+        MeasureFrames(split[0], split[1], split[2], true, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+//
+// TripleBufferTests.cpp - Hand off order and slot ownership, a writer and reader racing, and UpdateThread's steps
+//
+
+#include "pch.h"
+#include "TestHelpers.h"
+#include "TripleBuffer.h"
+#include "UpdateThread.h"
+
+#include <thread>
+#include <vector>
+
+using namespace DX;
+
+namespace
+{
+    struct Snapshot
+    {
+        uint64_t sequence;
+        std::vector<uint64_t> values;   // All equal to sequence once published
+    };
+
+    // One thread: the reader gets the newest value and keeps it until something newer comes
+    void TestHandOff()
+    {
+        TripleBuffer<int> buffer;
+        DX_CHECK(!buffer.Acquire());
+
+        buffer.GetWriteBuffer() = 1;
+        buffer.Publish();
+        DX_CHECK(buffer.Acquire());
+        DX_CHECK(buffer.GetReadBuffer() == 1);
+        DX_CHECK(!buffer.Acquire());
+        DX_CHECK(buffer.GetReadBuffer() == 1);
+
+        // Values published before the reader looks are skipped, not queued
+        for (int value = 2; value <= 5; value++)
+        {
+            buffer.GetWriteBuffer() = value;
+            buffer.Publish();
+            DX_CHECK(&buffer.GetWriteBuffer() != &buffer.GetReadBuffer());
+            DX_CHECK(buffer.GetReadBuffer() == 1);
+        }
+        DX_CHECK(buffer.Acquire());
+        DX_CHECK(buffer.GetReadBuffer() == 5);
+        DX_CHECK(!buffer.Acquire());
+
+        // The writer and reader never share a slot, and together with the middle use all three
+        const int* slots[3] = {};
+        for (int round = 0; round < 3; round++)
+        {
+            buffer.GetWriteBuffer() = 10 + round;
+            slots[round] = &buffer.GetWriteBuffer();
+            buffer.Publish();
+            DX_CHECK(&buffer.GetWriteBuffer() != &buffer.GetReadBuffer());
+            DX_CHECK(buffer.Acquire());
+            DX_CHECK(buffer.GetReadBuffer() == 10 + round);
+            DX_CHECK(&buffer.GetReadBuffer() == slots[round]);
+        }
+        DX_CHECK(slots[0] != slots[1] && slots[1] != slots[2] && slots[0] != slots[2]);
+    }
+
+    // A writer publishing as fast as it can while the reader checks every snapshot it takes is
+    // whole, newer than the last one and never changed under it
+    void TestRace()
+    {
+        const uint64_t publishCount = 500000;
+        TripleBuffer<Snapshot> buffer;
+        std::atomic<bool> done(false);
+        std::thread writer([&]()
+        {
+            for (uint64_t sequence = 1; sequence <= publishCount; sequence++)
+            {
+                Snapshot& snapshot = buffer.GetWriteBuffer();
+                snapshot.sequence = sequence;
+                snapshot.values.assign(64, sequence);
+                buffer.Publish();
+            }
+            done = true;
+        });
+
+        uint64_t last = 0;
+        uint64_t acquired = 0;
+        uint64_t torn = 0;
+        uint64_t stale = 0;
+        for (;;)
+        {
+            const bool writerDone = done.load();
+            if (buffer.Acquire())
+            {
+                const Snapshot& snapshot = buffer.GetReadBuffer();
+                acquired++;
+                stale += snapshot.sequence <= last ? 1 : 0;
+                last = snapshot.sequence;
+                for (int pass = 0; pass < 2; pass++)
+                {
+                    for (uint64_t value : snapshot.values)
+                    {
+                        if (value != last)
+                        {
+                            torn++;
+                            break;
+                        }
+                    }
+                }
+            }
+            else if (writerDone)
+            {
+                break;
+            }
+        }
+        writer.join();
+
+        DX_CHECK(acquired > 0);
+        DX_CHECK(torn == 0);
+        DX_CHECK(stale == 0);
+        DX_CHECK(last == publishCount);
+    }
+
+    // Steps run on their own thread until Stop, and not faster than the interval
+    void TestUpdateThread()
+    {
+        UpdateThread thread;
+        DX_CHECK(!thread.IsRunning());
+
+        std::atomic<uint64_t> steps(0);
+        std::thread::id stepThread;
+        thread.Start(0.0, [&]()
+        {
+            stepThread = std::this_thread::get_id();
+            steps++;
+        });
+        DX_CHECK(thread.IsRunning());
+        while (steps < 1000)
+        {
+            std::this_thread::yield();
+        }
+        thread.Stop();
+        DX_CHECK(!thread.IsRunning());
+        DX_CHECK(thread.GetStepCount() == steps);
+        DX_CHECK(stepThread != std::this_thread::get_id());
+
+        // 100 steps a second for a quarter of a second, the first runs at once
+        steps = 0;
+        Tests::Stopwatch stopwatch;
+        thread.Start(0.01, [&]() { steps++; });
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        thread.Stop();
+        DX_CHECK(thread.GetStepCount() == steps);
+        DX_CHECK(steps >= 1 && steps <= uint64_t(stopwatch.GetSeconds() * 100.0) + 1);
+
+        // Starting again counts from 0, and stopping twice is harmless
+        steps = 0;
+        thread.Start(0.0, [&]() { steps++; });
+        thread.Stop();
+        thread.Stop();
+        DX_CHECK(!thread.IsRunning());
+        DX_CHECK(thread.GetStepCount() == steps);
+    }
+}
+
+int main()
+{
+    TestHandOff();
+    TestRace();
+    TestUpdateThread();
+
+    return Tests::Finish("TripleBufferTests");
+}
@@ -0,0 +1,46 @@
+//
+// pch.h - Header for the test project, included through the game's pch.h in place of Windows,
+// Direct3D and the DirectX Tool Kit
+//
+
+#pragma once
+
+#if defined(_WIN32)
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0601
+#endif
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#include <DirectXMath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cwchar>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+
+// The profiler's zones are compiled in as in the game, unless DX_NO_PROFILE is defined
+#ifndef DX_NO_PROFILE
+#define DX_PROFILE
+#endif
+
+#if !defined(_WIN32)
+// The little the modules use of Windows and the MSVC runtime
+inline void OutputDebugStringA(const char* message)
+{
+    fputs(message, stderr);
+}
+
+template <size_t size, typename... Args>
+inline int sprintf_s(char (&buffer)[size], const char* format, Args... args)
+{
+    return snprintf(buffer, size, format, args...);
+}
+#endif
@@ -0,0 +1,115 @@
+//
+// TransformHierarchy.cpp - Scene node hierarchy in flat arrays with cached world matrices
+//
+
+#include "pch.h"
+#include "TransformHierarchy.h"
+
+using namespace DirectX;
+using namespace DX;
+
+void TransformHierarchy::Reserve(size_t nodeCount)
+{
+    m_parents.reserve(nodeCount);
+    m_positions.reserve(nodeCount);
+    m_rotations.reserve(nodeCount);
+    m_scales.reserve(nodeCount);
+    m_worlds.reserve(nodeCount);
+    m_dirty.reserve(nodeCount);
+    m_changed.reserve(nodeCount);
+}
+
+void TransformHierarchy::Clear() noexcept
+{
+    m_parents.clear();
+    m_positions.clear();
+    m_rotations.clear();
+    m_scales.clear();
+    m_worlds.clear();
+    m_dirty.clear();
+    m_changed.clear();
+}
+
+uint32_t XM_CALLCONV TransformHierarchy::AddNode(uint32_t parent, FXMVECTOR position, FXMVECTOR rotation, FXMVECTOR scale)
+{
+    const uint32_t node = static_cast<uint32_t>(m_parents.size());
+    if (parent != NoParent && parent >= node)
+    {
+        throw std::out_of_range("TransformHierarchy parent must be created before its children");
+    }
+
+    m_parents.push_back(parent);
+    m_positions.emplace_back();
+    m_rotations.emplace_back();
+    m_scales.emplace_back();
+    XMStoreFloat3(&m_positions.back(), position);
+    XMStoreFloat4(&m_rotations.back(), rotation);
+    XMStoreFloat3(&m_scales.back(), scale);
+    m_worlds.emplace_back();
+    XMStoreFloat4x4(&m_worlds.back(), XMMatrixIdentity());
+    m_dirty.push_back(1);
+    return node;
+}
+
+void XM_CALLCONV TransformHierarchy::SetLocalPosition(uint32_t node, FXMVECTOR position)
+{
+    XMStoreFloat3(&m_positions[node], position);
+    m_dirty[node] = 1;
+}
+
+void XM_CALLCONV TransformHierarchy::SetLocalRotation(uint32_t node, FXMVECTOR rotation)
+{
+    XMStoreFloat4(&m_rotations[node], rotation);
+    m_dirty[node] = 1;
+}
+
+void XM_CALLCONV TransformHierarchy::SetLocalScale(uint32_t node, FXMVECTOR scale)
+{
+    XMStoreFloat3(&m_scales[node], scale);
+    m_dirty[node] = 1;
+}
+
+size_t TransformHierarchy::Update()
+{
+    const size_t nodeCount = m_parents.size();
+    const uint32_t* parents = m_parents.data();
+    uint8_t* dirty = m_dirty.data();
+
+    // A node changes with its parent. Parents come first, so their flag is already final here.
+    m_changed.clear();
+    for (size_t i = 0; i < nodeCount; i++)
+    {
+        const uint32_t parent = parents[i];
+        if (parent != NoParent)
+        {
+            dirty[i] |= dirty[parent];
+        }
+        if (dirty[i])
+        {
+            m_changed.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    // Local matrices of every changed node, independent of each other
+    XMFLOAT4X4* worlds = m_worlds.data();
+    for (uint32_t node : m_changed)
+    {
+        XMMATRIX local = XMMatrixMultiply(XMMatrixScalingFromVector(XMLoadFloat3(&m_scales[node])),
+            XMMatrixRotationQuaternion(XMLoadFloat4(&m_rotations[node])));
+        local.r[3] = XMVectorSetW(XMLoadFloat3(&m_positions[node]), 1.f);
+        XMStoreFloat4x4(&worlds[node], local);
+    }
+
+    // Then into world space in index order, each parent's world matrix is already up to date
+    for (uint32_t node : m_changed)
+    {
+        const uint32_t parent = parents[node];
+        if (parent != NoParent)
+        {
+            XMStoreFloat4x4(&worlds[node], XMMatrixMultiply(XMLoadFloat4x4(&worlds[node]), XMLoadFloat4x4(&worlds[parent])));
+        }
+        dirty[node] = 0;
+    }
+
+    return m_changed.size();
+}
@@ -0,0 +1,54 @@
+//
+// TransformHierarchy.h - Scene node hierarchy in flat arrays with cached world matrices
+//
+
+#pragma once
+
+#include <vector>
+
+namespace DX
+{
+    // Nodes live in one array per component (structure of arrays) in creation order. A node's
+    // parent has to exist before it, so every parent comes before its children and one pass in
+    // index order sees each world matrix finished before it is needed.
+    //
+    // Local transforms are scale, then rotation (a quaternion), then translation, and the world
+    // matrix is local * parent world in the row vector convention of SimpleMath. Only nodes that
+    // were changed, or whose ancestors were, are recomputed by Update.
+    class TransformHierarchy
+    {
+    public:
+        static constexpr uint32_t NoParent = 0xFFFFFFFFu;
+
+        TransformHierarchy() = default;
+
+        void Reserve(size_t nodeCount);
+        void Clear() noexcept;
+
+        uint32_t XM_CALLCONV AddNode(uint32_t parent, DirectX::FXMVECTOR position,
+            DirectX::FXMVECTOR rotation = DirectX::g_XMIdentityR3, DirectX::FXMVECTOR scale = DirectX::g_XMOne);
+
+        void XM_CALLCONV SetLocalPosition(uint32_t node, DirectX::FXMVECTOR position);
+        void XM_CALLCONV SetLocalRotation(uint32_t node, DirectX::FXMVECTOR rotation);
+        void XM_CALLCONV SetLocalScale(uint32_t node, DirectX::FXMVECTOR scale);
+
+        // Recomputes the world matrices of the changed subtrees, returns how many there were
+        size_t Update();
+
+        // Valid after the Update that follows the node's last change
+        const DirectX::XMFLOAT4X4& GetWorld(uint32_t node) const noexcept { return m_worlds[node]; }
+        uint32_t GetParent(uint32_t node) const noexcept { return m_parents[node]; }
+        size_t GetNodeCount() const noexcept { return m_parents.size(); }
+
+    private:
+        std::vector<uint32_t> m_parents;
+        std::vector<DirectX::XMFLOAT3> m_positions;
+        std::vector<DirectX::XMFLOAT4> m_rotations;
+        std::vector<DirectX::XMFLOAT3> m_scales;
+        std::vector<DirectX::XMFLOAT4X4> m_worlds;
+        std::vector<uint8_t> m_dirty;
+
+        // Nodes recomputed by the current Update, in index order
+        std::vector<uint32_t> m_changed;
+    };
+}
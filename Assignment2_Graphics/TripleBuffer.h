@@ -0,0 +1,68 @@
+//
+// TripleBuffer.h - Hands the newest of a stream of values from one thread to another without locks
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace DX
+{
+    // One writer and one reader each own a slot of their own, and trade it for the shared middle
+    // slot when they are done with it. Neither ever waits for the other: the writer can always
+    // publish, and the reader always gets the newest value published, skipping any in between.
+    // The slot being read is never written until the reader gives it up in its next Acquire.
+    template <typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer() :
+            m_slots(),
+            m_middle(1),
+            m_write(0),
+            m_read(2)
+        {
+        }
+
+        TripleBuffer(TripleBuffer const&) = delete;
+        TripleBuffer& operator= (TripleBuffer const&) = delete;
+
+        // Writer side. The slot keeps whatever was in it, so containers in T keep their capacity.
+        T& GetWriteBuffer() noexcept { return m_slots[m_write]; }
+
+        void Publish() noexcept
+        {
+            m_write = m_middle.exchange(m_write | FreshBit, std::memory_order_acq_rel) & IndexMask;
+        }
+
+        // Reader side. Takes the newest published value, or returns false and keeps the one it
+        // has when nothing was published since.
+        bool Acquire() noexcept
+        {
+            if (!(m_middle.load(std::memory_order_relaxed) & FreshBit))
+            {
+                return false;
+            }
+            m_read = m_middle.exchange(m_read, std::memory_order_acq_rel) & IndexMask;
+            return true;
+        }
+
+        const T& GetReadBuffer() const noexcept { return m_slots[m_read]; }
+
+    private:
+        // The middle slot's index, with FreshBit set while it holds a value the reader hasn't taken
+        static constexpr uint32_t IndexMask = 3;
+        static constexpr uint32_t FreshBit = 4;
+        static constexpr size_t CacheLineBytes = 64;
+
+        // The indices are padded apart rather than aligned, C++14 doesn't align heap objects past 16 bytes
+        T m_slots[3];
+        char m_slotsPadding[CacheLineBytes];
+        std::atomic<uint32_t> m_middle;
+        char m_middlePadding[CacheLineBytes];
+        uint32_t m_write;
+        char m_writePadding[CacheLineBytes];
+        uint32_t m_read;
+    };
+}
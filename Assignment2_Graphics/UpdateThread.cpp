@@ -0,0 +1,51 @@
+//
+// UpdateThread.cpp - Runs a step function over and over on a thread of its own, paced by a FrameLimiter
+//
+
+#include "pch.h"
+#include "UpdateThread.h"
+#include "Profiler.h"
+
+using namespace DX;
+
+UpdateThread::UpdateThread() noexcept :
+    m_exit(false),
+    m_stepCount(0)
+{
+}
+
+UpdateThread::~UpdateThread()
+{
+    Stop();
+}
+
+void UpdateThread::Start(double intervalSeconds, std::function<void()> step)
+{
+    Stop();
+
+    m_step = std::move(step);
+    m_limiter.SetTargetSeconds(intervalSeconds);
+    m_exit = false;
+    m_stepCount = 0;
+    m_thread = std::thread(&UpdateThread::Run, this);
+}
+
+void UpdateThread::Stop()
+{
+    if (m_thread.joinable())
+    {
+        m_exit = true;
+        m_thread.join();
+    }
+}
+
+void UpdateThread::Run()
+{
+    DX_PROFILE_THREAD("Update");
+    while (!m_exit)
+    {
+        m_limiter.Wait();
+        m_step();
+        m_stepCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,43 @@
+//
+// UpdateThread.h - Runs a step function over and over on a thread of its own, paced by a FrameLimiter
+//
+
+#pragma once
+
+#include "FrameLimiter.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+namespace DX
+{
+    // Calls step at most once per interval until Stop, an interval of 0 calls it back to back.
+    // Whatever step shares with other threads is up to it, see TripleBuffer.
+    class UpdateThread
+    {
+    public:
+        UpdateThread() noexcept;
+        ~UpdateThread();
+
+        UpdateThread(UpdateThread const&) = delete;
+        UpdateThread& operator= (UpdateThread const&) = delete;
+
+        void Start(double intervalSeconds, std::function<void()> step);
+
+        // Waits for the step in progress to finish
+        void Stop();
+
+        bool IsRunning() const noexcept { return m_thread.joinable(); }
+        uint64_t GetStepCount() const noexcept { return m_stepCount.load(std::memory_order_relaxed); }
+
+    private:
+        void Run();
+
+        std::thread m_thread;
+        std::atomic<bool> m_exit;
+        std::atomic<uint64_t> m_stepCount;
+        std::function<void()> m_step;
+        FrameLimiter m_limiter;
+    };
+}
@@ -0,0 +1,30 @@
+//
+// Light shaders common
+// Constant buffers shared by the light vertex and pixel shaders, laid out like Shader's
+// FrameBufferType and ObjectBufferType
+//
+
+#ifndef __LIGHT_COMMON_HLSLI__
+#define __LIGHT_COMMON_HLSLI__
+
+// Uploaded once per frame and bound to both the vertex and pixel shader
+cbuffer FrameBuffer : register(b0)
+{
+    matrix viewProjectionMatrix;
+    float4 ambientColor;
+    float4 diffuseColor;
+    float3 lightPosition;
+    float padding0;
+    float3 cameraPosition;
+    float padding1;
+};
+
+// One block per draw, bound from a ring of them (see DX::ConstantRing). Instanced draws take
+// their world matrix from the instance data instead.
+cbuffer ObjectBuffer : register(b1)
+{
+    matrix worldMatrix;
+    matrix worldViewProjectionMatrix;
+};
+
+#endif
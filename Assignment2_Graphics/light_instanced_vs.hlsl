@@ -0,0 +1,50 @@
+// Light vertex shader for instanced draws
+// Same as light_vs, but each instance brings its own world matrix in vertex buffer slot 1
+
+#include "light_common.hlsli"
+
+struct InputType
+{
+    float4 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+    // World matrix rows, stored untransposed so they multiply like SimpleMath's row vectors
+    float4 world0 : WORLD0;
+    float4 world1 : WORLD1;
+    float4 world2 : WORLD2;
+    float4 world3 : WORLD3;
+};
+
+struct OutputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+	float3 position3D : TEXCOORD2;
+};
+
+OutputType main(InputType input)
+{
+    OutputType output;
+    float4x4 instanceWorld = float4x4(input.world0, input.world1, input.world2, input.world3);
+
+    input.position.w = 1.0f;
+
+    // Calculate the position of the vertex against the world, view, and projection matrices.
+    output.position = mul(input.position, instanceWorld);
+    output.position = mul(output.position, viewProjectionMatrix);
+
+    // Store the texture coordinates for the pixel shader (multiply these for tiling).
+    output.tex = input.tex;
+
+	 // Calculate the normal vector against the world matrix only.
+    output.normal = mul(input.normal, (float3x3)instanceWorld);
+
+    // Normalize the normal vector.
+    output.normal = normalize(output.normal);
+
+	// world position of vertex (for point light)
+	output.position3D = (float3)mul(input.position, instanceWorld);
+
+    return output;
+}
@@ -1,16 +1,41 @@
 // Light pixel shader
-// Calculate diffuse lighting for a single directional light (also texturing)
+// Calculate diffuse lighting for the scene light, then the point lights of the pixel's cluster (also texturing and the material colour)
 
 Texture2D shaderTexture : register(t0);
 SamplerState SampleType : register(s0);
 
 
-cbuffer LightBuffer : register(b0)
+#include "light_common.hlsli"
+
+// Point lights, laid out like DX::PointLight
+struct PointLight
+{
+    float3 position;
+    float radius;
+    float3 color;
+    float intensity;
+};
+
+// Clusters are screen tiles cut into slices of view depth, see DX::ClusteredLightCuller. Each has
+// an offset and count into the light index list.
+StructuredBuffer<PointLight> pointLights : register(t1);
+Buffer<uint2> lightClusters : register(t2);
+Buffer<uint> lightIndices : register(t3);
+
+cbuffer ClusterBuffer : register(b3)
 {
-	float4 ambientColor;
-    float4 diffuseColor;
-    float3 lightPosition;
-    float padding;
+    float4 viewDepthPlane;      // View depth of a world position p is dot(float4(p, 1), viewDepthPlane)
+    float2 tileScale;           // Tiles per pixel
+    float depthScale;           // Slice is log(view depth) * depthScale + depthBias
+    float depthBias;
+    uint3 clusterCount;
+    uint clusterPadding;
+};
+
+// Colour of the material the draw range uses, set per range by ModelClass
+cbuffer MaterialBuffer : register(b4)
+{
+    float4 materialColor;       // Kd, and the dissolve d as alpha
 };
 
 struct InputType
@@ -36,11 +61,28 @@ float4 main(InputType input) : SV_TARGET
 
 	// Determine the final amount of diffuse color based on the diffuse color combined with the light intensity.
 	color = ambientColor + (diffuseColor * lightIntensity); //adding ambient
+
+	// Add the point lights of this pixel's cluster, fading out smoothly at their radius
+	uint3 cluster;
+	cluster.xy = (uint2)(input.position.xy * tileScale);
+	cluster.z = (uint)max(log(dot(float4(input.position3D, 1.0f), viewDepthPlane)) * depthScale + depthBias, 0.0f);
+	cluster = min(cluster, clusterCount - 1);
+	uint2 range = lightClusters[(cluster.z * clusterCount.y + cluster.y) * clusterCount.x + cluster.x];
+	for (uint i = 0; i < range.y; i++)
+	{
+		PointLight light = pointLights[lightIndices[range.x + i]];
+		float3 toLight = light.position - input.position3D;
+		float distance = length(toLight);
+		float falloff = saturate(1.0f - distance / light.radius);
+		float intensity = light.intensity * falloff * falloff * saturate(dot(input.normal, toLight / max(distance, 1e-4f)));
+		color.rgb += light.color * intensity;
+	}
 	color = saturate(color);
 
-	// Sample the pixel color from the texture using the sampler at this texture coordinate location.
+	// Sample the pixel color from the texture using the sampler at this texture coordinate location,
+	// tinted by the material like an MTL map_Kd is by its Kd
 	textureColor = shaderTexture.Sample(SampleType, input.tex);
-	color = color * textureColor;
+	color = color * textureColor * materialColor;
 
     return color;
 }
@@ -0,0 +1,61 @@
+// Light vertex shader for quantized vertices
+// Same as light_vs, but decodes 16-bit positions, octahedral normals and half float UVs first
+
+#include "light_common.hlsli"
+
+// Per model decode constants: position = unorm * positionScale + positionOffset
+cbuffer QuantizationBuffer : register(b2)
+{
+    float3 positionScale;
+    float padding0;
+    float3 positionOffset;
+    float padding1;
+};
+
+struct InputType
+{
+    float4 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float2 normal : NORMAL;
+};
+
+struct OutputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+	float3 position3D : TEXCOORD2;
+};
+
+// Octahedral decode (Cigolle et al. 2014), the lower hemisphere is folded over the diagonals
+float3 DecodeOctahedral(float2 e)
+{
+    float3 n = float3(e.x, e.y, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += (n.xy >= 0.0f) ? -t : t;
+    return normalize(n);
+}
+
+OutputType main(InputType input)
+{
+    OutputType output;
+    
+    float4 position = float4(input.position.xyz * positionScale + positionOffset, 1.0f);
+
+    // Calculate the position of the vertex against the world, view, and projection matrices, combined on the CPU.
+    output.position = mul(position, worldViewProjectionMatrix);
+    
+    // Store the texture coordinates for the pixel shader (multiply these for tiling).
+    output.tex = input.tex;
+
+	 // Calculate the normal vector against the world matrix only.
+    output.normal = mul(DecodeOctahedral(input.normal), (float3x3)worldMatrix);
+	
+    // Normalize the normal vector.
+    output.normal = normalize(output.normal);
+
+	// world position of vertex (for point light)
+	output.position3D = (float3)mul(position, worldMatrix);
+
+    return output;
+}
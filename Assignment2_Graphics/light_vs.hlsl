@@ -1,12 +1,7 @@
 // Light vertex shader
 // Standard issue vertex shader, apply matrices, pass info to pixel shader
 
-cbuffer MatrixBuffer : register(b0)
-{
-    matrix worldMatrix;
-    matrix viewMatrix;
-    matrix projectionMatrix;
-};
+#include "light_common.hlsli"
 
 struct InputType
 {
@@ -29,10 +24,8 @@ OutputType main(InputType input)
     
     input.position.w = 1.0f;
 
-    // Calculate the position of the vertex against the world, view, and projection matrices.
-    output.position = mul(input.position, worldMatrix);
-    output.position = mul(output.position, viewMatrix);
-    output.position = mul(output.position, projectionMatrix);
+    // Calculate the position of the vertex against the world, view, and projection matrices, combined on the CPU.
+    output.position = mul(input.position, worldViewProjectionMatrix);
     
     // Store the texture coordinates for the pixel shader (multiply these for tiling).
     output.tex = input.tex;
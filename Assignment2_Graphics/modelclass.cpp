@@ -3,6 +3,14 @@
 ////////////////////////////////////////////////////////////////////////////////
 #include "pch.h"
 #include "modelclass.h"
+#include "ObjLoader.h"
+#include "MeshWelder.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MtlLoader.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "Shader.h"
 
 using namespace DirectX;
 
@@ -10,6 +18,19 @@ ModelClass::ModelClass()
 {
 	m_vertexBuffer = 0;
 	m_indexBuffer = 0;
+	m_vertexCount = 0;
+	m_indexCount = 0;
+	m_indexFormat = DXGI_FORMAT_R32_UINT;
+	m_vertexFormat = DX::VertexFormat::Standard;
+	m_vertexStride = sizeof(VertexType);
+	m_quantizationBuffer = 0;
+	m_boundsRadius = 0.f;
+	m_culledIndexBuffer = 0;
+	m_geometryPool = 0;
+	m_allocation = { DX::RangeAllocator::InvalidOffset, DX::RangeAllocator::InvalidOffset, 0, 0 };
+	m_softwareVertices = 0;
+	m_softwareIndices = 0;
+	m_preFab = PreFab::None;
 
 }
 ModelClass::~ModelClass()
@@ -17,18 +38,67 @@ ModelClass::~ModelClass()
 }
 
 
-bool ModelClass::InitializeModel(ID3D11Device *device, char* filename)
+bool ModelClass::InitializeModel(ID3D11Device *device, char* filename, DX::VertexFormat format)
 {
-	LoadModel(filename);
-	InitializeBuffers(device);
-	return false;
+	if (!LoadModelData(filename, format))
+	{
+		return false;
+	}
+
+	return CreateModelBuffers(device);
+}
+
+bool ModelClass::LoadModelData(const char* filename, DX::VertexFormat format)
+{
+	m_vertexFormat = format;
+	m_filename = filename;
+
+	// Upload straight from the mapped .meshbin when it is still valid for this OBJ
+	if (m_cache.Open(filename))
+	{
+		const DX::MeshCacheHeader& header = m_cache.GetHeader();
+		m_materials.assign(m_cache.GetMaterials(), m_cache.GetMaterials() + header.materialCount);
+		m_subsets.assign(m_cache.GetSubsets(), m_cache.GetSubsets() + header.subsetCount);
+		m_lods.assign(m_cache.GetLods(), m_cache.GetLods() + header.lodCount);
+		m_meshlets.assign(m_cache.GetMeshlets(), m_cache.GetMeshlets() + header.meshletCount);
+		m_meshletVertices.assign(m_cache.GetMeshletVertices(), m_cache.GetMeshletVertices() + header.meshletVertexCount);
+		m_meshletTriangles.assign(m_cache.GetMeshletTriangles(), m_cache.GetMeshletTriangles() + header.meshletTriangleCount);
+		return true;
+	}
+
+	// Never upload a partially parsed mesh
+	std::vector<std::string> materialLibraries;
+	if (!LoadModel(filename, materialLibraries))
+	{
+		return false;
+	}
+
+	// The cache holds the resolved materials, so it goes stale with the .mtl files as well as the OBJ
+	DX::MeshCache::Write(filename, m_mesh, materialLibraries);
+	return true;
+}
+
+bool ModelClass::CreateModelBuffers(ID3D11Device* device, DX::GeometryPool* pool)
+{
+	bool result;
+
+	m_geometryPool = pool;
+	if (!m_cache.IsOpen())
+	{
+		return InitializeBuffers(device);
+	}
+
+	const DX::MeshCacheHeader& header = m_cache.GetHeader();
+	result = CreateBuffers(device, static_cast<const DX::MeshVertex*>(m_cache.GetVertices()), header.vertexCount, m_cache.GetIndices(), header.indexCount,
+		header.indexStride == sizeof(uint16_t) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT);
+	m_cache.Close();
+
+	return result;
 }
 
 bool ModelClass::InitializeTeapot(ID3D11Device* device)
 {
-	GeometricPrimitive::CreateTeapot(preFabVertices, preFabIndices, 1, 8, false);
-	m_vertexCount	= preFabVertices.size();
-	m_indexCount	= preFabIndices.size();
+	m_preFab = PreFab::Teapot;
 
 	bool result;
 	// Initialize the vertex and index buffers.
@@ -42,9 +112,7 @@ bool ModelClass::InitializeTeapot(ID3D11Device* device)
 
 bool ModelClass::InitializeSphere(ID3D11Device *device)
 {
-	GeometricPrimitive::CreateSphere(preFabVertices, preFabIndices, 1, 8, false);
-	m_vertexCount = preFabVertices.size();
-	m_indexCount = preFabIndices.size();
+	m_preFab = PreFab::Sphere;
 
 	bool result;
 	// Initialize the vertex and index buffers.
@@ -58,10 +126,8 @@ bool ModelClass::InitializeSphere(ID3D11Device *device)
 
 bool ModelClass::InitializeBox(ID3D11Device * device, float xwidth, float yheight, float zdepth)
 {
-	GeometricPrimitive::CreateBox(preFabVertices, preFabIndices,
-		DirectX::SimpleMath::Vector3(xwidth, yheight, zdepth),false);
-	m_vertexCount = preFabVertices.size();
-	m_indexCount = preFabIndices.size();
+	m_preFab = PreFab::Box;
+	m_preFabSize = DirectX::SimpleMath::Vector3(xwidth, yheight, zdepth);
 
 	bool result;
 	// Initialize the vertex and index buffers.
@@ -88,13 +154,164 @@ void ModelClass::Shutdown()
 
 void ModelClass::Render(ID3D11DeviceContext* deviceContext)
 {
+	Render(deviceContext, 0);
+
+	return;
+}
+
+void ModelClass::Render(ID3D11DeviceContext* deviceContext, int lod)
+{
+	int i, firstSubset, subsetCount;
+
 	// Put the vertex and index buffers on the graphics pipeline to prepare them for drawing.
 	RenderBuffers(deviceContext);
-	deviceContext->DrawIndexed(m_indexCount, 0, 0);
+
+	// Each level of detail is its own run of material ranges
+	firstSubset = 0;
+	subsetCount = (int)m_subsets.size();
+	if (!m_lods.empty())
+	{
+		lod = std::max(0, std::min(lod, (int)m_lods.size() - 1));
+		firstSubset = (int)m_lods[lod].firstSubset;
+		subsetCount = (int)m_lods[lod].subsetCount;
+	}
+
+	// One draw per material range, the buffers stay bound between them
+	for (i = firstSubset; i < firstSubset + subsetCount; i++)
+	{
+		SetMaterial(deviceContext, m_subsets[i].materialIndex);
+		deviceContext->DrawIndexed(m_subsets[i].indexCount, m_allocation.firstIndex + m_subsets[i].firstIndex, m_allocation.baseVertex);
+	}
+
+	return;
+}
+
+void ModelClass::RenderInstanced(ID3D11DeviceContext* deviceContext, int lod, unsigned int instanceCount, unsigned int startInstance)
+{
+	int i, firstSubset, subsetCount;
+
+	RenderBuffers(deviceContext);
+
+	// Same material ranges as Render, each drawn once for all the instances
+	firstSubset = 0;
+	subsetCount = (int)m_subsets.size();
+	if (!m_lods.empty())
+	{
+		lod = std::max(0, std::min(lod, (int)m_lods.size() - 1));
+		firstSubset = (int)m_lods[lod].firstSubset;
+		subsetCount = (int)m_lods[lod].subsetCount;
+	}
+
+	for (i = firstSubset; i < firstSubset + subsetCount; i++)
+	{
+		SetMaterial(deviceContext, m_subsets[i].materialIndex);
+		deviceContext->DrawIndexedInstanced(m_subsets[i].indexCount, instanceCount, m_allocation.firstIndex + m_subsets[i].firstIndex, m_allocation.baseVertex, startInstance);
+	}
 
 	return;
 }
 
+void ModelClass::RenderSubset(ID3D11DeviceContext* deviceContext, int subset)
+{
+	RenderBuffers(deviceContext);
+	SetMaterial(deviceContext, m_subsets[subset].materialIndex);
+	deviceContext->DrawIndexed(m_subsets[subset].indexCount, m_allocation.firstIndex + m_subsets[subset].firstIndex, m_allocation.baseVertex);
+
+	return;
+}
+
+void ModelClass::RenderClusters(ID3D11DeviceContext* deviceContext, const SimpleMath::Matrix& world, const SimpleMath::Matrix& viewProjection, const SimpleMath::Vector3& cameraPosition)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	HRESULT result;
+	int i;
+
+	// Models without clusters (pre-fabs and the prism) draw whole
+	if (m_meshlets.empty() || !m_culledIndexBuffer)
+	{
+		Render(deviceContext, 0);
+		return;
+	}
+
+	m_meshletCuller.Cull(m_meshlets.data(), m_meshlets.size(), m_meshletVertices.data(), m_meshletTriangles.data(), world, viewProjection, cameraPosition);
+	const std::vector<uint32_t>& indices = m_meshletCuller.GetIndices();
+	const std::vector<DX::MeshSubset>& subsets = m_meshletCuller.GetSubsets();
+	if (indices.empty())
+	{
+		return;
+	}
+
+	// Replace the visible index list, the buffer is sized for every cluster being visible
+	result = deviceContext->Map(m_culledIndexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if (FAILED(result))
+	{
+		return;
+	}
+	memcpy(mappedResource.pData, indices.data(), indices.size() * sizeof(uint32_t));
+	deviceContext->Unmap(m_culledIndexBuffer, 0);
+
+	// Same vertex buffer, the culled indices replace the static ones
+	RenderBuffers(deviceContext);
+	deviceContext->IASetIndexBuffer(m_culledIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	for (i = 0; i < (int)subsets.size(); i++)
+	{
+		SetMaterial(deviceContext, subsets[i].materialIndex);
+		deviceContext->DrawIndexed(subsets[i].indexCount, subsets[i].firstIndex, m_allocation.baseVertex);
+	}
+
+	// The pool's index buffer is no longer the one bound
+	if (m_geometryPool)
+	{
+		m_geometryPool->ResetBindings();
+	}
+
+	return;
+}
+
+void ModelClass::RenderSoftware(DX::SoftwareRasterizer& rasterizer, int lod, const SimpleMath::Matrix& world, const DX::SoftwareTexture* texture) const
+{
+	int i, firstSubset, subsetCount;
+
+	if (!m_softwareIndices)
+	{
+		return;
+	}
+
+	// The same material ranges Render draws for this level
+	firstSubset = 0;
+	subsetCount = (int)m_subsets.size();
+	if (!m_lods.empty())
+	{
+		lod = std::max(0, std::min(lod, (int)m_lods.size() - 1));
+		firstSubset = (int)m_lods[lod].firstSubset;
+		subsetCount = (int)m_lods[lod].subsetCount;
+	}
+
+	for (i = firstSubset; i < firstSubset + subsetCount; i++)
+	{
+		const DX::MeshMaterial& material = m_materials[m_subsets[i].materialIndex];
+		rasterizer.DrawMesh(m_softwareVertices, m_softwareIndices + m_subsets[i].firstIndex, m_subsets[i].indexCount, world, texture,
+			XMFLOAT4(material.diffuse.x, material.diffuse.y, material.diffuse.z, material.opacity));
+	}
+
+	return;
+}
+
+int ModelClass::SelectLod(DX::LodSelector& selector, const SimpleMath::Matrix& world, const SimpleMath::Vector3& cameraPosition, float pixelScale) const
+{
+	SimpleMath::Vector3 center;
+	float scale, distance;
+
+	// The errors are in object space, so scale them by the largest axis of the world matrix
+	scale = std::max(world.Right().Length(), std::max(world.Up().Length(), world.Backward().Length()));
+
+	// Distance to the nearest point of the bounding sphere, inside it always draws full detail
+	center = SimpleMath::Vector3::Transform(m_boundsCenter, world);
+	distance = (center - cameraPosition).Length() - m_boundsRadius * scale;
+
+	return selector.Select(m_lods.data(), (int)m_lods.size(), scale, distance, pixelScale);
+}
+
 //void ModelClass::RenderWithTransformations(ID3D11DeviceContext* context, SimpleMath::Matrix m_world)
 
 //void ModelClass::RenderSkybox(ID3D11DeviceContext* deviceContext) {
@@ -115,6 +332,7 @@ bool ModelClass::InitializePrism(ID3D11Device* device)
 	
 	m_vertexCount = 8;
 	m_indexCount = 36;
+	m_indexFormat = DXGI_FORMAT_R32_UINT;
 
 	vertices = new VertexType[m_vertexCount];
 	indices = new unsigned long[m_indexCount];
@@ -296,7 +514,12 @@ bool ModelClass::InitializePrism(ID3D11Device* device)
 	delete[] indices;
 	indices = 0;
 
-	return true;
+	// The prism is a single range drawn with the default material
+	m_materials.assign(1, DX::MtlLoader::GetDefaultMaterial("default"));
+	m_subsets.assign(1, { 0, 0, (uint32_t)m_indexCount, 0 });
+	m_lods.assign(1, { 0, 1, 0.f, 0 });
+
+	return CreateMaterialBuffers(device);
 }
 
 
@@ -308,85 +531,289 @@ int ModelClass::GetIndexCount()
 
 bool ModelClass::InitializeBuffers(ID3D11Device* device)
 {
-	VertexType* vertices;
-	unsigned long* indices;
+	std::vector<uint16_t> shortIndices;
+	bool result;
+
+	if (m_preFab != PreFab::None)
+	{
+		LoadPreFab();
+	}
+
+	m_vertexCount = (int)m_mesh.vertices.size();
+	m_indexCount = (int)m_mesh.indices.size();
+	if (m_vertexCount == 0 || m_indexCount == 0)
+	{
+		return false;
+	}
+
+	// Pre-fabs have no materials, they draw as a single range with the default material
+	if (m_mesh.subsets.empty())
+	{
+		m_mesh.materials.assign(1, DX::MtlLoader::GetDefaultMaterial("default"));
+		m_mesh.subsets.push_back({ 0, 0, (uint32_t)m_indexCount, 0 });
+	}
+	if (m_mesh.lods.empty())
+	{
+		m_mesh.lods.push_back({ 0, (uint32_t)m_mesh.subsets.size(), 0.f, 0 });
+	}
+	m_materials.swap(m_mesh.materials);
+	m_subsets.swap(m_mesh.subsets);
+	m_lods.swap(m_mesh.lods);
+	m_meshlets.swap(m_mesh.meshlets);
+	m_meshletVertices.swap(m_mesh.meshletVertices);
+	m_meshletTriangles.swap(m_mesh.meshletTriangles);
+
+	// Small meshes get a 16-bit index buffer, which halves the index memory and bandwidth
+	if (m_mesh.Uses16BitIndices())
+	{
+		shortIndices.assign(m_mesh.indices.begin(), m_mesh.indices.end());
+		result = CreateBuffers(device, m_mesh.vertices.data(), m_vertexCount, shortIndices.data(), m_indexCount, DXGI_FORMAT_R16_UINT);
+	}
+	else
+	{
+		result = CreateBuffers(device, m_mesh.vertices.data(), m_vertexCount, m_mesh.indices.data(), m_indexCount, DXGI_FORMAT_R32_UINT);
+	}
+
+	// The buffers hold the mesh now, only the tables taken out above stay on the CPU
+	m_mesh = DX::MeshData();
+
+	return result;
+}
+
+
+// Generates the pre-fab and loads the mesh with its data (DirectXTK uses its own vertex layout)
+void ModelClass::LoadPreFab()
+{
+	unsigned int i;
+
+	static_assert(sizeof(VertexType) == sizeof(DX::MeshVertex), "VertexType must match DX::MeshVertex");
+
+	switch (m_preFab)
+	{
+	case PreFab::Teapot:
+		GeometricPrimitive::CreateTeapot(preFabVertices, preFabIndices, 1, 8, false);
+		break;
+	case PreFab::Sphere:
+		GeometricPrimitive::CreateSphere(preFabVertices, preFabIndices, 1, 8, false);
+		break;
+	case PreFab::Box:
+		GeometricPrimitive::CreateBox(preFabVertices, preFabIndices, m_preFabSize, false);
+		break;
+	default:
+		return;
+	}
+
+	m_mesh.vertices.resize(preFabVertices.size());
+	for (i = 0; i < preFabVertices.size(); i++)
+	{
+		m_mesh.vertices[i].position	= preFabVertices[i].position;
+		m_mesh.vertices[i].texture	= preFabVertices[i].textureCoordinate;
+		m_mesh.vertices[i].normal	= preFabVertices[i].normal;
+	}
+	m_mesh.indices.assign(preFabIndices.begin(), preFabIndices.end());
+
+	std::vector<VertexPositionNormalTexture>().swap(preFabVertices);
+	std::vector<uint16_t>().swap(preFabIndices);
+
+	return;
+}
+
+
+bool ModelClass::CreateBuffers(ID3D11Device* device, const DX::MeshVertex* vertices, unsigned int vertexCount,
+	const void* indices, unsigned int indexCount, DXGI_FORMAT indexFormat)
+{
 	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
     D3D11_SUBRESOURCE_DATA vertexData, indexData;
+	std::vector<DX::QuantizedVertex> quantized;
+	SimpleMath::Vector3 boundsMin, boundsMax;
+	unsigned int i;
 	HRESULT result;
-	int i;
 
-	// Create the vertex array.
-	vertices = new VertexType[m_vertexCount];
-	if(!vertices)
+	m_vertexCount = (int)vertexCount;
+	m_indexCount = (int)indexCount;
+	m_indexFormat = indexFormat;
+
+	if (vertexCount == 0 || indexCount == 0)
 	{
 		return false;
 	}
 
-	// Create the index array.
-	indices = new unsigned long[m_indexCount];
-	if(!indices)
+	// AABB for frustum culling, and the bounding sphere around it for LOD distances
+	boundsMin = boundsMax = vertices[0].position;
+	for (i = 1; i < vertexCount; i++)
+	{
+		boundsMin = SimpleMath::Vector3::Min(boundsMin, vertices[i].position);
+		boundsMax = SimpleMath::Vector3::Max(boundsMax, vertices[i].position);
+	}
+	m_boundsCenter = (boundsMin + boundsMax) * 0.5f;
+	m_boundsExtents = (boundsMax - boundsMin) * 0.5f;
+	m_boundsRadius = m_boundsExtents.Length();
+
+	if (!CreateMaterialBuffers(device))
 	{
 		return false;
 	}
-	
-	// Load the vertex array and index array with data from the pre-fab
-	for (i = 0; i < m_vertexCount; i++)
+
+	CreateOccluder(vertices, vertexCount, indices, indexFormat);
+
+	// Quantized models are encoded on the way to the GPU
+	vertexData.pSysMem = vertices;
+	if (m_vertexFormat == DX::VertexFormat::Quantized)
 	{
-		vertices[i].position	= DirectX::SimpleMath::Vector3(preFabVertices[i].position.x, preFabVertices[i].position.y, preFabVertices[i].position.z);
-		vertices[i].texture		= DirectX::SimpleMath::Vector2(preFabVertices[i].textureCoordinate.x, preFabVertices[i].textureCoordinate.y);
-		vertices[i].normal		= DirectX::SimpleMath::Vector3(preFabVertices[i].normal.x, preFabVertices[i].normal.y, preFabVertices[i].normal.z);
+		if (!CreateQuantizedVertices(device, vertices, vertexCount, quantized))
+		{
+			return false;
+		}
+		vertexData.pSysMem = quantized.data();
 	}
-	for (i = 0; i < m_indexCount; i++)
+	else
 	{
-		indices[i] = preFabIndices[i];
+		m_vertexStride = sizeof(VertexType);
 	}
 
-	// Set up the description of the static vertex buffer.
-    vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-    vertexBufferDesc.ByteWidth = sizeof(VertexType) * m_vertexCount;
-    vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-    vertexBufferDesc.CPUAccessFlags = 0;
-    vertexBufferDesc.MiscFlags = 0;
-	vertexBufferDesc.StructureByteStride = 0;
+	// Pooled models are copied into the shared buffers and only keep where they went
+	if (m_geometryPool)
+	{
+		if (!m_geometryPool->Allocate(vertexData.pSysMem, vertexCount, m_vertexStride, indices, indexCount, indexFormat, m_allocation))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		// Set up the description of the static vertex buffer.
+		vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		vertexBufferDesc.ByteWidth = m_vertexStride * vertexCount;
+		vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		vertexBufferDesc.CPUAccessFlags = 0;
+		vertexBufferDesc.MiscFlags = 0;
+		vertexBufferDesc.StructureByteStride = 0;
+
+		// Give the subresource structure a pointer to the vertex data.
+		vertexData.SysMemPitch = 0;
+		vertexData.SysMemSlicePitch = 0;
+
+		// Now create the vertex buffer.
+		result = device->CreateBuffer(&vertexBufferDesc, &vertexData, &m_vertexBuffer);
+		if(FAILED(result))
+		{
+			return false;
+		}
 
-	// Give the subresource structure a pointer to the vertex data.
-    vertexData.pSysMem = vertices;
-	vertexData.SysMemPitch = 0;
-	vertexData.SysMemSlicePitch = 0;
+		// Set up the description of the static index buffer.
+		indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		indexBufferDesc.ByteWidth = (indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t) : sizeof(uint32_t)) * indexCount;
+		indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		indexBufferDesc.CPUAccessFlags = 0;
+		indexBufferDesc.MiscFlags = 0;
+		indexBufferDesc.StructureByteStride = 0;
+
+		// Give the subresource structure a pointer to the index data.
+		indexData.pSysMem = indices;
+		indexData.SysMemPitch = 0;
+		indexData.SysMemSlicePitch = 0;
+
+		// Create the index buffer.
+		result = device->CreateBuffer(&indexBufferDesc, &indexData, &m_indexBuffer);
+		if(FAILED(result))
+		{
+			return false;
+		}
+	}
 
-	// Now create the vertex buffer.
-    result = device->CreateBuffer(&vertexBufferDesc, &vertexData, &m_vertexBuffer);
-	if(FAILED(result))
+	// Models with clusters also get a dynamic index buffer for the indices that survive culling,
+	// big enough for the whole full detail mesh
+	if (!m_meshlets.empty())
 	{
-		return false;
+		indexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		indexBufferDesc.ByteWidth = sizeof(uint32_t) * (unsigned int)m_meshletTriangles.size();
+		indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		indexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		indexBufferDesc.MiscFlags = 0;
+		indexBufferDesc.StructureByteStride = 0;
+
+		result = device->CreateBuffer(&indexBufferDesc, nullptr, &m_culledIndexBuffer);
+		if (FAILED(result))
+		{
+			return false;
+		}
 	}
 
-	// Set up the description of the static index buffer.
-    indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-    indexBufferDesc.ByteWidth = sizeof(unsigned long) * m_indexCount;
-    indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    indexBufferDesc.CPUAccessFlags = 0;
-    indexBufferDesc.MiscFlags = 0;
-	indexBufferDesc.StructureByteStride = 0;
+	return true;
+}
 
-	// Give the subresource structure a pointer to the index data.
-    indexData.pSysMem = indices;
-	indexData.SysMemPitch = 0;
-	indexData.SysMemSlicePitch = 0;
 
-	// Create the index buffer.
-	result = device->CreateBuffer(&indexBufferDesc, &indexData, &m_indexBuffer);
-	if(FAILED(result))
+bool ModelClass::CreateQuantizedVertices(ID3D11Device* device, const DX::MeshVertex* vertices, unsigned int vertexCount,
+	std::vector<DX::QuantizedVertex>& quantized)
+{
+	D3D11_BUFFER_DESC quantizationBufferDesc;
+	D3D11_SUBRESOURCE_DATA quantizationData;
+	HRESULT result;
+
+	// Positions are stored relative to the mesh bounds, normals octahedral and UVs as half floats
+	DX::QuantizationParams params = DX::MeshQuantizer::ComputeParams(vertices, vertexCount);
+	quantized.resize(vertexCount);
+	DX::MeshQuantizer::Encode(vertices, vertexCount, params, quantized.data());
+	m_vertexStride = sizeof(DX::QuantizedVertex);
+
+	DX::QuantizationStats stats = DX::MeshQuantizer::Measure(vertices, quantized.data(), vertexCount, params);
+	char message[256];
+	sprintf_s(message, "Quantized %u vertices, %u -> %u bytes, max error: position %g, normal %.3f deg, uv %g\n",
+		vertexCount, (unsigned int)(vertexCount * sizeof(VertexType)), (unsigned int)(vertexCount * sizeof(DX::QuantizedVertex)),
+		stats.maxPositionError, stats.maxNormalError, stats.maxTexCoordError);
+	OutputDebugStringA(message);
+
+	// The decode constants never change, so they live in an immutable constant buffer.
+	quantizationBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	quantizationBufferDesc.ByteWidth = sizeof(DX::QuantizationParams);
+	quantizationBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	quantizationBufferDesc.CPUAccessFlags = 0;
+	quantizationBufferDesc.MiscFlags = 0;
+	quantizationBufferDesc.StructureByteStride = 0;
+
+	quantizationData.pSysMem = &params;
+	quantizationData.SysMemPitch = 0;
+	quantizationData.SysMemSlicePitch = 0;
+
+	result = device->CreateBuffer(&quantizationBufferDesc, &quantizationData, &m_quantizationBuffer);
+	if (FAILED(result))
 	{
 		return false;
 	}
 
-	// Release the arrays now that the vertex and index buffers have been created and loaded.
-	delete [] vertices;
-	vertices = 0;
+	return true;
+}
 
-	delete [] indices;
-	indices = 0;
+
+// One small immutable constant buffer per material, so a range only has to bind its own
+bool ModelClass::CreateMaterialBuffers(ID3D11Device* device)
+{
+	D3D11_BUFFER_DESC materialBufferDesc;
+	D3D11_SUBRESOURCE_DATA materialData;
+	Shader::MaterialBufferType constants;
+	HRESULT result;
+
+	materialBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	materialBufferDesc.ByteWidth = sizeof(Shader::MaterialBufferType);
+	materialBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	materialBufferDesc.CPUAccessFlags = 0;
+	materialBufferDesc.MiscFlags = 0;
+	materialBufferDesc.StructureByteStride = 0;
+
+	materialData.pSysMem = &constants;
+	materialData.SysMemPitch = 0;
+	materialData.SysMemSlicePitch = 0;
+
+	m_materialBuffers.resize(m_materials.size());
+	for (size_t i = 0; i < m_materials.size(); i++)
+	{
+		constants.color = XMFLOAT4(m_materials[i].diffuse.x, m_materials[i].diffuse.y, m_materials[i].diffuse.z, m_materials[i].opacity);
+		result = device->CreateBuffer(&materialBufferDesc, &materialData, m_materialBuffers[i].ReleaseAndGetAddressOf());
+		if (FAILED(result))
+		{
+			return false;
+		}
+	}
 
 	return true;
 }
@@ -394,6 +821,30 @@ bool ModelClass::InitializeBuffers(ID3D11Device* device)
 
 void ModelClass::ShutdownBuffers()
 {
+	// Release the material colours.
+	m_materialBuffers.clear();
+
+	// Return the pooled ranges.
+	if (m_geometryPool)
+	{
+		m_geometryPool->Free(m_allocation);
+		m_geometryPool = 0;
+	}
+
+	// Release the culled cluster indices.
+	if (m_culledIndexBuffer)
+	{
+		m_culledIndexBuffer->Release();
+		m_culledIndexBuffer = 0;
+	}
+
+	// Release the position decode constants.
+	if (m_quantizationBuffer)
+	{
+		m_quantizationBuffer->Release();
+		m_quantizationBuffer = 0;
+	}
+
 	// Release the index buffer.
 	if(m_indexBuffer)
 	{
@@ -417,15 +868,28 @@ void ModelClass::RenderBuffers(ID3D11DeviceContext* deviceContext)
 	unsigned int stride;
 	unsigned int offset;
 
+	// Quantized positions are decoded in the vertex shader against this model's bounds
+	if (m_quantizationBuffer)
+	{
+		deviceContext->VSSetConstantBuffers(2, 1, &m_quantizationBuffer);
+	}
+
+	// Pooled models share buffers that are usually still bound from the previous draw
+	if (m_geometryPool)
+	{
+		m_geometryPool->Bind(deviceContext, m_vertexStride, m_indexFormat);
+		return;
+	}
+
 	// Set vertex buffer stride and offset.
-	stride = sizeof(VertexType); 
+	stride = m_vertexStride; 
 	offset = 0;
     
 	// Set the vertex buffer to active in the input assembler so it can be rendered.
 	deviceContext->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
 
     // Set the index buffer to active in the input assembler so it can be rendered.
-	deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	deviceContext->IASetIndexBuffer(m_indexBuffer, m_indexFormat, 0);
 
     // Set the type of primitive that should be rendered from this vertex buffer, in this case triangles.
 	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -434,116 +898,209 @@ void ModelClass::RenderBuffers(ID3D11DeviceContext* deviceContext)
 }
 
 
-bool ModelClass::LoadModel(char* filename)
+void ModelClass::SetMaterial(ID3D11DeviceContext* deviceContext, uint32_t material)
+{
+	// light_ps tints the texture with the range's material colour
+	if (material < m_materialBuffers.size())
+	{
+		deviceContext->PSSetConstantBuffers(4, 1, m_materialBuffers[material].GetAddressOf());
+	}
+
+	return;
+}
+
+
+bool ModelClass::LoadModel(const char* filename, std::vector<std::string>& materialLibraries)
 {
-	std::vector<XMFLOAT3> verts;
-	std::vector<XMFLOAT3> norms;
-	std::vector<XMFLOAT2> texCs;
-	std::vector<unsigned int> faces;
+	DX::ObjData obj;
 
-	FILE* file;// = fopen(filename, "r");
-	errno_t err;
-	err = fopen_s(&file, filename, "r");
-	if (err != 0)
-		//if (file == NULL)
+	// Memory map the file and parse it in line aligned chunks, as jobs on the job system
+	if (!DX::ObjLoader::LoadFile(filename, obj))
 	{
+		char message[256];
+		sprintf_s(message, "%s: failed to load OBJ\n", filename);
+		OutputDebugStringA(message);
 		return false;
 	}
 
-	while (true)
-	{
-		char lineHeader[128];
+	// Resolve the usemtl names against the .mtl libraries
+	std::vector<DX::MeshMaterial> materials;
+	DX::MtlLoader::ResolveMaterials(filename, obj, materials);
+	materialLibraries = obj.materialLibraries;
+
+	// Weld the face corners into a shared vertex array, one vertex per unique v/vt/vn triple,
+	// with the triangles grouped into one contiguous subset per material
+	DX::WeldStats stats;
+	DX::MeshWelder::WeldObj(obj, m_mesh, 0.f, &stats);
+	m_mesh.materials.swap(materials);
+
+	// Coarser levels of detail, appended as extra subsets that index the same vertices
+	DX::MeshSimplifier::BuildLods(m_mesh);
+
+	// Reorder triangles for the post-transform cache and overdraw, then vertices for fetch locality
+	DX::VertexCacheStats cacheBefore = DX::MeshOptimizer::AnalyzeVertexCache(m_mesh.indices, m_mesh.vertices.size());
+	DX::MeshOptimizer::Optimize(m_mesh);
+	DX::VertexCacheStats cacheAfter = DX::MeshOptimizer::AnalyzeVertexCache(m_mesh.indices, m_mesh.vertices.size());
+
+	// Split the full detail mesh into clusters for CPU culling once the vertex order is final
+	DX::MeshletBuilder::Build(m_mesh);
 
-		// Read first word of the line
-		int res = fscanf_s(file, "%s", lineHeader, sizeof(lineHeader));
-		if (res == EOF)
+	m_vertexCount = (int)m_mesh.vertices.size();
+	m_indexCount = (int)m_mesh.indices.size();
+
+	char message[256];
+	sprintf_s(message, "%s: %zu -> %zu vertices, %zu -> %zu bytes, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %zu materials\n", filename,
+		stats.inputVertices, stats.outputVertices, stats.inputBytes, stats.outputBytes,
+		cacheBefore.acmr, cacheAfter.acmr, cacheBefore.atvr, cacheAfter.atvr, m_mesh.materials.size());
+	OutputDebugStringA(message);
+
+	for (size_t lod = 0; lod < m_mesh.lods.size(); lod++)
+	{
+		uint32_t indexCount = 0;
+		for (uint32_t i = 0; i < m_mesh.lods[lod].subsetCount; i++)
 		{
-			break; // exit loop
+			indexCount += m_mesh.subsets[m_mesh.lods[lod].firstSubset + i].indexCount;
 		}
-		else // Parse
-		{
-			if (strcmp(lineHeader, "v") == 0) // Vertex
-			{
-				XMFLOAT3 vertex;
-				fscanf_s(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-				verts.push_back(vertex);
-			}
-			else if (strcmp(lineHeader, "vt") == 0) // Tex Coord
-			{
-				XMFLOAT2 uv;
-				fscanf_s(file, "%f %f\n", &uv.x, &uv.y);
-				texCs.push_back(uv);
-			}
-			else if (strcmp(lineHeader, "vn") == 0) // Normal
-			{
-				XMFLOAT3 normal;
-				fscanf_s(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-				norms.push_back(normal);
-			}
-			else if (strcmp(lineHeader, "f") == 0) // Face
-			{
-				unsigned int face[9];
-				int matches = fscanf_s(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &face[0], &face[1], &face[2],
-					&face[3], &face[4], &face[5],
-					&face[6], &face[7], &face[8]);
-				if (matches != 9)
-				{
-					// Parser error, or not triangle faces
-					return false;
-				}
-
-				for (int i = 0; i < 9; i++)
-				{
-					faces.push_back(face[i]);
-				}
+		sprintf_s(message, "%s: LOD %zu, %u triangles, error %.4f\n", filename, lod, indexCount / 3, m_mesh.lods[lod].error);
+		OutputDebugStringA(message);
+	}
+
+	sprintf_s(message, "%s: %zu meshlets, %.1f vertices and %.1f triangles each\n", filename, m_mesh.meshlets.size(),
+		m_mesh.meshlets.empty() ? 0.0 : (double)m_mesh.meshletVertices.size() / m_mesh.meshlets.size(),
+		m_mesh.meshlets.empty() ? 0.0 : (double)m_mesh.meshletTriangles.size() / 3 / m_mesh.meshlets.size());
+	OutputDebugStringA(message);
+
+	return true;
+}
+
 
+// Copies the full detail level out as an occluder, with only the positions it uses. Coarser levels
+// can reach outside the real silhouette and would hide objects that are visible past its edges.
+void ModelClass::CreateOccluder(const DX::MeshVertex* vertices, unsigned int vertexCount, const void* indices, DXGI_FORMAT indexFormat)
+{
+	std::vector<uint32_t> remap;
+	unsigned int firstSubset, subsetCount, i, j, index;
 
+	firstSubset = 0;
+	subsetCount = (unsigned int)m_subsets.size();
+	if (!m_lods.empty())
+	{
+		firstSubset = m_lods[0].firstSubset;
+		subsetCount = m_lods[0].subsetCount;
+	}
+
+	m_occluderPositions.clear();
+	m_occluderIndices.clear();
+	remap.assign(vertexCount, UINT32_MAX);
+	for (i = firstSubset; i < firstSubset + subsetCount; i++)
+	{
+		for (j = m_subsets[i].firstIndex; j < m_subsets[i].firstIndex + m_subsets[i].indexCount; j++)
+		{
+			index = indexFormat == DXGI_FORMAT_R16_UINT ? static_cast<const uint16_t*>(indices)[j] : static_cast<const uint32_t*>(indices)[j];
+			if (remap[index] == UINT32_MAX)
+			{
+				remap[index] = (uint32_t)m_occluderPositions.size();
+				m_occluderPositions.push_back(vertices[index].position);
 			}
+			m_occluderIndices.push_back(remap[index]);
 		}
 	}
 
-	int vIndex = 0, nIndex = 0, tIndex = 0;
-	int numFaces = (int)faces.size() / 9;
+	return;
+}
+
 
-	//// Create the model using the vertex count that was read in.
-	m_vertexCount = numFaces * 3;
-//	model = new ModelType[vertexCount];
+// Only a software capture needs the mesh on the CPU, so it is read back for one rather than kept
+// after upload. The .meshbin is mapped again and read in place, apart from 16 bit indices, which
+// the software renderer takes widened. Without a valid cache the OBJ goes through the same
+// processing as when it was loaded, and the result is only used if it still matches the buffers.
+bool ModelClass::LoadSoftwareMesh()
+{
+	std::vector<std::string> materialLibraries;
+	int vertexCount, indexCount;
 
-	// "Unroll" the loaded obj information into a list of triangles.
-	for (int f = 0; f < (int)faces.size(); f += 3)
+	if (m_softwareIndices)
 	{
-		VertexPositionNormalTexture tempVertex;
-		tempVertex.position.x = verts[(faces[f + 0] - 1)].x;
-		tempVertex.position.y = verts[(faces[f + 0] - 1)].y;
-		tempVertex.position.z = verts[(faces[f + 0] - 1)].z;
+		return true;
+	}
 
-		tempVertex.textureCoordinate.x = texCs[(faces[f + 1] - 1)].x;
-		tempVertex.textureCoordinate.y = texCs[(faces[f + 1] - 1)].y;
-			
-		tempVertex.normal.x = norms[(faces[f + 2] - 1)].x;
-		tempVertex.normal.y = norms[(faces[f + 2] - 1)].y;
-		tempVertex.normal.z = norms[(faces[f + 2] - 1)].z;
+	vertexCount = m_vertexCount;
+	indexCount = m_indexCount;
+	if (m_preFab != PreFab::None)
+	{
+		LoadPreFab();
+	}
+	else if (!m_filename.empty() && m_cache.Open(m_filename.c_str()))
+	{
+		const DX::MeshCacheHeader& header = m_cache.GetHeader();
+		if ((int)header.vertexCount != vertexCount || (int)header.indexCount != indexCount)
+		{
+			m_cache.Close();
+			return false;
+		}
 
-		//increase index count
-		preFabVertices.push_back(tempVertex);
-		
-		int tempIndex;
-		tempIndex = vIndex;
-		preFabIndices.push_back(tempIndex);
-		vIndex++;
+		m_softwareVertices = static_cast<const DX::MeshVertex*>(m_cache.GetVertices());
+		if (header.indexStride == sizeof(uint32_t))
+		{
+			m_softwareIndices = static_cast<const uint32_t*>(m_cache.GetIndices());
+		}
+		else
+		{
+			m_mesh.indices.assign(static_cast<const uint16_t*>(m_cache.GetIndices()), static_cast<const uint16_t*>(m_cache.GetIndices()) + header.indexCount);
+			m_softwareIndices = m_mesh.indices.data();
+		}
+		return true;
+	}
+	else if (m_filename.empty() || !LoadModel(m_filename.c_str(), materialLibraries))
+	{
+		ReleaseSoftwareMesh();
+		return false;
 	}
 
-	m_indexCount = vIndex;
+	// LoadModel counts what it read, while the buffers still hold what was counted at upload
+	m_vertexCount = vertexCount;
+	m_indexCount = indexCount;
+	if ((int)m_mesh.vertices.size() != vertexCount || (int)m_mesh.indices.size() != indexCount)
+	{
+		ReleaseSoftwareMesh();
+		return false;
+	}
+
+	m_softwareVertices = m_mesh.vertices.data();
+	m_softwareIndices = m_mesh.indices.data();
 
-	verts.clear();
-	norms.clear();
-	texCs.clear();
-	faces.clear();
 	return true;
 }
 
 
+void ModelClass::ReleaseSoftwareMesh()
+{
+	m_softwareVertices = 0;
+	m_softwareIndices = 0;
+	m_cache.Close();
+	m_mesh = DX::MeshData();
+
+	return;
+}
+
+
 void ModelClass::ReleaseModel()
 {
+	// Drop the CPU copy of the mesh, it is rebuilt when the device is restored
+	m_mesh.Clear();
+	m_cache.Close();
+	m_materials.clear();
+	m_subsets.clear();
+	m_lods.clear();
+	m_meshlets.clear();
+	m_meshletVertices.clear();
+	m_meshletTriangles.clear();
+	m_occluderPositions.clear();
+	m_occluderIndices.clear();
+	m_softwareVertices = 0;
+	m_softwareIndices = 0;
+	preFabVertices.clear();
+	preFabIndices.clear();
+
 	return;
 }
\ No newline at end of file
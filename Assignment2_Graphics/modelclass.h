@@ -9,6 +9,13 @@
 // INCLUDES //
 //////////////
 #include "pch.h"
+#include "MeshData.h"
+#include "MeshQuantizer.h"
+#include "LodSelector.h"
+#include "MeshletCuller.h"
+#include "MeshCache.h"
+#include "GeometryPool.h"
+#include "SoftwareRasterizer.h"
 //#include <d3dx10math.h>
 //#include <fstream>
 //using namespace std;
@@ -33,30 +40,129 @@ public:
 	ModelClass();
 	~ModelClass();
 
-	bool InitializeModel(ID3D11Device *device, char* filename);
+	//format selects the vertex layout uploaded to the GPU, Quantized needs a shader set up with the same format
+	bool InitializeModel(ID3D11Device *device, char* filename, DX::VertexFormat format = DX::VertexFormat::Standard);
+	//InitializeModel in two steps for DX::AssetLoader: LoadModelData reads and processes the file and may run on
+	//any thread, CreateModelBuffers uploads the result and runs on the thread that owns the device. With a pool the
+	//model is sub-allocated from its shared buffers instead of getting buffers of its own.
+	bool LoadModelData(const char* filename, DX::VertexFormat format = DX::VertexFormat::Standard);
+	bool CreateModelBuffers(ID3D11Device*, DX::GeometryPool* pool = nullptr);
 	bool InitializeTeapot(ID3D11Device*);
 	bool InitializeSphere(ID3D11Device*);
 	bool InitializeBox(ID3D11Device*, float xwidth, float yheight, float zdepth);
 	bool InitializePrism(ID3D11Device*);
 	void Shutdown();
 	void Render(ID3D11DeviceContext*);
+	void Render(ID3D11DeviceContext*, int lod);
+	void RenderSubset(ID3D11DeviceContext*, int subset);
+	//draws instanceCount copies of the level, their world matrices start at startInstance in the bound instance buffer
+	void RenderInstanced(ID3D11DeviceContext*, int lod, unsigned int instanceCount, unsigned int startInstance);
+	//draws the full detail mesh without the clusters that are off screen or facing away, viewProjection is view * projection
+	void RenderClusters(ID3D11DeviceContext*, const DirectX::SimpleMath::Matrix& world, const DirectX::SimpleMath::Matrix& viewProjection, const DirectX::SimpleMath::Vector3& cameraPosition);
+	//queues the level on the CPU renderer instead, from the mesh LoadSoftwareMesh read back; nothing is drawn without it
+	void RenderSoftware(DX::SoftwareRasterizer& rasterizer, int lod, const DirectX::SimpleMath::Matrix& world, const DX::SoftwareTexture* texture) const;
+	//reads the uploaded mesh back for RenderSoftware, from the .meshbin or the OBJ again, or by generating the pre-fab again;
+	//false when that no longer gives the mesh that was uploaded. ReleaseSoftwareMesh drops it once the capture is done.
+	bool LoadSoftwareMesh();
+	void ReleaseSoftwareMesh();
 	
 	int GetIndexCount();
 
+	//per-material draw ranges, all sharing the one vertex/index buffer pair
+	int GetSubsetCount() const { return (int)m_subsets.size(); }
+	const DX::MeshSubset& GetSubset(int subset) const { return m_subsets[subset]; }
+	const DX::MeshMaterial& GetMaterial(int material) const { return m_materials[material]; }
+
+	//levels of detail, each a run of subsets; level 0 is the full mesh
+	int GetLodCount() const { return (int)m_lods.size(); }
+	const DX::MeshLod& GetLod(int lod) const { return m_lods[lod]; }
+
+	//object space bounding box as its center and half extents, computed when the buffers are created
+	const DirectX::SimpleMath::Vector3& GetBoundsCenter() const { return m_boundsCenter; }
+	const DirectX::SimpleMath::Vector3& GetBoundsExtents() const { return m_boundsExtents; }
+
+	//full detail level as its own positions and triangle list, kept on the CPU for DX::OcclusionCuller
+	const std::vector<DirectX::XMFLOAT3>& GetOccluderPositions() const { return m_occluderPositions; }
+	const std::vector<uint32_t>& GetOccluderIndices() const { return m_occluderIndices; }
+
+	//level to draw this frame for an instance at world, pixelScale from DX::LodSelector::GetPixelScale
+	int SelectLod(DX::LodSelector& selector, const DirectX::SimpleMath::Matrix& world, const DirectX::SimpleMath::Vector3& cameraPosition, float pixelScale) const;
+
+	//clusters of the full detail mesh and what the last RenderClusters call kept of them
+	int GetMeshletCount() const { return (int)m_meshlets.size(); }
+	const DX::ClusterCullStats& GetClusterStats() const { return m_meshletCuller.GetStats(); }
+
 
 private:
 	bool InitializeBuffers(ID3D11Device*);
+	bool CreateBuffers(ID3D11Device*, const DX::MeshVertex* vertices, unsigned int vertexCount, const void* indices, unsigned int indexCount, DXGI_FORMAT indexFormat);
+	bool CreateQuantizedVertices(ID3D11Device*, const DX::MeshVertex* vertices, unsigned int vertexCount, std::vector<DX::QuantizedVertex>& quantized);
+	bool CreateMaterialBuffers(ID3D11Device*);
+	void CreateOccluder(const DX::MeshVertex* vertices, unsigned int vertexCount, const void* indices, DXGI_FORMAT indexFormat);
+	void LoadPreFab();
 	void ShutdownBuffers();
 	void RenderBuffers(ID3D11DeviceContext*);
-	bool LoadModel(char*);
+	void SetMaterial(ID3D11DeviceContext*, uint32_t material);
+	bool LoadModel(const char*, std::vector<std::string>& materialLibraries);
 
 	void ReleaseModel();
 
 private:
 	ID3D11Buffer *m_vertexBuffer, *m_indexBuffer;
 	int m_vertexCount, m_indexCount;
+	DXGI_FORMAT m_indexFormat;
+
+	//quantized models also carry the position decode constants for light_quantized_vs (register b2)
+	DX::VertexFormat m_vertexFormat;
+	unsigned int m_vertexStride;
+	ID3D11Buffer *m_quantizationBuffer;
+
+	//pooled models have no buffers of their own, just their place in the pool's shared buffers
+	DX::GeometryPool* m_geometryPool;
+	DX::GeometryAllocation m_allocation;
+
+	//welded, indexed mesh loaded from file (pre-fabs are copied in here before upload), released once it is uploaded
+	//and only read again while a software capture needs it
+	DX::MeshData m_mesh;
+
+	//valid .meshbin kept mapped between LoadModelData and CreateModelBuffers, so its streams upload without a copy,
+	//and again between LoadSoftwareMesh and ReleaseSoftwareMesh
+	DX::MeshCache m_cache;
+	std::string m_filename;
+
+	//material table and draw ranges, kept after the CPU mesh is released
+	std::vector<DX::MeshMaterial> m_materials;
+	std::vector<DX::MeshSubset> m_subsets;
+	std::vector<DX::MeshLod> m_lods;
+
+	//each material's colour as the constants light_ps reads from b4, bound before each range is drawn
+	std::vector<Microsoft::WRL::ComPtr<ID3D11Buffer>> m_materialBuffers;
+
+	//object space bounding sphere, used to measure the distance for LOD selection, around the AABB used for culling
+	DirectX::SimpleMath::Vector3 m_boundsCenter;
+	DirectX::SimpleMath::Vector3 m_boundsExtents;
+	float m_boundsRadius;
+
+	//simplified copy of the mesh that the software occlusion rasterizer draws
+	std::vector<DirectX::XMFLOAT3> m_occluderPositions;
+	std::vector<uint32_t> m_occluderIndices;
+
+	//every level as uploaded, with 32 bit indices, for DX::SoftwareRasterizer; points into the mapped .meshbin or m_mesh
+	//between LoadSoftwareMesh and ReleaseSoftwareMesh, null otherwise
+	const DX::MeshVertex* m_softwareVertices;
+	const uint32_t* m_softwareIndices;
+
+	//clusters are culled on the CPU each frame and the survivors' triangles streamed into a dynamic index buffer
+	std::vector<DX::Meshlet> m_meshlets;
+	std::vector<uint32_t> m_meshletVertices;
+	std::vector<uint8_t> m_meshletTriangles;
+	DX::MeshletCuller m_meshletCuller;
+	ID3D11Buffer *m_culledIndexBuffer;
 
-	//arrays for our generated objects Made by directX
+	//arrays for our generated objects Made by directX, and which one was generated so it can be generated again
+	enum class PreFab { None, Teapot, Sphere, Box };
+	PreFab m_preFab;
+	DirectX::SimpleMath::Vector3 m_preFabSize;
 	std::vector<VertexPositionNormalTexture> preFabVertices;
 	std::vector<uint16_t> preFabIndices;
 
@@ -5,6 +5,12 @@
 
 #pragma once
 
+// The test project (Tests/CMakeLists.txt) builds the modules that don't need Direct3D on their
+// own, with a header of its own in place of this one
+#if defined(DX_TESTS)
+#include "Tests/pch.h"
+#else
+
 #include <winsdkver.h>
 #ifndef _WIN32_WINNT
 #define _WIN32_WINNT 0x0601
@@ -53,6 +59,12 @@
 // Define flag for use of audio 
 #define DXTK_AUDIO
 
+// Define flag for the CPU profiler's zones (Profiler.h), without it they compile to nothing.
+// Add DX_NO_PROFILE to the project's preprocessor definitions to build without them.
+#ifndef DX_NO_PROFILE
+#define DX_PROFILE
+#endif
+
 // Include audio header if flag is defined
 #ifdef DXTK_AUDIO
 #include "Audio.h"
@@ -111,3 +123,5 @@ namespace DX
         }
     }
 }
+
+#endif